@@ -22,11 +22,26 @@
 #include "cache_service.hh"
 #include "api/api-doc/cache_service.json.hh"
 #include "column_family.hh"
+#include "sstables/key_cache.hh"
 
 namespace api {
 using namespace json;
 namespace cs = httpd::cache_service_json;
 
+template<typename T, typename Func>
+static future<T> map_reduce_key_cache(http_context& ctx, T init, Func f) {
+    return ctx.db.map_reduce0([f] (database&) {
+        return f(sstables::global_key_cache());
+    }, std::move(init), std::plus<T>());
+}
+
+template<typename T, typename Func>
+static future<json::json_return_type> map_reduce_key_cache_json(http_context& ctx, T init, Func f) {
+    return map_reduce_key_cache(ctx, std::move(init), std::move(f)).then([] (const T& res) {
+        return make_ready_future<json::json_return_type>(res);
+    });
+}
+
 void set_cache_service(http_context& ctx, routes& r) {
     cs::get_row_cache_save_period_in_seconds.set(r, [](std::unique_ptr<request> req) {
         // We never save the cache
@@ -106,10 +121,12 @@ void set_cache_service(http_context& ctx, routes& r) {
         return make_ready_future<json::json_return_type>(json_void());
     });
 
-    cs::invalidate_key_cache.set(r, [](std::unique_ptr<request> req) {
-        // TBD
-        unimplemented();
-        return make_ready_future<json::json_return_type>(json_void());
+    cs::invalidate_key_cache.set(r, [&ctx](std::unique_ptr<request> req) {
+        return ctx.db.invoke_on_all([] (database&) {
+            sstables::global_key_cache().clear();
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
     cs::invalidate_counter_cache.set(r, [](std::unique_ptr<request> req) {
@@ -125,11 +142,13 @@ void set_cache_service(http_context& ctx, routes& r) {
         return make_ready_future<json::json_return_type>(json_void());
     });
 
-    cs::set_key_cache_capacity_in_mb.set(r, [](std::unique_ptr<request> req) {
-        // TBD
-        unimplemented();
-        auto period = req->get_query_param("period");
-        return make_ready_future<json::json_return_type>(json_void());
+    cs::set_key_cache_capacity_in_mb.set(r, [&ctx](std::unique_ptr<request> req) {
+        auto capacity = boost::lexical_cast<uint64_t>(req->get_query_param("capacity"));
+        return ctx.db.invoke_on_all([capacity] (database&) {
+            sstables::global_key_cache().set_capacity((capacity << 20) / smp::count);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
     cs::set_counter_cache_capacity_in_mb.set(r, [](std::unique_ptr<request> req) {
@@ -145,66 +164,57 @@ void set_cache_service(http_context& ctx, routes& r) {
         return make_ready_future<json::json_return_type>(json_void());
     });
 
-    cs::get_key_capacity.set(r, [] (std::unique_ptr<request> req) {
-        // TBD
-        // FIXME
-        // we don't support keys cache,
-        // so currently returning a 0 for capacity is ok
-        return make_ready_future<json::json_return_type>(0);
+    cs::get_key_capacity.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return map_reduce_key_cache_json(ctx, uint64_t(0), [] (const sstables::key_cache& kc) {
+            return uint64_t(kc.capacity());
+        });
     });
 
-    cs::get_key_hits.set(r, [] (std::unique_ptr<request> req) {
-        // TBD
-        // FIXME
-        // we don't support keys cache,
-        // so currently returning a 0 for hits is ok
-        return make_ready_future<json::json_return_type>(0);
+    cs::get_key_hits.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return map_reduce_key_cache_json(ctx, uint64_t(0), [] (const sstables::key_cache& kc) {
+            return kc.get_stats().hits.count();
+        });
     });
 
-    cs::get_key_requests.set(r, [] (std::unique_ptr<request> req) {
-        // TBD
-        // FIXME
-        // we don't support keys cache,
-        // so currently returning a 0 for request is ok
-        return make_ready_future<json::json_return_type>(0);
+    cs::get_key_requests.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return map_reduce_key_cache_json(ctx, uint64_t(0), [] (const sstables::key_cache& kc) {
+            return kc.get_stats().hits.count() + kc.get_stats().misses.count();
+        });
     });
 
-    cs::get_key_hit_rate.set(r, [] (std::unique_ptr<request> req) {
-        // TBD
-        // FIXME
-        // we don't support keys cache,
-        // so currently returning a 0 for rate is ok
-        return make_ready_future<json::json_return_type>(0);
+    cs::get_key_hit_rate.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return map_reduce_key_cache_json(ctx, ratio_holder(), [] (const sstables::key_cache& kc) {
+            return ratio_holder(kc.get_stats().hits.count() + kc.get_stats().misses.count(),
+                    kc.get_stats().hits.count());
+        });
     });
 
     cs::get_key_hits_moving_avrage.set(r, [&ctx] (std::unique_ptr<request> req) {
-        // TBD
-        // FIXME
-        // See above
-        return make_ready_future<json::json_return_type>(meter_to_json(utils::rate_moving_average()));
+        return map_reduce_key_cache(ctx, utils::rate_moving_average(), [] (const sstables::key_cache& kc) {
+            return kc.get_stats().hits.rate();
+        }).then([](const utils::rate_moving_average& m) {
+            return make_ready_future<json::json_return_type>(meter_to_json(m));
+        });
     });
 
     cs::get_key_requests_moving_avrage.set(r, [&ctx] (std::unique_ptr<request> req) {
-        // TBD
-        // FIXME
-        // See above
-        return make_ready_future<json::json_return_type>(meter_to_json(utils::rate_moving_average()));
+        return map_reduce_key_cache(ctx, utils::rate_moving_average(), [] (const sstables::key_cache& kc) {
+            return kc.get_stats().hits.rate() + kc.get_stats().misses.rate();
+        }).then([](const utils::rate_moving_average& m) {
+            return make_ready_future<json::json_return_type>(meter_to_json(m));
+        });
     });
 
-    cs::get_key_size.set(r, [] (std::unique_ptr<request> req) {
-        // TBD
-        // FIXME
-        // we don't support keys cache,
-        // so currently returning a 0 for size is ok
-        return make_ready_future<json::json_return_type>(0);
+    cs::get_key_size.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return map_reduce_key_cache_json(ctx, uint64_t(0), [] (const sstables::key_cache& kc) {
+            return uint64_t(kc.region().occupancy().used_space());
+        });
     });
 
-    cs::get_key_entries.set(r, [] (std::unique_ptr<request> req) {
-        // TBD
-        // FIXME
-        // we don't support keys cache,
-        // so currently returning a 0 for key entries is ok
-        return make_ready_future<json::json_return_type>(0);
+    cs::get_key_entries.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return map_reduce_key_cache_json(ctx, uint64_t(0), [] (const sstables::key_cache& kc) {
+            return kc.entries();
+        });
     });
 
     cs::get_row_capacity.set(r, [&ctx] (std::unique_ptr<request> req) {
@@ -34,7 +34,11 @@ static auto acquire_cl_metric(http_context& ctx, Func&& func) {
         if (db.commitlog() == nullptr) {
             return make_ready_future<ret_type>();
         }
-        return make_ready_future<ret_type>(func(db.commitlog()));
+        auto res = func(db.commitlog());
+        if (db.system_commitlog() != nullptr) {
+            res += func(db.system_commitlog());
+        }
+        return make_ready_future<ret_type>(res);
     }, ret_type(), std::plus<ret_type>()).then([](ret_type res) {
         return make_ready_future<json::json_return_type>(res);
     });
@@ -50,7 +54,12 @@ void set_commitlog(http_context& ctx, routes& r) {
             if (db.commitlog() == nullptr) {
                 return make_ready_future<std::vector<sstring>>(std::vector<sstring>());
             }
-            return make_ready_future<std::vector<sstring>>(db.commitlog()->get_active_segment_names());
+            auto names = db.commitlog()->get_active_segment_names();
+            if (db.system_commitlog() != nullptr) {
+                auto system_names = db.system_commitlog()->get_active_segment_names();
+                names.insert(names.end(), system_names.begin(), system_names.end());
+            }
+            return make_ready_future<std::vector<sstring>>(std::move(names));
         }).then([res] {
             return make_ready_future<json::json_return_type>(*res.get());
         });
@@ -19,57 +19,84 @@
  * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <boost/range/algorithm/sort.hpp>
+#include <boost/range/algorithm/unique.hpp>
 #include "hinted_handoff.hh"
 #include "api/api-doc/hinted_handoff.json.hh"
+#include "service/storage_proxy.hh"
+#include "gms/inet_address.hh"
 
 namespace api {
 
 using namespace json;
 namespace hh = httpd::hinted_handoff_json;
+using proxy = service::storage_proxy;
 
-void set_hinted_handoff(http_context& ctx, routes& r) {
-    hh::list_endpoints_pending_hints.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        std::vector<sstring> res;
+static future<json::json_return_type> sum_ep_hints_count(http_context& ctx, gms::inet_address ep,
+        uint64_t (db::hints::manager::*f)(gms::inet_address) const) {
+    return ctx.sp.map_reduce0([ep, f] (proxy& p) {
+        return (p.get_hints_manager().*f)(ep);
+    }, uint64_t(0), std::plus<uint64_t>()).then([] (uint64_t res) {
         return make_ready_future<json::json_return_type>(res);
     });
+}
 
-    hh::truncate_all_hints.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(json_void());
+void set_hinted_handoff(http_context& ctx, routes& r) {
+    hh::list_endpoints_pending_hints.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return ctx.sp.map_reduce0([] (proxy& p) {
+            return p.get_hints_manager().endpoints_pending_hints();
+        }, std::vector<gms::inet_address>(), [] (std::vector<gms::inet_address> a, std::vector<gms::inet_address> b) {
+            a.insert(a.end(), b.begin(), b.end());
+            return a;
+        }).then([] (std::vector<gms::inet_address> eps) {
+            boost::sort(eps);
+            eps.erase(boost::unique(eps).end(), eps.end());
+            std::vector<sstring> res;
+            for (auto&& ep : eps) {
+                res.push_back(ep.to_sstring());
+            }
+            return make_ready_future<json::json_return_type>(res);
+        });
     });
 
-    hh::schedule_hint_delivery.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
+    hh::truncate_all_hints.set(r, [&ctx] (std::unique_ptr<request> req) {
         sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(json_void());
+        stdx::optional<gms::inet_address> ep;
+        if (!host.empty()) {
+            ep = gms::inet_address(host);
+        }
+        return ctx.sp.invoke_on_all([ep] (proxy& p) {
+            return p.get_hints_manager().truncate_hints(ep);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
-    hh::pause_hints_delivery.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring pause = req->get_query_param("pause");
-        return make_ready_future<json::json_return_type>(json_void());
+    hh::schedule_hint_delivery.set(r, [&ctx] (std::unique_ptr<request> req) {
+        gms::inet_address ep(req->get_query_param("host"));
+        return ctx.sp.invoke_on_all([ep] (proxy& p) {
+            p.get_hints_manager().schedule_delivery(ep);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
-    hh::get_create_hint_count.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(0);
+    hh::pause_hints_delivery.set(r, [&ctx] (std::unique_ptr<request> req) {
+        bool pause = strcasecmp(req->get_query_param("pause").c_str(), "true") == 0;
+        return ctx.sp.invoke_on_all([pause] (proxy& p) {
+            p.get_hints_manager().pause_delivery(pause);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
-    hh::get_not_stored_hints_count.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(0);
+    hh::get_create_hint_count.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return sum_ep_hints_count(ctx, gms::inet_address(req->param["addr"]), &db::hints::manager::created_hints_count);
     });
-}
 
+    hh::get_not_stored_hints_count.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return sum_ep_hints_count(ctx, gms::inet_address(req->param["addr"]), &db::hints::manager::not_stored_hints_count);
+    });
 }
 
+}
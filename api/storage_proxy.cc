@@ -70,18 +70,15 @@ static future<json::json_return_type>  total_latency(http_context& ctx, utils::t
 }
 
 void set_storage_proxy(http_context& ctx, routes& r) {
-    sp::get_total_hints.set(r, [](std::unique_ptr<request> req)  {
-        //TBD
-        unimplemented();
-        return make_ready_future<json::json_return_type>(0);
+    sp::get_total_hints.set(r, [&ctx](std::unique_ptr<request> req)  {
+        return ctx.sp.map_reduce0([](proxy& p) {return p.get_hints_manager().get_stats().written;}, uint64_t(0),
+                std::plus<uint64_t>()).then([](uint64_t res) {
+            return make_ready_future<json::json_return_type>(res);
+        });
     });
 
-    sp::get_hinted_handoff_enabled.set(r, [](std::unique_ptr<request> req)  {
-        //TBD
-        // FIXME
-        // hinted handoff is not supported currently,
-        // so we should return false
-        return make_ready_future<json::json_return_type>(false);
+    sp::get_hinted_handoff_enabled.set(r, [&ctx](std::unique_ptr<request> req)  {
+        return make_ready_future<json::json_return_type>(ctx.db.local().get_config().hinted_handoff_enabled());
     });
 
     sp::set_hinted_handoff_enabled.set(r, [](std::unique_ptr<request> req)  {
@@ -105,10 +102,8 @@ void set_storage_proxy(http_context& ctx, routes& r) {
         return make_ready_future<json::json_return_type>(json_void());
     });
 
-    sp::get_max_hint_window.set(r, [](std::unique_ptr<request> req)  {
-        //TBD
-        unimplemented();
-        return make_ready_future<json::json_return_type>(0);
+    sp::get_max_hint_window.set(r, [&ctx](std::unique_ptr<request> req)  {
+        return make_ready_future<json::json_return_type>(ctx.db.local().get_config().max_hint_window_in_ms());
     });
 
     sp::set_max_hint_window.set(r, [](std::unique_ptr<request> req)  {
@@ -131,10 +126,11 @@ void set_storage_proxy(http_context& ctx, routes& r) {
         return make_ready_future<json::json_return_type>(json_void());
     });
 
-    sp::get_hints_in_progress.set(r, [](std::unique_ptr<request> req)  {
-        //TBD
-        unimplemented();
-        return make_ready_future<json::json_return_type>(0);
+    sp::get_hints_in_progress.set(r, [&ctx](std::unique_ptr<request> req)  {
+        return ctx.sp.map_reduce0([](proxy& p) {return p.get_hints_manager().hints_in_progress();}, size_t(0),
+                std::plus<size_t>()).then([](size_t res) {
+            return make_ready_future<json::json_return_type>(res);
+        });
     });
 
     sp::get_rpc_timeout.set(r, [&ctx](const_req req)  {
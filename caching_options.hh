@@ -32,8 +32,9 @@ class caching_options {
     // For Origin, the default value for the row is "NONE". However, since our
     // row_cache will cache both keys and rows, we will default to ALL.
     //
-    // FIXME: We don't yet make any changes to our caching policies based on
-    // this (and maybe we shouldn't)
+    // The "keys" option controls whether partition index entries are kept in
+    // the key cache. We don't make any changes to row caching based on the
+    // "rows_per_partition" option (and maybe we shouldn't).
     static constexpr auto default_key = "ALL";
     static constexpr auto default_row = "ALL";
 
@@ -63,6 +64,10 @@ class caching_options {
         return {{ "keys", _key_cache }, { "rows_per_partition", _row_cache }};
     }
 
+    bool key_cache_enabled() const {
+        return _key_cache == "ALL";
+    }
+
     sstring to_sstring() const {
         return json::to_json(to_map());
     }
@@ -40,6 +40,7 @@ enum class compaction_strategy_type {
 };
 
 class compaction_strategy_impl;
+class compaction_backlog_tracker;
 class sstable;
 class sstable_set;
 struct compaction_descriptor;
@@ -71,9 +72,26 @@ class compaction_strategy {
     // Return if optimization to rule out sstables based on clustering key filter should be applied.
     bool use_clustering_key_filter() const;
 
+    // Return if compaction should release its input sstables as soon as their
+    // data was written to sealed output sstables, instead of when it's done.
+    bool incremental() const;
+
+    // Size of output sstables written by incremental compaction.
+    uint64_t incremental_fragment_size() const;
+
+    // Return if output sstables of a compaction are treated as a run, which
+    // allows incremental compaction to cut them into fragments.
+    bool run_aware() const;
+
     // An estimation of number of compaction for strategy to be satisfied.
     int64_t estimated_pending_compactions(column_family& cf) const;
 
+    // Must be told about all sstables added to and removed from the table.
+    compaction_backlog_tracker& get_backlog_tracker();
+
+    // An estimation of how many bytes compaction has to rewrite for strategy to be satisfied.
+    uint64_t compaction_backlog(column_family& cf) const;
+
     static sstring name(compaction_strategy_type type) {
         switch (type) {
         case compaction_strategy_type::null:
@@ -40,6 +40,7 @@ class compound_type final {
     const bool _byte_order_equal;
     const bool _byte_order_comparable;
     const bool _is_reversed;
+    const bool _memcomparable;
 public:
     static constexpr bool is_prefixable = AllowPrefixes == allow_prefixes::yes;
     using prefix_type = compound_type<allow_prefixes::yes>;
@@ -53,6 +54,9 @@ class compound_type final {
             }))
         , _byte_order_comparable(false)
         , _is_reversed(_types.size() == 1 && _types[0]->is_reversed())
+        , _memcomparable(std::all_of(_types.begin(), _types.end(), [] (auto t) {
+                return t->is_memcomparable();
+            }))
     { }
 
     compound_type(compound_type&&) = default;
@@ -216,6 +220,52 @@ class compound_type final {
                 return type->compare(v1, v2);
             });
     }
+    // Returns true iff values of this type have a memcomparable form.
+    bool is_memcomparable() const {
+        return _memcomparable;
+    }
+    // Returns the memcomparable ("normalized") form of given value: a byte string which
+    // compares with compare_unsigned() the same way as the value compares with compare().
+    // The form of a prefix is a prefix of the form of the full value.
+    // Valid only if is_memcomparable().
+    bytes memcomparable_form(bytes_view v) const {
+        size_t size = 0;
+        auto t = _types.begin();
+        for (auto&& value : components(v)) {
+            size += (*t++)->memcomparable_size(value);
+        }
+        bytes b(bytes::initialized_later(), size);
+        memcomparable_writer out(b.begin(), b.end());
+        t = _types.begin();
+        for (auto&& value : components(v)) {
+            (*t++)->write_memcomparable(value, out);
+        }
+        return b;
+    }
+    // Returns the first 8 bytes of memcomparable_form(v) as a big-endian integer,
+    // padded with zeros.
+    //
+    // If prefixes of two values differ, they order the values the same way as compare()
+    // does, provided neither value is a prefix of the other, e.g. both are full.
+    // Equal prefixes tell nothing.
+    // Only the first 8 bytes of the form are produced, without allocating.
+    // Valid only if is_memcomparable().
+    uint64_t memcomparable_prefix(bytes_view v) const {
+        int8_t buf[sizeof(uint64_t)] = {};
+        memcomparable_writer out(std::begin(buf), std::end(buf));
+        auto t = _types.begin();
+        for (auto&& value : components(v)) {
+            if (out.full()) {
+                break;
+            }
+            (*t++)->write_memcomparable(value, out);
+        }
+        uint64_t prefix = 0;
+        for (auto b : buf) {
+            prefix = (prefix << 8) | uint8_t(b);
+        }
+        return prefix;
+    }
     // Retruns true iff given prefix has no missing components
     bool is_full(bytes_view v) const {
         assert(AllowPrefixes == allow_prefixes::yes);
@@ -28,6 +28,7 @@ enum class compressor {
     lz4,
     snappy,
     deflate,
+    zstd,
 };
 
 class compression_parameters {
@@ -38,10 +39,20 @@ class compression_parameters {
     static constexpr auto SSTABLE_COMPRESSION = "sstable_compression";
     static constexpr auto CHUNK_LENGTH_KB = "chunk_length_kb";
     static constexpr auto CRC_CHECK_CHANCE = "crc_check_chance";
+    // ZstdCompressor only
+    static constexpr auto COMPRESSION_LEVEL = "compression_level";
+    static constexpr auto DICTIONARY_SIZE_KB = "dictionary_size_in_kb";
+
+    static constexpr int DEFAULT_ZSTD_COMPRESSION_LEVEL = 3;
+    // The dictionary is stored as an option value in CompressionInfo.db,
+    // which is limited to 64k.
+    static constexpr int MAX_DICTIONARY_SIZE_KB = 63;
 private:
     compressor _compressor;
     std::experimental::optional<int> _chunk_length;
     std::experimental::optional<double> _crc_check_chance;
+    std::experimental::optional<int> _compression_level;
+    std::experimental::optional<int> _dictionary_size;
 public:
     compression_parameters(compressor c = compressor::lz4) : _compressor(c) { }
     compression_parameters(const std::map<sstring, sstring>& options) {
@@ -59,6 +70,8 @@ class compression_parameters {
             _compressor = compressor::snappy;
         } else if (is_compressor_class(compressor_class, "DeflateCompressor")) {
             _compressor = compressor::deflate;
+        } else if (is_compressor_class(compressor_class, "ZstdCompressor")) {
+            _compressor = compressor::zstd;
         } else {
             throw exceptions::configuration_exception(sstring("Unsupported compression class '") + compressor_class + "'.");
         }
@@ -78,11 +91,33 @@ class compression_parameters {
                 throw exceptions::syntax_exception(sstring("Invalid double value ") + crc_chance->second + "for " + CRC_CHECK_CHANCE);
             }
         }
+        auto level = options.find(COMPRESSION_LEVEL);
+        if (level != options.end()) {
+            try {
+                _compression_level = std::stoi(level->second);
+            } catch (const std::exception& e) {
+                throw exceptions::syntax_exception(sstring("Invalid integer value ") + level->second + " for " + COMPRESSION_LEVEL);
+            }
+        }
+        auto dictionary_size = options.find(DICTIONARY_SIZE_KB);
+        if (dictionary_size != options.end()) {
+            try {
+                _dictionary_size = std::stoi(dictionary_size->second) * 1024;
+            } catch (const std::exception& e) {
+                throw exceptions::syntax_exception(sstring("Invalid integer value ") + dictionary_size->second + " for " + DICTIONARY_SIZE_KB);
+            }
+        }
+        if ((_compression_level || _dictionary_size) && _compressor != compressor::zstd) {
+            throw exceptions::configuration_exception(sprint("Options '%s' and '%s' are only supported by ZstdCompressor.", COMPRESSION_LEVEL, DICTIONARY_SIZE_KB));
+        }
     }
 
     compressor get_compressor() const { return _compressor; }
     int32_t chunk_length() const { return _chunk_length.value_or(int(DEFAULT_CHUNK_LENGTH)); }
     double crc_check_chance() const { return _crc_check_chance.value_or(double(DEFAULT_CRC_CHECK_CHANCE)); }
+    int compression_level() const { return _compression_level.value_or(int(DEFAULT_ZSTD_COMPRESSION_LEVEL)); }
+    // Size of the dictionary trained for each sstable, 0 if dictionaries are disabled.
+    int dictionary_size() const { return _dictionary_size.value_or(0); }
 
     void validate() {
         if (_chunk_length) {
@@ -98,6 +133,14 @@ class compression_parameters {
         if (_crc_check_chance && (_crc_check_chance.value() < 0.0 || _crc_check_chance.value() > 1.0)) {
             throw exceptions::configuration_exception(sstring(CRC_CHECK_CHANCE) + " must be between 0.0 and 1.0.");
         }
+        // Levels above 19 need a lot of memory, and negative levels are
+        // not supported by all the library versions we build with.
+        if (_compression_level && (_compression_level.value() < 1 || _compression_level.value() > 19)) {
+            throw exceptions::configuration_exception(sstring(COMPRESSION_LEVEL) + " must be between 1 and 19.");
+        }
+        if (_dictionary_size && (_dictionary_size.value() < 0 || _dictionary_size.value() > MAX_DICTIONARY_SIZE_KB * 1024)) {
+            throw exceptions::configuration_exception(sprint("%s must be between 0 and %d.", DICTIONARY_SIZE_KB, MAX_DICTIONARY_SIZE_KB));
+        }
     }
 
     std::map<sstring, sstring> get_options() const {
@@ -112,23 +155,33 @@ class compression_parameters {
         if (_crc_check_chance) {
             opts.emplace(sstring(CRC_CHECK_CHANCE), std::to_string(_crc_check_chance.value()));
         }
+        if (_compression_level) {
+            opts.emplace(sstring(COMPRESSION_LEVEL), std::to_string(_compression_level.value()));
+        }
+        if (_dictionary_size) {
+            opts.emplace(sstring(DICTIONARY_SIZE_KB), std::to_string(_dictionary_size.value() / 1024));
+        }
         return opts;
     }
     bool operator==(const compression_parameters& other) const {
         return _compressor == other._compressor
                && _chunk_length == other._chunk_length
-               && _crc_check_chance == other._crc_check_chance;
+               && _crc_check_chance == other._crc_check_chance
+               && _compression_level == other._compression_level
+               && _dictionary_size == other._dictionary_size;
     }
     bool operator!=(const compression_parameters& other) const {
         return !(*this == other);
     }
 private:
     void validate_options(const std::map<sstring, sstring>& options) {
-        // currently, there are no options specific to a particular compressor
+        // compressor specific options are checked after the compressor is known
         static std::set<sstring> keywords({
             sstring(SSTABLE_COMPRESSION),
             sstring(CHUNK_LENGTH_KB),
             sstring(CRC_CHECK_CHANCE),
+            sstring(COMPRESSION_LEVEL),
+            sstring(DICTIONARY_SIZE_KB),
         });
         for (auto&& opt : options) {
             if (!keywords.count(opt.first)) {
@@ -148,6 +201,8 @@ class compression_parameters {
             return "org.apache.cassandra.io.compress.SnappyCompressor";
         case compressor::deflate:
             return "org.apache.cassandra.io.compress.DeflateCompressor";
+        case compressor::zstd:
+            return "org.apache.cassandra.io.compress.ZstdCompressor";
         default:
             abort();
         }
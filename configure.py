@@ -185,6 +185,7 @@ scylla_tests = [
     'tests/row_cache_alloc_stress',
     'tests/perf_row_cache_update',
     'tests/perf/perf_hash',
+    'tests/perf/perf_key_compare',
     'tests/perf/perf_cql_parser',
     'tests/perf/perf_simple_query',
     'tests/perf/perf_fast_forward',
@@ -219,9 +220,13 @@ scylla_tests = [
     'tests/network_topology_strategy_test',
     'tests/query_processor_test',
     'tests/batchlog_manager_test',
+    'tests/hints_manager_test',
+    'tests/row_level_repair_test',
+    'tests/sstable_streaming_test',
     'tests/bytes_ostream_test',
     'tests/UUID_test',
     'tests/murmur_hash_test',
+    'tests/xx_hasher_test',
     'tests/allocation_strategy_test',
     'tests/logalloc_test',
     'tests/log_heap_test',
@@ -252,6 +257,7 @@ scylla_tests = [
     'tests/aggregate_fcts_test',
     'tests/role_manager_test',
     'tests/caching_options_test',
+    'tests/bloom_filter_test',
 ]
 
 apps = [
@@ -328,6 +334,7 @@ scylla_core = (['database.cc',
                  'canonical_mutation.cc',
                  'frozen_mutation.cc',
                  'memtable.cc',
+                 'streaming_sstable_writer.cc',
                  'schema_mutations.cc',
                  'release.cc',
                  'supervisor.cc',
@@ -339,12 +346,15 @@ scylla_core = (['database.cc',
                  'mutation_reader.cc',
                  'flat_mutation_reader.cc',
                  'mutation_query.cc',
+                 'querier.cc',
                  'keys.cc',
                  'counters.cc',
                  'sstables/sstables.cc',
                  'sstables/compress.cc',
                  'sstables/row.cc',
                  'sstables/partition.cc',
+                 'sstables/key_cache.cc',
+                 'sstables/chunk_cache.cc',
                  'sstables/compaction.cc',
                  'sstables/compaction_strategy.cc',
                  'sstables/compaction_manager.cc',
@@ -455,6 +465,7 @@ scylla_core = (['database.cc',
                  'db/index/secondary_index.cc',
                  'db/marshal/type_parser.cc',
                  'db/batchlog_manager.cc',
+                 'db/hints/manager.cc',
                  'db/view/view.cc',
                  'index/secondary_index_manager.cc',
                  'io/io.cc',
@@ -527,6 +538,7 @@ scylla_core = (['database.cc',
                  'init.cc',
                  'lister.cc',
                  'repair/repair.cc',
+                 'repair/row_level.cc',
                  'exceptions/exceptions.cc',
                  'auth/allow_all_authenticator.cc',
                  'auth/allow_all_authorizer.cc',
@@ -603,6 +615,7 @@ idls = ['idl/gossip_digest.idl.hh',
         'idl/paging_state.idl.hh',
         'idl/frozen_schema.idl.hh',
         'idl/partition_checksum.idl.hh',
+        'idl/repair.idl.hh',
         'idl/replay_position.idl.hh',
         'idl/truncation_record.idl.hh',
         'idl/mutation.idl.hh',
@@ -612,6 +625,7 @@ idls = ['idl/gossip_digest.idl.hh',
         'idl/tracing.idl.hh',
         'idl/consistency_level.idl.hh',
         'idl/cache_temperature.idl.hh',
+        'idl/aggregate.idl.hh',
         ]
 
 scylla_tests_dependencies = scylla_core + api + idls + [
@@ -652,6 +666,7 @@ pure_boost_tests = set([
     'tests/chunked_vector_test',
     'tests/big_decimal_test',
     'tests/caching_options_test',
+    'tests/bloom_filter_test',
 ])
 
 tests_not_using_seastar_test_framework = set([
@@ -661,6 +676,7 @@ tests_not_using_seastar_test_framework = set([
     'tests/row_cache_alloc_stress',
     'tests/perf_row_cache_update',
     'tests/perf/perf_hash',
+    'tests/perf/perf_key_compare',
     'tests/perf/perf_cql_parser',
     'tests/message',
     'tests/perf/perf_simple_query',
@@ -691,6 +707,7 @@ deps['tests/bytes_ostream_test'] = ['tests/bytes_ostream_test.cc', 'utils/manage
 deps['tests/input_stream_test'] = ['tests/input_stream_test.cc']
 deps['tests/UUID_test'] = ['utils/UUID_gen.cc', 'tests/UUID_test.cc', 'utils/uuid.cc', 'utils/managed_bytes.cc', 'utils/logalloc.cc', 'utils/dynamic_bitset.cc']
 deps['tests/murmur_hash_test'] = ['bytes.cc', 'utils/murmur_hash.cc', 'tests/murmur_hash_test.cc']
+deps['tests/xx_hasher_test'] = ['bytes.cc', 'tests/xx_hasher_test.cc']
 deps['tests/allocation_strategy_test'] = ['tests/allocation_strategy_test.cc', 'utils/logalloc.cc', 'utils/dynamic_bitset.cc']
 deps['tests/log_heap_test'] = ['tests/log_heap_test.cc']
 deps['tests/anchorless_list_test'] = ['tests/anchorless_list_test.cc']
@@ -843,7 +860,7 @@ for mode in build_modes:
 seastar_deps = 'practically_anything_can_change_so_lets_run_it_every_time_and_restat.'
 
 args.user_cflags += " " + pkg_config("--cflags", "jsoncpp")
-libs = ' '.join(['-lyaml-cpp', '-llz4', '-lz', '-lsnappy', pkg_config("--libs", "jsoncpp"),
+libs = ' '.join(['-lyaml-cpp', '-llz4', '-lz', '-lsnappy', '-lzstd', pkg_config("--libs", "jsoncpp"),
                  maybe_static(args.staticboost, '-lboost_filesystem'), ' -lcrypt',
                  maybe_static(args.staticboost, '-lboost_date_time'),
                 ])
@@ -87,3 +87,64 @@ class flush_cpu_controller {
 };
 
 
+
+// Proportional controller to adjust shares of compaction.
+//
+// Unlike flushes, compaction has no deadline that tells us how urgent it is: if it falls behind,
+// nothing stops, but the number of sstables, and with it read amplification, keeps growing. A
+// fixed quota is either too small to keep up with heavy writes or needlessly steals CPU from
+// requests when there's little to compact.
+//
+// So we look at the compaction backlog instead: the number of bytes that the compaction strategies
+// of all tables estimate they still have to rewrite. As for virtual dirty, we normalize it, here by
+// the bytes in the shard's sstables, which gives the number of times each byte still has to be
+// rewritten on average. That doesn't grow with the amount of data: size-tiered sstables in steady
+// state, with fewer than min_threshold sstables in each tier, are around 1, the point where
+// compaction is comfortably keeping up. The quota is a piecewise linear function of the normalized
+// backlog going through the points (0, qmin), (b1, q1), (b2, q2) and (bmax, qmax): compaction
+// always makes some progress, is gentle while the backlog is low and becomes increasingly
+// aggressive as it grows.
+class compaction_cpu_controller {
+    static constexpr float qmin = 0.05;
+    static constexpr float b1 = 0.5;
+    static constexpr float q1 = 0.1;
+    static constexpr float b2 = 1.5;
+    static constexpr float q2 = 0.5;
+    static constexpr float bmax = 3;
+    static constexpr float qmax = 1;
+
+    float _current_quota = 0.0f;
+    uint64_t _current_backlog = 0;
+    std::function<uint64_t()> _backlog;
+    std::function<uint64_t()> _total_bytes;
+    std::chrono::milliseconds _interval;
+    timer<> _update_timer;
+
+    seastar::thread_scheduling_group _scheduling_group;
+    seastar::thread_scheduling_group *_current_scheduling_group = nullptr;
+    bool _adjust_quota;
+
+    void adjust();
+public:
+    seastar::thread_scheduling_group* scheduling_group() {
+        return _current_scheduling_group;
+    }
+    float current_quota() const {
+        return _current_quota;
+    }
+    // Backlog in bytes, as of the last adjustment. Kept up to date even when
+    // the quota isn't adjusted, for metrics.
+    uint64_t current_backlog() const {
+        return _current_backlog;
+    }
+    // The quota for a backlog divided by the bytes of the sstables it
+    // was estimated for.
+    static float quota(float normalized_backlog);
+
+    struct disabled {
+        seastar::thread_scheduling_group *backup;
+    };
+    compaction_cpu_controller(disabled d, std::chrono::milliseconds interval, std::function<uint64_t()> backlog);
+    compaction_cpu_controller(std::chrono::milliseconds interval, std::function<uint64_t()> backlog, std::function<uint64_t()> total_bytes);
+    compaction_cpu_controller(compaction_cpu_controller&&) = default;
+};
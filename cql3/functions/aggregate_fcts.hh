@@ -41,6 +41,7 @@
 
 #pragma once
 
+#include <seastar/core/byteorder.hh>
 #include "utils/big_decimal.hh"
 #include "aggregate_function.hh"
 #include "native_aggregate_function.hh"
@@ -65,6 +66,12 @@ class impl_count_function : public aggregate_function::aggregate {
     virtual void add_input(cql_serialization_format sf, const std::vector<opt_bytes>& values) override {
         ++_count;
     }
+    virtual opt_bytes compute_partial(cql_serialization_format sf) override {
+        return compute(sf);
+    }
+    virtual void merge_partial(cql_serialization_format sf, const opt_bytes& state) override {
+        _count += value_cast<int64_t>(long_type->deserialize(*state));
+    }
 };
 
 static const sstring COUNT_ROWS_FUNCTION_NAME = "countRows";
@@ -75,6 +82,9 @@ class count_rows_function final : public native_aggregate_function {
     virtual std::unique_ptr<aggregate> new_aggregate() override {
         return std::make_unique<impl_count_function>();
     }
+    virtual bool is_reducible() const override {
+        return true;
+    }
     virtual sstring column_name(const std::vector<sstring>& column_names) override {
         return "count";
     }
@@ -106,6 +116,12 @@ class impl_sum_function_for final : public aggregate_function::aggregate {
         }
         _sum += value_cast<Type>(data_type_for<Type>()->deserialize(*values[0]));
     }
+    virtual opt_bytes compute_partial(cql_serialization_format sf) override {
+        return compute(sf);
+    }
+    virtual void merge_partial(cql_serialization_format sf, const opt_bytes& state) override {
+        add_input(sf, { state });
+    }
 };
 
 template <typename Type>
@@ -115,6 +131,9 @@ class sum_function_for final : public native_aggregate_function {
     virtual std::unique_ptr<aggregate> new_aggregate() override {
         return std::make_unique<impl_sum_function_for<Type>>();
     }
+    virtual bool is_reducible() const override {
+        return true;
+    }
 };
 
 
@@ -186,9 +205,37 @@ struct accumulator_for<big_decimal> {
     using type = big_decimal;
 };
 
+// Serializes the accumulator of an average into its partial state.
+template <typename Accumulator>
+struct accumulator_serializer {
+    static bytes serialize(const Accumulator& v) {
+        return data_type_for<Accumulator>()->decompose(v);
+    }
+    static Accumulator deserialize(bytes_view v) {
+        return value_cast<Accumulator>(data_type_for<Accumulator>()->deserialize(v));
+    }
+};
+
+template <>
+struct accumulator_serializer<__int128> {
+    static bytes serialize(__int128 v) {
+        auto u = static_cast<unsigned __int128>(v);
+        bytes b(bytes::initialized_later(), 2 * sizeof(uint64_t));
+        write_be(reinterpret_cast<char*>(b.begin()), static_cast<uint64_t>(u >> 64));
+        write_be(reinterpret_cast<char*>(b.begin()) + sizeof(uint64_t), static_cast<uint64_t>(u));
+        return b;
+    }
+    static __int128 deserialize(bytes_view v) {
+        auto hi = read_be<uint64_t>(reinterpret_cast<const char*>(v.begin()));
+        auto lo = read_be<uint64_t>(reinterpret_cast<const char*>(v.begin()) + sizeof(uint64_t));
+        return static_cast<__int128>((static_cast<unsigned __int128>(hi) << 64) | lo);
+    }
+};
+
 template <typename Type>
 class impl_avg_function_for final : public aggregate_function::aggregate {
-   typename accumulator_for<Type>::type _sum{};
+   using accumulator_type = typename accumulator_for<Type>::type;
+   accumulator_type _sum{};
    int64_t _count = 0;
 public:
     virtual void reset() override {
@@ -209,6 +256,20 @@ class impl_avg_function_for final : public aggregate_function::aggregate {
         ++_count;
         _sum += value_cast<Type>(data_type_for<Type>()->deserialize(*values[0]));
     }
+    // The state is the count followed by the sum.
+    virtual opt_bytes compute_partial(cql_serialization_format sf) override {
+        auto sum = accumulator_serializer<accumulator_type>::serialize(_sum);
+        bytes b(bytes::initialized_later(), sizeof(int64_t) + sum.size());
+        write_be(reinterpret_cast<char*>(b.begin()), _count);
+        std::copy(sum.begin(), sum.end(), b.begin() + sizeof(int64_t));
+        return b;
+    }
+    virtual void merge_partial(cql_serialization_format sf, const opt_bytes& state) override {
+        bytes_view v = *state;
+        _count += read_be<int64_t>(reinterpret_cast<const char*>(v.begin()));
+        v.remove_prefix(sizeof(int64_t));
+        _sum += accumulator_serializer<accumulator_type>::deserialize(v);
+    }
 };
 
 template <typename Type>
@@ -218,6 +279,9 @@ class avg_function_for final : public native_aggregate_function {
     virtual std::unique_ptr<aggregate> new_aggregate() override {
         return std::make_unique<impl_avg_function_for<Type>>();
     }
+    virtual bool is_reducible() const override {
+        return true;
+    }
 };
 
 template <typename Type>
@@ -251,6 +315,12 @@ class impl_max_function_for final : public aggregate_function::aggregate {
             _max = std::max(*_max, val);
         }
     }
+    virtual opt_bytes compute_partial(cql_serialization_format sf) override {
+        return compute(sf);
+    }
+    virtual void merge_partial(cql_serialization_format sf, const opt_bytes& state) override {
+        add_input(sf, { state });
+    }
 };
 
 template <typename Type>
@@ -260,6 +330,9 @@ class max_function_for final : public native_aggregate_function {
     virtual std::unique_ptr<aggregate> new_aggregate() override {
         return std::make_unique<impl_max_function_for<Type>>();
     }
+    virtual bool is_reducible() const override {
+        return true;
+    }
 };
 
     /**
@@ -298,6 +371,12 @@ class impl_min_function_for final : public aggregate_function::aggregate {
             _min = std::min(*_min, val);
         }
     }
+    virtual opt_bytes compute_partial(cql_serialization_format sf) override {
+        return compute(sf);
+    }
+    virtual void merge_partial(cql_serialization_format sf, const opt_bytes& state) override {
+        add_input(sf, { state });
+    }
 };
 
 template <typename Type>
@@ -307,6 +386,9 @@ class min_function_for final : public native_aggregate_function {
     virtual std::unique_ptr<aggregate> new_aggregate() override {
         return std::make_unique<impl_min_function_for<Type>>();
     }
+    virtual bool is_reducible() const override {
+        return true;
+    }
 };
 
 
@@ -339,6 +421,12 @@ class impl_count_function_for final : public aggregate_function::aggregate {
         }
         ++_count;
     }
+    virtual opt_bytes compute_partial(cql_serialization_format sf) override {
+        return compute(sf);
+    }
+    virtual void merge_partial(cql_serialization_format sf, const opt_bytes& state) override {
+        _count += value_cast<int64_t>(long_type->deserialize(*state));
+    }
 };
 
 template <typename Type>
@@ -348,6 +436,9 @@ class count_function_for final : public native_aggregate_function {
     virtual std::unique_ptr<aggregate> new_aggregate() override {
         return std::make_unique<impl_count_function_for<Type>>();
     }
+    virtual bool is_reducible() const override {
+        return true;
+    }
 };
 
     /**
@@ -62,6 +62,15 @@ class aggregate_function : public virtual function {
      */
     virtual std::unique_ptr<aggregate> new_aggregate() = 0;
 
+    /**
+     * Checks if aggregates of this function can be computed separately over
+     * disjoint sets of rows and then combined, using
+     * <code>aggregate::compute_partial()</code> and <code>aggregate::merge_partial()</code>.
+     */
+    virtual bool is_reducible() const {
+        return false;
+    }
+
     /**
      * An aggregation operation.
      */
@@ -91,6 +100,27 @@ class aggregate_function : public virtual function {
          * Reset this aggregate.
          */
         virtual void reset() = 0;
+
+        /**
+         * Computes and returns the state of this aggregate, which can be combined with
+         * the states of other aggregates of the same function. Only for reducible functions.
+         *
+         * @param protocol_version native protocol version
+         * @return the aggregate state.
+         */
+        virtual opt_bytes compute_partial(cql_serialization_format sf) {
+            throw std::logic_error("aggregate is not reducible");
+        }
+
+        /**
+         * Adds a state returned by <code>compute_partial()</code> to this aggregate.
+         *
+         * @param protocol_version native protocol version
+         * @param state the state to add to the aggregate.
+         */
+        virtual void merge_partial(cql_serialization_format sf, const opt_bytes& state) {
+            throw std::logic_error("aggregate is not reducible");
+        }
     };
 };
 
@@ -40,6 +40,7 @@
 #include "abstract_function_selector.hh"
 #include "aggregate_function_selector.hh"
 #include "scalar_function_selector.hh"
+#include "simple_selector.hh"
 #include "to_string.hh"
 
 namespace cql3 {
@@ -97,6 +98,25 @@ abstract_function_selector::new_factory(shared_ptr<functions::function> fun, sha
         virtual bool is_aggregate_selector_factory() override {
             return _fun->is_aggregate() || _factories->contains_only_aggregate_functions();
         }
+
+        virtual stdx::optional<query::aggregation_info> get_reducible_aggregation() override {
+            auto agg = dynamic_pointer_cast<functions::aggregate_function>(_fun);
+            if (!agg || !agg->is_reducible()) {
+                return stdx::nullopt;
+            }
+            query::aggregation_info info{_fun->name().keyspace, _fun->name().name, {}};
+            auto arg_type = _fun->arg_types().begin();
+            for (auto&& f : *_factories) {
+                // Replicas look the function up by the types of the columns, so
+                // they have to be exactly the argument types.
+                auto arg = dynamic_pointer_cast<simple_selector_factory>(f);
+                if (!arg || arg->get_return_type() != *arg_type++) {
+                    return stdx::nullopt;
+                }
+                info.column_indexes.push_back(arg->index());
+            }
+            return info;
+        }
     };
 
     return make_shared<fun_selector_factory>(std::move(fun), std::move(factories));
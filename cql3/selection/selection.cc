@@ -162,6 +162,13 @@ class selection_with_processing : public selection {
     virtual bool is_aggregate() const override {
         return _factories->contains_only_aggregate_functions();
     }
+
+    virtual stdx::optional<std::vector<query::aggregation_info>> get_reducible_aggregations() const override {
+        if (!is_aggregate()) {
+            return stdx::nullopt;
+        }
+        return _factories->get_reducible_aggregations();
+    }
 protected:
     class selectors_with_processing : public selectors {
     private:
@@ -175,6 +175,15 @@ class selection {
     }
 
     query::partition_slice::option_set get_query_options();
+
+    /**
+     * Returns the aggregations computed by this selection, if it consists only of
+     * aggregations which replicas can compute over parts of the queried data
+     * (see storage_proxy::query_aggregate()).
+     */
+    virtual stdx::optional<std::vector<query::aggregation_info>> get_reducible_aggregations() const {
+        return stdx::nullopt;
+    }
 private:
     static bool processes_selection(const std::vector<::shared_ptr<raw_selector>>& raw_selectors) {
         return std::any_of(raw_selectors.begin(), raw_selectors.end(),
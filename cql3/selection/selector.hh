@@ -45,6 +45,8 @@
 #include "cql3/assignment_testable.hh"
 #include "types.hh"
 #include "schema.hh"
+#include "query-request.hh"
+#include "stdx.hh"
 
 namespace cql3 {
 
@@ -186,6 +188,16 @@ class selector::factory {
      * @return the selector output type
      */
     virtual data_type get_return_type() = 0;
+
+    /**
+     * Returns the aggregation computed by the selector instances created by this factory, if it
+     * can be computed by replicas over parts of the queried data and combined by the coordinator.
+     *
+     * @return the aggregation, or nothing if the selector instances don't compute a reducible aggregation
+     */
+    virtual stdx::optional<query::aggregation_info> get_reducible_aggregation() {
+        return stdx::nullopt;
+    }
 };
 
 }
@@ -89,6 +89,19 @@ std::vector<::shared_ptr<selector>> selector_factories::new_instances() const {
     return r;
 }
 
+stdx::optional<std::vector<query::aggregation_info>> selector_factories::get_reducible_aggregations() const {
+    std::vector<query::aggregation_info> r;
+    r.reserve(_factories.size());
+    for (auto&& f : _factories) {
+        auto info = f->get_reducible_aggregation();
+        if (!info) {
+            return stdx::nullopt;
+        }
+        r.push_back(std::move(*info));
+    }
+    return r;
+}
+
 std::vector<sstring> selector_factories::get_column_names() const {
     std::vector<sstring> r;
     r.reserve(_factories.size());
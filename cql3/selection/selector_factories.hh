@@ -164,6 +164,14 @@ class selector_factories {
      * @return a list of column names
      */
     std::vector<sstring> get_column_names() const;
+
+    /**
+     * Returns the aggregations computed by the selector instances created by these factories,
+     * if all of them are reducible aggregations.
+     *
+     * @return the aggregations, or nothing if some selector doesn't compute a reducible aggregation
+     */
+    stdx::optional<std::vector<query::aggregation_info>> get_reducible_aggregations() const;
 };
 
 }
@@ -68,6 +68,13 @@ class simple_selector_factory : public selector::factory {
         return _type;
     }
 
+    /**
+     * Returns the index of the selected column in the selection's columns.
+     */
+    uint32_t index() const {
+        return _idx;
+    }
+
     virtual ::shared_ptr<selector> new_instance() override;
 };
 
@@ -40,6 +40,7 @@
  */
 
 #include "cql3/statements/cf_prop_defs.hh"
+#include "service/storage_service.hh"
 
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -120,6 +121,10 @@ void cf_prop_defs::validate() {
         }
         compression_parameters cp(*compression_options);
         cp.validate();
+        // Nodes which don't know ZstdCompressor couldn't read the sstables.
+        if (cp.get_compressor() == compressor::zstd && !service::get_local_storage_service().cluster_supports_zstd_compression()) {
+            throw exceptions::configuration_exception("ZstdCompressor is not supported by all nodes in the cluster");
+        }
     }
 
     validate_minimum_int(KW_DEFAULT_TIME_TO_LIVE, 0, DEFAULT_DEFAULT_TIME_TO_LIVE);
@@ -44,6 +44,7 @@
 
 #include "transport/messages/result_message.hh"
 #include "cql3/selection/selection.hh"
+#include "cql3/result_set.hh"
 #include "cql3/util.hh"
 #include "core/shared_ptr.hh"
 #include "query-result-reader.hh"
@@ -53,6 +54,9 @@
 #include "view_info.hh"
 #include "partition_slice_builder.hh"
 #include "cql3/untyped_result_set.hh"
+#include "service/storage_service.hh"
+#include <boost/algorithm/cxx11/all_of.hpp>
+#include <boost/range/adaptor/transformed.hpp>
 
 namespace cql3 {
 
@@ -247,7 +251,7 @@ select_statement::do_execute(distributed<service::storage_proxy>& proxy,
     ++_stats.reads;
 
     auto command = ::make_lw_shared<query::read_command>(_schema->id(), _schema->version(),
-        make_partition_slice(options), limit, now, tracing::make_trace_info(state.get_trace_state()), query::max_partitions, options.get_timestamp(state));
+        make_partition_slice(options), limit, now, tracing::make_trace_info(state.get_trace_state()), query::max_partitions, utils::UUID(), query::is_first_page::no, options.get_timestamp(state));
 
     int32_t page_size = options.get_page_size();
 
@@ -261,6 +265,13 @@ select_statement::do_execute(distributed<service::storage_proxy>& proxy,
 
     auto key_ranges = _restrictions->get_partition_key_ranges(options);
 
+    if (aggregate) {
+        auto aggregations = get_reducible_aggregations(*command, key_ranges, options);
+        if (aggregations) {
+            return execute_aggregate(proxy, command, std::move(key_ranges), std::move(*aggregations), state, options);
+        }
+    }
+
     if (!aggregate && (page_size <= 0
             || !service::pager::query_pagers::may_need_paging(page_size,
                     *command, key_ranges))) {
@@ -306,6 +317,37 @@ select_statement::do_execute(distributed<service::storage_proxy>& proxy,
             });
 }
 
+stdx::optional<std::vector<query::aggregation_info>>
+select_statement::get_reducible_aggregations(const query::read_command& cmd, const dht::partition_range_vector& key_ranges,
+                                             const query_options& options) const {
+    // Aggregations over single partitions are cheap enough to compute here.
+    if (_limit || options.get_paging_state()
+            || cmd.slice.options.contains<query::partition_slice::option::reversed>()
+            || boost::algorithm::all_of(key_ranges, std::mem_fn(&dht::partition_range::is_singular))
+            || !service::get_local_storage_service().cluster_supports_aggregate_pushdown()) {
+        return stdx::nullopt;
+    }
+    return _selection->get_reducible_aggregations();
+}
+
+future<shared_ptr<cql_transport::messages::result_message>>
+select_statement::execute_aggregate(distributed<service::storage_proxy>& proxy,
+                                    lw_shared_ptr<query::read_command> cmd,
+                                    dht::partition_range_vector&& partition_ranges,
+                                    std::vector<query::aggregation_info> aggregations,
+                                    service::query_state& state,
+                                    const query_options& options)
+{
+    auto column_names = boost::copy_range<std::vector<bytes>>(_selection->get_columns()
+            | boost::adaptors::transformed([] (const column_definition* def) { return def->name(); }));
+    query::aggregate_request req{std::move(aggregations), std::move(column_names), *cmd, std::move(partition_ranges), options.get_consistency()};
+    return proxy.local().query_aggregate(_schema, std::move(req), state.get_trace_state()).then([this] (std::vector<bytes_opt> values) {
+        auto rs = std::make_unique<result_set>(::make_shared<metadata>(*_selection->get_result_metadata()));
+        rs->add_row(std::move(values));
+        return ::make_shared<cql_transport::messages::result_message::rows>(std::move(rs));
+    });
+}
+
 future<shared_ptr<cql_transport::messages::result_message>>
 select_statement::execute(distributed<service::storage_proxy>& proxy,
                           lw_shared_ptr<query::read_command> cmd,
@@ -350,7 +392,7 @@ select_statement::execute_internal(distributed<service::storage_proxy>& proxy,
     int32_t limit = get_limit(options);
     auto now = gc_clock::now();
     auto command = ::make_lw_shared<query::read_command>(_schema->id(), _schema->version(),
-        make_partition_slice(options), limit, now, std::experimental::nullopt, query::max_partitions, options.get_timestamp(state));
+        make_partition_slice(options), limit, now, std::experimental::nullopt, query::max_partitions, utils::UUID(), query::is_first_page::no, options.get_timestamp(state));
     auto partition_ranges = _restrictions->get_partition_key_ranges(options);
 
     tracing::add_table_name(state.get_trace_state(), keyspace(), column_family());
@@ -499,6 +541,8 @@ indexed_table_select_statement::do_execute(distributed<service::storage_proxy>&
                 now,
                 tracing::make_trace_info(state.get_trace_state()),
                 query::max_partitions,
+                utils::UUID(),
+                query::is_first_page::no,
                 options.get_timestamp(state));
         return this->execute(proxy, command, std::move(partition_ranges), state, options, now);
     });
@@ -534,6 +578,8 @@ indexed_table_select_statement::find_index_partition_ranges(distributed<service:
             now,
             tracing::make_trace_info(state.get_trace_state()),
             query::max_partitions,
+            utils::UUID(),
+            query::is_first_page::no,
             options.get_timestamp(state));
     return proxy.local().query(view.schema(),
                                cmd,
@@ -138,6 +138,15 @@ protected :
 protected:
     int32_t get_limit(const query_options& options) const;
     bool needs_post_query_ordering() const;
+
+    // Returns the aggregations of this query if replicas can compute them
+    // (see storage_proxy::query_aggregate()), rather than the coordinator.
+    stdx::optional<std::vector<query::aggregation_info>> get_reducible_aggregations(const query::read_command& cmd,
+        const dht::partition_range_vector& key_ranges, const query_options& options) const;
+
+    future<::shared_ptr<cql_transport::messages::result_message>> execute_aggregate(distributed<service::storage_proxy>& proxy,
+        lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector&& partition_ranges,
+        std::vector<query::aggregation_info> aggregations, service::query_state& state, const query_options& options);
 };
 
 class primary_key_select_statement : public select_statement {
@@ -694,17 +694,35 @@ column_family::make_reader(schema_ptr s,
 flat_mutation_reader
 column_family::make_streaming_reader(schema_ptr s,
                            const dht::partition_range_vector& ranges) const {
+    return make_streaming_reader(std::move(s), ranges, {});
+}
+
+flat_mutation_reader
+column_family::make_streaming_reader(schema_ptr s,
+                           const dht::partition_range_vector& ranges,
+                           const std::vector<sstables::shared_sstable>& excluded) const {
     auto& slice = s->full_slice();
     auto& pc = service::get_local_streaming_read_priority();
 
-    auto source = mutation_source([this] (schema_ptr s, const dht::partition_range& range, const query::partition_slice& slice,
+    lw_shared_ptr<sstables::sstable_set> sstables;
+    if (!excluded.empty()) {
+        std::unordered_set<sstables::shared_sstable> excluded_set(excluded.begin(), excluded.end());
+        sstables = make_lw_shared(_compaction_strategy.make_sstable_set(_schema));
+        for (auto&& sst : *_sstables->all()) {
+            if (!excluded_set.count(sst)) {
+                sstables->insert(sst);
+            }
+        }
+    }
+
+    auto source = mutation_source([this, sstables = std::move(sstables)] (schema_ptr s, const dht::partition_range& range, const query::partition_slice& slice,
                                       const io_priority_class& pc, tracing::trace_state_ptr trace_state, streamed_mutation::forwarding fwd, mutation_reader::forwarding fwd_mr) {
         std::vector<mutation_reader> readers;
         readers.reserve(_memtables->size() + 1);
         for (auto&& mt : *_memtables) {
             readers.emplace_back(mt->make_reader(s, range, slice, pc, trace_state, fwd, fwd_mr));
         }
-        readers.emplace_back(make_sstable_reader(s, _sstables, range, slice, pc, std::move(trace_state), fwd, fwd_mr));
+        readers.emplace_back(make_sstable_reader(s, sstables ? sstables : _sstables, range, slice, pc, std::move(trace_state), fwd, fwd_mr));
         return make_combined_reader(s, std::move(readers), fwd, fwd_mr);
     });
 
@@ -821,6 +839,7 @@ void column_family::add_sstable(sstables::shared_sstable sstable, const std::vec
     auto new_sstables = make_lw_shared(*_sstables);
     new_sstables->insert(sstable);
     _sstables = std::move(new_sstables);
+    _compaction_strategy.get_backlog_tracker().add_sstable(sstable);
     update_stats_for_new_sstable(sstable->bytes_on_disk(), shards_for_the_sstable);
 }
 
@@ -1072,6 +1091,12 @@ column_family::stop() {
     return _async_gate.close().then([this] {
         return when_all(_memtables->request_flush(), _streaming_memtables->request_flush()).discard_result().finally([this] {
             return _compaction_manager.remove(this).then([this] {
+                auto entries = boost::copy_range<std::vector<lw_shared_ptr<streaming_sstables>>>(_streaming_sstables | boost::adaptors::map_values);
+                _streaming_sstables.clear();
+                return parallel_for_each(entries, [this] (auto& entry) {
+                    return this->abort_streaming_sstables(entry);
+                });
+            }).then([this] {
                 // Nest, instead of using when_all, so we don't lose any exceptions.
                 return _streaming_flush_gate.close();
             }).then([this] {
@@ -1287,6 +1312,18 @@ column_family::rebuild_sstable_list(const std::vector<sstables::shared_sstable>&
     _sstables = make_lw_shared(std::move(new_sstable_list));
     _sstables_compacted_but_not_deleted = std::move(new_compacted_but_not_deleted);
 
+    auto& backlog_tracker = _compaction_strategy.get_backlog_tracker();
+    for (auto&& sst : new_sstables) {
+        if (!s.count(sst)) {
+            backlog_tracker.add_sstable(sst);
+        }
+    }
+    for (auto&& sst : *current_sstables->all()) {
+        if (s.count(sst)) {
+            backlog_tracker.remove_sstable(sst);
+        }
+    }
+
     rebuild_statistics();
 
     // Second, delete the old sstables.  This is done in the background, so we can
@@ -1378,10 +1415,37 @@ column_family::compact_sstables(sstables::compaction_descriptor descriptor, bool
                 sst->set_unshared();
                 return sst;
         };
-        return sstables::compact_sstables(*sstables_to_compact, *this, create_sstable, descriptor.max_sstable_bytes, descriptor.level,
-                cleanup, _config.background_writer_scheduling_group).then([this, sstables_to_compact] (auto info) {
-            _compaction_strategy.notify_completion(*sstables_to_compact, info.new_sstables);
-            this->rebuild_sstable_list(info.new_sstables, *sstables_to_compact);
+        auto max_sstable_bytes = descriptor.max_sstable_bytes;
+        sstables::sstable_replacer_fn replacer;
+        if (_compaction_strategy.incremental() && !cleanup) {
+            // Other strategies would see the fragments as small sstables
+            // and compact them again; their inputs are still released as
+            // outputs are sealed at the strategy's own size.
+            if (_compaction_strategy.run_aware()) {
+                max_sstable_bytes = std::min(max_sstable_bytes, _compaction_strategy.incremental_fragment_size());
+            }
+            replacer = [this, sstables_to_compact, release_exhausted = std::move(descriptor.release_exhausted)]
+                    (std::vector<sstables::shared_sstable> exhausted, std::vector<sstables::shared_sstable> sealed) {
+                _compaction_strategy.notify_completion(exhausted, sealed);
+                this->rebuild_sstable_list(sealed, exhausted);
+                std::unordered_set<sstables::shared_sstable> s(exhausted.begin(), exhausted.end());
+                auto e = boost::range::remove_if(*sstables_to_compact, [&] (const sstables::shared_sstable& sst) {
+                    return s.count(sst);
+                });
+                sstables_to_compact->erase(e, sstables_to_compact->end());
+                if (release_exhausted) {
+                    release_exhausted(exhausted);
+                }
+            };
+        }
+        bool incremental = bool(replacer);
+        return sstables::compact_sstables(*sstables_to_compact, *this, create_sstable, max_sstable_bytes, descriptor.level,
+                cleanup, _config.compaction_scheduling_group, std::move(replacer)).then([this, sstables_to_compact, incremental] (auto info) {
+            // Incremental compaction has already replaced all of its inputs.
+            if (!incremental) {
+                _compaction_strategy.notify_completion(*sstables_to_compact, info.new_sstables);
+                this->rebuild_sstable_list(info.new_sstables, *sstables_to_compact);
+            }
             return info;
         });
     }).then([this] (auto info) {
@@ -1481,6 +1545,7 @@ void column_family::set_compaction_strategy(sstables::compaction_strategy_type s
     auto new_sstables = new_cs.make_sstable_set(_schema);
     for (auto&& s : *_sstables->all()) {
         new_sstables.insert(s);
+        new_cs.get_backlog_tracker().add_sstable(s);
     }
     // now exception safe:
     _compaction_strategy = std::move(new_cs);
@@ -1511,6 +1576,10 @@ int64_t column_family::get_unleveled_sstables() const {
     return 0;
 }
 
+uint64_t column_family::compaction_backlog() {
+    return _compaction_strategy.compaction_backlog(*this);
+}
+
 const sstables::sstable_set& column_family::get_sstable_set() const {
     return *_sstables;
 }
@@ -1588,7 +1657,8 @@ future<> distributed_loader::open_sstable(distributed<database>& db, sstables::e
         return with_semaphore(local.sstable_load_concurrency_sem(), 1, [&db, &local, comps = std::move(comps), func = std::move(func), pc] {
             auto& cf = local.find_column_family(comps.ks, comps.cf);
 
-            auto f = sstables::sstable::load_shared_components(cf.schema(), cf._config.datadir, comps.generation, comps.version, comps.format, pc);
+            auto f = sstables::sstable::load_shared_components(cf.schema(), cf._config.datadir, comps.generation, comps.version, comps.format, pc,
+                    local.get_config().lazy_sstable_filter_loading());
             return f.then([&db, comps = std::move(comps), func = std::move(func)] (sstables::sstable_open_info info) {
                 // shared components loaded, now opening sstable in all shards with shared components
                 return do_with(std::move(info), [&db, comps = std::move(comps), func = std::move(func)] (auto& info) {
@@ -2027,6 +2097,15 @@ make_flush_cpu_controller(db::config& cfg, seastar::thread_scheduling_group* bac
     return flush_cpu_controller(flush_cpu_controller::disabled{backup});
 }
 
+inline
+compaction_cpu_controller
+make_compaction_cpu_controller(db::config& cfg, seastar::thread_scheduling_group* backup, std::function<uint64_t()> fn, std::function<uint64_t()> total_bytes) {
+    if (cfg.auto_adjust_compaction_quota()) {
+        return compaction_cpu_controller(1s, std::move(fn), std::move(total_bytes));
+    }
+    return compaction_cpu_controller(compaction_cpu_controller::disabled{backup}, 1s, std::move(fn));
+}
+
 utils::UUID database::empty_version = utils::UUID_gen::get_name_UUID(bytes{});
 
 database::database() : database(db::config())
@@ -2044,11 +2123,19 @@ database::database(const db::config& cfg)
     , _memtable_cpu_controller(make_flush_cpu_controller(*_cfg, &_background_writer_scheduling_group, [this, limit = 2.0f * _dirty_memory_manager.throttle_threshold()] {
         return (_dirty_memory_manager.virtual_dirty_memory()) / limit;
     }))
+    , _compaction_cpu_controller(make_compaction_cpu_controller(*_cfg,
+            _cfg->background_writer_scheduling_quota() < 1.0f ? &_background_writer_scheduling_group : nullptr,
+            [this] { return compaction_backlog(); },
+            [this] { return live_sstable_bytes(); }))
+    , _sstable_load_concurrency_sem(std::max<size_t>(1, _cfg->sstable_load_concurrency()))
     , _version(empty_version)
     , _compaction_manager(std::make_unique<compaction_manager>())
     , _enable_incremental_backups(cfg.incremental_backups())
 {
     _compaction_manager->start();
+    // Cache sizes are node-wide, split them evenly between shards.
+    sstables::global_key_cache().set_capacity((size_t(_cfg->key_cache_size_in_mb()) << 20) / smp::count);
+    sstables::global_chunk_cache().set_capacity((size_t(_cfg->chunk_cache_size_in_mb()) << 20) / smp::count);
     setup_metrics();
 
     dblog.info("Row: max_vector_size: {}, internal_count: {}", size_t(row::max_vector_size), size_t(row::internal_count));
@@ -2081,6 +2168,68 @@ flush_cpu_controller::flush_cpu_controller(std::chrono::milliseconds interval, f
     _update_timer.arm_periodic(_interval);
 }
 
+void compaction_cpu_controller::adjust() {
+    _current_backlog = _backlog();
+    if (!_adjust_quota) {
+        return;
+    }
+
+    auto backlog = float(_current_backlog) / std::max<uint64_t>(_total_bytes(), 1);
+    _current_quota = quota(backlog);
+
+    dblog.trace("compaction backlog {} ({} normalized), quota {}", _current_backlog, backlog, _current_quota);
+    _scheduling_group.update_usage(_current_quota);
+}
+
+float compaction_cpu_controller::quota(float backlog) {
+    if (backlog < b1) {
+        return qmin + backlog * (q1 - qmin) / b1;
+    } else if (backlog < b2) {
+        return q1 + (backlog - b1) * (q2 - q1) / (b2 - b1);
+    }
+    return std::min(qmax, q2 + (backlog - b2) * (qmax - q2) / (bmax - b2));
+}
+
+compaction_cpu_controller::compaction_cpu_controller(std::chrono::milliseconds interval, std::function<uint64_t()> backlog, std::function<uint64_t()> total_bytes)
+    : _current_quota(qmin)
+    , _backlog(std::move(backlog))
+    , _total_bytes(std::move(total_bytes))
+    , _interval(interval)
+    , _update_timer([this] { adjust(); })
+    , _scheduling_group(1ms, qmin)
+    , _current_scheduling_group(&_scheduling_group)
+    , _adjust_quota(true)
+{
+    _update_timer.arm_periodic(_interval);
+}
+
+compaction_cpu_controller::compaction_cpu_controller(disabled d, std::chrono::milliseconds interval, std::function<uint64_t()> backlog)
+    : _backlog(std::move(backlog))
+    , _interval(interval)
+    , _update_timer([this] { adjust(); })
+    , _scheduling_group(std::chrono::nanoseconds(0), 0)
+    , _current_scheduling_group(d.backup)
+    , _adjust_quota(false)
+{
+    _update_timer.arm_periodic(_interval);
+}
+
+uint64_t database::compaction_backlog() const {
+    uint64_t backlog = 0;
+    for (auto& cf : _column_families) {
+        backlog += cf.second->compaction_backlog();
+    }
+    return backlog;
+}
+
+uint64_t database::live_sstable_bytes() const {
+    uint64_t bytes = 0;
+    for (auto& cf : _column_families) {
+        bytes += cf.second->get_stats().live_disk_space_used;
+    }
+    return bytes;
+}
+
 void
 dirty_memory_manager::setup_collectd(sstring namestr) {
     namespace sm = seastar::metrics;
@@ -2226,12 +2375,37 @@ database::setup_metrics() {
         sm::make_gauge("cpu_flush_quota", [this] { return _memtable_cpu_controller.current_quota(); },
                              sm::description("The current quota for memtable CPU scheduling group")),
 
+        sm::make_gauge("cpu_compaction_quota", [this] { return _compaction_cpu_controller.current_quota(); },
+                             sm::description("The current quota for compaction CPU scheduling group. Zero if it's not automatically adjusted.")),
+
+        sm::make_gauge("compaction_backlog", [this] { return _compaction_cpu_controller.current_backlog(); },
+                       sm::description("Holds the number of bytes compaction strategies of all tables estimate they have yet to rewrite. "
+                                       "If this value keeps growing, compaction doesn't keep up with writes.")),
+
         sm::make_derive("short_data_queries", _stats->short_data_queries,
                        sm::description("The rate of data queries (data or digest reads) that returned less rows than requested due to result size limiting.")),
 
         sm::make_derive("short_mutation_queries", _stats->short_mutation_queries,
                        sm::description("The rate of mutation queries that returned less rows than requested due to result size limiting.")),
 
+        sm::make_derive("querier_cache_lookups", [this] { return _querier_cache.get_stats().lookups; },
+                       sm::description("Counts pages of paged queries which looked for the reader kept by the previous page.")),
+
+        sm::make_derive("querier_cache_misses", [this] { return _querier_cache.get_stats().misses; },
+                       sm::description("Counts pages of paged queries which didn't find the reader kept by the previous page.")),
+
+        sm::make_derive("querier_cache_drops", [this] { return _querier_cache.get_stats().drops; },
+                       sm::description("Counts readers kept by the previous page which couldn't be used because the page starts at a different position.")),
+
+        sm::make_derive("querier_cache_time_based_evictions", [this] { return _querier_cache.get_stats().time_based_evictions; },
+                       sm::description("Counts readers kept between pages which were evicted because the next page didn't come in time.")),
+
+        sm::make_derive("querier_cache_resource_based_evictions", [this] { return _querier_cache.get_stats().resource_based_evictions; },
+                       sm::description("Counts readers kept between pages which were evicted because reads were short of memory.")),
+
+        sm::make_gauge("querier_cache_population", [this] { return _querier_cache.get_stats().population; },
+                       sm::description("Holds the number of readers kept between pages of paged queries.")),
+
         sm::make_total_operations("counter_cell_lock_acquisition", _cl_stats->lock_acquisitions,
                                  sm::description("The number of acquired counter cell locks.")),
 
@@ -2262,9 +2436,12 @@ future<> distributed_loader::populate_keyspace(distributed<database>& db, sstrin
         dblog.info("Populating Keyspace {}", ks_name);
         auto& ks = i->second;
         auto& column_families = db.local().get_column_families();
+        auto start = std::chrono::steady_clock::now();
+        auto total_cfs = ks.metadata()->cf_meta_data().size();
+        auto done_cfs = make_lw_shared<size_t>(0);
 
         return parallel_for_each(ks.metadata()->cf_meta_data() | boost::adaptors::map_values,
-            [ks_name, &ks, &column_families, &db] (schema_ptr s) {
+            [ks_name, &ks, &column_families, &db, total_cfs, done_cfs] (schema_ptr s) {
                 utils::UUID uuid = s->id();
                 lw_shared_ptr<column_family> cf = column_families[uuid];
                 sstring cfname = cf->schema()->cf_name();
@@ -2272,6 +2449,8 @@ future<> distributed_loader::populate_keyspace(distributed<database>& db, sstrin
                 dblog.info("Keyspace {}: Reading CF {} ", ks_name, cfname);
                 return ks.make_directory_for_column_family(cfname, uuid).then([&db, sstdir, uuid, ks_name, cfname] {
                     return distributed_loader::populate_column_family(db, sstdir, ks_name, cfname);
+                }).then([ks_name, cfname, total_cfs, done_cfs] {
+                    dblog.info("Keyspace {}: Done reading CF {} ({}/{})", ks_name, cfname, ++*done_cfs, total_cfs);
                 }).handle_exception([ks_name, cfname, sstdir](std::exception_ptr eptr) {
                     std::string msg =
                         sprint("Exception while populating keyspace '%s' with column family '%s' from file '%s': %s",
@@ -2280,6 +2459,26 @@ future<> distributed_loader::populate_keyspace(distributed<database>& db, sstrin
                                 ks_name, cfname, sstdir, eptr);
                     throw std::runtime_error(msg.c_str());
                 });
+            }).then([&db, ks_name, start] {
+                // Shared sstables are present on all their owning shards, count them on the first one only.
+                return db.map_reduce0([ks_name] (database& db) {
+                    std::pair<size_t, uint64_t> count_and_size;
+                    for (auto& s : db.find_keyspace(ks_name).metadata()->cf_meta_data() | boost::adaptors::map_values) {
+                        for (auto& sst : *db.find_column_family(s).get_sstables()) {
+                            if (sst->get_shards_for_this_sstable().front() == engine().cpu_id()) {
+                                count_and_size.first++;
+                                count_and_size.second += sst->bytes_on_disk();
+                            }
+                        }
+                    }
+                    return count_and_size;
+                }, std::make_pair(size_t(0), uint64_t(0)), [] (auto a, auto b) {
+                    return std::make_pair(a.first + b.first, a.second + b.second);
+                }).then([ks_name, start] (std::pair<size_t, uint64_t> count_and_size) {
+                    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+                    dblog.info("Populated Keyspace {}: {} sstables, {} bytes in {} ms",
+                               ks_name, count_and_size.first, count_and_size.second, elapsed.count());
+                });
             });
     }
 }
@@ -2424,24 +2623,88 @@ future<> distributed_loader::init_non_system_keyspaces(distributed<database>& db
 
         const auto& cfg = db.local().get_config();
         populate(db, cfg.data_file_directories()[0]).get();
+
+        if (cfg.lazy_sstable_filter_loading() && cfg.sstable_filter_warmup()) {
+            db.invoke_on_all([] (database& db) {
+                db.start_sstable_filter_warmup();
+            }).get();
+        }
+    });
+}
+
+void database::start_sstable_filter_warmup() {
+    std::vector<sstables::shared_sstable> ssts;
+    for (auto& cf : _column_families | boost::adaptors::map_values) {
+        auto set = cf->get_sstables();
+        ssts.insert(ssts.end(), set->begin(), set->end());
+    }
+    auto start = std::chrono::steady_clock::now();
+    with_gate(_sstable_filter_warmup_gate, [this, ssts = std::move(ssts), start] () mutable {
+        return do_with(std::move(ssts), [this, start] (std::vector<sstables::shared_sstable>& ssts) {
+            return parallel_for_each(ssts, [this] (const sstables::shared_sstable& sst) {
+                return with_semaphore(_sstable_load_concurrency_sem, 1, [sst] {
+                    return sst->load_filter(service::get_local_compaction_priority());
+                });
+            }).then([&ssts, start] {
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+                dblog.info("Loaded filters of {} sstables in {} ms", ssts.size(), elapsed.count());
+            });
+        });
+    }).handle_exception([] (std::exception_ptr ep) {
+        // Filters which weren't loaded will be loaded on first use.
+        dblog.debug("Filter warm-up interrupted: {}", ep);
     });
 }
 
 future<>
 database::init_commitlog() {
-    return db::commitlog::create_commitlog(*_cfg).then([this](db::commitlog&& log) {
+    db::commitlog::config scfg(*_cfg);
+    scfg.commit_log_location = system_commitlog_directory(*_cfg);
+    scfg.commitlog_segment_size_in_mb = _cfg->system_commitlog_segment_size_in_mb();
+    // The system keyspaces are small and flushed often, so a few segments
+    // per shard suffice.
+    scfg.commitlog_total_space_in_mb = scfg.commitlog_segment_size_in_mb * 4 * smp::count;
+    scfg.max_reserve_segments = 2;
+    if (!_cfg->system_commitlog_sync().empty()) {
+        scfg.mode = _cfg->system_commitlog_sync() == "batch" ? db::commitlog::sync_mode::BATCH : db::commitlog::sync_mode::PERIODIC;
+    }
+    scfg.metrics_category_name = "system_commitlog";
+
+    return db::commitlog::create_commitlog(*_cfg).then([this, scfg = std::move(scfg)](db::commitlog&& log) {
         _commitlog = std::make_unique<db::commitlog>(std::move(log));
-        _commitlog->add_flush_handler([this](db::cf_id_type id, db::replay_position pos) {
-            if (_column_families.count(id) == 0) {
-                // the CF has been removed.
-                _commitlog->discard_completed_segments(id);
-                return;
-            }
-            _column_families[id]->flush();
-        }).release(); // we have longer life time than CL. Ignore reg anchor
+        add_commitlog_flush_handler(*_commitlog);
+        return db::commitlog::create_commitlog(std::move(scfg));
+    }).then([this](db::commitlog&& log) {
+        _system_commitlog = std::make_unique<db::commitlog>(std::move(log));
+        add_commitlog_flush_handler(*_system_commitlog);
     });
 }
 
+void
+database::add_commitlog_flush_handler(db::commitlog& log) {
+    log.add_flush_handler([this, &log](db::cf_id_type id, db::replay_position pos) {
+        if (_column_families.count(id) == 0) {
+            // the CF has been removed.
+            log.discard_completed_segments(id);
+            return;
+        }
+        _column_families[id]->flush();
+    }).release(); // we have longer life time than CL. Ignore reg anchor
+}
+
+sstring
+database::system_commitlog_directory(const db::config& cfg) {
+    if (!cfg.system_commitlog_directory().empty()) {
+        return cfg.system_commitlog_directory();
+    }
+    return cfg.commitlog_directory() + "/system";
+}
+
+db::commitlog*
+database::commitlog_for(const sstring& ks_name) const {
+    return is_system_keyspace(ks_name) ? system_commitlog() : commitlog();
+}
+
 unsigned
 database::shard_of(const dht::token& t) {
     return dht::shard_of(t);
@@ -2490,8 +2753,9 @@ void database::add_column_family(keyspace& ks, schema_ptr schema, column_family:
     schema->registry_entry()->mark_synced();
 
     lw_shared_ptr<column_family> cf;
-    if (cfg.enable_commitlog && _commitlog) {
-       cf = make_lw_shared<column_family>(schema, std::move(cfg), *_commitlog, *_compaction_manager, *_cl_stats);
+    auto cl = commitlog_for(schema->ks_name());
+    if (cfg.enable_commitlog && cl) {
+       cf = make_lw_shared<column_family>(schema, std::move(cfg), *cl, *_compaction_manager, *_cl_stats);
     } else {
        cf = make_lw_shared<column_family>(schema, std::move(cfg), column_family::no_commitlog(), *_compaction_manager, *_cl_stats);
     }
@@ -2541,6 +2805,7 @@ bool database::update_column_family(schema_ptr new_schema) {
 void database::remove(const column_family& cf) {
     auto s = cf.schema();
     auto& ks = find_keyspace(s->ks_name());
+    _querier_cache.evict_all_for_table(s->id());
     _column_families.erase(s->id());
     ks.metadata()->remove_column_family(s);
     _ks_cf_to_uuid.erase(std::make_pair(s->ks_name(), s->cf_name()));
@@ -2692,12 +2957,15 @@ keyspace::make_column_family_config(const schema& s, const db::config& db_config
     cfg.enable_cache = _config.enable_cache;
     cfg.dirty_memory_manager = _config.dirty_memory_manager;
     cfg.streaming_dirty_memory_manager = _config.streaming_dirty_memory_manager;
+    cfg.enable_streaming_to_sstables = _config.enable_streaming_to_sstables;
+    cfg.streaming_sstable_writers_sem = _config.streaming_sstable_writers_sem;
     cfg.read_concurrency_config = _config.read_concurrency_config;
     cfg.streaming_read_concurrency_config = _config.streaming_read_concurrency_config;
     cfg.cf_stats = _config.cf_stats;
     cfg.enable_incremental_backups = _config.enable_incremental_backups;
     cfg.background_writer_scheduling_group = _config.background_writer_scheduling_group;
     cfg.memtable_scheduling_group = _config.memtable_scheduling_group;
+    cfg.compaction_scheduling_group = _config.compaction_scheduling_group;
     cfg.enable_metrics_reporting = db_config.enable_keyspace_column_family_metrics();
 
     return cfg;
@@ -2882,10 +3150,11 @@ struct query_state {
                          const query::read_command& cmd,
                          query::result_request request,
                          const dht::partition_range_vector& ranges,
-                         query::result_memory_accounter memory_accounter = { })
+                         query::result_memory_accounter memory_accounter = { },
+                         query::digest_algorithm da = query::digest_algorithm::MD5)
             : schema(std::move(s))
             , cmd(cmd)
-            , builder(cmd.slice, request, std::move(memory_accounter))
+            , builder(cmd.slice, request, std::move(memory_accounter), da)
             , limit(cmd.row_limit)
             , partition_limit(cmd.partition_limit)
             , current_partition_range(ranges.begin())
@@ -2915,18 +3184,18 @@ future<lw_shared_ptr<query::result>>
 column_family::query(schema_ptr s, const query::read_command& cmd, query::result_request request,
                      const dht::partition_range_vector& partition_ranges,
                      tracing::trace_state_ptr trace_state, query::result_memory_limiter& memory_limiter,
-                     uint64_t max_size) {
+                     uint64_t max_size, query::querier_cache_context cache_ctx, query::digest_algorithm da) {
     utils::latency_counter lc;
     _stats.reads.set_latency(lc);
     auto f = request == query::result_request::only_digest
              ? memory_limiter.new_digest_read(max_size) : memory_limiter.new_data_read(max_size);
-    return f.then([this, lc, s = std::move(s), &cmd, request, &partition_ranges, trace_state = std::move(trace_state)] (query::result_memory_accounter accounter) mutable {
-        auto qs_ptr = std::make_unique<query_state>(std::move(s), cmd, request, partition_ranges, std::move(accounter));
+    return f.then([this, lc, s = std::move(s), &cmd, request, &partition_ranges, trace_state = std::move(trace_state), cache_ctx, da] (query::result_memory_accounter accounter) mutable {
+        auto qs_ptr = std::make_unique<query_state>(std::move(s), cmd, request, partition_ranges, std::move(accounter), da);
         auto& qs = *qs_ptr;
-        return do_until(std::bind(&query_state::done, &qs), [this, &qs, trace_state = std::move(trace_state)] {
+        return do_until(std::bind(&query_state::done, &qs), [this, &qs, trace_state = std::move(trace_state), cache_ctx] {
             auto&& range = *qs.current_partition_range++;
             return data_query(qs.schema, as_mutation_source(), range, qs.cmd.slice, qs.remaining_rows(),
-                              qs.remaining_partitions(), qs.cmd.timestamp, qs.builder, trace_state);
+                              qs.remaining_partitions(), qs.cmd.timestamp, qs.builder, trace_state, cache_ctx);
         }).then([qs_ptr = std::move(qs_ptr), &qs] {
             return make_ready_future<lw_shared_ptr<query::result>>(
                     make_lw_shared<query::result>(qs.builder.build()));
@@ -2949,6 +3218,37 @@ column_family::as_mutation_source() const {
                                    streamed_mutation::forwarding fwd,
                                    mutation_reader::forwarding fwd_mr) {
         return this->make_reader(std::move(s), range, slice, pc, std::move(trace_state), fwd, fwd_mr);
+    }, [] {
+        return make_default_partition_presence_checker();
+    }, [this] (schema_ptr s, const dht::decorated_key& dk, const io_priority_class& pc) {
+        return this->clustering_split_points(std::move(s), dk, pc);
+    });
+}
+
+future<std::vector<clustering_key_prefix>>
+column_family::clustering_split_points(schema_ptr s, const dht::decorated_key& dk, const io_priority_class& pc) const {
+    if (_virtual_reader || !s->clustering_key_size()) {
+        return make_ready_future<std::vector<clustering_key_prefix>>();
+    }
+    auto key = sstables::key::from_partition_key(*s, dk.key());
+    auto sstables = _sstables->select(dht::partition_range::make_singular(dk));
+    sstables.erase(boost::remove_if(sstables, [&key] (const sstables::shared_sstable& sst) {
+        return !sst->filter_has_key(key);
+    }), sstables.end());
+    if (sstables.empty()) {
+        return make_ready_future<std::vector<clustering_key_prefix>>();
+    }
+    return do_with(std::move(sstables), std::vector<clustering_key_prefix>(), dk,
+            [s = std::move(s), &pc] (auto& sstables, auto& points, const dht::decorated_key& dk) {
+        return parallel_for_each(sstables, [&points, &dk, &pc] (const sstables::shared_sstable& sst) {
+            return sst->clustering_split_points(dk, pc).then([&points] (std::vector<clustering_key_prefix> sst_points) {
+                std::move(sst_points.begin(), sst_points.end(), std::back_inserter(points));
+            });
+        }).then([s, &points] {
+            boost::sort(points, clustering_key_prefix::less_compare(*s));
+            points.erase(std::unique(points.begin(), points.end(), clustering_key_prefix::equality(*s)), points.end());
+            return std::move(points);
+        });
     });
 }
 
@@ -2970,11 +3270,12 @@ static thread_local auto data_query_stage = seastar::make_execution_stage("data_
 
 future<lw_shared_ptr<query::result>, cache_temperature>
 database::query(schema_ptr s, const query::read_command& cmd, query::result_request request, const dht::partition_range_vector& ranges, tracing::trace_state_ptr trace_state,
-                uint64_t max_result_size) {
+                uint64_t max_result_size, query::digest_algorithm da) {
     column_family& cf = find_column_family(cmd.cf_id);
+    _querier_cache.evict_if_short_of_resources();
     return data_query_stage(&cf, std::move(s), seastar::cref(cmd), request, seastar::cref(ranges),
                             std::move(trace_state), seastar::ref(get_result_memory_limiter()),
-                            max_result_size).then_wrapped([this, s = _stats, hit_rate = cf.get_global_cache_hit_rate()] (auto f) {
+                            max_result_size, query::querier_cache_context(_querier_cache, cmd.query_uuid, cmd.is_first_page), da).then_wrapped([this, s = _stats, hit_rate = cf.get_global_cache_hit_rate()] (auto f) {
         if (f.failed()) {
             ++s->total_reads_failed;
             return make_exception_future<lw_shared_ptr<query::result>, cache_temperature>(f.get_exception());
@@ -3162,6 +3463,108 @@ void column_family::apply_streaming_mutation(schema_ptr m_schema, utils::UUID pl
     _streaming_memtables->active_memtable().apply(m, m_schema);
 }
 
+future<> column_family::write_streaming_mutation(schema_ptr m_schema, utils::UUID plan_id, const frozen_mutation& fm) {
+    return with_gate(_streaming_flush_gate, [this, m_schema = std::move(m_schema), plan_id, &fm] () mutable {
+        auto it = _streaming_sstables.find(plan_id);
+        if (it == _streaming_sstables.end()) {
+            it = _streaming_sstables.emplace(plan_id, make_lw_shared<streaming_sstables>()).first;
+        }
+        auto entry = it->second;
+        return with_gate(entry->writes, [this, entry, m_schema = std::move(m_schema), plan_id, &fm] () mutable {
+            auto m = fm.unfreeze(m_schema);
+            m.upgrade(_schema);
+            if (dblog.is_enabled(logging::log_level::trace)) {
+                dblog.trace("streaming write {}", m);
+            }
+            auto& writers = entry->writers;
+            // Writers opened before the table's schema changed would write m
+            // with a schema other than its own.
+            for (auto w = writers.begin(); w != writers.end();) {
+                if ((*w)->schema() == _schema) {
+                    ++w;
+                    continue;
+                }
+                (void)with_gate(entry->writes, [this, entry, w = std::move(*w)] () mutable {
+                    return finish_streaming_sstable_writer(entry, std::move(w));
+                });
+                w = writers.erase(w);
+            }
+            auto& s = *_schema;
+            auto last_key_less = [&s] (const lw_shared_ptr<streaming_sstable_writer>& a, const lw_shared_ptr<streaming_sstable_writer>& b) {
+                return a->last_key()->less_compare(s, *b->last_key());
+            };
+            auto best = writers.end();
+            for (auto w = writers.begin(); w != writers.end(); ++w) {
+                if ((*w)->last_key()->less_compare(s, m.decorated_key()) && (best == writers.end() || last_key_less(*best, *w))) {
+                    best = w;
+                }
+            }
+            if (best != writers.end() && (*best)->partitions() < max_streaming_sstable_partitions) {
+                auto w = *best;
+                return w->push(std::move(m)).finally([w] { });
+            }
+            auto& sem = *_config.streaming_sstable_writers_sem;
+            if (best == writers.end()) {
+                if (sem.try_wait(streaming_sstable_writer_memory)) {
+                    auto w = make_streaming_sstable_writer(semaphore_units<>(sem, streaming_sstable_writer_memory));
+                    writers.push_back(w);
+                    return w->push(std::move(m)).finally([w] { });
+                }
+                if (writers.empty()) {
+                    // The shard's writers are all taken; m will be flushed
+                    // with the streaming memtable when the plan completes.
+                    return _config.streaming_dirty_memory_manager->region_group().run_when_memory_available([this, m_schema = std::move(m_schema), plan_id, &fm] {
+                        apply_streaming_mutation(m_schema, plan_id, fm, false);
+                    });
+                }
+                // m starts a new run. The writer which is ahead of all
+                // others is the least likely to be continued.
+                best = std::max_element(writers.begin(), writers.end(), last_key_less);
+            }
+            // Replace the writer. The memory of the old one is released once
+            // it has been written, so the new one may have to wait for it,
+            // but never for a writer which is still open.
+            auto old = std::move(*best);
+            writers.erase(best);
+            (void)with_gate(entry->writes, [this, entry, old = std::move(old)] () mutable {
+                return finish_streaming_sstable_writer(entry, std::move(old));
+            });
+            return get_units(sem, streaming_sstable_writer_memory).then([this, entry, m = std::move(m)] (semaphore_units<> units) mutable {
+                if (entry->aborted) {
+                    return make_exception_future<>(std::runtime_error("streaming sstables aborted"));
+                }
+                m.upgrade(_schema);
+                auto w = make_streaming_sstable_writer(std::move(units));
+                entry->writers.push_back(w);
+                return w->push(std::move(m)).finally([w] { });
+            });
+        });
+    });
+}
+
+lw_shared_ptr<streaming_sstable_writer> column_family::make_streaming_sstable_writer(semaphore_units<> memory) {
+    auto sst = sstables::make_sstable(_schema,
+            _config.datadir, calculate_generation_for_new_table(),
+            sstables::sstable::version_types::ka,
+            sstables::sstable::format_types::big);
+    sst->set_unshared();
+    sstables::sstable_writer_config cfg;
+    cfg.leave_unsealed = true;
+    cfg.thread_scheduling_group = _config.background_writer_scheduling_group;
+    auto&& priority = service::get_local_streaming_write_priority();
+    return make_lw_shared<streaming_sstable_writer>(_schema, std::move(sst), max_streaming_sstable_partitions, cfg, priority, std::move(memory));
+}
+
+future<> column_family::finish_streaming_sstable_writer(lw_shared_ptr<streaming_sstables> entry, lw_shared_ptr<streaming_sstable_writer> writer) {
+    return writer->finish().then_wrapped([entry, writer] (future<sstables::shared_sstable> f) {
+        try {
+            entry->sstables.push_back(f.get0());
+        } catch (...) {
+            entry->failure = std::current_exception();
+        }
+    });
+}
+
 void column_family::apply_streaming_big_mutation(schema_ptr m_schema, utils::UUID plan_id, const frozen_mutation& m) {
     auto it = _streaming_memtables_big.find(plan_id);
     if (it == _streaming_memtables_big.end()) {
@@ -3404,6 +3807,10 @@ future<> database::apply_streaming_mutation(schema_ptr s, utils::UUID plan_id, c
         throw std::runtime_error(sprint("attempted to mutate using not synced schema of %s.%s, version=%s",
                                  s->ks_name(), s->cf_name(), s->version()));
     }
+    auto& cf = find_column_family(m.column_family_id());
+    if (!fragmented && cf.writes_streaming_mutations_to_sstables()) {
+        return cf.write_streaming_mutation(std::move(s), plan_id, m);
+    }
     return _streaming_dirty_memory_manager.region_group().run_when_memory_available([this, &m, plan_id, fragmented, s = std::move(s)] {
         auto uuid = m.column_family_id();
         auto& cf = find_column_family(uuid);
@@ -3431,6 +3838,8 @@ database::make_keyspace_config(const keyspace_metadata& ksm) {
     }
     cfg.dirty_memory_manager = &_dirty_memory_manager;
     cfg.streaming_dirty_memory_manager = &_streaming_dirty_memory_manager;
+    cfg.enable_streaming_to_sstables = _cfg->enable_streaming_to_sstables();
+    cfg.streaming_sstable_writers_sem = &_streaming_sstable_writers_sem;
     cfg.read_concurrency_config.resources_sem = &_read_concurrency_sem;
     cfg.read_concurrency_config.active_reads = &_stats->active_reads;
     cfg.read_concurrency_config.timeout = _cfg->read_request_timeout_in_ms() * 1ms;
@@ -3450,6 +3859,7 @@ database::make_keyspace_config(const keyspace_metadata& ksm) {
         cfg.background_writer_scheduling_group = &_background_writer_scheduling_group;
         cfg.memtable_scheduling_group = _memtable_cpu_controller.scheduling_group();
     }
+    cfg.compaction_scheduling_group = _compaction_cpu_controller.scheduling_group();
     cfg.enable_metrics_reporting = _cfg->enable_keyspace_column_family_metrics();
     return cfg;
 }
@@ -3536,15 +3946,27 @@ schema_ptr database::find_indexed_table(const sstring& ks_name, const sstring& i
     return nullptr;
 }
 
+future<>
+database::shutdown_commitlogs() {
+    auto shutdown = [] (db::commitlog* log) {
+        return log ? log->shutdown() : make_ready_future<>();
+    };
+    return when_all(shutdown(_commitlog.get()), shutdown(_system_commitlog.get())).then([] (auto results) {
+        std::get<0>(results).get();
+        std::get<1>(results).get();
+    });
+}
+
 future<>
 database::stop() {
-    return _compaction_manager->stop().then([this] {
+    _sstable_load_concurrency_sem.broken();
+    return _sstable_filter_warmup_gate.close().then([this] {
+        return _compaction_manager->stop();
+    }).then([this] {
         // try to ensure that CL has done disk flushing
-        if (_commitlog != nullptr) {
-            return _commitlog->shutdown();
-        }
-        return make_ready_future<>();
+        return shutdown_commitlogs();
     }).then([this] {
+        _querier_cache.evict_all();
         return parallel_for_each(_column_families, [this] (auto& val_pair) {
             return val_pair.second->stop();
         });
@@ -3553,6 +3975,11 @@ database::stop() {
             return _commitlog->release();
         }
         return make_ready_future<>();
+    }).then([this] {
+        if (_system_commitlog != nullptr) {
+            return _system_commitlog->release();
+        }
+        return make_ready_future<>();
     }).then([this] {
         return _system_dirty_memory_manager.shutdown();
     }).then([this] {
@@ -3935,7 +4362,25 @@ future<> column_family::flush_streaming_mutations(utils::UUID plan_id, dht::part
     // temporary counter measure.
     dblog.debug("Flushing streaming memtable, plan={}", plan_id);
     return with_gate(_streaming_flush_gate, [this, plan_id, ranges = std::move(ranges)] () mutable {
-        return flush_streaming_big_mutations(plan_id).then([this, ranges = std::move(ranges)] (auto sstables) mutable {
+        return when_all(flush_streaming_big_mutations(plan_id), flush_streaming_sstables(plan_id)).then([] (auto results) {
+            auto& big = std::get<0>(results);
+            auto& written = std::get<1>(results);
+            if (big.failed() || written.failed()) {
+                // Neither set of sstables may become visible without the other.
+                for (auto* f : { &big, &written }) {
+                    if (!f->failed()) {
+                        for (auto&& sst : f->get0()) {
+                            sst->mark_for_deletion();
+                        }
+                    }
+                }
+                return make_exception_future<std::vector<sstables::shared_sstable>>(big.failed() ? big.get_exception() : written.get_exception());
+            }
+            auto sstables = big.get0();
+            auto more = written.get0();
+            std::move(more.begin(), more.end(), std::back_inserter(sstables));
+            return make_ready_future<std::vector<sstables::shared_sstable>>(std::move(sstables));
+        }).then([this, ranges = std::move(ranges)] (auto sstables) mutable {
             return _streaming_memtables->seal_active_memtable_delayed().then([this] {
                 return _streaming_flush_phaser.advance_and_await();
             }).then([this, sstables = std::move(sstables), ranges = std::move(ranges)] () mutable {
@@ -3972,18 +4417,99 @@ future<std::vector<sstables::shared_sstable>> column_family::flush_streaming_big
     });
 }
 
+future<std::vector<sstables::shared_sstable>> column_family::flush_streaming_sstables(utils::UUID plan_id) {
+    auto it = _streaming_sstables.find(plan_id);
+    if (it == _streaming_sstables.end()) {
+        return make_ready_future<std::vector<sstables::shared_sstable>>(std::vector<sstables::shared_sstable>());
+    }
+    auto entry = it->second;
+    _streaming_sstables.erase(it);
+    return entry->writes.close().then([this, entry] {
+        return parallel_for_each(entry->writers, [this, entry] (auto& w) {
+            return this->finish_streaming_sstable_writer(entry, w);
+        });
+    }).then([this, entry] {
+        entry->writers.clear();
+        if (entry->failure) {
+            for (auto&& sst : entry->sstables) {
+                sst->mark_for_deletion();
+            }
+            return make_exception_future<>(entry->failure);
+        }
+        return parallel_for_each(entry->sstables, [this] (auto& sst) {
+            return sst->seal_sstable(this->incremental_backups_enabled()).then([sst] {
+                return sst->open_data();
+            });
+        });
+    }).then([entry] {
+        return std::move(entry->sstables);
+    });
+}
+
+future<> column_family::abort_streaming_sstables(lw_shared_ptr<streaming_sstables> entry) {
+    entry->aborted = true;
+    return parallel_for_each(entry->writers, [] (auto& w) {
+        return w->abort();
+    }).then([entry] {
+        entry->writers.clear();
+        return entry->writes.close();
+    }).then([entry] {
+        for (auto&& sst : entry->sstables) {
+            sst->mark_for_deletion();
+        }
+    });
+}
+
+future<> column_family::write_and_add_sstable(flat_mutation_reader reader, uint64_t estimated_partitions,
+        dht::partition_range_vector ranges) {
+    return with_gate(_streaming_flush_gate, [this, reader = std::move(reader), estimated_partitions, ranges = std::move(ranges)] () mutable {
+        return with_lock(_sstables_lock.for_read(), [this, reader = std::move(reader), estimated_partitions] () mutable {
+            auto sst = sstables::make_sstable(_schema,
+                    _config.datadir, calculate_generation_for_new_table(),
+                    sstables::sstable::version_types::ka,
+                    sstables::sstable::format_types::big);
+            sst->set_unshared();
+            sstables::sstable_writer_config cfg;
+            cfg.backup = incremental_backups_enabled();
+            cfg.thread_scheduling_group = _config.background_writer_scheduling_group;
+            auto&& priority = service::get_local_streaming_write_priority();
+            return sst->write_components(std::move(reader), estimated_partitions, _schema, cfg, priority).then([sst] {
+                return sst->open_data();
+            }).then([sst] {
+                return sst;
+            }).handle_exception([sst] (auto ep) {
+                dblog.error("failed to write sstable {}: {}", sst->get_filename(), ep);
+                sst->mark_for_deletion();
+                return make_exception_future<sstables::shared_sstable>(ep);
+            });
+        }).then([this, ranges = std::move(ranges)] (sstables::shared_sstable sst) mutable {
+            return _cache.invalidate([this, sst] () mutable noexcept {
+                // FIXME: this is not really noexcept, but we need to provide strong exception guarantees.
+                this->add_sstable(sst, {engine().cpu_id()});
+                this->try_trigger_compaction();
+            }, std::move(ranges));
+        });
+    });
+}
+
 future<> column_family::fail_streaming_mutations(utils::UUID plan_id) {
+    auto written = make_ready_future<>();
+    auto sit = _streaming_sstables.find(plan_id);
+    if (sit != _streaming_sstables.end()) {
+        written = abort_streaming_sstables(sit->second);
+        _streaming_sstables.erase(sit);
+    }
     auto it = _streaming_memtables_big.find(plan_id);
     if (it == _streaming_memtables_big.end()) {
-        return make_ready_future<>();
+        return written;
     }
     auto entry = it->second;
     _streaming_memtables_big.erase(it);
-    return entry->flush_in_progress.close().then([this, entry] {
+    return when_all(std::move(written), entry->flush_in_progress.close().then([this, entry] {
         for (auto&& sst : entry->sstables) {
             sst->mark_for_deletion();
         }
-    });
+    })).discard_result();
 }
 
 future<> column_family::clear() {
@@ -3995,7 +4521,13 @@ future<> column_family::clear() {
     _streaming_memtables->clear();
     _streaming_memtables->add_memtable();
     _streaming_memtables_big.clear();
-    return _cache.invalidate([] { /* There is no underlying mutation source */ });
+    auto entries = boost::copy_range<std::vector<lw_shared_ptr<streaming_sstables>>>(_streaming_sstables | boost::adaptors::map_values);
+    _streaming_sstables.clear();
+    return parallel_for_each(entries, [this] (auto& entry) {
+        return this->abort_streaming_sstables(entry);
+    }).then([this] {
+        return _cache.invalidate([] { /* There is no underlying mutation source */ });
+    });
 }
 
 // NOTE: does not need to be futurized, but might eventually, depending on
@@ -4020,6 +4552,7 @@ future<db::replay_position> column_family::discard_sstables(db_clock::time_point
                 for (auto& p : *cf._sstables->all()) {
                     if (p->max_data_age() <= gc_trunc) {
                         rp = std::max(p->get_stats_metadata().position, rp);
+                        cf._compaction_strategy.get_backlog_tracker().remove_sstable(p);
                         remove.emplace_back(p);
                         continue;
                     }
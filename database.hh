@@ -80,6 +80,8 @@
 #include "cpu_controller.hh"
 #include "dirty_memory_manager.hh"
 #include "reader_resource_tracker.hh"
+#include "querier.hh"
+#include "streaming_sstable_writer.hh"
 
 class cell_locker;
 class cell_locker_stats;
@@ -296,11 +298,14 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         bool enable_incremental_backups = false;
         ::dirty_memory_manager* dirty_memory_manager = &default_dirty_memory_manager;
         ::dirty_memory_manager* streaming_dirty_memory_manager = &default_dirty_memory_manager;
+        bool enable_streaming_to_sstables = false;
+        semaphore* streaming_sstable_writers_sem = nullptr;
         restricted_mutation_reader_config read_concurrency_config;
         restricted_mutation_reader_config streaming_read_concurrency_config;
         ::cf_stats* cf_stats = nullptr;
         seastar::thread_scheduling_group* background_writer_scheduling_group = nullptr;
         seastar::thread_scheduling_group* memtable_scheduling_group = nullptr;
+        seastar::thread_scheduling_group* compaction_scheduling_group = nullptr;
         bool enable_metrics_reporting = false;
     };
     struct no_commitlog {};
@@ -378,6 +383,36 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     };
     std::unordered_map<utils::UUID, lw_shared_ptr<streaming_memtable_big>> _streaming_memtables_big;
 
+    // Unfragmented mutations received by streaming skip the memtables and
+    // are written directly into per-plan sstables, which, like those of
+    // _streaming_memtables_big, become visible when streaming is complete.
+    //
+    // An sstable has to be written in ring order, but the partitions sent by
+    // the different shards of a sender arrive interleaved. So a plan writes
+    // several sstables at a time, and each partition is appended to the one
+    // whose last partition is the closest smaller one.
+    //
+    // Open writers are limited per shard by streaming_sstable_writers_sem.
+    // A partition which would need another writer while none is available
+    // goes to _streaming_memtables instead.
+    struct streaming_sstables {
+        std::vector<lw_shared_ptr<streaming_sstable_writer>> writers;
+        // Complete, but not yet sealed.
+        std::vector<sstables::shared_sstable> sstables;
+        std::exception_ptr failure;
+        seastar::gate writes;
+        bool aborted = false;
+    };
+    std::unordered_map<utils::UUID, lw_shared_ptr<streaming_sstables>> _streaming_sstables;
+    // Bloom filters of streamed sstables are sized for this many partitions,
+    // so an sstable is closed once it holds that many.
+    static constexpr uint64_t max_streaming_sstable_partitions = 256 * 1024;
+
+    lw_shared_ptr<streaming_sstable_writer> make_streaming_sstable_writer(semaphore_units<> memory);
+    future<> finish_streaming_sstable_writer(lw_shared_ptr<streaming_sstables> entry, lw_shared_ptr<streaming_sstable_writer> writer);
+    future<std::vector<sstables::shared_sstable>> flush_streaming_sstables(utils::UUID plan_id);
+    future<> abort_streaming_sstables(lw_shared_ptr<streaming_sstables> entry);
+
     future<std::vector<sstables::shared_sstable>> flush_streaming_big_mutations(utils::UUID plan_id);
     void apply_streaming_big_mutation(schema_ptr m_schema, utils::UUID plan_id, const frozen_mutation& m);
     future<> seal_active_streaming_memtable_big(streaming_memtable_big& smb, flush_permit&&);
@@ -591,8 +626,19 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     flat_mutation_reader make_streaming_reader(schema_ptr schema,
             const dht::partition_range_vector& ranges) const;
 
+    // Like make_streaming_reader() above, but doesn't read the sstables in
+    // excluded, which are streamed as whole files.
+    flat_mutation_reader make_streaming_reader(schema_ptr schema,
+            const dht::partition_range_vector& ranges, const std::vector<sstables::shared_sstable>& excluded) const;
+
     mutation_source as_mutation_source() const;
 
+    // Returns points at which given partition can be split into pieces of bounded
+    // size on disk, based on the promoted indexes of sstables containing it.
+    // See mutation_source::get_clustering_split_points().
+    future<std::vector<clustering_key_prefix>> clustering_split_points(schema_ptr s, const dht::decorated_key& dk,
+        const io_priority_class& pc) const;
+
     void set_virtual_reader(mutation_source virtual_reader) {
         _virtual_reader = std::move(virtual_reader);
     }
@@ -635,6 +681,16 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     void apply(const frozen_mutation& m, const schema_ptr& m_schema, db::rp_handle&& = {});
     void apply(const mutation& m, db::rp_handle&& = {});
     void apply_streaming_mutation(schema_ptr, utils::UUID plan_id, const frozen_mutation&, bool fragmented);
+    // Appends an unfragmented streamed mutation to an sstable of the plan.
+    // Mutations of one sender should come in ring order, or the plan ends up
+    // with many small sstables.
+    future<> write_streaming_mutation(schema_ptr, utils::UUID plan_id, const frozen_mutation&);
+    bool writes_streaming_mutations_to_sstables() const {
+        return _config.enable_disk_writes && _config.enable_streaming_to_sstables && _config.streaming_sstable_writers_sem;
+    }
+    // Estimated memory used by an open streaming sstable writer: the bloom
+    // filter for max_streaming_sstable_partitions plus the write buffers.
+    static constexpr size_t streaming_sstable_writer_memory = 1 << 20;
 
     // Returns at most "cmd.limit" rows
     future<lw_shared_ptr<query::result>> query(schema_ptr,
@@ -642,13 +698,21 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         const dht::partition_range_vector& ranges,
         tracing::trace_state_ptr trace_state,
         query::result_memory_limiter& memory_limiter,
-        uint64_t max_result_size);
+        uint64_t max_result_size,
+        query::querier_cache_context cache_ctx = { },
+        query::digest_algorithm da = query::digest_algorithm::MD5);
 
     void start();
     future<> stop();
     future<> flush();
     future<> flush_streaming_mutations(utils::UUID plan_id, dht::partition_range_vector ranges = dht::partition_range_vector{});
     future<> fail_streaming_mutations(utils::UUID plan_id);
+    // Writes the partitions produced by reader, which must belong to this
+    // shard, into a new sstable and adds it to the table, bypassing the
+    // memtables. ranges must cover the written partitions, their cache
+    // entries are invalidated.
+    future<> write_and_add_sstable(flat_mutation_reader reader, uint64_t estimated_partitions,
+            dht::partition_range_vector ranges);
     future<> clear(); // discards memtable(s) without flushing them to disk.
     future<db::replay_position> discard_sstables(db_clock::time_point);
 
@@ -724,6 +788,8 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     size_t sstables_count() const;
     std::vector<uint64_t> sstable_count_per_level() const;
     int64_t get_unleveled_sstables() const;
+    // Bytes the compaction strategy estimates it has to rewrite to be satisfied.
+    uint64_t compaction_backlog();
 
     void start_compaction();
     void trigger_compaction();
@@ -941,11 +1007,14 @@ class keyspace {
         bool enable_incremental_backups = false;
         ::dirty_memory_manager* dirty_memory_manager = &default_dirty_memory_manager;
         ::dirty_memory_manager* streaming_dirty_memory_manager = &default_dirty_memory_manager;
+        bool enable_streaming_to_sstables = false;
+        semaphore* streaming_sstable_writers_sem = nullptr;
         restricted_mutation_reader_config read_concurrency_config;
         restricted_mutation_reader_config streaming_read_concurrency_config;
         ::cf_stats* cf_stats = nullptr;
         seastar::thread_scheduling_group* background_writer_scheduling_group = nullptr;
         seastar::thread_scheduling_group* memtable_scheduling_group = nullptr;
+        seastar::thread_scheduling_group* compaction_scheduling_group = nullptr;
         bool enable_metrics_reporting = false;
     };
 private:
@@ -1026,12 +1095,22 @@ class no_such_column_family : public std::runtime_error {
 class database {
 public:
     using timeout_clock = lowres_clock;
+    // Memory which the results of concurrent user reads may take on a shard.
+    static size_t max_memory_concurrent_reads() { return memory::stats().total_memory() * 0.02; }
 private:
     ::cf_stats _cf_stats;
-    static size_t max_memory_concurrent_reads() { return memory::stats().total_memory() * 0.02; }
     static size_t max_memory_streaming_concurrent_reads() { return memory::stats().total_memory() * 0.02; }
     static size_t max_memory_system_concurrent_reads() { return memory::stats().total_memory() * 0.02; };
-    static constexpr size_t max_concurrent_sstable_loads() { return 3; }
+    // At most 16 streaming sstable writers are open on a shard, fewer if
+    // they would take more than 2% of its memory.
+    static size_t max_memory_streaming_sstable_writers() {
+        return std::min<size_t>(memory::stats().total_memory() * 0.02, 16 * column_family::streaming_sstable_writer_memory);
+    }
+public:
+    // Read concurrency semaphore units kept free for new reads by evicting
+    // cached queriers, which hold on to the units of their readers.
+    static constexpr size_t querier_cache_read_reserve = 1 << 20;
+private:
     struct db_stats {
         uint64_t total_writes = 0;
         uint64_t total_writes_failed = 0;
@@ -1059,19 +1138,26 @@ class database {
 
     seastar::thread_scheduling_group _background_writer_scheduling_group;
     flush_cpu_controller _memtable_cpu_controller;
+    compaction_cpu_controller _compaction_cpu_controller;
 
     semaphore _read_concurrency_sem{max_memory_concurrent_reads()};
     semaphore _streaming_concurrency_sem{max_memory_streaming_concurrent_reads()};
+    semaphore _streaming_sstable_writers_sem{max_memory_streaming_sstable_writers()};
     restricted_mutation_reader_config _read_concurrency_config;
     semaphore _system_read_concurrency_sem{max_memory_system_concurrent_reads()};
     restricted_mutation_reader_config _system_read_concurrency_config;
 
-    semaphore _sstable_load_concurrency_sem{max_concurrent_sstable_loads()};
+    semaphore _sstable_load_concurrency_sem;
+    seastar::gate _sstable_filter_warmup_gate;
 
     std::unordered_map<sstring, keyspace> _keyspaces;
     std::unordered_map<utils::UUID, lw_shared_ptr<column_family>> _column_families;
     std::unordered_map<std::pair<sstring, sstring>, utils::UUID, utils::tuple_hash> _ks_cf_to_uuid;
     std::unique_ptr<db::commitlog> _commitlog;
+    // Logs the system keyspaces, so that their small, latency sensitive
+    // writes don't queue behind user writes, and their segments aren't
+    // held by the flushes of user tables.
+    std::unique_ptr<db::commitlog> _system_commitlog;
     utils::UUID _version;
     // compaction_manager object is referenced by all column families of a database.
     std::unique_ptr<compaction_manager> _compaction_manager;
@@ -1079,6 +1165,7 @@ class database {
     bool _enable_incremental_backups = false;
 
     future<> init_commitlog();
+    void add_commitlog_flush_handler(db::commitlog& log);
     future<> apply_in_memory(const frozen_mutation& m, schema_ptr m_schema, db::rp_handle&&, timeout_clock::time_point timeout);
     future<> apply_in_memory(const mutation& m, column_family& cf, db::rp_handle&&, timeout_clock::time_point timeout);
 private:
@@ -1088,6 +1175,8 @@ class database {
     void create_in_memory_keyspace(const lw_shared_ptr<keyspace_metadata>& ksm);
     friend void db::system_keyspace::make(database& db, bool durable, bool volatile_testing_only);
     void setup_metrics();
+    uint64_t compaction_backlog() const;
+    uint64_t live_sstable_bytes() const;
 
     friend class db_apply_executor;
     future<> do_apply(schema_ptr, const frozen_mutation&, timeout_clock::time_point timeout);
@@ -1095,6 +1184,11 @@ class database {
     future<> apply_with_commitlog(column_family& cf, const mutation& m, timeout_clock::time_point timeout);
 
     query::result_memory_limiter _result_memory_limiter;
+    // Readers of paged queries kept between pages. Evicted before new reads
+    // would have to queue for memory.
+    query::querier_cache _querier_cache{[this] {
+        return _read_concurrency_sem.waiters() > 0 || _read_concurrency_sem.available_units() < ssize_t(querier_cache_read_reserve);
+    }};
 
     future<mutation> do_apply_counter_update(column_family& cf, const frozen_mutation& fm, schema_ptr m_schema, timeout_clock::time_point timeout,
                                              tracing::trace_state_ptr trace_state);
@@ -1108,6 +1202,10 @@ class database {
         return _result_memory_limiter;
     }
 
+    query::querier_cache& get_querier_cache() {
+        return _querier_cache;
+    }
+
     void set_enable_incremental_backups(bool val) { _enable_incremental_backups = val; }
 
     future<> parse_system_tables(distributed<service::storage_proxy>&);
@@ -1124,6 +1222,19 @@ class database {
         return _commitlog.get();
     }
 
+    // The commitlog of the system keyspaces; null before init_commitlog().
+    db::commitlog* system_commitlog() const {
+        return _system_commitlog.get();
+    }
+
+    static sstring system_commitlog_directory(const db::config& cfg);
+
+    // The commitlog which writes to tables of keyspace ks_name go to.
+    db::commitlog* commitlog_for(const sstring& ks_name) const;
+
+    // Shuts down both commitlogs, writing out what they buffer.
+    future<> shutdown_commitlogs();
+
     compaction_manager& get_compaction_manager() {
         return *_compaction_manager;
     }
@@ -1171,7 +1282,8 @@ class database {
     unsigned shard_of(const mutation& m);
     unsigned shard_of(const frozen_mutation& m);
     future<lw_shared_ptr<query::result>, cache_temperature> query(schema_ptr, const query::read_command& cmd, query::result_request request, const dht::partition_range_vector& ranges,
-                                               tracing::trace_state_ptr trace_state, uint64_t max_result_size);
+                                               tracing::trace_state_ptr trace_state, uint64_t max_result_size,
+                                               query::digest_algorithm da = query::digest_algorithm::MD5);
     future<reconcilable_result, cache_temperature> query_mutations(schema_ptr, const query::read_command& cmd, const dht::partition_range& range,
                                                 query::result_memory_accounter&& accounter, tracing::trace_state_ptr trace_state);
     // Apply the mutation atomically.
@@ -1235,9 +1347,15 @@ class database {
     semaphore& system_keyspace_read_concurrency_sem() {
         return _system_read_concurrency_sem;
     }
+    semaphore& read_concurrency_sem() {
+        return _read_concurrency_sem;
+    }
     semaphore& sstable_load_concurrency_sem() {
         return _sstable_load_concurrency_sem;
     }
+    // Loads, in the background, the filters of this shard's sstables which
+    // were opened with lazy filter loading.
+    void start_sstable_filter_warmup();
     void register_connection_drop_notifier(netw::messaging_service& ms);
 
     db_stats& get_stats() {
@@ -45,6 +45,11 @@
 #include <seastar/core/metrics.hh>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/adaptor/sliced.hpp>
+#include <boost/range/irange.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <boost/range/algorithm/find_if.hpp>
+#include <boost/range/algorithm/max_element.hpp>
 
 #include "batchlog_manager.hh"
 #include "canonical_mutation.hh"
@@ -69,11 +74,14 @@
 #include "idl/frozen_schema.dist.impl.hh"
 #include "message/messaging_service.hh"
 #include "cql3/untyped_result_set.hh"
+#include "query-result-set.hh"
+#include "partition_slice_builder.hh"
 
 static logging::logger blogger("batchlog_manager");
 
 const uint32_t db::batchlog_manager::replay_interval;
 const uint32_t db::batchlog_manager::page_size;
+const uint32_t db::batchlog_manager::bucket_duration;
 
 db::batchlog_manager::batchlog_manager(cql3::query_processor& qp)
         : _qp(qp)
@@ -84,10 +92,22 @@ db::batchlog_manager::batchlog_manager(cql3::query_processor& qp)
         sm::make_derive("total_write_replay_attempts", _stats.write_attempts,
                         sm::description("Counts write operations issued in a batchlog replay flow. "
                                         "The high value of this metric indicates that we have a long batch replay list.")),
+
+        sm::make_derive("total_dropped_buckets", _stats.buckets_dropped,
+                        sm::description("Counts the time buckets of the batchlog which were deleted as a whole after their batches were replayed.")),
+
+        sm::make_gauge("replay_lag", [this] {
+                            if (!_oldest_unreplayed) {
+                                return int64_t(0);
+                            }
+                            return int64_t(std::chrono::duration_cast<std::chrono::seconds>(db_clock::now() - *_oldest_unreplayed).count());
+                        },
+                        sm::description("Holds the age, in seconds, of the oldest batch which this shard failed to replay, or 0 if there is none. "
+                                        "A growing value indicates that batches are stuck in the batchlog.")),
     });
 }
 
-future<> db::batchlog_manager::do_batch_log_replay() {
+future<> db::batchlog_manager::do_legacy_batch_log_replay() {
     // Use with_semaphore is much simpler, but nested invoke_on can
     // cause deadlock.
     return get_batchlog_manager().invoke_on(0, [] (auto& bm) {
@@ -108,24 +128,36 @@ future<> db::batchlog_manager::do_batch_log_replay() {
     });
 }
 
-future<> db::batchlog_manager::start() {
-    // Since replay is a "node global" operation, we should not attempt to do
-    // it in parallel on each shard. It will just overlap/interfere.  To
-    // simplify syncing between the timer and user initiated replay operations,
-    // we use the _timer and _sem on shard zero only. Replaying batchlog can
-    // generate a lot of work, so we distrute the real work on all cpus with
-    // round-robin scheduling.
-    if (engine().cpu_id() == 0) {
-        _timer.set_callback([this] {
-            return do_batch_log_replay().handle_exception([] (auto ep) {
-                blogger.error("Exception in batch replay: {}", ep);
-            }).finally([this] {
-                _timer.arm(lowres_clock::now() + std::chrono::milliseconds(replay_interval));
-            });
+future<> db::batchlog_manager::do_batch_log_replay() {
+    return do_legacy_batch_log_replay().then([] {
+        return get_batchlog_manager().invoke_on_all([] (auto& bm) {
+            return bm.replay_local_batches();
         });
-        auto ring_delay = service::get_local_storage_service().get_ring_delay();
-        _timer.arm(lowres_clock::now() + ring_delay);
-    }
+    });
+}
+
+void db::batchlog_manager::on_timer() {
+    // Each shard replays the part of system.batchlog_v2 it holds, on its own
+    // schedule. The legacy batchlog, which is only written to until all
+    // nodes support the new one, is a "node global" table, whose replays
+    // would overlap if several shards started them; it is replayed from
+    // shard 0, which distributes the work among the shards round-robin.
+    auto legacy = engine().cpu_id() == 0 ? do_legacy_batch_log_replay() : make_ready_future<>();
+    legacy.then([this] {
+        return replay_local_batches();
+    }).handle_exception([] (auto ep) {
+        blogger.error("Exception in batch replay: {}", ep);
+    }).finally([this] {
+        if (!_stop) {
+            _timer.arm(lowres_clock::now() + std::chrono::milliseconds(replay_interval));
+        }
+    });
+}
+
+future<> db::batchlog_manager::start() {
+    _timer.set_callback(std::bind(&batchlog_manager::on_timer, this));
+    auto ring_delay = service::get_local_storage_service().get_ring_delay();
+    _timer.arm(lowres_clock::now() + ring_delay);
     return make_ready_future<>();
 }
 
@@ -139,9 +171,16 @@ future<> db::batchlog_manager::stop() {
 }
 
 future<size_t> db::batchlog_manager::count_all_batches() const {
-    sstring query = sprint("SELECT count(*) FROM %s.%s", system_keyspace::NAME, system_keyspace::BATCHLOG);
-    return _qp.execute_internal(query).then([](::shared_ptr<cql3::untyped_result_set> rs) {
-       return size_t(rs->one().get_as<int64_t>("count"));
+    auto count = [this] (const char* table) {
+        sstring query = sprint("SELECT count(*) FROM %s.%s", system_keyspace::NAME, table);
+        return _qp.execute_internal(query).then([](::shared_ptr<cql3::untyped_result_set> rs) {
+           return size_t(rs->one().get_as<int64_t>("count"));
+        });
+    };
+    return count(system_keyspace::BATCHLOG).then([count] (size_t legacy) {
+        return count(system_keyspace::BATCHLOG_V2).then([legacy] (size_t n) {
+            return legacy + n;
+        });
     });
 }
 
@@ -150,8 +189,6 @@ mutation db::batchlog_manager::get_batch_log_mutation_for(const std::vector<muta
 }
 
 mutation db::batchlog_manager::get_batch_log_mutation_for(const std::vector<mutation>& mutations, const utils::UUID& id, int32_t version, db_clock::time_point now) {
-    auto schema = _qp.db().local().find_schema(system_keyspace::NAME, system_keyspace::BATCHLOG);
-    auto key = partition_key::from_singular(*schema, id);
     auto timestamp = api::new_timestamp();
     auto data = [this, &mutations] {
         std::vector<canonical_mutation> fm(mutations.begin(), mutations.end());
@@ -162,124 +199,163 @@ mutation db::batchlog_manager::get_batch_log_mutation_for(const std::vector<muta
         return to_bytes(out.linearize());
     }();
 
-    mutation m(key, schema);
-    m.set_cell(clustering_key_prefix::make_empty(), to_bytes("version"), version, timestamp);
-    m.set_cell(clustering_key_prefix::make_empty(), to_bytes("written_at"), now, timestamp);
-    m.set_cell(clustering_key_prefix::make_empty(), to_bytes("data"), data_value(std::move(data)), timestamp);
+    if (!service::get_local_storage_service().cluster_supports_sharded_batchlog()) {
+        auto schema = _qp.db().local().find_schema(system_keyspace::NAME, system_keyspace::BATCHLOG);
+        auto key = partition_key::from_singular(*schema, id);
+        mutation m(key, schema);
+        m.set_cell(clustering_key_prefix::make_empty(), to_bytes("version"), version, timestamp);
+        m.set_cell(clustering_key_prefix::make_empty(), to_bytes("written_at"), now, timestamp);
+        m.set_cell(clustering_key_prefix::make_empty(), to_bytes("data"), data_value(std::move(data)), timestamp);
+        return m;
+    }
 
+    auto schema = _qp.db().local().find_schema(system_keyspace::NAME, system_keyspace::BATCHLOG_V2);
+    auto bucket = now - now.time_since_epoch() % std::chrono::milliseconds(bucket_duration);
+    auto key = partition_key::from_exploded(*schema, {
+            int32_type->decompose(int32_t(engine().cpu_id())),
+            timestamp_type->decompose(bucket),
+    });
+    auto ckey = clustering_key::from_exploded(*schema, {
+            timestamp_type->decompose(now),
+            uuid_type->decompose(id),
+    });
+    mutation m(key, schema);
+    m.set_clustered_cell(ckey, to_bytes("version"), version, timestamp);
+    m.set_clustered_cell(ckey, to_bytes("data"), data_value(std::move(data)), timestamp);
     return m;
 }
 
+mutation db::batchlog_manager::get_batch_log_remove_mutation_for(const mutation& m) {
+    // Deletes the batch with the timestamp it was written with, which can't
+    // shadow batches written to the same bucket after it.
+    auto schema = m.schema();
+    auto& data_col = *schema->get_column_definition("data");
+    mutation rm(m.key(), schema);
+    for (auto& row : m.partition().clustered_rows()) {
+        auto timestamp = row.row().cells().cell_at(data_col.id).as_atomic_cell().timestamp();
+        rm.partition().apply_delete(*schema, row.key(), tombstone(timestamp, gc_clock::now()));
+    }
+    return rm;
+}
+
 db_clock::duration db::batchlog_manager::get_batch_log_timeout() const {
     // enough time for the actual write + BM removal mutation
     return db_clock::duration(_qp.db().local().get_config().write_request_timeout_in_ms()) * 2;
 }
 
-future<> db::batchlog_manager::replay_all_failed_batches() {
+future<bool> db::batchlog_manager::replay_batch(utils::UUID id, db_clock::time_point written_at, stdx::optional<int32_t> version, bytes data,
+        lw_shared_ptr<utils::rate_limiter> limiter) {
     typedef db_clock::rep clock_type;
 
-    // rate limit is in bytes per second. Uses Double.MAX_VALUE if disabled (set to 0 in cassandra.yaml).
-    // max rate is scaled by the number of nodes in the cluster (same as for HHOM - see CASSANDRA-5272).
-    auto throttle_in_kb = _qp.db().local().get_config().batchlog_replay_throttle_in_kb() / service::get_storage_service().local().get_token_metadata().get_all_endpoints().size();
-    auto limiter = make_lw_shared<utils::rate_limiter>(throttle_in_kb * 1000);
-
-    auto batch = [this, limiter](const cql3::untyped_result_set::row& row) {
-        auto written_at = row.get_as<db_clock::time_point>("written_at");
-        auto id = row.get_as<utils::UUID>("id");
-        // enough time for the actual write + batchlog entry mutation delivery (two separate requests).
-        auto timeout = get_batch_log_timeout();
-        if (db_clock::now() < written_at + timeout) {
-            blogger.debug("Skipping replay of {}, too fresh", id);
-            return make_ready_future<>();
-        }
-
-        // check version of serialization format
-        if (!row.has("version")) {
-            blogger.warn("Skipping logged batch because of unknown version");
-            return make_ready_future<>();
-        }
+    // enough time for the actual write + batchlog entry mutation delivery (two separate requests).
+    auto timeout = get_batch_log_timeout();
+    if (db_clock::now() < written_at + timeout) {
+        blogger.debug("Skipping replay of {}, too fresh", id);
+        return make_ready_future<bool>(false);
+    }
 
-        auto version = row.get_as<int32_t>("version");
-        if (version != netw::messaging_service::current_version) {
-            blogger.warn("Skipping logged batch because of incorrect version");
-            return make_ready_future<>();
-        }
+    // check version of serialization format
+    if (!version) {
+        blogger.warn("Skipping logged batch because of unknown version");
+        return make_ready_future<bool>(false);
+    }
 
-        auto data = row.get_blob("data");
+    if (*version != netw::messaging_service::current_version) {
+        blogger.warn("Skipping logged batch because of incorrect version");
+        return make_ready_future<bool>(false);
+    }
 
-        blogger.debug("Replaying batch {}", id);
+    blogger.debug("Replaying batch {}", id);
 
-        auto fms = make_lw_shared<std::deque<canonical_mutation>>();
-        auto in = ser::as_input_stream(data);
-        while (in.size()) {
-            fms->emplace_back(ser::deserialize(in, boost::type<canonical_mutation>()));
-        }
+    auto fms = make_lw_shared<std::deque<canonical_mutation>>();
+    auto in = ser::as_input_stream(data);
+    while (in.size()) {
+        fms->emplace_back(ser::deserialize(in, boost::type<canonical_mutation>()));
+    }
 
-        auto size = data.size();
+    auto size = data.size();
 
-        return map_reduce(*fms, [this, written_at] (canonical_mutation& fm) {
-            return system_keyspace::get_truncated_at(fm.column_family_id()).then([written_at, &fm] (db_clock::time_point t) ->
-                    std::experimental::optional<std::reference_wrapper<canonical_mutation>> {
-                if (written_at > t) {
-                    return { std::ref(fm) };
-                } else {
-                    return {};
-                }
-            });
-        },
-        std::vector<mutation>(),
-        [this] (std::vector<mutation> mutations, std::experimental::optional<std::reference_wrapper<canonical_mutation>> fm) {
-            if (fm) {
-                schema_ptr s = _qp.db().local().find_schema(fm.value().get().column_family_id());
-                mutations.emplace_back(fm.value().get().to_mutation(s));
-            }
-            return mutations;
-        }).then([this, id, limiter, written_at, size, fms] (std::vector<mutation> mutations) {
-            if (mutations.empty()) {
-                return make_ready_future<>();
+    return map_reduce(*fms, [this, written_at] (canonical_mutation& fm) {
+        return system_keyspace::get_truncated_at(fm.column_family_id()).then([written_at, &fm] (db_clock::time_point t) ->
+                std::experimental::optional<std::reference_wrapper<canonical_mutation>> {
+            if (written_at > t) {
+                return { std::ref(fm) };
+            } else {
+                return {};
             }
-            const auto ttl = [this, &mutations, written_at]() -> clock_type {
-                /*
-                 * Calculate ttl for the mutations' hints (and reduce ttl by the time the mutations spent in the batchlog).
-                 * This ensures that deletes aren't "undone" by an old batch replay.
-                 */
-                auto unadjusted_ttl = std::numeric_limits<gc_clock::rep>::max();
-                warn(unimplemented::cause::HINT);
+        });
+    },
+    std::vector<mutation>(),
+    [this] (std::vector<mutation> mutations, std::experimental::optional<std::reference_wrapper<canonical_mutation>> fm) {
+        if (fm) {
+            schema_ptr s = _qp.db().local().find_schema(fm.value().get().column_family_id());
+            mutations.emplace_back(fm.value().get().to_mutation(s));
+        }
+        return mutations;
+    }).then([this, id, limiter, written_at, size, fms] (std::vector<mutation> mutations) {
+        if (mutations.empty()) {
+            return make_ready_future<>();
+        }
+        const auto ttl = [this, &mutations, written_at]() -> clock_type {
+            /*
+             * Calculate ttl for the mutations' hints (and reduce ttl by the time the mutations spent in the batchlog).
+             * This ensures that deletes aren't "undone" by an old batch replay.
+             */
+            auto unadjusted_ttl = std::numeric_limits<gc_clock::rep>::max();
+            warn(unimplemented::cause::HINT);
 #if 0
-                for (auto& m : *mutations) {
-                    unadjustedTTL = Math.min(unadjustedTTL, HintedHandOffManager.calculateHintTTL(mutation));
-                }
+            for (auto& m : *mutations) {
+                unadjustedTTL = Math.min(unadjustedTTL, HintedHandOffManager.calculateHintTTL(mutation));
+            }
 #endif
-                return unadjusted_ttl - std::chrono::duration_cast<gc_clock::duration>(db_clock::now() - written_at).count();
-            }();
+            return unadjusted_ttl - std::chrono::duration_cast<gc_clock::duration>(db_clock::now() - written_at).count();
+        }();
 
-            if (ttl <= 0) {
-                return make_ready_future<>();
-            }
-            // Origin does the send manually, however I can't see a super great reason to do so.
-            // Our normal write path does not add much redundancy to the dispatch, and rate is handled after send
-            // in both cases.
-            // FIXME: verify that the above is reasonably true.
-            return limiter->reserve(size).then([this, mutations = std::move(mutations), id] {
-                _stats.write_attempts += mutations.size();
-                // #1222 - change cl level to ALL, emulating origins behaviour of sending/hinting
-                // to all natural end points.
-                // Note however that origin uses hints here, and actually allows for this
-                // send to partially or wholly fail in actually sending stuff. Since we don't
-                // have hints (yet), send with CL=ALL, and hope we can re-do this soon.
-                // See below, we use retry on write failure.
-                return _qp.proxy().local().mutate(mutations, db::consistency_level::ALL, nullptr);
-            });
-        }).then_wrapped([this, id](future<> batch_result) {
-            try {
-                batch_result.get();
-            } catch (no_such_keyspace& ex) {
-                // should probably ignore and drop the batch
-            } catch (...) {
-                // timeout, overload etc.
-                // Do _not_ remove the batch, assuning we got a node write error.
-                // Since we don't have hints (which origin is satisfied with),
-                // we have to resort to keeping this batch to next lap.
+        if (ttl <= 0) {
+            return make_ready_future<>();
+        }
+        // Origin does the send manually, however I can't see a super great reason to do so.
+        // Our normal write path does not add much redundancy to the dispatch, and rate is handled after send
+        // in both cases.
+        // FIXME: verify that the above is reasonably true.
+        return limiter->reserve(size).then([this, mutations = std::move(mutations), id] {
+            _stats.write_attempts += mutations.size();
+            // #1222 - change cl level to ALL, emulating origins behaviour of sending/hinting
+            // to all natural end points.
+            // Note however that origin uses hints here, and actually allows for this
+            // send to partially or wholly fail in actually sending stuff. Since we don't
+            // have hints (yet), send with CL=ALL, and hope we can re-do this soon.
+            // See below, we use retry on write failure.
+            return _qp.proxy().local().mutate(mutations, db::consistency_level::ALL, nullptr);
+        });
+    }).then_wrapped([this, id](future<> batch_result) {
+        try {
+            batch_result.get();
+        } catch (no_such_keyspace& ex) {
+            // should probably ignore and drop the batch
+        } catch (...) {
+            // timeout, overload etc.
+            // Do _not_ remove the batch, assuning we got a node write error.
+            // Since we don't have hints (which origin is satisfied with),
+            // we have to resort to keeping this batch to next lap.
+            return false;
+        }
+        return true;
+    });
+}
+
+future<> db::batchlog_manager::replay_all_failed_batches() {
+    // rate limit is in bytes per second. Uses Double.MAX_VALUE if disabled (set to 0 in cassandra.yaml).
+    // max rate is scaled by the number of nodes in the cluster (same as for HHOM - see CASSANDRA-5272).
+    auto throttle_in_kb = _qp.db().local().get_config().batchlog_replay_throttle_in_kb() / service::get_storage_service().local().get_token_metadata().get_all_endpoints().size();
+    auto limiter = make_lw_shared<utils::rate_limiter>(throttle_in_kb * 1000);
+
+    auto batch = [this, limiter](const cql3::untyped_result_set::row& row) {
+        auto written_at = row.get_as<db_clock::time_point>("written_at");
+        auto id = row.get_as<utils::UUID>("id");
+        auto version = row.get_opt<int32_t>("version");
+        return replay_batch(id, written_at, version, row.get_blob("data"), limiter).then([this, id] (bool replayed) {
+            if (!replayed) {
                 return make_ready_future<>();
             }
             // delete batch
@@ -338,6 +414,199 @@ future<> db::batchlog_manager::replay_all_failed_batches() {
     });
 }
 
+
+future<> db::batchlog_manager::replay_local_batches() {
+    return with_semaphore(_local_sem, 1, [this] {
+      return seastar::with_gate(_gate, [this] {
+        blogger.debug("Started replay of the batches of shard {}", engine().cpu_id());
+
+        auto schema = _qp.db().local().find_schema(system_keyspace::NAME, system_keyspace::BATCHLOG_V2);
+        // As in replay_all_failed_batches(), but all shards replay at once.
+        auto endpoints = service::get_local_storage_service().get_token_metadata().get_all_endpoints().size();
+        auto throttle_in_kb = std::max<size_t>(_qp.db().local().get_config().batchlog_replay_throttle_in_kb() / endpoints / smp::count, 1);
+        auto limiter = make_lw_shared<utils::rate_limiter>(throttle_in_kb * 1000);
+        // Batches written before the horizon are due for replay.
+        auto horizon = db_clock::now() - get_batch_log_timeout();
+
+        struct replay_state {
+            // The buckets left to read, past the one being resumed.
+            dht::partition_range range = query::full_partition_range;
+            // The bucket cut by the last short read, and the last batch read
+            // from it.
+            stdx::optional<std::pair<dht::decorated_key, clustering_key>> resume;
+            // Whether batches were kept in the part of the bucket read so far.
+            bool resume_kept = false;
+            stdx::optional<db_clock::time_point> oldest_unreplayed;
+        };
+        struct batch_row {
+            const rows_entry* e;
+            api::timestamp_type timestamp;
+            bool live;
+            bool deletable;
+        };
+
+        // Replays the due batches of bucket m, read past start_after or from
+        // its start. Drops the whole bucket once it has ended before the
+        // horizon and none of its batches is kept. Otherwise deletes the
+        // batches which need not be kept: only what was read is deleted, with
+        // timestamps no higher than those of the rows, so that batches which
+        // coordinators with clocks behind ours write survive. Resolves to
+        // whether batches were kept.
+        auto replay_bucket = [this, schema, limiter, horizon] (replay_state& st, mutation& m, stdx::optional<clustering_key> start_after, bool cut, bool kept_before) {
+            auto& data_col = *schema->get_column_definition("data");
+            auto& version_col = *schema->get_column_definition("version");
+            auto rows = make_lw_shared<std::vector<batch_row>>();
+            for (auto& e : m.partition().clustered_rows()) {
+                auto cell = e.row().cells().find_cell(data_col.id);
+                if (cell && cell->as_atomic_cell().is_live()) {
+                    rows->push_back(batch_row{&e, cell->as_atomic_cell().timestamp(), true, false});
+                } else {
+                    // Deleted by a coordinator whose clock is ahead of ours, so not purged yet.
+                    rows->push_back(batch_row{&e, e.row().deleted_at().tomb().timestamp, false, true});
+                }
+            }
+            return parallel_for_each(*rows, [this, schema, &st, &data_col, &version_col, horizon, limiter] (batch_row& r) {
+                if (!r.live) {
+                    return make_ready_future<>();
+                }
+                auto ckey = r.e->key().explode(*schema);
+                auto written_at = value_cast<db_clock::time_point>(timestamp_type->deserialize(ckey[0]));
+                if (written_at >= horizon) {
+                    return make_ready_future<>();
+                }
+                auto id = value_cast<utils::UUID>(uuid_type->deserialize(ckey[1]));
+                auto& cells = r.e->row().cells();
+                auto data = to_bytes(cells.find_cell(data_col.id)->as_atomic_cell().value());
+                stdx::optional<int32_t> version;
+                if (auto cell = cells.find_cell(version_col.id)) {
+                    version = value_cast<int32_t>(int32_type->deserialize(cell->as_atomic_cell().value()));
+                }
+                return replay_batch(id, written_at, version, std::move(data), limiter).then([&st, &r, written_at] (bool replayed) {
+                    r.deletable = replayed;
+                    if (!replayed) {
+                        st.oldest_unreplayed = std::min(st.oldest_unreplayed.value_or(written_at), written_at);
+                    }
+                });
+            }).then([this, schema, rows, &m, start_after = std::move(start_after), cut, kept_before, horizon] () mutable {
+                mutation rm(m.key(), schema);
+                auto deletion_time = gc_clock::now();
+                auto kept = kept_before || boost::algorithm::any_of(*rows, [] (const batch_row& r) { return !r.deletable; });
+                auto pkey = m.key().explode(*schema);
+                auto bucket_end = value_cast<db_clock::time_point>(timestamp_type->deserialize(pkey[1])) + std::chrono::milliseconds(bucket_duration);
+                if (!cut && !kept && bucket_end <= horizon && !rows->empty()) {
+                    // All of the bucket was read, it can't get new batches which are still
+                    // acted upon, and they all replayed: it goes with a single partition
+                    // tombstone. Its timestamp is the greatest one read, so that it can't
+                    // shadow batches from coordinators whose clocks are ahead of ours.
+                    // A batch which reaches the bucket this late was written after its
+                    // coordinator timed out, so it was never applied.
+                    auto ts = api::min_timestamp;
+                    for (auto& r : *rows) {
+                        ts = std::max(ts, r.timestamp);
+                    }
+                    rm.partition().apply(tombstone(ts, deletion_time));
+                    return do_with(std::move(rm), [this] (mutation& rm) {
+                        return _qp.proxy().local().mutate_locally(rm);
+                    }).then([this] {
+                        _stats.buckets_dropped++;
+                        return false;
+                    });
+                }
+                // The batches up to the first one kept go with a single range
+                // tombstone, as do those deleted already.
+                auto first_kept = boost::find_if(*rows, [] (const batch_row& r) { return !r.deletable; });
+                if (first_kept != rows->begin()) {
+                    auto ts = boost::max_element(boost::make_iterator_range(rows->begin(), first_kept), [] (const batch_row& a, const batch_row& b) {
+                        return a.timestamp < b.timestamp;
+                    })->timestamp;
+                    auto start = start_after ? *start_after : clustering_key_prefix::make_empty();
+                    auto start_kind = start_after ? bound_kind::excl_start : bound_kind::incl_start;
+                    rm.partition().apply_delete(*schema, range_tombstone(std::move(start), start_kind,
+                            std::prev(first_kept)->e->key(), bound_kind::incl_end, tombstone(ts, deletion_time)));
+                }
+                for (auto it = first_kept; it != rows->end(); ++it) {
+                    if (it->live && it->deletable) {
+                        rm.partition().apply_delete(*schema, it->e->key(), tombstone(it->timestamp, deletion_time));
+                    }
+                }
+                if (rm.partition().empty()) {
+                    return make_ready_future<bool>(kept);
+                }
+                return do_with(std::move(rm), [this] (mutation& rm) {
+                    return _qp.proxy().local().mutate_locally(rm);
+                }).then([kept] {
+                    return kept;
+                });
+            });
+        };
+
+        return do_with(replay_state(), std::move(replay_bucket), [this, schema] (replay_state& st, auto& replay_bucket) {
+            return repeat([this, schema, &st, &replay_bucket] {
+                auto slice = partition_slice_builder(*schema);
+                auto range = make_lw_shared<dht::partition_range>(st.range);
+                stdx::optional<clustering_key> start_after;
+                auto kept_before = st.resume_kept;
+                if (st.resume) {
+                    *range = dht::partition_range::make_singular(st.resume->first);
+                    start_after = st.resume->second;
+                    slice.with_range(query::clustering_range::make_starting_with(query::clustering_range::bound(st.resume->second, false)));
+                    st.resume = stdx::nullopt;
+                    st.resume_kept = false;
+                }
+                // Reads only the data of this shard. The table has no grace
+                // period, so deleted batches and dropped buckets are purged
+                // from the result, and later passes skip them.
+                auto cmd = make_lw_shared<query::read_command>(schema->id(), schema->version(), slice.build(),
+                        query::max_rows, gc_clock::now(), stdx::nullopt, page_size);
+                cmd->slice.options.set<query::partition_slice::option::allow_short_read>();
+                auto& db = _qp.db().local();
+                return db.get_result_memory_limiter().new_mutation_read(query::result_memory_limiter::maximum_result_size).then([&db, schema, cmd, range] (query::result_memory_accounter accounter) {
+                    return db.query_mutations(schema, *cmd, *range, std::move(accounter), nullptr);
+                }).then([this, schema, cmd, range, &st, &replay_bucket, start_after = std::move(start_after), kept_before] (reconcilable_result res, cache_temperature) {
+                    auto short_read = bool(res.is_short_read());
+                    auto resumed = bool(start_after);
+                    auto buckets = make_lw_shared<std::vector<mutation>>();
+                    for (auto& p : res.partitions()) {
+                        buckets->push_back(p.mut().unfreeze(schema));
+                    }
+                    if (buckets->empty()) {
+                        return make_ready_future<stop_iteration>(stop_iteration(!resumed));
+                    }
+                    auto last_kept = make_lw_shared<bool>(false);
+                    return parallel_for_each(boost::irange<size_t>(0, buckets->size()), [&st, &replay_bucket, start_after, buckets, short_read, kept_before, last_kept] (size_t i) {
+                        // Only the first bucket may be resumed, and a short
+                        // read cuts the last one.
+                        auto first = i == 0;
+                        auto last = i + 1 == buckets->size();
+                        return replay_bucket(st, (*buckets)[i], first ? start_after : stdx::nullopt, short_read && last, first && kept_before).then([last, last_kept] (bool kept) {
+                            if (last) {
+                                *last_kept = kept;
+                            }
+                        });
+                    }).then([&st, buckets, short_read, resumed, last_kept] {
+                        auto& last = buckets->back();
+                        st.range = dht::partition_range::make_starting_with(dht::partition_range::bound(dht::ring_position(last.decorated_key()), false));
+                        auto& rows = last.partition().clustered_rows();
+                        if (short_read && !rows.empty()) {
+                            // Resumes inside the bucket, past the last batch read.
+                            st.resume = std::make_pair(last.decorated_key(), std::prev(rows.end())->key());
+                            st.resume_kept = *last_kept;
+                        }
+                        if (short_read || resumed) {
+                            return stop_iteration::no;
+                        }
+                        return stop_iteration(buckets->size() < page_size);
+                    });
+                });
+            }).then([this, &st] {
+                _oldest_unreplayed = st.oldest_unreplayed;
+                blogger.debug("Finished replay of the batches of shard {}", engine().cpu_id());
+            });
+        });
+      });
+    });
+}
+
 std::unordered_set<gms::inet_address> db::batchlog_manager::endpoint_filter(const sstring& local_rack, const std::unordered_map<sstring, std::unordered_set<gms::inet_address>>& endpoints) {
     // special case for single-node data centers
     if (endpoints.size() == 1 && endpoints.begin()->second.size() == 1) {
@@ -51,6 +51,11 @@
 #include "cql3/query_processor.hh"
 #include "gms/inet_address.hh"
 #include "db_clock.hh"
+#include "stdx.hh"
+
+namespace utils {
+class rate_limiter;
+}
 
 namespace db {
 
@@ -58,11 +63,14 @@ class batchlog_manager {
 private:
     static constexpr uint32_t replay_interval = 60 * 1000; // milliseconds
     static constexpr uint32_t page_size = 128; // same as HHOM, for now, w/out using any heuristics. TODO: set based on avg batch size.
+    // Width of the time buckets of system.batchlog_v2.
+    static constexpr uint32_t bucket_duration = 60 * 1000; // milliseconds
 
     using clock_type = lowres_clock;
 
     struct stats {
         uint64_t write_attempts = 0;
+        uint64_t buckets_dropped = 0;
     } _stats;
 
     seastar::metrics::metric_groups _metrics;
@@ -71,14 +79,25 @@ class batchlog_manager {
     cql3::query_processor& _qp;
     timer<clock_type> _timer;
     semaphore _sem{1};
+    // Serializes the replays of this shard's part of system.batchlog_v2.
+    semaphore _local_sem{1};
     seastar::gate _gate;
+    // The oldest batch due for replay which the last replay of this shard
+    // left behind, if any.
+    stdx::optional<db_clock::time_point> _oldest_unreplayed;
     unsigned _cpu = 0;
     bool _stop = false;
 
     std::random_device _rd;
     std::default_random_engine _e1;
 
+    future<> do_legacy_batch_log_replay();
     future<> replay_all_failed_batches();
+    future<> replay_local_batches();
+    // Replays one batch. Resolves to true if the batch need not be kept.
+    future<bool> replay_batch(utils::UUID id, db_clock::time_point written_at, stdx::optional<int32_t> version, bytes data,
+            lw_shared_ptr<utils::rate_limiter> limiter);
+    void on_timer();
 public:
     // Takes a QP, not a distributes. Because this object is supposed
     // to be per shard and does no dispatching beyond delegating the the
@@ -94,8 +113,16 @@ class batchlog_manager {
     size_t get_total_batches_replayed() const {
         return _total_batches_replayed;
     }
+    uint64_t get_dropped_buckets() const {
+        return _stats.buckets_dropped;
+    }
+    // Batches go to system.batchlog_v2 once all nodes support it, and to
+    // the legacy system.batchlog until then.
     mutation get_batch_log_mutation_for(const std::vector<mutation>&, const utils::UUID&, int32_t);
     mutation get_batch_log_mutation_for(const std::vector<mutation>&, const utils::UUID&, int32_t, db_clock::time_point);
+    // Removes the batch written by get_batch_log_mutation_for() as the
+    // mutation m.
+    mutation get_batch_log_remove_mutation_for(const mutation& m);
     db_clock::duration get_batch_log_timeout() const;
 
     std::unordered_set<gms::inet_address> endpoint_filter(const sstring&, const std::unordered_map<sstring, std::unordered_set<gms::inet_address>>&);
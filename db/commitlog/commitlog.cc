@@ -60,6 +60,7 @@
 #include <seastar/core/chunked_fifo.hh>
 #include <seastar/core/queue.hh>
 #include <seastar/core/sleep.hh>
+#include <seastar/core/shared_future.hh>
 #include <net/byteorder.hh>
 
 #include "seastarx.hh"
@@ -71,9 +72,11 @@
 #include "utils/crc.hh"
 #include "utils/runtime.hh"
 #include "utils/flush_queue.hh"
+#include "utils/estimated_histogram.hh"
 #include "log.hh"
 #include "commitlog_entry.hh"
 #include "service/priority_manager.hh"
+#include "sstables/compress.hh"
 
 #include <boost/range/numeric.hpp>
 #include <boost/range/adaptor/transformed.hpp>
@@ -106,6 +109,59 @@ class crc32_nbo {
     }
 };
 
+static compressor parse_commitlog_compression(const sstring& name) {
+    if (name.empty()) {
+        return compressor::none;
+    }
+    if (name == "LZ4Compressor" || name == "org.apache.cassandra.io.compress.LZ4Compressor") {
+        return compressor::lz4;
+    }
+    if (name == "ZstdCompressor" || name == "org.apache.cassandra.io.compress.ZstdCompressor") {
+        return compressor::zstd;
+    }
+    throw std::invalid_argument(sprint("Unsupported commitlog compression: %s", name));
+}
+
+// Commitlog chunks are compressed for bandwidth, and zstd is run at its
+// fastest level accordingly. The level is not needed for decompression.
+static const sstables::zstd_compression& commitlog_zstd() {
+    static thread_local sstables::zstd_compression zstd(1, bytes());
+    return zstd;
+}
+
+static size_t commitlog_compress_max_size(compressor c, size_t input_len) {
+    switch (c) {
+    case compressor::lz4:
+        return compress_max_size_lz4(input_len);
+    case compressor::zstd:
+        return commitlog_zstd().compress_max_size(input_len);
+    default:
+        throw std::invalid_argument(sprint("Unsupported commitlog compression %d", int(c)));
+    }
+}
+
+static size_t commitlog_compress(compressor c, const char* input, size_t input_len, char* output, size_t output_len) {
+    switch (c) {
+    case compressor::lz4:
+        return compress_lz4(input, input_len, output, output_len);
+    case compressor::zstd:
+        return commitlog_zstd().compress(input, input_len, output, output_len);
+    default:
+        throw std::invalid_argument(sprint("Unsupported commitlog compression %d", int(c)));
+    }
+}
+
+static size_t commitlog_uncompress(compressor c, const char* input, size_t input_len, char* output, size_t output_len) {
+    switch (c) {
+    case compressor::lz4:
+        return uncompress_lz4(input, input_len, output, output_len);
+    case compressor::zstd:
+        return commitlog_zstd().uncompress(input, input_len, output, output_len);
+    default:
+        throw std::invalid_argument(sprint("Unsupported commitlog compression %d", int(c)));
+    }
+}
+
 class db::cf_holder {
 public:
     virtual ~cf_holder() {};
@@ -118,6 +174,8 @@ db::commitlog::config::config(const db::config& cfg)
     , commitlog_segment_size_in_mb(cfg.commitlog_segment_size_in_mb())
     , commitlog_sync_period_in_ms(cfg.commitlog_sync_period_in_ms())
     , mode(cfg.commitlog_sync() == "batch" ? sync_mode::BATCH : sync_mode::PERIODIC)
+    , compression(parse_commitlog_compression(cfg.commitlog_compression()))
+    , batch_window_in_ms(cfg.commitlog_sync_batch_window_in_ms())
 {}
 
 db::commitlog::descriptor::descriptor(segment_id_type i, uint32_t v)
@@ -223,10 +281,36 @@ class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_
         uint64_t buffer_list_bytes = 0;
         uint64_t total_size_on_disk = 0;
         uint64_t requests_blocked_memory = 0;
+        uint64_t bytes_before_compression = 0;
+        uint64_t bytes_after_compression = 0;
     };
 
     stats totals;
 
+    // Group commit in BATCH mode: a write which would start a sync waits up
+    // to batch_window for other writes to share it, unless its buffer already
+    // holds cfg.batch_target_bytes. Waiting for a fraction of a sync costs
+    // little compared to the sync itself, so the window follows the observed
+    // sync latency. It shrinks while syncs are not shared anyway, so a lone
+    // writer is not delayed.
+    std::chrono::microseconds batch_window{0};
+    double batch_sync_latency_us = 0;
+    utils::estimated_histogram batch_sync_writes;
+    utils::estimated_histogram batch_sync_wait;
+
+    void on_batch_synced(uint64_t writes, std::chrono::steady_clock::duration latency) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+        batch_sync_latency_us = batch_sync_latency_us ? 0.8 * batch_sync_latency_us + 0.2 * us : us;
+        batch_sync_writes.add(writes);
+        if (writes > 1) {
+            // Syncs of a fast device may be too short to measure, so shared syncs open a minimal window anyway.
+            auto window = std::max(std::chrono::microseconds(10), std::chrono::microseconds(int64_t(batch_sync_latency_us / 2)));
+            batch_window = std::min<std::chrono::microseconds>(std::chrono::milliseconds(cfg.batch_window_in_ms), window);
+        } else {
+            batch_window /= 2;
+        }
+    }
+
     size_t pending_allocations() const {
         return _request_controller.waiters();
     }
@@ -269,6 +353,7 @@ class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_
 
     future<> clear();
     future<> sync_all_segments(bool shutdown = false);
+    future<> force_new_active_segment();
     future<> shutdown();
 
     void create_counters();
@@ -378,10 +463,15 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     file _file;
     sstring _file_name;
 
+    // Positions are in the uncompressed layout of the segment, which is what
+    // replay positions refer to. _disk_pos is where the next chunk goes in
+    // the file, and only differs from _file_pos if chunks are compressed.
     uint64_t _file_pos = 0;
+    uint64_t _disk_pos = 0;
     uint64_t _flush_pos = 0;
     uint64_t _buf_pos = 0;
     bool _closed = false;
+    compressor _compression;
 
     using buffer_type = segment_manager::buffer_type;
     using sseg_ptr = segment_manager::sseg_ptr;
@@ -396,6 +486,11 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     utils::flush_queue<replay_position, std::less<replay_position>, clock_type> _pending_ops;
 
     uint64_t _num_allocs = 0;
+    // Writes since the last sync, in BATCH mode.
+    uint64_t _unsynced_writes = 0;
+    // Open while writes in BATCH mode wait for others to join their sync.
+    stdx::optional<shared_promise<>> _batch_window;
+    timer<> _batch_timer{[this] { close_batch_window(); }};
 
     std::unordered_set<table_schema_version> _known_schema_versions;
 
@@ -424,6 +519,13 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     static constexpr size_t segment_overhead_size = 2 * sizeof(uint32_t);
     static constexpr size_t descriptor_header_size = 5 * sizeof(uint32_t);
     static constexpr uint32_t segment_magic = ('S'<<24) |('C'<< 16) | ('L' << 8) | 'C';
+    // Segments with compressed chunks. Their header holds the compressor
+    // after the segment id.
+    static constexpr uint32_t compressed_segment_magic = ('S'<<24) |('C'<< 16) | ('L' << 8) | 'Z';
+    static constexpr size_t compressed_descriptor_header_size = descriptor_header_size + sizeof(uint32_t);
+    // A compressed chunk has a second header after the chunk header (int: position of the
+    // entries + int: their size + int: compressed size + int: checksum [header, compressed data])
+    static constexpr size_t compressed_chunk_header_size = 4 * sizeof(uint32_t);
 
     // The commit log (chained) sync marker/header size in bytes (int: length + int: checksum [segmentId, position])
     static constexpr size_t sync_marker_size = 2 * sizeof(uint32_t);
@@ -434,7 +536,8 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
 
     segment(::shared_ptr<segment_manager> m, const descriptor& d, file && f, bool active)
             : _segment_manager(std::move(m)), _desc(std::move(d)), _file(std::move(f)),
-        _file_name(_segment_manager->cfg.commit_log_location + "/" + _desc.filename()), _sync_time(
+        _file_name(_segment_manager->cfg.commit_log_location + "/" + _desc.filename()),
+        _compression(_segment_manager->cfg.compression), _sync_time(
                     clock_type::now()), _pending_ops(true) // want exception propagation
     {
         ++_segment_manager->totals.segments_created;
@@ -495,6 +598,14 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         sync();
         return _segment_manager->active_segment(timeout);
     }
+    /**
+     * Finalize this segment without getting a new one. The next
+     * allocation will pick up a new segment.
+     */
+    future<sseg_ptr> finish() {
+        _closed = true;
+        return sync();
+    }
     void reset_sync_time() {
         _sync_time = clock_type::now();
     }
@@ -553,9 +664,14 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
                 clogger.trace("{} already synced! ({} < {})", *this, pos, _flush_pos);
                 return make_ready_future<>();
             }
-            return _file.flush().then_wrapped([this, pos](future<> f) {
+            auto writes = std::exchange(_unsynced_writes, 0);
+            auto start = std::chrono::steady_clock::now();
+            return _file.flush().then_wrapped([this, pos, writes, start](future<> f) {
                 try {
                     f.get();
+                    if (_segment_manager->cfg.mode == sync_mode::BATCH) {
+                        _segment_manager->on_batch_synced(writes, std::chrono::steady_clock::now() - start);
+                    }
                     // TODO: retry/ignore/fail/stop - optional behaviour in origin.
                     // we fast-fail the whole commit.
                     _flush_pos = std::max(pos, _flush_pos);
@@ -581,7 +697,7 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
 
         auto overhead = segment_overhead_size;
         if (_file_pos == 0) {
-            overhead += descriptor_header_size;
+            overhead += header_size();
         }
 
         auto a = align_up(s + overhead, alignment);
@@ -607,26 +723,72 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         _segment_manager->totals.total_size += k;
     }
 
+    size_t header_size() const {
+        return _compression == compressor::none ? descriptor_header_size : compressed_descriptor_header_size;
+    }
+
     bool buffer_is_empty() const {
         return _buf_pos <= segment_overhead_size
-                        || (_file_pos == 0 && _buf_pos <= (segment_overhead_size + descriptor_header_size));
+                        || (_file_pos == 0 && _buf_pos <= (segment_overhead_size + header_size()));
+    }
+
+    /**
+     * Replace the buffer about to be written with one holding its entries
+     * compressed. Headers are left blank, as in the original.
+     * Returns the new buffer and how much of it is to be written.
+     */
+    std::pair<buffer_type, size_t> compress_chunk(buffer_type buf, uint64_t off, size_t header_size, size_t data_end) {
+        auto data_start = header_size + segment_overhead_size;
+        auto data_size = data_end - data_start;
+        auto prefix = data_start + compressed_chunk_header_size;
+        auto out = _segment_manager->acquire_buffer(align_up(prefix + commitlog_compress_max_size(_compression, data_size), alignment));
+        std::fill(out.get_write(), out.get_write() + prefix, 0);
+        auto compressed_size = commitlog_compress(_compression, buf.get() + data_start, data_size, out.get_write() + prefix, out.size() - prefix);
+        auto size = align_up(prefix + compressed_size, alignment);
+        std::fill(out.get_write() + prefix + compressed_size, out.get_write() + size, 0);
+
+        crc32_nbo crc;
+        data_output header(out.get_write() + data_start, compressed_chunk_header_size);
+        for (auto v : { uint32_t(off + data_start), uint32_t(data_size), uint32_t(compressed_size) }) {
+            header.write(v);
+            crc.process(v);
+        }
+        crc.process_bytes(out.get() + prefix, compressed_size);
+        header.write(crc.checksum());
+
+        _segment_manager->release_buffer(std::move(buf));
+        return std::make_pair(std::move(out), size);
     }
     /**
      * Send any buffer contents to disk and get a new tmp buffer
      */
     // See class comment for info
     future<sseg_ptr> cycle(bool flush_after = false) {
+        close_batch_window();
         if (_buffer.empty()) {
             return flush_after ? flush() : make_ready_future<sseg_ptr>(shared_from_this());
         }
 
+        auto data_end = _buf_pos;
         auto size = clear_buffer_slack();
         auto buf = std::move(_buffer);
         auto off = _file_pos;
         auto top = off + size;
         auto num = _num_allocs;
+        auto header_size = off == 0 ? this->header_size() : 0;
+
+        // From here on, offsets and sizes are those in the file.
+        auto memory_size = size;
+        auto disk_off = _disk_pos;
+        if (_compression != compressor::none) {
+            std::tie(buf, size) = compress_chunk(std::move(buf), off, header_size, data_end);
+            _segment_manager->totals.total_size -= memory_size - size;
+            _segment_manager->totals.bytes_before_compression += memory_size;
+            _segment_manager->totals.bytes_after_compression += size;
+        }
 
         _file_pos = top;
+        _disk_pos = disk_off + size;
         _buf_pos = 0;
         _num_allocs = 0;
 
@@ -638,28 +800,29 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
 
         data_output out(p, p + buf.size());
 
-        auto header_size = 0;
-
         if (off == 0) {
             // first block. write file header.
-            out.write(segment_magic);
+            out.write(_compression == compressor::none ? segment_magic : compressed_segment_magic);
             out.write(_desc.ver);
             out.write(_desc.id);
             crc32_nbo crc;
             crc.process(_desc.ver);
             crc.process<int32_t>(_desc.id & 0xffffffff);
             crc.process<int32_t>(_desc.id >> 32);
+            if (_compression != compressor::none) {
+                out.write(uint32_t(_compression));
+                crc.process(uint32_t(_compression));
+            }
             out.write(crc.checksum());
-            header_size = descriptor_header_size;
         }
 
         // write chunk header
         crc32_nbo crc;
         crc.process<int32_t>(_desc.id & 0xffffffff);
         crc.process<int32_t>(_desc.id >> 32);
-        crc.process(uint32_t(off + header_size));
+        crc.process(uint32_t(disk_off + header_size));
 
-        out.write(uint32_t(_file_pos));
+        out.write(uint32_t(_disk_pos));
         out.write(crc.checksum());
 
         forget_schema_versions();
@@ -670,7 +833,7 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
 
         // The write will be allowed to start now, but flush (below) must wait for not only this,
         // but all previous write/flush pairs.
-        return _pending_ops.run_with_ordered_post_op(rp, [this, size, off, buf = std::move(buf)]() mutable {
+        return _pending_ops.run_with_ordered_post_op(rp, [this, size, off = disk_off, memory_size, buf = std::move(buf)]() mutable {
                 auto written = make_lw_shared<size_t>(0);
                 auto p = buf.get();
                 return repeat([this, size, off, written, p]() mutable {
@@ -697,9 +860,9 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
                             throw;
                         }
                     });
-                }).finally([this, buf = std::move(buf), size]() mutable {
+                }).finally([this, buf = std::move(buf), memory_size]() mutable {
                     _segment_manager->release_buffer(std::move(buf));
-                    _segment_manager->notify_memory_written(size);
+                    _segment_manager->notify_memory_written(memory_size);
                 });
         }, [me, flush_after, top, rp] { // lambda instead of bind, so we keep "me" alive.
             assert(me->_pending_ops.has_operation(rp));
@@ -718,22 +881,33 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
          */
         auto me = shared_from_this();
         auto fp = _file_pos;
-        return _pending_ops.wait_for_pending(timeout).then([me = std::move(me), fp, timeout] {
+        auto written_by_other = [me, fp, timeout] {
+            // some other request already wrote this buffer.
+            // If so, wait for the operation at our intended file offset
+            // to finish, then we know the flush is complete and we
+            // are in accord.
+            // (Note: wait_for_pending(pos) waits for operation _at_ pos (and before),
+            replay_position rp(me->_desc.id, position_type(fp));
+            return me->_pending_ops.wait_for_pending(rp, timeout).then([me, fp] {
+                assert(me->_flush_pos > fp);
+                return make_ready_future<sseg_ptr>(me);
+            });
+        };
+        return _pending_ops.wait_for_pending(timeout).then([me = std::move(me), fp, timeout, written_by_other] {
             if (fp != me->_file_pos) {
-                // some other request already wrote this buffer.
-                // If so, wait for the operation at our intended file offset
-                // to finish, then we know the flush is complete and we
-                // are in accord.
-                // (Note: wait_for_pending(pos) waits for operation _at_ pos (and before),
-                replay_position rp(me->_desc.id, position_type(fp));
-                return me->_pending_ops.wait_for_pending(rp, timeout).then([me, fp] {
-                    assert(me->_flush_pos > fp);
-                    return make_ready_future<sseg_ptr>(me);
-                });
+                return written_by_other();
             }
-            // It is ok to leave the sync behind on timeout because there will be at most one
-            // such sync, all later allocations will block on _pending_ops until it is done.
-            return with_timeout(timeout, me->sync());
+            auto start = std::chrono::steady_clock::now();
+            return me->wait_for_batch(timeout).then([me, fp, timeout, written_by_other, start] {
+                auto waited = std::chrono::steady_clock::now() - start;
+                me->_segment_manager->batch_sync_wait.add(std::chrono::duration_cast<std::chrono::microseconds>(waited).count());
+                if (fp != me->_file_pos) {
+                    return written_by_other();
+                }
+                // It is ok to leave the sync behind on timeout because there will be at most one
+                // such sync, all later allocations will block on _pending_ops until it is done.
+                return with_timeout(timeout, me->sync());
+            });
         }).handle_exception([me, fp](auto p) {
             // If we get an IO exception (which we assume this is)
             // we should close the segment.
@@ -744,6 +918,27 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         });
     }
 
+    future<> wait_for_batch(timeout_clock::time_point timeout) {
+        auto window = _segment_manager->batch_window;
+        if (window.count() == 0 || _buf_pos >= _segment_manager->cfg.batch_target_bytes) {
+            return make_ready_future<>();
+        }
+        if (!_batch_window) {
+            _batch_window.emplace();
+            _batch_timer.arm(window);
+        }
+        return with_timeout(timeout, _batch_window->get_shared_future());
+    }
+
+    void close_batch_window() {
+        _batch_timer.cancel();
+        if (_batch_window) {
+            auto p = std::move(*_batch_window);
+            _batch_window = { };
+            p.set_value();
+        }
+    }
+
     /**
      * Add a "mutation" to the segment.
      */
@@ -823,6 +1018,10 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         _gate.leave();
 
         if (_segment_manager->cfg.mode == sync_mode::BATCH) {
+            ++_unsynced_writes;
+            if (_batch_window && _buf_pos >= _segment_manager->cfg.batch_target_bytes) {
+                close_batch_window();
+            }
             return batch_cycle(timeout).then([h = std::move(h)](auto s) mutable {
                 return make_ready_future<rp_handle>(std::move(h));
             });
@@ -844,7 +1043,7 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     }
 
     size_t size_on_disk() const {
-        return _file_pos;
+        return _disk_pos;
     }
 
     // ensures no more of this segment is writeable, by allocating any unused section at the end and marking it discarded
@@ -1070,7 +1269,11 @@ future<> db::commitlog::segment_manager::init() {
 void db::commitlog::segment_manager::create_counters() {
     namespace sm = seastar::metrics;
 
-    _metrics.add_group("commitlog", {
+    if (cfg.metrics_category_name.empty()) {
+        return;
+    }
+
+    _metrics.add_group(cfg.metrics_category_name, {
         sm::make_gauge("segments", [this] { return _segments.size(); },
                        sm::description("Holds the current number of segments.")),
 
@@ -1099,6 +1302,21 @@ void db::commitlog::segment_manager::create_counters() {
         sm::make_derive("slack", totals.bytes_slack,
                        sm::description("Counts a number of unused bytes written to the disk due to disk segment alignment.")),
 
+        sm::make_histogram("batch_sync_writes", sm::description("Histogram of the number of writes made durable by each sync in batch mode."),
+                       [this] { return batch_sync_writes.get_histogram(1, 12); }),
+
+        sm::make_histogram("batch_sync_wait", sm::description("Histogram of the time writes waited for others to join their sync in batch mode, in microseconds."),
+                       [this] { return batch_sync_wait.get_histogram(std::chrono::microseconds(10)); }),
+
+        sm::make_gauge("batch_sync_window", [this] { return batch_window.count(); },
+                       sm::description("Holds the current time, in microseconds, a write waits for others to join its sync in batch mode.")),
+
+        sm::make_derive("bytes_before_compression", totals.bytes_before_compression,
+                       sm::description("Counts a number of bytes of compressed chunks, before compression.")),
+
+        sm::make_derive("bytes_after_compression", totals.bytes_after_compression,
+                       sm::description("Counts a number of bytes of compressed chunks, as written to the disk.")),
+
         sm::make_gauge("pending_flushes", totals.pending_flushes,
                        sm::description("Holds a number of currently pending flushes. See the related flush_limit_exceeded metric.")),
 
@@ -1286,6 +1504,15 @@ void db::commitlog::segment_manager::discard_unused_segments() {
     }
 }
 
+future<> db::commitlog::segment_manager::force_new_active_segment() {
+    if (_segments.empty() || !_segments.back()->is_still_allocating()) {
+        return make_ready_future<>();
+    }
+    auto s = _segments.back();
+    clogger.debug("Closing segment {} on request", *s);
+    return s->finish().discard_result();
+}
+
 // FIXME: pop() will call unlink -> sleeping in reactor thread.
 // Not urgent since mostly called during shutdown, but have to fix.
 future<> db::commitlog::segment_manager::clear_reserve_segments() {
@@ -1567,6 +1794,10 @@ future<> db::commitlog::sync_all_segments() {
     return _segment_manager->sync_all_segments();
 }
 
+future<> db::commitlog::force_new_active_segment() {
+    return _segment_manager->force_new_active_segment();
+}
+
 future<> db::commitlog::shutdown() {
     return _segment_manager->shutdown();
 }
@@ -1609,6 +1840,15 @@ db::commitlog::read_log_file(const sstring& filename, commit_load_reader_func ne
 // on error at startup if required
 subscription<temporary_buffer<char>, db::replay_position>
 db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type off) {
+    class buffer_data_source_impl : public data_source_impl {
+        temporary_buffer<char> _buf;
+    public:
+        explicit buffer_data_source_impl(temporary_buffer<char> buf) : _buf(std::move(buf)) { }
+        virtual future<temporary_buffer<char>> get() override {
+            return make_ready_future<temporary_buffer<char>>(std::move(_buf));
+        }
+    };
+
     struct work {
     private:
         file_input_stream_options make_file_input_stream_options() {
@@ -1633,6 +1873,7 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
         bool eof = false;
         bool header = true;
         bool failed = false;
+        compressor compression = compressor::none;
 
         work(file f, position_type o = 0)
                 : f(f), fin(make_file_input_stream(f, 0, make_file_input_stream_options())), start_off(o) {
@@ -1689,7 +1930,7 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
                     return stop();
                 }
 
-                if (magic != segment::segment_magic) {
+                if (magic != segment::segment_magic && magic != segment::compressed_segment_magic) {
                     throw std::invalid_argument("Not a scylla format commitlog file");
                 }
                 crc32_nbo crc;
@@ -1697,15 +1938,34 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
                 crc.process<int32_t>(id & 0xffffffff);
                 crc.process<int32_t>(id >> 32);
 
-                auto cs = crc.checksum();
-                if (cs != checksum) {
-                    throw std::runtime_error("Checksum error in file header");
-                }
+                auto check_header = [this, id, crc] (uint32_t checksum) mutable {
+                    auto cs = crc.checksum();
+                    if (cs != checksum) {
+                        throw std::runtime_error("Checksum error in file header");
+                    }
 
-                this->id = id;
-                this->next = 0;
+                    this->id = id;
+                    this->next = 0;
+                };
 
-                return make_ready_future<>();
+                if (magic == segment::segment_magic) {
+                    check_header(checksum);
+                    return make_ready_future<>();
+                }
+                // What was read as the checksum is the compressor.
+                auto c = checksum;
+                crc.process(c);
+                return fin.read_exactly(sizeof(uint32_t)).then([this, c, check_header] (temporary_buffer<char> buf) mutable {
+                    if (!advance(buf)) {
+                        throw std::runtime_error("Truncated file header");
+                    }
+                    data_input in(buf);
+                    check_header(in.read<uint32_t>());
+                    compression = compressor(c);
+                    if (compression != compressor::lz4 && compression != compressor::zstd) {
+                        throw std::runtime_error(sprint("Unsupported compression %d in file header", c));
+                    }
+                });
             });
         }
         future<> read_chunk() {
@@ -1741,6 +2001,10 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
 
                 this->next = next;
 
+                if (compression != compressor::none) {
+                    return read_compressed_chunk();
+                }
+
                 if (start_off >= next) {
                     return skip(next - pos);
                 }
@@ -1748,6 +2012,74 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
                 return do_until(std::bind(&work::end_of_chunk, this), std::bind(&work::read_entry, this));
             });
         }
+        future<> read_compressed_chunk() {
+            return fin.read_exactly(segment::compressed_chunk_header_size).then([this](temporary_buffer<char> buf) {
+                if (!advance(buf)) {
+                    return make_ready_future<>();
+                }
+
+                data_input in(buf);
+                auto data_pos = in.read<uint32_t>();
+                auto data_size = in.read<uint32_t>();
+                auto compressed_size = in.read<uint32_t>();
+                auto checksum = in.read<uint32_t>();
+
+                if (compressed_size > next - pos) {
+                    clogger.debug("Compressed chunk at {} has broken header. Skipping to next chunk ({} bytes)", pos, next - pos);
+                    corrupt_size += next - pos;
+                    return skip(next - pos);
+                }
+
+                return fin.read_exactly(compressed_size).then([this, data_pos, data_size, compressed_size, checksum](temporary_buffer<char> buf) {
+                    if (!advance(buf)) {
+                        return make_ready_future<>();
+                    }
+
+                    crc32_nbo crc;
+                    crc.process(data_pos);
+                    crc.process(data_size);
+                    crc.process(compressed_size);
+                    crc.process_bytes(buf.get(), buf.size());
+                    if (crc.checksum() != checksum) {
+                        clogger.debug("Compressed chunk at {} checksum error. Skipping {} bytes", pos - compressed_size, compressed_size);
+                        corrupt_size += compressed_size;
+                        return skip(next - pos);
+                    }
+                    if (start_off >= data_pos + data_size) {
+                        return skip(next - pos);
+                    }
+
+                    temporary_buffer<char> data(data_size);
+                    try {
+                        if (commitlog_uncompress(compression, buf.get(), buf.size(), data.get_write(), data.size()) != data_size) {
+                            throw std::runtime_error("unexpected uncompressed size");
+                        }
+                    } catch (...) {
+                        clogger.debug("Failed to uncompress chunk at {}: {}. Skipping {} bytes", pos - compressed_size, std::current_exception(), compressed_size);
+                        corrupt_size += compressed_size;
+                        return skip(next - pos);
+                    }
+                    return read_uncompressed_entries(std::move(data), data_pos).then([this] {
+                        return skip(next - pos);
+                    });
+                });
+            });
+        }
+        // Reads the entries of a compressed chunk, at their positions in the
+        // uncompressed layout of the segment.
+        future<> read_uncompressed_entries(temporary_buffer<char> data, uint32_t data_pos) {
+            auto file_pos = pos;
+            auto file_next = next;
+            auto file_in = std::move(fin);
+            pos = data_pos;
+            next = data_pos + data.size();
+            fin = input_stream<char>(data_source(std::make_unique<buffer_data_source_impl>(std::move(data))));
+            return do_until(std::bind(&work::end_of_chunk, this), std::bind(&work::read_entry, this)).finally([this, file_in = std::move(file_in), file_pos, file_next] () mutable {
+                fin = std::move(file_in);
+                pos = file_pos;
+                next = file_next;
+            });
+        }
         future<> read_entry() {
             static constexpr size_t entry_header_size = segment::entry_overhead_size - sizeof(uint32_t);
 
@@ -1860,6 +2192,10 @@ uint64_t db::commitlog::get_flush_count() const {
     return _segment_manager->totals.flush_count;
 }
 
+std::chrono::microseconds db::commitlog::get_batch_window() const {
+    return _segment_manager->batch_window;
+}
+
 uint64_t db::commitlog::get_pending_tasks() const {
     return _segment_manager->totals.pending_flushes;
 }
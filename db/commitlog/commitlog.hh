@@ -48,6 +48,7 @@
 #include "core/stream.hh"
 #include "replay_position.hh"
 #include "commitlog_entry.hh"
+#include "compress.hh"
 
 namespace seastar { class file; }
 
@@ -125,6 +126,17 @@ class commitlog {
         uint64_t max_active_flushes = 0;
 
         sync_mode mode = sync_mode::PERIODIC;
+        // BATCH mode group commit: the longest a write waits for others to
+        // share its sync, and the amount of buffered data which ends the
+        // wait early.
+        uint64_t batch_window_in_ms = 2;
+        uint64_t batch_target_bytes = 1024 * 1024;
+        // Compression of new segments: none, lz4 or zstd. Each segment
+        // records its own, so this can be changed between restarts.
+        compressor compression = compressor::none;
+        // Metrics are not registered if empty, e.g. when there
+        // are many instances on a shard.
+        sstring metrics_category_name = "commitlog";
     };
 
     struct descriptor {
@@ -271,6 +283,11 @@ class commitlog {
     uint64_t get_total_size() const;
     uint64_t get_completed_tasks() const;
     uint64_t get_flush_count() const;
+    /**
+     * Get how long a write currently waits for others to share its sync,
+     * in BATCH mode
+     */
+    std::chrono::microseconds get_batch_window() const;
     uint64_t get_pending_tasks() const;
     uint64_t get_pending_flushes() const;
     uint64_t get_pending_allocations() const;
@@ -312,6 +329,12 @@ class commitlog {
      * those can/will be missed.
      */
     future<> sync_all_segments();
+    /**
+     * Closes the segment currently being written to, if any, and syncs it.
+     * The next "add" starts a new segment. Segments written before this call
+     * can then be read back while the commitlog keeps being appended to.
+     */
+    future<> force_new_active_segment();
     /**
      * Shuts everything down and causes any
      * incoming writes to throw exceptions
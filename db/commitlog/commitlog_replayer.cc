@@ -44,9 +44,13 @@
 #include <algorithm>
 #include <unordered_map>
 #include <boost/range/adaptor/map.hpp>
+#include <boost/range/irange.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
 
 #include <core/future.hh>
 #include <core/sharded.hh>
+#include <core/semaphore.hh>
+#include <core/gate.hh>
 
 #include "commitlog.hh"
 #include "commitlog_replayer.hh"
@@ -61,6 +65,9 @@
 
 static logging::logger rlogger("commitlog_replayer");
 
+// Segments replayed at the same time by each shard.
+static constexpr size_t max_concurrent_segments = 4;
+
 class db::commitlog_replayer::impl {
     struct column_mappings {
         std::unordered_map<table_schema_version, column_mapping> map;
@@ -85,12 +92,14 @@ class db::commitlog_replayer::impl {
         uint64_t skipped_mutations = 0;
         uint64_t applied_mutations = 0;
         uint64_t corrupt_bytes = 0;
+        uint64_t replayed_bytes = 0;
 
         stats& operator+=(const stats& s) {
             invalid_mutations += s.invalid_mutations;
             skipped_mutations += s.skipped_mutations;
             applied_mutations += s.applied_mutations;
             corrupt_bytes += s.corrupt_bytes;
+            replayed_bytes += s.replayed_bytes;
             return *this;
         }
         stats operator+(const stats& s) const {
@@ -109,16 +118,89 @@ class db::commitlog_replayer::impl {
         return _column_mappings.stop();
     }
 
-    future<> process(stats*, temporary_buffer<char> buf, replay_position rp) const;
+    // A decoded entry, to be applied on the shard owning its mutation.
+    struct entry {
+        commitlog_entry_reader cer;
+        // Owned by the _column_mappings of the shard which read the entry.
+        const column_mapping* src_cm;
+        replay_position rp;
+    };
+
+    // Replay of a single segment. Reading, verifying and decoding entries
+    // are not held up by applying them: decoded entries are collected per
+    // owning shard, and sent there in batches while the segment is read on.
+    // The number of batches in flight is bounded, which stalls the reader
+    // when the shards can't keep up.
+    class segment_replay {
+        static constexpr size_t max_batch_entries = 128;
+        static constexpr size_t max_batch_bytes = 256 * 1024;
+
+        struct batch {
+            std::vector<entry> entries;
+            size_t bytes = 0;
+        };
+
+        const impl& _impl;
+        stats& _stats;
+        std::vector<batch> _batches;
+        semaphore _in_flight;
+        seastar::gate _deliveries;
+    public:
+        segment_replay(const impl& i, stats& s)
+            : _impl(i)
+            , _stats(s)
+            , _batches(smp::count)
+            , _in_flight(2 * smp::count) {
+        }
+        future<> add(unsigned shard, entry e, size_t bytes);
+        // Delivers the entries collected so far and waits for all of them
+        // to be applied.
+        future<> flush();
+    private:
+        future<> deliver(unsigned shard);
+    };
+
+    future<> process(segment_replay&, stats*, replay_position gp, temporary_buffer<char> buf, replay_position rp) const;
+    future<stats> apply(std::vector<entry> entries) const;
     future<stats> recover(sstring file) const;
 
     typedef std::unordered_map<utils::UUID, replay_position> rp_map;
     typedef std::unordered_map<unsigned, rp_map> shard_rpm_map;
     typedef std::unordered_map<unsigned, replay_position> shard_rp_map;
-
-    replay_position min_pos(unsigned shard) const {
-        auto i = _min_pos.find(shard);
-        return i != _min_pos.end() ? i->second : replay_position();
+    // The system keyspaces have a commitlog of their own, whose positions
+    // aren't comparable with those of the main one, so the minimum positions
+    // are kept per commitlog directory.
+    typedef std::unordered_map<sstring, shard_rp_map> log_rp_map;
+
+    sstring log_location(const utils::UUID& uuid) const {
+        auto& db = _qp.local().db().local();
+        auto cl = db.commitlog_for(db.find_schema(uuid)->ks_name());
+        return cl ? cl->active_config().commit_log_location : sstring();
+    }
+    static sstring log_location(const db::commitlog* cl) {
+        return cl ? cl->active_config().commit_log_location : sstring();
+    }
+    // The minimum position from which segments in given directory are replayed.
+    replay_position segment_min_pos(const sstring& location, unsigned shard) const {
+        auto gp = min_pos(location, shard);
+        auto& db = _qp.local().db().local();
+        // Segments of the main log which were written before the system
+        // keyspaces got a log of their own hold their mutations too, and the
+        // positions in their sstables refer to those segments. With nothing in
+        // the system log to replay, that may be the case, so the main log is
+        // replayed from the minimum of both.
+        if (!_system_log_replayed && location == log_location(db.commitlog())) {
+            gp = std::min(gp, min_pos(log_location(db.system_commitlog()), shard));
+        }
+        return gp;
+    }
+    replay_position min_pos(const sstring& location, unsigned shard) const {
+        auto i = _min_pos.find(location);
+        if (i == _min_pos.end()) {
+            return replay_position();
+        }
+        auto j = i->second.find(shard);
+        return j != i->second.end() ? j->second : replay_position();
     }
     replay_position cf_min_pos(const utils::UUID& uuid, unsigned shard) const {
         auto i = _rpm.find(shard);
@@ -133,8 +215,10 @@ class db::commitlog_replayer::impl {
         _qp;
     shard_rpm_map
         _rpm;
-    shard_rp_map
+    log_rp_map
         _min_pos;
+    bool
+        _system_log_replayed = false;
 };
 
 db::commitlog_replayer::impl::impl(seastar::sharded<cql3::query_processor>& qp)
@@ -148,9 +232,10 @@ future<> db::commitlog_replayer::impl::init() {
                 auto& pp = _rpm[p1.first][p2.first];
                 pp = std::max(pp, p2.second);
 
-                auto i = _min_pos.find(p1.first);
-                if (i == _min_pos.end() || p2.second < i->second) {
-                    _min_pos[p1.first] = p2.second;
+                auto& min_pos = _min_pos[log_location(p2.first)];
+                auto i = min_pos.find(p1.first);
+                if (i == min_pos.end() || p2.second < i->second) {
+                    min_pos[p1.first] = p2.second;
                 }
             }
         }
@@ -189,12 +274,14 @@ future<> db::commitlog_replayer::impl::init() {
         for (auto&p : _qp.local().db().local().get_column_families()) {
             for (auto&p1 : _rpm) { // for each shard
                 if (!p1.second.count(p.first)) {
-                    _min_pos[p1.first] = replay_position();
+                    _min_pos[log_location(p.first)][p1.first] = replay_position();
                 }
             }
         }
-        for (auto&p : _min_pos) {
-            rlogger.debug("minimum position for shard {}: {}", p.first, p.second);
+        for (auto&p1 : _min_pos) {
+            for (auto& p2 : p1.second) {
+                rlogger.debug("minimum position in {} for shard {}: {}", p1.first, p2.first, p2.second);
+            }
         }
         for (auto&p1 : _rpm) {
             for (auto& p2 : p1.second) {
@@ -209,7 +296,7 @@ db::commitlog_replayer::impl::recover(sstring file) const {
     assert(_column_mappings.local_is_initialized());
 
     replay_position rp{commitlog::descriptor(file)};
-    auto gp = min_pos(rp.shard_id());
+    auto gp = segment_min_pos(file.substr(0, file.find_last_of('/')), rp.shard_id());
 
     if (rp.id < gp.id) {
         rlogger.debug("skipping replay of fully-flushed {}", file);
@@ -221,25 +308,29 @@ db::commitlog_replayer::impl::recover(sstring file) const {
     }
 
     auto s = make_lw_shared<stats>();
+    auto sr = make_lw_shared<segment_replay>(*this, *s);
 
     return db::commitlog::read_log_file(file,
-            std::bind(&impl::process, this, s.get(), std::placeholders::_1,
+            std::bind(&impl::process, this, std::ref(*sr), s.get(), gp, std::placeholders::_1,
                     std::placeholders::_2), p).then([](auto s) {
         auto f = s->done();
         return f.finally([s = std::move(s)] {});
-    }).then_wrapped([s](future<> f) {
-        try {
-            f.get();
-        } catch (commitlog::segment_data_corruption_error& e) {
-            s->corrupt_bytes += e.bytes();
-        } catch (...) {
-            throw;
-        }
-        return make_ready_future<stats>(*s);
+    }).then_wrapped([s, sr](future<> f) {
+        // Whatever was read is applied, even if the segment ends in garbage.
+        return sr->flush().then([s, f = std::move(f)] () mutable {
+            try {
+                f.get();
+            } catch (commitlog::segment_data_corruption_error& e) {
+                s->corrupt_bytes += e.bytes();
+            } catch (...) {
+                throw;
+            }
+            return make_ready_future<stats>(*s);
+        });
     });
 }
 
-future<> db::commitlog_replayer::impl::process(stats* s, temporary_buffer<char> buf, replay_position rp) const {
+future<> db::commitlog_replayer::impl::process(segment_replay& sr, stats* s, replay_position gp, temporary_buffer<char> buf, replay_position rp) const {
     try {
 
         commitlog_entry_reader cer(buf);
@@ -257,7 +348,7 @@ future<> db::commitlog_replayer::impl::process(stats* s, temporary_buffer<char>
         const column_mapping& src_cm = cm_it->second;
 
         auto shard_id = rp.shard_id();
-        if (rp < min_pos(shard_id)) {
+        if (rp < gp) {
             rlogger.trace("entry {} is less than global min position. skipping", rp);
             s->skipped_mutations++;
             return make_ready_future<>();
@@ -272,43 +363,8 @@ future<> db::commitlog_replayer::impl::process(stats* s, temporary_buffer<char>
         }
 
         auto shard = _qp.local().db().local().shard_of(fm);
-        return _qp.local().db().invoke_on(shard, [this, cer = std::move(cer), &src_cm, rp, shard, s] (database& db) -> future<> {
-            auto& fm = cer.mutation();
-            // TODO: might need better verification that the deserialized mutation
-            // is schema compatible. My guess is that just applying the mutation
-            // will not do this.
-            auto& cf = db.find_column_family(fm.column_family_id());
-
-            if (rlogger.is_enabled(logging::log_level::debug)) {
-                rlogger.debug("replaying at {} v={} {}:{} at {}", fm.column_family_id(), fm.schema_version(),
-                        cf.schema()->ks_name(), cf.schema()->cf_name(), rp);
-            }
-            // Removed forwarding "new" RP. Instead give none/empty.
-            // This is what origin does, and it should be fine.
-            // The end result should be that once sstables are flushed out
-            // their "replay_position" attribute will be empty, which is
-            // lower than anything the new session will produce.
-            if (cf.schema()->version() != fm.schema_version()) {
-                auto& local_cm = _column_mappings.local().map;
-                auto cm_it = local_cm.find(fm.schema_version());
-                if (cm_it == local_cm.end()) {
-                    cm_it = local_cm.emplace(fm.schema_version(), src_cm).first;
-                }
-                const column_mapping& cm = cm_it->second;
-                mutation m(fm.decorated_key(*cf.schema()), cf.schema());
-                converting_mutation_partition_applier v(cm, *cf.schema(), m.partition());
-                fm.partition().accept(cm, v);
-                cf.apply(std::move(m));
-            } else {
-                cf.apply(fm, cf.schema());
-            }
-            s->applied_mutations++;
-            return make_ready_future<>();
-        }).handle_exception([s](auto ep) {
-            s->invalid_mutations++;
-            // TODO: write mutation to file like origin.
-            rlogger.warn("error replaying: {}", ep);
-        });
+        s->replayed_bytes += buf.size();
+        return sr.add(shard, entry{std::move(cer), &src_cm, rp}, buf.size());
     } catch (no_such_column_family&) {
         // No such CF now? Origin just ignores this.
     } catch (...) {
@@ -320,6 +376,93 @@ future<> db::commitlog_replayer::impl::process(stats* s, temporary_buffer<char>
     return make_ready_future<>();
 }
 
+future<> db::commitlog_replayer::impl::segment_replay::add(unsigned shard, entry e, size_t bytes) {
+    auto& b = _batches[shard];
+    b.entries.push_back(std::move(e));
+    b.bytes += bytes;
+    if (b.entries.size() < max_batch_entries && b.bytes < max_batch_bytes) {
+        return make_ready_future<>();
+    }
+    return deliver(shard);
+}
+
+future<> db::commitlog_replayer::impl::segment_replay::deliver(unsigned shard) {
+    auto entries = std::exchange(_batches[shard], batch{}).entries;
+    if (entries.empty()) {
+        return make_ready_future<>();
+    }
+    // Resolves once the batch is under way, not when it is applied.
+    return get_units(_in_flight, 1).then([this, shard, entries = std::move(entries)] (auto units) mutable {
+        (void)with_gate(_deliveries, [this, shard, entries = std::move(entries), units = std::move(units)] () mutable {
+            return _impl._qp.local().db().invoke_on(shard, [this, entries = std::move(entries)] (database&) mutable {
+                return _impl.apply(std::move(entries));
+            }).then([this, units = std::move(units)] (stats applied) {
+                _stats += applied;
+            });
+        });
+    });
+}
+
+future<> db::commitlog_replayer::impl::segment_replay::flush() {
+    return parallel_for_each(boost::irange<unsigned>(0, smp::count), [this] (unsigned shard) {
+        return deliver(shard);
+    }).finally([this] {
+        return _deliveries.close();
+    });
+}
+
+future<db::commitlog_replayer::impl::stats> db::commitlog_replayer::impl::apply(std::vector<entry> entries) const {
+    return do_with(std::move(entries), stats(), [this] (std::vector<entry>& entries, stats& s) {
+        return do_for_each(entries, [this, &s] (entry& e) {
+            auto& fm = e.cer.mutation();
+            auto& rp = e.rp;
+            return futurize_apply([this, &e, &fm, &rp] {
+                // TODO: might need better verification that the deserialized mutation
+                // is schema compatible. My guess is that just applying the mutation
+                // will not do this.
+                auto& cf = _qp.local().db().local().find_column_family(fm.column_family_id());
+
+                if (rlogger.is_enabled(logging::log_level::debug)) {
+                    rlogger.debug("replaying at {} v={} {}:{} at {}", fm.column_family_id(), fm.schema_version(),
+                            cf.schema()->ks_name(), cf.schema()->cf_name(), rp);
+                }
+                // Replay goes through the regular dirty memory accounting, so
+                // memtables are flushed into sstables as they fill up instead
+                // of the whole commitlog piling up in memory.
+                return cf.dirty_memory_region_group().run_when_memory_available([this, &e, &fm, &cf] {
+                    // Removed forwarding "new" RP. Instead give none/empty.
+                    // This is what origin does, and it should be fine.
+                    // The end result should be that once sstables are flushed out
+                    // their "replay_position" attribute will be empty, which is
+                    // lower than anything the new session will produce.
+                    if (cf.schema()->version() != fm.schema_version()) {
+                        auto& local_cm = _column_mappings.local().map;
+                        auto cm_it = local_cm.find(fm.schema_version());
+                        if (cm_it == local_cm.end()) {
+                            cm_it = local_cm.emplace(fm.schema_version(), *e.src_cm).first;
+                        }
+                        const column_mapping& cm = cm_it->second;
+                        mutation m(fm.decorated_key(*cf.schema()), cf.schema());
+                        converting_mutation_partition_applier v(cm, *cf.schema(), m.partition());
+                        fm.partition().accept(cm, v);
+                        cf.apply(std::move(m));
+                    } else {
+                        cf.apply(fm, cf.schema());
+                    }
+                });
+            }).then([&s] {
+                s.applied_mutations++;
+            }).handle_exception([&s] (auto ep) {
+                s.invalid_mutations++;
+                // TODO: write mutation to file like origin.
+                rlogger.warn("error replaying: {}", ep);
+            });
+        }).then([&s] {
+            return s;
+        });
+    });
+}
+
 db::commitlog_replayer::commitlog_replayer(seastar::sharded<cql3::query_processor>& qp)
     : _impl(std::make_unique<impl>(qp))
 {}
@@ -345,6 +488,11 @@ future<> db::commitlog_replayer::recover(std::vector<sstring> files) {
 
     rlogger.info("Replaying {}", join(", ", files));
 
+    auto system_location = impl::log_location(_impl->_qp.local().db().local().system_commitlog());
+    _impl->_system_log_replayed = boost::algorithm::any_of(files, [&system_location] (const sstring& f) {
+        return f.substr(0, f.find_last_of('/')) == system_location;
+    });
+
     // pre-compute work per shard already.
     auto map = ::make_lw_shared<shard_file_map>();
     for (auto& f : files) {
@@ -354,37 +502,44 @@ future<> db::commitlog_replayer::recover(std::vector<sstring> files) {
     }
 
     return _impl->start().then([this, map] {
+        auto start = std::chrono::steady_clock::now();
         return map_reduce(smp::all_cpus(), [this, map](unsigned id) {
             return smp::submit_to(id, [this, id, map]() {
                 auto total = ::make_lw_shared<impl::stats>();
-                // TODO: or something. For now, we do this serialized per shard,
-                // to reduce mutation congestion. We could probably (says avi)
-                // do 2 segments in parallel or something, but lets use this first.
+                // Each segment being replayed keeps the other shards busy
+                // already, more than a few mostly add memory pressure.
+                auto concurrency = ::make_lw_shared<semaphore>(max_concurrent_segments);
                 auto range = map->equal_range(id);
-                return do_for_each(range.first, range.second, [this, total](const std::pair<unsigned, sstring>& p) {
-                    auto&f = p.second;
-                    rlogger.debug("Replaying {}", f);
-                    return _impl->recover(f).then([f, total](impl::stats stats) {
-                        if (stats.corrupt_bytes != 0) {
-                            rlogger.warn("Corrupted file: {}. {} bytes skipped.", f, stats.corrupt_bytes);
-                        }
-                        rlogger.debug("Log replay of {} complete, {} replayed mutations ({} invalid, {} skipped)"
-                                        , f
-                                        , stats.applied_mutations
-                                        , stats.invalid_mutations
-                                        , stats.skipped_mutations
-                        );
-                        *total += stats;
+                return parallel_for_each(range.first, range.second, [this, total, concurrency](const std::pair<const unsigned, sstring>& p) {
+                    return with_semaphore(*concurrency, 1, [this, total, &f = p.second] {
+                        rlogger.debug("Replaying {}", f);
+                        return _impl->recover(f).then([f, total](impl::stats stats) {
+                            if (stats.corrupt_bytes != 0) {
+                                rlogger.warn("Corrupted file: {}. {} bytes skipped.", f, stats.corrupt_bytes);
+                            }
+                            rlogger.debug("Log replay of {} complete, {} replayed mutations ({} invalid, {} skipped)"
+                                            , f
+                                            , stats.applied_mutations
+                                            , stats.invalid_mutations
+                                            , stats.skipped_mutations
+                            );
+                            *total += stats;
+                        });
                     });
                 }).then([total] {
                     return make_ready_future<impl::stats>(*total);
                 });
             });
-        }, impl::stats(), std::plus<impl::stats>()).then([](impl::stats totals) {
-            rlogger.info("Log replay complete, {} replayed mutations ({} invalid, {} skipped)"
+        }, impl::stats(), std::plus<impl::stats>()).then([start](impl::stats totals) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count();
+            auto mb = totals.replayed_bytes / double(1024 * 1024);
+            rlogger.info("Log replay complete, {} replayed mutations ({} invalid, {} skipped), {:.1f} MB in {:.1f} s ({:.1f} MB/s)"
                             , totals.applied_mutations
                             , totals.invalid_mutations
                             , totals.skipped_mutations
+                            , mb
+                            , elapsed
+                            , elapsed > 0 ? mb / elapsed : 0.0
             );
         });
     }).finally([this] {
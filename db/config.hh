@@ -114,6 +114,9 @@ class config : public utils::config_file {
     val(auto_adjust_flush_quota, bool, false, Used, \
             "true: auto-adjust quota for flush processes. false: put everyone together in the static background writer group - if background writer group is enabled. Not intended for setting in normal operations" \
     )   \
+    val(auto_adjust_compaction_quota, bool, false, Used, \
+            "true: auto-adjust quota for compaction according to the compaction backlog. false: compaction runs in the static background writer group - if background writer group is enabled." \
+    )   \
     /* Initialization properties */             \
     /* The minimal properties needed for configuring a cluster. */  \
     val(cluster_name, sstring, "", Used,   \
@@ -135,6 +138,9 @@ class config : public utils::config_file {
     val(commitlog_directory, sstring, "/var/lib/scylla/commitlog", Used,   \
             "The directory where the commit log is stored. For optimal write performance, it is recommended the commit log be on a separate disk partition (ideally, a separate physical device) from the data file directories."   \
     )                                           \
+    val(hints_directory, sstring, "/var/lib/scylla/hints", Used,   \
+            "The directory where hints files are stored if hinted handoff is enabled."   \
+    )                                           \
     val(data_file_directories, string_list, { "/var/lib/scylla/data" }, Used,   \
             "The directory location where table data (SSTables) is stored"   \
     )                                           \
@@ -242,7 +248,7 @@ class config : public utils::config_file {
             "The method that Scylla uses to acknowledge writes in milliseconds:\n"   \
             "\n"    \
             "\tperiodic : Used with commitlog_sync_period_in_ms (Default: 10000 - 10 seconds ) to control how often the commit log is synchronized to disk. Periodic syncs are acknowledged immediately.\n"   \
-            "\tbatch : Used with commitlog_sync_batch_window_in_ms (Default: disabled **) to control how long Scylla waits for other writes before performing a sync. When using this method, writes are not acknowledged until fsynced to disk.\n"  \
+            "\tbatch : Used with commitlog_sync_batch_window_in_ms (Default: 2) to control how long Scylla waits for other writes before performing a sync. When using this method, writes are not acknowledged until fsynced to disk.\n"  \
             "Related information: Durability"   \
     )                                                   \
     val(commitlog_segment_size_in_mb, uint32_t, 64, Used,     \
@@ -254,8 +260,20 @@ class config : public utils::config_file {
             "Controls how long the system waits for other writes before performing a sync in \"periodic\" mode."    \
     )   \
     /* Note: does not exist on the listing page other than in above comment, wtf? */    \
-    val(commitlog_sync_batch_window_in_ms, uint32_t, 10000, Used,     \
-            "Controls how long the system waits for other writes before performing a sync in \"batch\" mode."    \
+    val(commitlog_sync_batch_window_in_ms, uint32_t, 2, Used,     \
+            "Controls how long the system waits for other writes before performing a sync in \"batch\" mode. This is the longest wait: the actual one adapts to the observed sync latency, and is zero while writes do not arrive concurrently. 0 disables waiting."    \
+    )   \
+    val(commitlog_compression, sstring, "", Used,     \
+            "Compresses the chunks written to commitlog segments, trading CPU for commitlog bandwidth. Set to LZ4Compressor or ZstdCompressor; empty (the default) disables compression. Segments written with compression cannot be replayed by versions which do not support it."    \
+    )   \
+    val(system_commitlog_directory, sstring, "", Used,     \
+            "The directory of the separate commit log which the system keyspaces are written to. Empty (the default) uses the system subdirectory of commitlog_directory."    \
+    )   \
+    val(system_commitlog_sync, sstring, "", Used,     \
+            "The method the commit log of the system keyspaces uses to acknowledge writes: periodic or batch, as in commitlog_sync. Empty (the default) uses commitlog_sync."    \
+    )   \
+    val(system_commitlog_segment_size_in_mb, uint32_t, 8, Used,     \
+            "Sets the size of the segments of the commit log of the system keyspaces. It holds little data, and small segments are freed sooner."    \
     )   \
     val(commitlog_total_space_in_mb, int64_t, -1, Used,     \
             "Total space used for commitlogs. If the used space goes above this value, Scylla rounds up to the next nearest segment multiple and flushes memtables to disk for the oldest commitlog segments, removing those log segments. This reduces the amount of data to replay on startup, and prevents infrequently-updated tables from indefinitely keeping commitlog segments. A small total commitlog space tends to cause more flush activity on less-active tables.\n"  \
@@ -393,10 +411,13 @@ class config : public utils::config_file {
     val(key_cache_save_period, uint32_t, 14400, Unused,                \
             "Duration in seconds that keys are saved in cache. Caches are saved to saved_caches_directory. Saved caches greatly improve cold-start speeds and has relatively little effect on I/O."  \
     )   \
-    val(key_cache_size_in_mb, uint32_t, 100, Unused,                \
+    val(key_cache_size_in_mb, uint32_t, 100, Used,                \
             "A global cache setting for tables. It is the maximum size of the key cache in memory. To disable set to 0.\n"  \
             "Related information: nodetool setcachecapacity."   \
     )   \
+    val(chunk_cache_size_in_mb, uint32_t, 128, Used,                \
+            "Maximum size of the cache of decompressed chunks of compressed SSTables. Reads of partitions which share a chunk with a recently read one avoid decompressing it again. Reads done by compaction and streaming bypass this cache. To disable set to 0."  \
+    )   \
     val(row_cache_keys_to_save, uint32_t, 0, Unused,                \
             "Number of keys from the row cache to save."  \
     )   \
@@ -560,17 +581,17 @@ class config : public utils::config_file {
     val(dynamic_snitch_update_interval_in_ms, uint32_t, 100, Unused,     \
             "The time interval for how often the snitch calculates node scores. Because score calculation is CPU intensive, be careful when reducing this interval."  \
     )   \
-    val(hinted_handoff_enabled, bool, true, Unused,     \
+    val(hinted_handoff_enabled, bool, true, Used,     \
             "Enable or disable hinted handoff. To enable per data center, add data center list. For example: hinted_handoff_enabled: DC1,DC2. A hint indicates that the write needs to be replayed to an unavailable node. Where Cassandra writes the hint depends on the version:\n"  \
             "\n"    \
             "\tPrior to 1.0: Writes to a live replica node.\n"  \
             "\t1.0 and later: Writes to the coordinator node.\n"  \
             "Related information: About hinted handoff writes"  \
     )   \
-    val(hinted_handoff_throttle_in_kb, uint32_t, 1024, Unused,     \
+    val(hinted_handoff_throttle_in_kb, uint32_t, 1024, Used,     \
             "Maximum throttle per delivery thread in kilobytes per second. This rate reduces proportionally to the number of nodes in the cluster. For example, if there are two nodes in the cluster, each delivery thread will use the maximum rate. If there are three, each node will throttle to half of the maximum, since the two nodes are expected to deliver hints simultaneously."  \
     )   \
-    val(max_hint_window_in_ms, uint32_t, 10800000, Unused,     \
+    val(max_hint_window_in_ms, uint32_t, 10800000, Used,     \
             "Maximum amount of time that hints are generates hints for an unresponsive node. After this interval, new hints are no longer generated until the node is back up and responsive. If the node goes down again, a new interval begins. This setting can prevent a sudden demand for resources when a node is brought back online and the rest of the cluster attempts to replay a large volume of hinted writes.\n"  \
             "Related information: Failure detection and recovery"  \
     )   \
@@ -686,12 +707,13 @@ class config : public utils::config_file {
     val(enable_in_memory_data_store, bool, false, Used, "Enable in memory mode (system tables are always persisted)") \
     val(enable_cache, bool, true, Used, "Enable cache") \
     val(enable_commitlog, bool, true, Used, "Enable commitlog") \
+    val(enable_streaming_to_sstables, bool, false, Used, "Write partitions received by streaming directly into sstables instead of streaming memtables. Best suited to bootstrap and decommission, which stream whole token ranges in ring order. At most 16 such sstables are written at a time on each shard; other partitions go to memtables.") \
     val(volatile_system_keyspace_for_testing, bool, false, Used, "Don't persist system keyspace - testing only!") \
     val(api_port, uint16_t, 10000, Used, "Http Rest API port") \
     val(api_address, sstring, "", Used, "Http Rest API address") \
     val(api_ui_dir, sstring, "swagger-ui/dist/", Used, "The directory location of the API GUI") \
     val(api_doc_dir, sstring, "api/api-doc/", Used, "The API definition file directory") \
-    val(load_balance, sstring, "none", Used, "CQL request load balancing: 'none' or round-robin'") \
+    val(load_balance, sstring, "none", Used, "CQL request load balancing: 'none' or round-robin'. Shard-aware clients route requests to the right shard themselves, which only works with 'none'.") \
     val(consistent_rangemovement, bool, true, Used, "When set to true, range movements will be consistent. It means: 1) it will refuse to bootstrap a new node if other bootstrapping/leaving/moving nodes detected. 2) data will be streamed to a new node only from the node which is no longer responsible for the token range. Same as -Dcassandra.consistent.rangemovement in cassandra") \
     val(join_ring, bool, true, Used, "When set to true, a node will join the token ring. When set to false, a node will not join the token ring. User can use nodetool join to initiate ring joinging later. Same as -Dcassandra.join_ring in cassandra.") \
     val(load_ring_state, bool, true, Used, "When set to true, load tokens and host_ids previously saved. Same as -Dcassandra.load_ring_state in cassandra.") \
@@ -722,6 +744,12 @@ class config : public utils::config_file {
     val(enable_keyspace_column_family_metrics, bool, false, Used, "Enable per keyspace and per column family metrics reporting") \
     val(enable_sstable_data_integrity_check, bool, false, Used, "Enable interposer which checks for integrity of every sstable write." \
         " Performance is affected to some extent as a result. Useful to help debugging problems that may arise at another layers.") \
+    val(sstable_blocked_bloom_filter, bool, false, Used, "Write sstable bloom filters in the cache-line blocked format, which checks a key with a single memory access. " \
+        "Sstables written this way cannot be read as having a usable filter by versions which don't support the format.") \
+    val(sstable_load_concurrency, uint32_t, 16, Used, "Maximum number of sstables each shard loads from disk concurrently at startup and on refresh.") \
+    val(lazy_sstable_filter_loading, bool, true, Used, "Don't read sstable bloom filters when opening sstables at startup, but when they are first needed. " \
+        "Until its filter is loaded, an sstable is considered to contain every partition key.") \
+    val(sstable_filter_warmup, bool, true, Used, "When lazy_sstable_filter_loading is enabled, load all bloom filters in the background once sstables are opened.") \
     /* done! */
 
 #define _make_value_member(name, type, deflt, status, desc, ...)    \
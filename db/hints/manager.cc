@@ -0,0 +1,573 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <seastar/core/future-util.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/semaphore.hh>
+#include <boost/range/adaptor/map.hpp>
+#include <boost/range/algorithm/find.hpp>
+
+#include "db/hints/manager.hh"
+#include "db/config.hh"
+#include "db/commitlog/commitlog_entry.hh"
+#include "database.hh"
+#include "converting_mutation_partition_applier.hh"
+#include "disk-error-handler.hh"
+#include "checked-file-impl.hh"
+#include "gms/gossiper.hh"
+#include "lister.hh"
+#include "log.hh"
+#include "service/storage_proxy.hh"
+#include "service/storage_service.hh"
+#include "utils/rate_limiter.hh"
+
+namespace db {
+namespace hints {
+
+static logging::logger hlogger("hints_manager");
+
+const std::chrono::seconds manager::hints_flush_period = std::chrono::seconds(10);
+
+static constexpr uint64_t hints_segment_size_in_mb = 32;
+// Maximum number of hints being sent to one endpoint at a time.
+static constexpr size_t max_hints_send_concurrency = 16;
+// All hints are accounted under this id in the hints commitlogs, so that a
+// delivered segment is released with a single discard_completed_segments().
+static const utils::UUID hints_cf_id;
+
+// Thrown to abort sending a segment.
+class hints_delivery_aborted : public std::runtime_error {
+public:
+    hints_delivery_aborted() : std::runtime_error("hints delivery aborted") {}
+};
+
+manager::end_point_hints_manager::end_point_hints_manager(gms::inet_address ep, manager& m)
+    : _ep(ep)
+    , _manager(m)
+    , _hints_dir(m.hints_dir_for(ep))
+{ }
+
+future<> manager::end_point_hints_manager::start() {
+    return with_lock(_file_update_lock.for_write(), [this] {
+        return io_check(recursive_touch_directory, _hints_dir).then([this] {
+            return create_hints_store();
+        });
+    });
+}
+
+future<> manager::end_point_hints_manager::stop() {
+    _stopping = true;
+    return _gate.close().then([this] {
+        return with_lock(_file_update_lock.for_write(), [this] {
+            if (!_hints_store) {
+                return make_ready_future<>();
+            }
+            return _hints_store->shutdown().then([this] {
+                return _hints_store->release();
+            }).finally([this] {
+                _hints_store = stdx::nullopt;
+            });
+        });
+    });
+}
+
+// Must be called with _file_update_lock held for write.
+future<> manager::end_point_hints_manager::create_hints_store() {
+    commitlog::config cfg;
+    cfg.commit_log_location = _hints_dir;
+    cfg.commitlog_segment_size_in_mb = hints_segment_size_in_mb;
+    cfg.commitlog_sync_period_in_ms = std::chrono::duration_cast<std::chrono::milliseconds>(hints_flush_period).count();
+    cfg.max_reserve_segments = 0;
+    cfg.metrics_category_name = "";
+    return commitlog::create_commitlog(std::move(cfg)).then([this] (commitlog cl) {
+        for (auto&& fname : cl.get_segments_to_replay()) {
+            if (boost::range::find(_segments_to_replay, fname) == _segments_to_replay.end()) {
+                _segments_to_replay.push_back(std::move(fname));
+            }
+        }
+        _hints_store.emplace(std::move(cl));
+    });
+}
+
+bool manager::end_point_hints_manager::store_hint(schema_ptr s, lw_shared_ptr<const frozen_mutation> fm) noexcept {
+    if (_stopping) {
+        ++_stats.not_stored;
+        ++_manager._stats.dropped;
+        return false;
+    }
+    try {
+        ++_hints_in_progress;
+        ++_manager._hints_in_progress;
+        _dirty = true;
+        with_gate(_gate, [this, s = std::move(s), fm = std::move(fm)] () mutable {
+            return with_lock(_file_update_lock.for_read(), [this, s = std::move(s), fm = std::move(fm)] () mutable {
+                if (!_hints_store) {
+                    return make_exception_future<>(std::runtime_error(sprint("hints store for %s is not available", _ep)));
+                }
+                commitlog_entry_writer cew(s, *fm);
+                return _hints_store->add_entry(hints_cf_id, cew, commitlog::timeout_clock::time_point::max()).then([this, fm] (rp_handle rh) {
+                    // Keeps the segment dirty, and thus on disk, until its hints are sent.
+                    auto id = rh.rp().id;
+                    _segment_hints[id].put(std::move(rh));
+                });
+            });
+        }).then_wrapped([this] (future<> f) {
+            if (f.failed()) {
+                ++_stats.not_stored;
+                ++_manager._stats.errors;
+                hlogger.debug("Failed to store a hint for {}: {}", _ep, f.get_exception());
+            } else {
+                ++_stats.created;
+                ++_manager._stats.written;
+            }
+            --_hints_in_progress;
+            --_manager._hints_in_progress;
+        });
+        return true;
+    } catch (...) {
+        --_hints_in_progress;
+        --_manager._hints_in_progress;
+        ++_stats.not_stored;
+        ++_manager._stats.errors;
+        hlogger.debug("Failed to store a hint for {}: {}", _ep, std::current_exception());
+        return false;
+    }
+}
+
+// Closes the segment being written to, so that segments written so far become available for replay.
+future<> manager::end_point_hints_manager::flush_current_hints() {
+    return with_lock(_file_update_lock.for_write(), [this] {
+        if (!_dirty || !_hints_store) {
+            return make_ready_future<>();
+        }
+        _dirty = false;
+        return _hints_store->force_new_active_segment().then([this] {
+            // No hint is being written, so all segments which still hold hints are closed.
+            for (auto&& fname : _hints_store->get_active_segment_names()) {
+                if (boost::range::find(_segments_to_replay, fname) == _segments_to_replay.end()) {
+                    _segments_to_replay.push_back(std::move(fname));
+                }
+            }
+        });
+    });
+}
+
+void manager::end_point_hints_manager::flush_and_send() noexcept {
+    if (_sending || _stopping) {
+        return;
+    }
+    _sending = true;
+    with_gate(_gate, [this] {
+        return flush_current_hints().then([this] {
+            if (_manager._delivery_paused || !gms::get_local_gossiper().is_alive(_ep)) {
+                return make_ready_future<>();
+            }
+            return send_hints();
+        }).handle_exception([this] (std::exception_ptr eptr) {
+            hlogger.warn("Failed to deliver hints to {}: {}", _ep, eptr);
+        }).finally([this] {
+            _sending = false;
+        });
+    }).handle_exception([] (std::exception_ptr) {
+        // The gate is closed, we're stopping.
+    });
+}
+
+future<> manager::end_point_hints_manager::send_hints() {
+    return repeat([this] {
+        if (_segments_to_replay.empty() || _stopping || _manager._delivery_paused || !gms::get_local_gossiper().is_alive(_ep)) {
+            return make_ready_future<stop_iteration>(stop_iteration::yes);
+        }
+        auto fname = _segments_to_replay.front();
+        return send_one_segment(fname).then([this, fname] (bool done) {
+            if (!done) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            if (!_segments_to_replay.empty() && _segments_to_replay.front() == fname) {
+                _segments_to_replay.pop_front();
+            }
+            hlogger.debug("Sent all hints in {}", fname);
+            return remove_segment(fname).then([] {
+                return stop_iteration::no;
+            });
+        });
+    });
+}
+
+future<> manager::end_point_hints_manager::remove_segment(const sstring& fname) {
+    auto it = _segment_hints.find(commitlog::descriptor(fname).id);
+    if (it != _segment_hints.end()) {
+        // The commitlog deletes the segment once it no longer holds hints.
+        if (_hints_store) {
+            _hints_store->discard_completed_segments(hints_cf_id, it->second);
+        }
+        _segment_hints.erase(it);
+        return make_ready_future<>();
+    }
+    // Left over by a previous run, the commitlog doesn't know about it.
+    return io_check(remove_file, fname).handle_exception([fname] (std::exception_ptr eptr) {
+        // Could have been removed by truncate().
+        hlogger.debug("Failed to remove {}: {}", fname, eptr);
+    });
+}
+
+future<bool> manager::end_point_hints_manager::send_one_segment(sstring fname) {
+    struct send_state {
+        semaphore sem{max_hints_send_concurrency};
+        bool failed = false;
+        std::unordered_map<table_schema_version, column_mapping> column_mappings;
+        utils::rate_limiter limiter;
+        gc_clock::time_point written_at;
+
+        send_state(size_t rate) : limiter(rate) { }
+    };
+
+    auto& db = _manager._db;
+    auto state = make_lw_shared<send_state>(_manager.max_send_rate());
+    return open_checked_file_dma(general_disk_error_handler, fname, open_flags::ro).then([] (file f) {
+        return f.stat().finally([f] () mutable {
+            return f.close().finally([f] {});
+        });
+    }).then([this, fname, state, &db] (struct stat st) {
+        // Segments aren't written to after they are closed, so the modification
+        // time is an upper bound on when any of its hints was written.
+        state->written_at = gc_clock::time_point(std::chrono::seconds(st.st_mtime));
+        return commitlog::read_log_file(fname, [this, fname, state, &db] (temporary_buffer<char> buf, replay_position rp) {
+            if (_stopping || state->failed || _segments_to_replay.empty() || _segments_to_replay.front() != fname
+                    || !gms::get_local_gossiper().is_alive(_ep)) {
+                return make_exception_future<>(hints_delivery_aborted());
+            }
+            try {
+                commitlog_entry_reader cer(buf);
+                auto& fm = cer.mutation();
+
+                auto cm_it = state->column_mappings.find(fm.schema_version());
+                if (cm_it == state->column_mappings.end()) {
+                    if (!cer.get_column_mapping()) {
+                        throw std::runtime_error(sprint("unknown schema version %s", fm.schema_version()));
+                    }
+                    cm_it = state->column_mappings.emplace(fm.schema_version(), *cer.get_column_mapping()).first;
+                }
+                const column_mapping& cm = cm_it->second;
+
+                schema_ptr s;
+                try {
+                    s = db.find_schema(fm.column_family_id());
+                } catch (no_such_column_family&) {
+                    ++_manager._stats.discarded;
+                    return make_ready_future<>();
+                }
+
+                // Delivering a hint older than gc_grace_seconds could resurrect data
+                // whose tombstones were already purged.
+                if (state->written_at + s->gc_grace_seconds() < gc_clock::now()) {
+                    ++_manager._stats.discarded;
+                    return make_ready_future<>();
+                }
+
+                mutation m(fm.decorated_key(*s), s);
+                if (s->version() == fm.schema_version()) {
+                    m.partition().apply(*s, fm.partition(), *s);
+                } else {
+                    converting_mutation_partition_applier v(cm, *s, m.partition());
+                    fm.partition().accept(cm, v);
+                }
+
+                auto size = buf.size();
+                return state->limiter.reserve(size).then([state] {
+                    return state->sem.wait();
+                }).then([this, state, m = std::move(m)] () mutable {
+                    // Sent in the background, at most max_hints_send_concurrency at a time.
+                    send_one_hint(std::move(m)).then_wrapped([this, state] (future<> f) {
+                        if (f.failed()) {
+                            state->failed = true;
+                            ++_manager._stats.send_errors;
+                            hlogger.debug("Failed to send a hint to {}: {}", _ep, f.get_exception());
+                        } else {
+                            ++_manager._stats.sent;
+                        }
+                        state->sem.signal();
+                    });
+                });
+            } catch (...) {
+                ++_manager._stats.discarded;
+                hlogger.warn("Discarding a corrupted hint for {} at {} in {}: {}", _ep, rp, fname, std::current_exception());
+                return make_ready_future<>();
+            }
+        }).then([] (auto s) {
+            auto f = s->done();
+            return f.finally([s = std::move(s)] {});
+        }).then_wrapped([this, fname, state] (future<> f) {
+            try {
+                f.get();
+            } catch (hints_delivery_aborted&) {
+                state->failed = true;
+            } catch (commitlog::segment_data_corruption_error& e) {
+                hlogger.warn("Segment {} is corrupted, {} bytes of hints for {} were lost", fname, e.bytes(), _ep);
+            } catch (...) {
+                state->failed = true;
+                hlogger.warn("Failed to read hints from {}: {}", fname, std::current_exception());
+            }
+            // Wait for the hints which are still being sent.
+            return state->sem.wait(max_hints_send_concurrency).then([state] {
+                return !state->failed;
+            });
+        });
+    });
+}
+
+future<> manager::end_point_hints_manager::send_one_hint(mutation m) {
+    auto& ks = _manager._db.find_keyspace(m.schema()->ks_name());
+    auto natural_endpoints = ks.get_replication_strategy().get_natural_endpoints(m.token());
+    if (boost::range::find(natural_endpoints, _ep) != natural_endpoints.end()) {
+        return _manager._proxy->send_to_endpoint(std::move(m), _ep, db::write_type::SIMPLE);
+    }
+    // The endpoint no longer owns the data. Write it to the current replicas
+    // instead, which may include pending ones. As for the original write, the
+    // replicas which don't acknowledge it get a hint of their own. Counter
+    // mutations in hints are already replicated shards, not updates, and
+    // can't be hinted at CL=ANY.
+    auto raw_counters = m.schema()->is_counter();
+    auto cl = raw_counters ? db::consistency_level::ONE : db::consistency_level::ANY;
+    return _manager._proxy->mutate({std::move(m)}, cl, nullptr, raw_counters);
+}
+
+future<> manager::end_point_hints_manager::truncate() {
+    return with_lock(_file_update_lock.for_write(), [this] {
+        _segments_to_replay.clear();
+        _segment_hints.clear();
+        auto f = make_ready_future<>();
+        if (_hints_store) {
+            f = _hints_store->shutdown().then([this] {
+                return _hints_store->release();
+            });
+        }
+        return f.then([this] {
+            _hints_store = stdx::nullopt;
+            _dirty = false;
+            return lister::scan_dir(_hints_dir, { directory_entry_type::regular }, [] (lister::path dir, directory_entry de) {
+                return io_check(remove_file, (dir / de.name.c_str()).native());
+            });
+        }).then([this] {
+            return create_hints_store();
+        });
+    });
+}
+
+manager::manager(const db::config& cfg, database& db)
+    : _hints_dir(sprint("%s/%d", cfg.hints_directory(), engine().cpu_id()))
+    , _throttle_in_kb(cfg.hinted_handoff_throttle_in_kb())
+    , _max_hint_window(cfg.max_hint_window_in_ms())
+    , _db(db)
+    , _timer([this] { on_timer(); })
+{
+    namespace sm = seastar::metrics;
+
+    _metrics.add_group("hints_manager", {
+        sm::make_queue_length("size_of_hints_in_progress", _hints_in_progress,
+                        sm::description("Number of hints which are being written to disk.")),
+
+        sm::make_derive("written", _stats.written,
+                        sm::description("Number of successfully written hints.")),
+
+        sm::make_derive("errors", _stats.errors,
+                        sm::description("Number of hints which failed to be written.")),
+
+        sm::make_derive("dropped", _stats.dropped,
+                        sm::description("Number of hints which were not written because the manager is stopping.")),
+
+        sm::make_derive("sent", _stats.sent,
+                        sm::description("Number of hints delivered to their endpoints.")),
+
+        sm::make_derive("discarded", _stats.discarded,
+                        sm::description("Number of hints which were not delivered because their table was dropped, "
+                                        "they were older than gc_grace_seconds or they were corrupted.")),
+
+        sm::make_derive("send_errors", _stats.send_errors,
+                        sm::description("Number of hints which failed to be delivered and will be retried.")),
+    });
+}
+
+manager::~manager() {
+    assert(_ep_managers.empty());
+}
+
+future<> manager::start(shared_ptr<service::storage_proxy> proxy) {
+    _proxy = std::move(proxy);
+    return io_check(recursive_touch_directory, _hints_dir).then([this] {
+        return load_ep_managers();
+    }).then([this] {
+        _started = true;
+        service::get_local_storage_service().register_subscriber(this);
+        _timer.arm(clock_type::now() + hints_flush_period);
+    });
+}
+
+future<> manager::stop() {
+    if (_started) {
+        service::get_local_storage_service().unregister_subscriber(this);
+    }
+    _started = false;
+    _timer.cancel();
+    return _gate.close().then([this] {
+        return parallel_for_each(_ep_managers | boost::adaptors::map_values, [] (auto& ep_man) {
+            return ep_man->stop();
+        });
+    }).then([this] {
+        _ep_managers.clear();
+    });
+}
+
+future<> manager::load_ep_managers() {
+    return lister::scan_dir(_hints_dir, { directory_entry_type::directory }, [this] (lister::path dir, directory_entry de) {
+        gms::inet_address ep;
+        try {
+            ep = gms::inet_address(de.name);
+        } catch (...) {
+            hlogger.warn("Ignoring {}/{}, which is not named after an endpoint", dir.native(), de.name);
+            return make_ready_future<>();
+        }
+        hlogger.debug("Loading hints for {}", ep);
+        auto ep_man = std::make_unique<end_point_hints_manager>(ep, *this);
+        auto f = ep_man->start();
+        _ep_managers.emplace(ep, std::move(ep_man));
+        return f;
+    });
+}
+
+sstring manager::hints_dir_for(gms::inet_address ep) const {
+    return sprint("%s/%s", _hints_dir, ep);
+}
+
+// Bytes per second this shard may send to one endpoint. As for the batchlog,
+// the configured throttle is shared by the nodes which may be delivering hints
+// to the same endpoint at the same time.
+size_t manager::max_send_rate() const {
+    auto nodes = service::get_local_storage_service().get_token_metadata().get_all_endpoints().size();
+    auto senders = std::max<size_t>(nodes, 2) - 1;
+    return std::max<size_t>(size_t(_throttle_in_kb) * 1024 / senders / smp::count, 1);
+}
+
+manager::end_point_hints_manager& manager::get_ep_manager(gms::inet_address ep) {
+    auto it = _ep_managers.find(ep);
+    if (it != _ep_managers.end()) {
+        return *it->second;
+    }
+    auto& ep_man = *_ep_managers.emplace(ep, std::make_unique<end_point_hints_manager>(ep, *this)).first->second;
+    // Takes the file update lock right away, so writes wait until the store is ready.
+    with_gate(_gate, [&ep_man] {
+        return ep_man.start();
+    }).handle_exception([ep] (std::exception_ptr eptr) {
+        hlogger.error("Failed to create the hints store for {}: {}", ep, eptr);
+    });
+    return ep_man;
+}
+
+bool manager::can_hint_for(gms::inet_address ep) const noexcept {
+    if (!_started) {
+        return false;
+    }
+    // Stop hinting for an endpoint which has been down for too long. It will
+    // need a repair anyway.
+    auto downtime = std::chrono::microseconds(gms::get_local_gossiper().get_endpoint_downtime(ep));
+    return downtime <= _max_hint_window;
+}
+
+size_t manager::hints_in_progress_for(gms::inet_address ep) const {
+    auto it = _ep_managers.find(ep);
+    return it == _ep_managers.end() ? 0 : it->second->hints_in_progress();
+}
+
+bool manager::store_hint(gms::inet_address ep, schema_ptr s, lw_shared_ptr<const frozen_mutation> fm) noexcept {
+    if (!_started) {
+        ++_stats.dropped;
+        return false;
+    }
+    try {
+        return get_ep_manager(ep).store_hint(std::move(s), std::move(fm));
+    } catch (...) {
+        ++_stats.errors;
+        hlogger.debug("Failed to store a hint for {}: {}", ep, std::current_exception());
+        return false;
+    }
+}
+
+void manager::on_timer() {
+    auto& gossiper = gms::get_local_gossiper();
+    for (auto&& e : _ep_managers) {
+        // Endpoints which are down are taken care of by on_up().
+        if (e.second->has_pending_hints() && gossiper.is_alive(e.first)) {
+            e.second->flush_and_send();
+        }
+    }
+    if (_started) {
+        _timer.arm(clock_type::now() + hints_flush_period);
+    }
+}
+
+void manager::schedule_delivery(gms::inet_address ep) {
+    auto it = _ep_managers.find(ep);
+    if (it != _ep_managers.end()) {
+        it->second->flush_and_send();
+    }
+}
+
+void manager::on_up(const gms::inet_address& endpoint) {
+    schedule_delivery(endpoint);
+}
+
+std::vector<gms::inet_address> manager::endpoints_pending_hints() const {
+    std::vector<gms::inet_address> eps;
+    for (auto&& e : _ep_managers) {
+        if (e.second->has_pending_hints()) {
+            eps.push_back(e.first);
+        }
+    }
+    return eps;
+}
+
+future<> manager::truncate_hints(stdx::optional<gms::inet_address> ep) {
+    return with_gate(_gate, [this, ep] {
+        if (ep) {
+            auto it = _ep_managers.find(*ep);
+            if (it == _ep_managers.end()) {
+                return make_ready_future<>();
+            }
+            return it->second->truncate();
+        }
+        return parallel_for_each(_ep_managers | boost::adaptors::map_values, [] (auto& ep_man) {
+            return ep_man->truncate();
+        });
+    });
+}
+
+uint64_t manager::created_hints_count(gms::inet_address ep) const {
+    auto it = _ep_managers.find(ep);
+    return it == _ep_managers.end() ? 0 : it->second->get_stats().created;
+}
+
+uint64_t manager::not_stored_hints_count(gms::inet_address ep) const {
+    auto it = _ep_managers.find(ep);
+    return it == _ep_managers.end() ? 0 : it->second->get_stats().not_stored;
+}
+
+}
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <seastar/core/future.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/rwlock.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/core/metrics_registration.hh>
+
+#include "db/commitlog/commitlog.hh"
+#include "db/commitlog/rp_set.hh"
+#include "frozen_mutation.hh"
+#include "mutation.hh"
+#include "gms/inet_address.hh"
+#include "schema.hh"
+#include "service/endpoint_lifecycle_subscriber.hh"
+#include "stdx.hh"
+
+class database;
+
+namespace service {
+class storage_proxy;
+}
+
+namespace db {
+
+class config;
+
+namespace hints {
+
+// Stores hints, i.e. writes which some replica didn't acknowledge, and
+// delivers them once the replica is back up.
+//
+// There is one manager per shard. Hints for each endpoint are appended to a
+// commitlog of their own, in <hints_directory>/<shard>/<endpoint>. Before
+// delivering, the segment being written to is closed, so that all segments
+// written so far can be replayed. Segments are deleted once all their hints
+// have been delivered.
+//
+// Delivery starts when gossip marks the endpoint up. Every hints_flush_period
+// it is also retried for the endpoints which are up and still have hints, e.g.
+// because they were only overloaded or because a delivery failed.
+class manager : public service::endpoint_lifecycle_subscriber {
+public:
+    using clock_type = lowres_clock;
+    static const std::chrono::seconds hints_flush_period;
+
+    struct stats {
+        uint64_t written = 0;
+        uint64_t errors = 0;
+        uint64_t dropped = 0;
+        uint64_t sent = 0;
+        uint64_t discarded = 0;
+        uint64_t send_errors = 0;
+    };
+private:
+    class end_point_hints_manager {
+    public:
+        struct stats {
+            uint64_t created = 0;
+            uint64_t not_stored = 0;
+        };
+    private:
+        gms::inet_address _ep;
+        manager& _manager;
+        sstring _hints_dir;
+        stdx::optional<commitlog> _hints_store;
+        // Held for read by writers, for write when the segment being written
+        // to is closed or the commitlog is reopened.
+        rwlock _file_update_lock;
+        // Segments which are no longer written to, oldest first.
+        std::list<sstring> _segments_to_replay;
+        // Hints in each segment of _hints_store. They keep the segment on disk
+        // until they are delivered.
+        std::unordered_map<segment_id_type, rp_set> _segment_hints;
+        seastar::gate _gate;
+        stats _stats;
+        size_t _hints_in_progress = 0;
+        bool _sending = false;
+        // Set when hints were written to the segment being written to.
+        bool _dirty = false;
+        bool _stopping = false;
+    public:
+        end_point_hints_manager(gms::inet_address ep, manager& m);
+        end_point_hints_manager(end_point_hints_manager&&) = delete;
+
+        future<> start();
+        future<> stop();
+
+        // Returns false if the hint wasn't accepted for storing.
+        bool store_hint(schema_ptr s, lw_shared_ptr<const frozen_mutation> fm) noexcept;
+
+        // Makes hints written so far available for delivery and delivers
+        // them. Does nothing if a delivery is already in progress.
+        void flush_and_send() noexcept;
+
+        // Removes all hints.
+        future<> truncate();
+
+        bool has_pending_hints() const {
+            return !_segments_to_replay.empty() || _dirty;
+        }
+        size_t hints_in_progress() const { return _hints_in_progress; }
+        const stats& get_stats() const { return _stats; }
+        stats& get_stats() { return _stats; }
+    private:
+        future<> create_hints_store();
+        future<> flush_current_hints();
+        future<> send_hints();
+        // Deletes a segment whose hints were all sent or discarded.
+        future<> remove_segment(const sstring& fname);
+        // Returns true if all hints in the segment were sent or discarded.
+        future<bool> send_one_segment(sstring fname);
+        future<> send_one_hint(mutation m);
+    };
+
+    sstring _hints_dir;
+    uint32_t _throttle_in_kb;
+    std::chrono::milliseconds _max_hint_window;
+    shared_ptr<service::storage_proxy> _proxy;
+    database& _db;
+    std::unordered_map<gms::inet_address, std::unique_ptr<end_point_hints_manager>> _ep_managers;
+    timer<clock_type> _timer;
+    seastar::gate _gate;
+    stats _stats;
+    size_t _hints_in_progress = 0;
+    seastar::metrics::metric_groups _metrics;
+    bool _started = false;
+    bool _delivery_paused = false;
+public:
+    manager(const db::config& cfg, database& db);
+    manager(manager&&) = delete;
+    ~manager();
+
+    // Loads hints left on disk and starts delivering them.
+    future<> start(shared_ptr<service::storage_proxy> proxy);
+    future<> stop();
+
+    bool started() const { return _started; }
+
+    // Returns true if a hint for ep should be stored.
+    bool can_hint_for(gms::inet_address ep) const noexcept;
+
+    // Number of hints which are being written to disk.
+    size_t hints_in_progress() const {
+        return _hints_in_progress;
+    }
+    size_t hints_in_progress_for(gms::inet_address ep) const;
+
+    // Stores the hint in the background. Returns false if it wasn't accepted.
+    bool store_hint(gms::inet_address ep, schema_ptr s, lw_shared_ptr<const frozen_mutation> fm) noexcept;
+
+    std::vector<gms::inet_address> endpoints_pending_hints() const;
+
+    // Removes hints for given endpoint, or for all endpoints if none is given.
+    future<> truncate_hints(stdx::optional<gms::inet_address> ep = stdx::nullopt);
+
+    // Delivers hints for ep now rather than at the next flush period.
+    void schedule_delivery(gms::inet_address ep);
+
+    void pause_delivery(bool paused) {
+        _delivery_paused = paused;
+    }
+    bool delivery_paused() const {
+        return _delivery_paused;
+    }
+
+    uint64_t created_hints_count(gms::inet_address ep) const;
+    uint64_t not_stored_hints_count(gms::inet_address ep) const;
+
+    const stats& get_stats() const { return _stats; }
+
+    virtual void on_join_cluster(const gms::inet_address& endpoint) override { }
+    virtual void on_leave_cluster(const gms::inet_address& endpoint) override { }
+    virtual void on_up(const gms::inet_address& endpoint) override;
+    virtual void on_down(const gms::inet_address& endpoint) override { }
+    virtual void on_move(const gms::inet_address& endpoint) override { }
+private:
+    end_point_hints_manager& get_ep_manager(gms::inet_address ep);
+    future<> load_ep_managers();
+    void on_timer();
+    sstring hints_dir_for(gms::inet_address ep) const;
+    size_t max_send_rate() const;
+};
+
+}
+}
@@ -161,6 +161,33 @@ schema_ptr batchlog() {
     return batchlog;
 }
 
+// Batches are stored in partitions per coordinator shard and time bucket,
+// ordered by the time they were written. Once a bucket has ended and all its
+// batches are replayed or deleted by their coordinators, the replay deletes
+// the whole bucket with a partition tombstone.
+schema_ptr batchlog_v2() {
+    static thread_local auto batchlog_v2 = [] {
+        schema_builder builder(make_lw_shared(schema(generate_legacy_id(NAME, BATCHLOG_V2), NAME, BATCHLOG_V2,
+        // partition key
+        {{"shard", int32_type}, {"bucket", timestamp_type}},
+        // clustering key
+        {{"written_at", timestamp_type}, {"id", uuid_type}},
+        // regular columns
+        {{"data", bytes_type}, {"version", int32_type}},
+        // static columns
+        {},
+        // regular column name type
+        utf8_type,
+        // comment
+        "batches awaiting replay, by coordinator shard and time bucket"
+       )));
+       builder.set_gc_grace_seconds(0);
+       builder.with_version(generate_schema_version(builder.uuid()));
+       return builder.build(schema_builder::compact_storage::no);
+    }();
+    return batchlog_v2;
+}
+
 /*static*/ schema_ptr paxos() {
     static thread_local auto paxos = [] {
         schema_builder builder(make_lw_shared(schema(generate_legacy_id(NAME, PAXOS), NAME, PAXOS,
@@ -1536,7 +1563,7 @@ std::vector<schema_ptr> all_tables() {
     std::vector<schema_ptr> r;
     auto schema_tables = db::schema_tables::all_tables();
     std::copy(schema_tables.begin(), schema_tables.end(), std::back_inserter(r));
-    r.insert(r.end(), { built_indexes(), hints(), batchlog(), paxos(), local(),
+    r.insert(r.end(), { built_indexes(), hints(), batchlog(), batchlog_v2(), paxos(), local(),
                     peers(), peer_events(), range_xfers(),
                     compactions_in_progress(), compaction_history(),
                     sstable_activity(), size_estimates(),
@@ -1559,7 +1586,7 @@ static void maybe_add_virtual_reader(schema_ptr s, database& db) {
 }
 
 static bool maybe_write_in_user_memory(schema_ptr s, database& db) {
-    return (s.get() == batchlog().get());
+    return (s.get() == batchlog().get()) || (s.get() == batchlog_v2().get());
 }
 
 void make(database& db, bool durable, bool volatile_testing_only) {
@@ -70,6 +70,7 @@ namespace system_keyspace {
 static constexpr auto NAME = "system";
 static constexpr auto HINTS = "hints";
 static constexpr auto BATCHLOG = "batchlog";
+static constexpr auto BATCHLOG_V2 = "batchlog_v2";
 static constexpr auto PAXOS = "paxos";
 static constexpr auto BUILT_INDEXES = "IndexInfo";
 static constexpr auto LOCAL = "local";
@@ -120,6 +121,7 @@ struct range_estimates {
 
 extern schema_ptr hints();
 extern schema_ptr batchlog();
+extern schema_ptr batchlog_v2();
 extern schema_ptr built_indexes(); // TODO (from Cassandra): make private
 
 namespace legacy {
@@ -56,7 +56,7 @@ boost::multiprecision::cpp_int cppint_token(const token& t) {
 
     // If the token is minimum token, token._data will be empty,
     // zero will be returned
-    for (uint8_t d : t._data) {
+    for (uint8_t d : t.data()) {
         ret = (ret << 8) + d;
     }
 
@@ -78,7 +78,7 @@ std::map<token, float> byte_ordered_partitioner::describe_ownership(const std::v
     } else {
         unsigned sigbits = 0;
         for (auto const& t : sorted_tokens) {
-            sigbits = std::max(sigbits, t._data.size() * 8);
+            sigbits = std::max(sigbits, unsigned(t.data().size() * 8));
         }
 
         const token& start = sorted_tokens[0];
@@ -99,7 +99,7 @@ std::map<token, float> byte_ordered_partitioner::describe_ownership(const std::v
 }
 
 token byte_ordered_partitioner::midpoint(const token& t1, const token& t2) const {
-    unsigned sigbytes = std::max(t1._data.size(), t2._data.size());
+    unsigned sigbytes = std::max(t1.data().size(), t2.data().size());
     if (sigbytes == 0) {
         // The midpoint of two minimum token is minimum token
         return minimum_token();
@@ -142,7 +142,7 @@ token byte_ordered_partitioner::midpoint(const token& t1, const token& t2) const
     }
     // now t = 0x00 0x12 0x34 0x56 0x80
 
-    return token(token::kind::key, managed_bytes(t.data(), t.size()));
+    return token(token::kind::key, bytes_view(t.data(), t.size()));
 }
 
 unsigned
@@ -153,11 +153,11 @@ byte_ordered_partitioner::shard_of(const token& t) const {
         case token::kind::after_all_keys:
             return _shard_count - 1;
         case token::kind::key:
-            if (t._data.empty()) {
+            if (t.data().empty()) {
                 return 0;
             }
             // treat first byte as a fraction in the range [0, 1) and divide it evenly:
-            return (uint8_t(t._data[0]) * _shard_count) >> 8;
+            return (uint8_t(t.data()[0]) * _shard_count) >> 8;
     }
     abort();
 }
@@ -174,7 +174,7 @@ byte_ordered_partitioner::token_for_next_shard(const token& t, shard_id shard, u
             return maximum_token();
         }
         auto e = div_ceil(shard << 8, _shard_count);
-        return token(token::kind::key, managed_bytes({int8_t(e)}));
+        return token(token::kind::key, bytes(1, int8_t(e)));
     }
     assert(0);
     throw std::invalid_argument("invalid token");
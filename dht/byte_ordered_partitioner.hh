@@ -48,14 +48,14 @@ class byte_ordered_partitioner final : public i_partitioner {
     virtual std::map<token, float> describe_ownership(const std::vector<token>& sorted_tokens) override;
     virtual data_type get_token_validator() override { return bytes_type; }
     virtual int tri_compare(const token& t1, const token& t2) const override {
-        return compare_unsigned(t1._data, t2._data);
+        return compare_unsigned(t1.data(), t2.data());
     }
     virtual token midpoint(const token& t1, const token& t2) const;
     virtual sstring to_sstring(const dht::token& t) const override {
         if (t._kind == dht::token::kind::before_all_keys) {
             return sstring();
         } else {
-            return to_hex(t._data);
+            return to_hex(t.data());
         }
     }
     virtual dht::token from_sstring(const sstring& t) const override {
@@ -96,7 +96,7 @@ midpoint_unsigned_tokens(const token& t1, const token& t2) {
         return t1;
     }
     // we can ignore beginning-of-range, since their representation is 0.0
-    auto sum_carry = add_bytes(t1._data, t2._data);
+    auto sum_carry = add_bytes(t1.data(), t2.data());
     auto& sum = sum_carry.first;
     // if either was end-of-range, we added 0.0, so pretend we added 1.0 and
     // and got a carry:
@@ -113,33 +113,12 @@ midpoint_unsigned_tokens(const token& t1, const token& t2) {
     return token{token::kind::key, std::move(avg)};
 }
 
-int tri_compare(const token& t1, const token& t2) {
-    if (t1._kind == t2._kind) {
-        return global_partitioner().tri_compare(t1, t2);
-    } else if (t1._kind < t2._kind) {
-        return -1;
+// Compares tokens of the same kind.
+int tri_compare_slow(const token& t1, const token& t2) {
+    if (t1._kind != token::kind::key) {
+        return 0;
     }
-    return 1;
-}
-
-bool operator==(const token& t1, const token& t2)
-{
-    if (t1._kind != t2._kind) {
-        return false;
-    } else if (t1._kind == token::kind::key) {
-        return global_partitioner().is_equal(t1, t2);
-    }
-    return true;
-}
-
-bool operator<(const token& t1, const token& t2)
-{
-    if (t1._kind < t2._kind) {
-        return true;
-    } else if (t1._kind == token::kind::key && t2._kind == token::kind::key) {
-        return global_partitioner().is_less(t1, t2);
-    }
-    return false;
+    return global_partitioner().tri_compare(t1, t2);
 }
 
 std::ostream& operator<<(std::ostream& out, const token& t) {
@@ -160,10 +139,14 @@ std::ostream& operator<<(std::ostream& out, const decorated_key& dk) {
 // FIXME: make it per-keyspace
 std::unique_ptr<i_partitioner> default_partitioner;
 
+// The default is murmur3_partitioner.
+bool global_partitioner_has_long_tokens = true;
+
 void set_global_partitioner(const sstring& class_name, unsigned ignore_msb)
 {
     try {
         default_partitioner = create_object<i_partitioner, const unsigned&, const unsigned&>(class_name, smp::count, ignore_msb);
+        global_partitioner_has_long_tokens = default_partitioner->has_long_tokens();
     } catch (std::exception& e) {
         auto supported_partitioners = ::join(", ", class_registry<i_partitioner>::classes() |
                 boost::adaptors::map_keys);
@@ -176,6 +159,7 @@ i_partitioner&
 global_partitioner() {
     if (!default_partitioner) {
         default_partitioner = std::make_unique<murmur3_partitioner>(smp::count, 12);
+        global_partitioner_has_long_tokens = true;
     }
     return *default_partitioner;
 }
@@ -502,6 +486,20 @@ int ring_position_comparator::operator()(sstables::decorated_key_view a, ring_po
     return -(*this)(b, a);
 }
 
+int ring_position_comparator::operator()(ring_position_view lh, sstables::key_view lh_key, sstables::decorated_key_view rh) const {
+    auto token_cmp = tri_compare(*lh._token, rh.token());
+    if (token_cmp) {
+        return token_cmp;
+    }
+    if (lh._key) {
+        auto rel = rh.key().tri_compare(lh_key);
+        if (rel) {
+            return -rel;
+        }
+    }
+    return lh._weight;
+}
+
 dht::partition_range
 to_partition_range(dht::token_range r) {
     using bound_opt = std::experimental::optional<dht::partition_range::bound>;
@@ -554,7 +552,7 @@ split_ranges_to_shards(const dht::token_range_vector& ranges, const schema& s) {
 namespace std {
 
 size_t
-hash<dht::token>::hash_large_token(const managed_bytes& b) const {
+hash<dht::token>::hash_large_token(bytes_view b) const {
     auto read_bytes = boost::irange<size_t>(0, b.size())
             | boost::adaptors::transformed([&b] (size_t idx) { return b[idx]; });
     std::array<uint64_t, 2> result;
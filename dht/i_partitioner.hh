@@ -45,6 +45,7 @@
 #include "types.hh"
 #include "keys.hh"
 #include "utils/managed_bytes.hh"
+#include "net/byteorder.hh"
 #include "stdx.hh"
 #include <memory>
 #include <random>
@@ -88,6 +89,16 @@ class token {
         after_all_keys,
     };
     kind _kind;
+private:
+    // Tokens whose representation is 8 bytes long, which includes all tokens
+    // of murmur3_partitioner, are kept inline in _long_value instead of in
+    // _data. Comparing such tokens doesn't need to go through the partitioner
+    // when its tokens are all integers (see global_partitioner_has_long_tokens).
+    //
+    // _long_value holds the bytes in their big-endian order, so that data()
+    // can return a view of them. long_value() converts them to the integer.
+    bool _has_long_value = false;
+    int64_t _long_value = 0;
     // _data can be interpreted as a big endian binary fraction
     // in the range [0.0, 1.0).
     //
@@ -97,11 +108,41 @@ class token {
     //     [0x00, 0x80] == 1/512
     //     [0xff, 0x80] == 1 - 1/512
     managed_bytes _data;
-
+public:
     token() : _kind(kind::before_all_keys) {
     }
 
-    token(kind k, managed_bytes d) : _kind(std::move(k)), _data(std::move(d)) {
+    token(kind k, bytes_view d) : _kind(std::move(k)) {
+        if (d.size() == sizeof(_long_value)) {
+            _has_long_value = true;
+            std::copy_n(d.begin(), sizeof(_long_value), reinterpret_cast<int8_t*>(&_long_value));
+        } else {
+            _data = managed_bytes(d);
+        }
+    }
+
+    static token from_int64(int64_t v) {
+        token t;
+        t._kind = kind::key;
+        t._has_long_value = true;
+        t._long_value = net::hton(v);
+        return t;
+    }
+
+    bytes_view data() const {
+        if (_has_long_value) {
+            return bytes_view(reinterpret_cast<const int8_t*>(&_long_value), sizeof(_long_value));
+        }
+        return _data;
+    }
+
+    bool has_long_value() const {
+        return _has_long_value;
+    }
+
+    // Valid only if has_long_value().
+    int64_t long_value() const {
+        return net::ntoh(_long_value);
     }
 
     bool is_minimum() const {
@@ -121,12 +162,30 @@ class token {
     }
 };
 
+// Set when all tokens of the global partitioner are 64-bit integers ordered
+// as signed ones, which is the case of murmur3_partitioner, so that tokens can
+// be compared without consulting it.
+extern bool global_partitioner_has_long_tokens;
+
 token midpoint_unsigned(const token& t1, const token& t2);
 const token& minimum_token();
 const token& maximum_token();
-bool operator==(const token& t1, const token& t2);
-bool operator<(const token& t1, const token& t2);
-int tri_compare(const token& t1, const token& t2);
+int tri_compare_slow(const token& t1, const token& t2);
+
+inline int tri_compare(const token& t1, const token& t2) {
+    if (t1._kind != t2._kind) {
+        return t1._kind < t2._kind ? -1 : 1;
+    }
+    if (t1._kind == token::kind::key && t1.has_long_value() && t2.has_long_value() && global_partitioner_has_long_tokens) {
+        auto l1 = t1.long_value();
+        auto l2 = t2.long_value();
+        return l1 == l2 ? 0 : (l1 < l2 ? -1 : 1);
+    }
+    return tri_compare_slow(t1, t2);
+}
+
+inline bool operator==(const token& t1, const token& t2) { return tri_compare(t1, t2) == 0; }
+inline bool operator<(const token& t1, const token& t2) { return tri_compare(t1, t2) < 0; }
 inline bool operator!=(const token& t1, const token& t2) { return std::rel_ops::operator!=(t1, t2); }
 inline bool operator>(const token& t1, const token& t2) { return std::rel_ops::operator>(t1, t2); }
 inline bool operator<=(const token& t1, const token& t2) { return std::rel_ops::operator<=(t1, t2); }
@@ -299,6 +358,22 @@ class i_partitioner {
      */
     virtual unsigned shard_of(const token& t) const = 0;
 
+    /**
+     * @return name of the algorithm used by shard_of(), published to clients
+     * which route requests to shards themselves. Empty if the algorithm is
+     * not published.
+     */
+    virtual sstring sharding_algorithm_name() const {
+        return {};
+    }
+
+    /**
+     * @return number of most significant token bits ignored by shard_of().
+     */
+    virtual unsigned sharding_ignore_msb() const {
+        return 0;
+    }
+
     /**
      * Gets the first token greater than `t` that is in shard `shard`, and is a shard boundary (its first token).
      *
@@ -323,7 +398,8 @@ class i_partitioner {
      * @return bytes that represent the token as required by get_token_validator().
      */
     virtual bytes token_to_bytes(const token& t) const {
-        return bytes(t._data.begin(), t._data.end());
+        auto data = t.data();
+        return bytes(data.begin(), data.end());
     }
 
     /**
@@ -343,6 +419,13 @@ class i_partitioner {
         return tri_compare(t1, t2) < 0;
     }
 
+    /**
+     * @return true if all tokens are 64-bit integers compared as signed ones.
+     */
+    virtual bool has_long_tokens() const {
+        return false;
+    }
+
     /**
      * @return number of shards configured for this partitioner
      */
@@ -350,9 +433,6 @@ class i_partitioner {
         return _shard_count;
     }
 
-    friend bool operator==(const token& t1, const token& t2);
-    friend bool operator<(const token& t1, const token& t2);
-    friend int tri_compare(const token& t1, const token& t2);
 };
 
 //
@@ -571,6 +651,10 @@ struct ring_position_comparator {
     int operator()(ring_position_view, ring_position_view) const;
     int operator()(ring_position_view, sstables::decorated_key_view) const;
     int operator()(sstables::decorated_key_view, ring_position_view) const;
+    // Like operator()(ring_position_view, sstables::decorated_key_view), but takes the key
+    // of the ring position already converted to the sstable format, so that keys are
+    // compared with memcmp.
+    int operator()(ring_position_view, sstables::key_view, sstables::decorated_key_view) const;
 };
 
 // "less" comparator giving the same order as ring_position_comparator
@@ -723,7 +807,7 @@ template<>
 struct hash<dht::token> {
     size_t operator()(const dht::token& t) const {
         size_t ret = 0;
-        const auto& b = t._data;
+        auto b = t.data();
         if (b.size() <= sizeof(ret)) { // practically always
             std::copy_n(b.data(), b.size(), reinterpret_cast<int8_t*>(&ret));
         } else {
@@ -732,7 +816,7 @@ struct hash<dht::token> {
         return ret;
     }
 private:
-    size_t hash_large_token(const managed_bytes& b) const;
+    size_t hash_large_token(bytes_view b) const;
 };
 
 template <>
@@ -81,10 +81,7 @@ murmur3_partitioner::get_token(uint64_t value) const {
     // We don't normalize() the value, since token includes an is-before-everything
     // indicator.
     // FIXME: will this require a repair when importing a database?
-    auto t = net::hton(normalize(value));
-    bytes b(bytes::initialized_later(), 8);
-    std::copy_n(reinterpret_cast<int8_t*>(&t), 8, b.begin());
-    return token{token::kind::key, std::move(b)};
+    return token::from_int64(normalize(value));
 }
 
 token
@@ -110,13 +107,11 @@ inline int64_t long_token(const token& t) {
         return std::numeric_limits<long>::min();
     }
 
-    if (t._data.size() != sizeof(int64_t)) {
-        throw runtime_exception(sprint("Invalid token. Should have size %ld, has size %ld\n", sizeof(int64_t), t._data.size()));
+    if (!t.has_long_value()) {
+        throw runtime_exception(sprint("Invalid token. Should have size %ld, has size %ld\n", sizeof(int64_t), t.data().size()));
     }
 
-    auto ptr = t._data.begin();
-    auto lp = unaligned_cast<const int64_t *>(ptr);
-    return net::ntoh(*lp);
+    return t.long_value();
 }
 
 uint64_t
@@ -42,6 +42,7 @@ class murmur3_partitioner final : public i_partitioner {
     virtual token get_token(const sstables::key_view& key) override;
     virtual token get_random_token() override;
     virtual bool preserves_order() override { return false; }
+    virtual bool has_long_tokens() const override { return true; }
     virtual std::map<token, float> describe_ownership(const std::vector<token>& sorted_tokens) override;
     virtual data_type get_token_validator() override;
     virtual int tri_compare(const token& t1, const token& t2) const override;
@@ -51,6 +52,8 @@ class murmur3_partitioner final : public i_partitioner {
     virtual dht::token from_bytes(bytes_view bytes) const override;
 
     virtual unsigned shard_of(const token& t) const override;
+    virtual sstring sharding_algorithm_name() const override { return "biased-token-round-robin"; }
+    virtual unsigned sharding_ignore_msb() const override { return _sharding_ignore_msb_bits; }
     virtual token token_for_next_shard(const token& t, shard_id shard, unsigned spans) const override;
 private:
     using uint128_t = unsigned __int128;
@@ -35,7 +35,7 @@ static boost::multiprecision::uint128_t token_to_cppint(const token& t) {
     boost::multiprecision::uint128_t ret{0};
     // If the token is minimum token, token._data will be empty,
     // zero will be returned
-    for (uint8_t d : t._data) {
+    for (uint8_t d : t.data()) {
         ret = (ret << 8) + d;
     }
     return ret;
@@ -57,7 +57,7 @@ static token cppint_to_token(boost::multiprecision::uint128_t i) {
         i >>= 8;
     }
     std::reverse(t.begin(), t.end());
-    return token(token::kind::key, managed_bytes(t.data(), t.size()));
+    return token(token::kind::key, bytes_view(t.data(), t.size()));
 }
 
 // Convert a 16 bytes long raw byte array to token. Byte 0 is the most significant byte.
@@ -160,7 +160,7 @@ std::map<token, float> random_partitioner::describe_ownership(const std::vector<
 }
 
 token random_partitioner::midpoint(const token& t1, const token& t2) const {
-    unsigned sigbytes = std::max(t1._data.size(), t2._data.size());
+    unsigned sigbytes = std::max(t1.data().size(), t2.data().size());
     if (sigbytes == 0) {
         // The midpoint of two minimum token is minimum token
         return minimum_token();
@@ -246,11 +246,11 @@ random_partitioner::token_for_next_shard(const token& t, shard_id shard, unsigne
 
 bytes random_partitioner::token_to_bytes(const token& t) const {
     static const bytes zero_byte(1, int8_t(0x00));
-    if (t.is_minimum() || t._data.empty()) {
+    if (t.is_minimum() || t.data().empty()) {
         return zero_byte;
     }
-    auto data = bytes(t._data.begin(), t._data.end());
-    if (t._data[0] & 0x80) {
+    auto data = bytes(t.data().begin(), t.data().end());
+    if (t.data()[0] & 0x80) {
         // Prepend 0x00 to the byte array to mimic BigInteger.toByteArray's
         // byte array representation which has a sign bit.
         return zero_byte + data;
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+namespace query {
+
+struct aggregation_info {
+    sstring function_keyspace;
+    sstring function_name;
+    std::vector<uint32_t> column_indexes;
+};
+
+struct aggregate_request {
+    std::vector<query::aggregation_info> aggregations;
+    std::vector<bytes> column_names;
+    query::read_command cmd;
+    std::vector<nonwrapping_range<dht::ring_position>> ranges;
+    db::consistency_level cl;
+};
+
+struct aggregate_result {
+    std::vector<std::experimental::optional<bytes>> partial_states;
+};
+
+}
@@ -32,6 +32,7 @@ class query_result stub [[writable]] {
 enum class digest_algorithm : uint8_t {
     none = 0,  // digest not required
     MD5 = 1,   // default algorithm
+    xxHash = 2,  // faster non-cryptographic hash, once the cluster supports it
 };
 
 }
@@ -44,6 +44,7 @@
 #include "init.hh"
 #include "release.hh"
 #include "repair/repair.hh"
+#include "repair/row_level.hh"
 #include <cstdio>
 #include <core/file.hh>
 #include <sys/time.h>
@@ -461,11 +462,17 @@ int main(int ac, char** av) {
             dirs.touch_and_lock(db.local().get_config().data_file_directories()).get();
             supervisor::notify("creating commitlog directory");
             dirs.touch_and_lock(db.local().get_config().commitlog_directory()).get();
+            dirs.touch_and_lock(database::system_commitlog_directory(db.local().get_config())).get();
+            if (cfg->hinted_handoff_enabled()) {
+                supervisor::notify("creating hints directory");
+                dirs.touch_and_lock(db.local().get_config().hints_directory()).get();
+            }
             supervisor::notify("verifying data and commitlog directories");
             std::unordered_set<sstring> directories;
             directories.insert(db.local().get_config().data_file_directories().cbegin(),
                     db.local().get_config().data_file_directories().cend());
             directories.insert(db.local().get_config().commitlog_directory());
+            directories.insert(database::system_commitlog_directory(db.local().get_config()));
             parallel_for_each(directories, [&db] (sstring pathname) {
                 return disk_sanity(pathname, db.local().get_config().developer_mode());
             }).get();
@@ -554,6 +561,8 @@ int main(int ac, char** av) {
             auto cl = db.local().commitlog();
             if (cl != nullptr) {
                 auto paths = cl->get_segments_to_replay();
+                auto system_paths = db.local().system_commitlog()->get_segments_to_replay();
+                paths.insert(paths.end(), system_paths.begin(), system_paths.end());
                 if (!paths.empty()) {
                     supervisor::notify("replaying commit log");
                     auto rp = db::commitlog_replayer::create_replayer(qp).get0();
@@ -612,6 +621,7 @@ int main(int ac, char** av) {
                         return checksum_range(db, keyspace, cf, range, hv);
                     });
                 });
+                row_level_repair_init_messaging_service_handler(db);
             }).get();
             supervisor::notify("starting storage service", true);
             auto& ss = service::get_local_storage_service();
@@ -622,6 +632,12 @@ int main(int ac, char** av) {
             db::get_batchlog_manager().invoke_on_all([] (db::batchlog_manager& b) {
                 return b.start();
             }).get();
+            if (cfg->hinted_handoff_enabled()) {
+                supervisor::notify("starting hints manager");
+                proxy.invoke_on_all([] (service::storage_proxy& p) {
+                    return p.start_hints_manager();
+                }).get();
+            }
             supervisor::notify("starting load broadcaster");
             // should be unique_ptr, but then lambda passed to at_exit will be non copieable and
             // casting to std::function<> will fail to compile
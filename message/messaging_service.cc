@@ -53,8 +53,10 @@
 #include "idl/read_command.dist.hh"
 #include "idl/range.dist.hh"
 #include "idl/partition_checksum.dist.hh"
+#include "idl/repair.dist.hh"
 #include "idl/query.dist.hh"
 #include "idl/cache_temperature.dist.hh"
+#include "idl/aggregate.dist.hh"
 #include "serializer_impl.hh"
 #include "serialization_visitors.hh"
 #include "idl/consistency_level.dist.impl.hh"
@@ -72,8 +74,10 @@
 #include "idl/read_command.dist.impl.hh"
 #include "idl/range.dist.impl.hh"
 #include "idl/partition_checksum.dist.impl.hh"
+#include "idl/repair.dist.impl.hh"
 #include "idl/query.dist.impl.hh"
 #include "idl/cache_temperature.dist.impl.hh"
+#include "idl/aggregate.dist.impl.hh"
 #include "rpc/lz4_compressor.hh"
 #include "rpc/multi_algo_compressor_factory.hh"
 #include "partition_range_compat.hh"
@@ -111,6 +115,16 @@ lw_shared_ptr<T> read(serializer s, Input& in, boost::type<lw_shared_ptr<T>>) {
     return make_lw_shared(read(s, in, boost::type<T>()));
 }
 
+// Has the same wire format as std::vector<T>, so that the sender doesn't
+// have to copy objects it shares with someone else.
+template <typename Output, typename T>
+void write(serializer s, Output& out, const std::vector<lw_shared_ptr<T>>& v) {
+    ser::safe_serialize_as_uint32(out, v.size());
+    for (auto&& e : v) {
+        ser::serialize(out, *e);
+    }
+}
+
 static logging::logger mlogger("messaging_service");
 static logging::logger rpc_logger("rpc");
 
@@ -399,9 +413,15 @@ static unsigned get_rpc_client_idx(messaging_verb verb) {
                verb == messaging_verb::PREPARE_DONE_MESSAGE ||
                verb == messaging_verb::STREAM_MUTATION ||
                verb == messaging_verb::STREAM_MUTATION_DONE ||
-               verb == messaging_verb::COMPLETE_MESSAGE) {
+               verb == messaging_verb::STREAM_SSTABLE_COMPONENT ||
+               verb == messaging_verb::STREAM_SSTABLE_DONE ||
+               verb == messaging_verb::COMPLETE_MESSAGE ||
+               verb == messaging_verb::REPAIR_ROW_LEVEL_GET_ROWS ||
+               verb == messaging_verb::REPAIR_ROW_LEVEL_PUT_ROWS) {
         idx = 2;
-    } else if (verb == messaging_verb::MUTATION_DONE || verb == messaging_verb::MUTATION_FAILED) {
+    } else if (verb == messaging_verb::MUTATION_DONE ||
+               verb == messaging_verb::MUTATIONS_DONE ||
+               verb == messaging_verb::MUTATION_FAILED) {
         idx = 3;
     }
     return idx;
@@ -696,6 +716,25 @@ future<> messaging_service::send_stream_mutation_done(msg_addr id, UUID plan_id,
         plan_id, std::move(ranges), cf_id, dst_cpu_id);
 }
 
+// STREAM_SSTABLE_COMPONENT
+void messaging_service::register_stream_sstable_component(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, UUID sstable_id,
+        sstring file_name, bytes data, bool last, unsigned dst_cpu_id)>&& func) {
+    register_handler(this, messaging_verb::STREAM_SSTABLE_COMPONENT, std::move(func));
+}
+future<> messaging_service::send_stream_sstable_component(msg_addr id, UUID plan_id, UUID cf_id, UUID sstable_id,
+        sstring file_name, bytes data, bool last, unsigned dst_cpu_id) {
+    return send_message<void>(this, messaging_verb::STREAM_SSTABLE_COMPONENT, id,
+        plan_id, cf_id, sstable_id, std::move(file_name), std::move(data), last, dst_cpu_id);
+}
+
+// STREAM_SSTABLE_DONE
+void messaging_service::register_stream_sstable_done(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, UUID sstable_id, unsigned dst_cpu_id)>&& func) {
+    register_handler(this, messaging_verb::STREAM_SSTABLE_DONE, std::move(func));
+}
+future<> messaging_service::send_stream_sstable_done(msg_addr id, UUID plan_id, UUID cf_id, UUID sstable_id, unsigned dst_cpu_id) {
+    return send_message<void>(this, messaging_verb::STREAM_SSTABLE_DONE, id, plan_id, cf_id, sstable_id, dst_cpu_id);
+}
+
 // COMPLETE_MESSAGE
 void messaging_service::register_complete_message(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, unsigned dst_cpu_id, rpc::optional<bool> failed)>&& func) {
     register_handler(this, messaging_verb::COMPLETE_MESSAGE, std::move(func));
@@ -791,6 +830,19 @@ future<> messaging_service::send_mutation(msg_addr id, clock_type::time_point ti
         std::move(reply_to), std::move(shard), std::move(response_id), std::move(trace_info));
 }
 
+void messaging_service::register_mutations(std::function<future<rpc::no_wait_type> (const rpc::client_info&, rpc::opt_time_point, std::vector<frozen_mutation> fms, std::vector<inet_address> forward,
+    inet_address reply_to, unsigned shard, std::vector<response_id_type> response_ids, stdx::optional<tracing::trace_info> trace_info)>&& func) {
+    register_handler(this, netw::messaging_verb::MUTATIONS, std::move(func));
+}
+void messaging_service::unregister_mutations() {
+    _rpc->unregister_handler(netw::messaging_verb::MUTATIONS);
+}
+future<> messaging_service::send_mutations(msg_addr id, clock_type::time_point timeout, const std::vector<lw_shared_ptr<const frozen_mutation>>& fms, std::vector<inet_address> forward,
+    inet_address reply_to, unsigned shard, const std::vector<response_id_type>& response_ids, stdx::optional<tracing::trace_info> trace_info) {
+    return send_message_oneway_timeout(this, timeout, messaging_verb::MUTATIONS, std::move(id), fms, std::move(forward),
+        std::move(reply_to), std::move(shard), response_ids, std::move(trace_info));
+}
+
 void messaging_service::register_counter_mutation(std::function<future<> (const rpc::client_info&, rpc::opt_time_point, std::vector<frozen_mutation> fms, db::consistency_level cl, stdx::optional<tracing::trace_info> trace_info)>&& func) {
     register_handler(this, netw::messaging_verb::COUNTER_MUTATION, std::move(func));
 }
@@ -811,6 +863,16 @@ future<> messaging_service::send_mutation_done(msg_addr id, unsigned shard, resp
     return send_message_oneway(this, messaging_verb::MUTATION_DONE, std::move(id), std::move(shard), std::move(response_id));
 }
 
+void messaging_service::register_mutations_done(std::function<future<rpc::no_wait_type> (const rpc::client_info& cinfo, unsigned shard, std::vector<response_id_type> response_ids)>&& func) {
+    register_handler(this, netw::messaging_verb::MUTATIONS_DONE, std::move(func));
+}
+void messaging_service::unregister_mutations_done() {
+    _rpc->unregister_handler(netw::messaging_verb::MUTATIONS_DONE);
+}
+future<> messaging_service::send_mutations_done(msg_addr id, unsigned shard, const std::vector<response_id_type>& response_ids) {
+    return send_message_oneway(this, messaging_verb::MUTATIONS_DONE, std::move(id), std::move(shard), response_ids);
+}
+
 void messaging_service::register_mutation_failed(std::function<future<rpc::no_wait_type> (const rpc::client_info& cinfo, unsigned shard, response_id_type response_id, size_t num_failed)>&& func) {
     register_handler(this, netw::messaging_verb::MUTATION_FAILED, std::move(func));
 }
@@ -831,6 +893,16 @@ future<query::result, rpc::optional<cache_temperature>> messaging_service::send_
     return send_message_timeout<future<query::result, rpc::optional<cache_temperature>>>(this, messaging_verb::READ_DATA, std::move(id), timeout, cmd, pr, da);
 }
 
+void messaging_service::register_aggregate(std::function<future<query::aggregate_result> (const rpc::client_info&, query::aggregate_request req)>&& func) {
+    register_handler(this, netw::messaging_verb::AGGREGATE, std::move(func));
+}
+void messaging_service::unregister_aggregate() {
+    _rpc->unregister_handler(netw::messaging_verb::AGGREGATE);
+}
+future<query::aggregate_result> messaging_service::send_aggregate(msg_addr id, clock_type::time_point timeout, const query::aggregate_request& req) {
+    return send_message_timeout<query::aggregate_result>(this, messaging_verb::AGGREGATE, std::move(id), timeout, req);
+}
+
 void messaging_service::register_get_schema_version(std::function<future<frozen_schema>(unsigned, table_schema_version)>&& func) {
     register_handler(this, netw::messaging_verb::GET_SCHEMA_VERSION, std::move(func));
 }
@@ -861,14 +933,14 @@ future<reconcilable_result, rpc::optional<cache_temperature>> messaging_service:
     return send_message_timeout<future<reconcilable_result, rpc::optional<cache_temperature>>>(this, messaging_verb::READ_MUTATION_DATA, std::move(id), timeout, cmd, pr);
 }
 
-void messaging_service::register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr)>&& func) {
+void messaging_service::register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda)>&& func) {
     register_handler(this, netw::messaging_verb::READ_DIGEST, std::move(func));
 }
 void messaging_service::unregister_read_digest() {
     _rpc->unregister_handler(netw::messaging_verb::READ_DIGEST);
 }
-future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> messaging_service::send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr) {
-    return send_message_timeout<future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>>>(this, netw::messaging_verb::READ_DIGEST, std::move(id), timeout, cmd, pr);
+future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> messaging_service::send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr, query::digest_algorithm da) {
+    return send_message_timeout<future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>>>(this, netw::messaging_verb::READ_DIGEST, std::move(id), timeout, cmd, pr, da);
 }
 
 // Wrapper for TRUNCATE
@@ -913,4 +985,81 @@ future<partition_checksum> messaging_service::send_repair_checksum_range(
             std::move(keyspace), std::move(cf), std::move(range), hash_version);
 }
 
+// Wrapper for REPAIR_ROW_LEVEL_START
+void messaging_service::register_repair_row_level_start(std::function<future<> (UUID session_id, sstring keyspace, sstring cf, dht::token_range range)>&& func) {
+    register_handler(this, messaging_verb::REPAIR_ROW_LEVEL_START, std::move(func));
+}
+void messaging_service::unregister_repair_row_level_start() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_ROW_LEVEL_START);
+}
+future<> messaging_service::send_repair_row_level_start(msg_addr id, UUID session_id, sstring keyspace, sstring cf, dht::token_range range) {
+    return send_message<void>(this, messaging_verb::REPAIR_ROW_LEVEL_START, std::move(id), session_id, std::move(keyspace), std::move(cf), std::move(range));
+}
+
+// Wrapper for REPAIR_ROW_LEVEL_FILL
+void messaging_service::register_repair_row_level_fill(std::function<future<repair_round_summary> (UUID session_id, stdx::optional<repair_row_position> bound)>&& func) {
+    register_handler(this, messaging_verb::REPAIR_ROW_LEVEL_FILL, std::move(func));
+}
+void messaging_service::unregister_repair_row_level_fill() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_ROW_LEVEL_FILL);
+}
+future<repair_round_summary> messaging_service::send_repair_row_level_fill(msg_addr id, UUID session_id, stdx::optional<repair_row_position> bound) {
+    return send_message<repair_round_summary>(this, messaging_verb::REPAIR_ROW_LEVEL_FILL, std::move(id), session_id, std::move(bound));
+}
+
+// Wrapper for REPAIR_ROW_LEVEL_SET_BOUND
+void messaging_service::register_repair_row_level_set_bound(std::function<future<repair_hash> (UUID session_id, stdx::optional<repair_row_position> bound)>&& func) {
+    register_handler(this, messaging_verb::REPAIR_ROW_LEVEL_SET_BOUND, std::move(func));
+}
+void messaging_service::unregister_repair_row_level_set_bound() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_ROW_LEVEL_SET_BOUND);
+}
+future<repair_hash> messaging_service::send_repair_row_level_set_bound(msg_addr id, UUID session_id, stdx::optional<repair_row_position> bound) {
+    return send_message<repair_hash>(this, messaging_verb::REPAIR_ROW_LEVEL_SET_BOUND, std::move(id), session_id, std::move(bound));
+}
+
+// Wrapper for REPAIR_ROW_LEVEL_GET_HASHES
+void messaging_service::register_repair_row_level_get_hashes(std::function<future<std::vector<repair_hash>> (UUID session_id)>&& func) {
+    register_handler(this, messaging_verb::REPAIR_ROW_LEVEL_GET_HASHES, std::move(func));
+}
+void messaging_service::unregister_repair_row_level_get_hashes() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_ROW_LEVEL_GET_HASHES);
+}
+future<std::vector<repair_hash>> messaging_service::send_repair_row_level_get_hashes(msg_addr id, UUID session_id) {
+    return send_message<std::vector<repair_hash>>(this, messaging_verb::REPAIR_ROW_LEVEL_GET_HASHES, std::move(id), session_id);
+}
+
+// Wrapper for REPAIR_ROW_LEVEL_GET_ROWS
+void messaging_service::register_repair_row_level_get_rows(std::function<future<std::vector<frozen_mutation>> (UUID session_id, std::vector<repair_hash> hashes)>&& func) {
+    register_handler(this, messaging_verb::REPAIR_ROW_LEVEL_GET_ROWS, std::move(func));
+}
+void messaging_service::unregister_repair_row_level_get_rows() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_ROW_LEVEL_GET_ROWS);
+}
+future<std::vector<frozen_mutation>> messaging_service::send_repair_row_level_get_rows(msg_addr id, UUID session_id, std::vector<repair_hash> hashes) {
+    return send_message<std::vector<frozen_mutation>>(this, messaging_verb::REPAIR_ROW_LEVEL_GET_ROWS, std::move(id), session_id, std::move(hashes));
+}
+
+// Wrapper for REPAIR_ROW_LEVEL_PUT_ROWS
+void messaging_service::register_repair_row_level_put_rows(std::function<future<> (UUID session_id, std::vector<frozen_mutation> rows)>&& func) {
+    register_handler(this, messaging_verb::REPAIR_ROW_LEVEL_PUT_ROWS, std::move(func));
+}
+void messaging_service::unregister_repair_row_level_put_rows() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_ROW_LEVEL_PUT_ROWS);
+}
+future<> messaging_service::send_repair_row_level_put_rows(msg_addr id, UUID session_id, std::vector<frozen_mutation> rows) {
+    return send_message<void>(this, messaging_verb::REPAIR_ROW_LEVEL_PUT_ROWS, std::move(id), session_id, std::move(rows));
+}
+
+// Wrapper for REPAIR_ROW_LEVEL_STOP
+void messaging_service::register_repair_row_level_stop(std::function<future<> (UUID session_id)>&& func) {
+    register_handler(this, messaging_verb::REPAIR_ROW_LEVEL_STOP, std::move(func));
+}
+void messaging_service::unregister_repair_row_level_stop() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_ROW_LEVEL_STOP);
+}
+future<> messaging_service::send_repair_row_level_stop(msg_addr id, UUID session_id) {
+    return send_message<void>(this, messaging_verb::REPAIR_ROW_LEVEL_STOP, std::move(id), session_id);
+}
+
 } // namespace net
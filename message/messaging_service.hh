@@ -68,6 +68,8 @@ namespace query {
     using partition_range = dht::partition_range;
     class read_command;
     class result;
+    struct aggregate_request;
+    struct aggregate_result;
 }
 
 namespace compat {
@@ -109,7 +111,21 @@ enum class messaging_verb : int32_t {
     SCHEMA_CHECK = 22,
     COUNTER_MUTATION = 23,
     MUTATION_FAILED = 24,
-    LAST = 25,
+    MUTATIONS = 25,
+    MUTATIONS_DONE = 26,
+    AGGREGATE = 27,
+    // Used by row-level repair
+    REPAIR_ROW_LEVEL_START = 28,
+    REPAIR_ROW_LEVEL_FILL = 29,
+    REPAIR_ROW_LEVEL_SET_BOUND = 30,
+    REPAIR_ROW_LEVEL_GET_HASHES = 31,
+    REPAIR_ROW_LEVEL_GET_ROWS = 32,
+    REPAIR_ROW_LEVEL_PUT_ROWS = 33,
+    REPAIR_ROW_LEVEL_STOP = 34,
+    // end of row-level repair verbs
+    STREAM_SSTABLE_COMPONENT = 35,
+    STREAM_SSTABLE_DONE = 36,
+    LAST = 37,
 };
 
 } // namespace netw
@@ -250,6 +266,16 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     void register_stream_mutation_done(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, dht::token_range_vector ranges, UUID cf_id, unsigned dst_cpu_id)>&& func);
     future<> send_stream_mutation_done(msg_addr id, UUID plan_id, dht::token_range_vector ranges, UUID cf_id, unsigned dst_cpu_id);
 
+    // Wrapper for STREAM_SSTABLE_COMPONENT verb
+    void register_stream_sstable_component(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, UUID sstable_id,
+            sstring file_name, bytes data, bool last, unsigned dst_cpu_id)>&& func);
+    future<> send_stream_sstable_component(msg_addr id, UUID plan_id, UUID cf_id, UUID sstable_id,
+            sstring file_name, bytes data, bool last, unsigned dst_cpu_id);
+
+    // Wrapper for STREAM_SSTABLE_DONE verb
+    void register_stream_sstable_done(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, UUID sstable_id, unsigned dst_cpu_id)>&& func);
+    future<> send_stream_sstable_done(msg_addr id, UUID plan_id, UUID cf_id, UUID sstable_id, unsigned dst_cpu_id);
+
     void register_complete_message(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, unsigned dst_cpu_id, rpc::optional<bool> failed)>&& func);
     future<> send_complete_message(msg_addr id, UUID plan_id, unsigned dst_cpu_id, bool failed = false);
 
@@ -258,6 +284,41 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     void unregister_repair_checksum_range();
     future<partition_checksum> send_repair_checksum_range(msg_addr id, sstring keyspace, sstring cf, dht::token_range range, repair_checksum hash_version);
 
+    // Wrapper for REPAIR_ROW_LEVEL_START verb
+    void register_repair_row_level_start(std::function<future<> (UUID session_id, sstring keyspace, sstring cf, dht::token_range range)>&& func);
+    void unregister_repair_row_level_start();
+    future<> send_repair_row_level_start(msg_addr id, UUID session_id, sstring keyspace, sstring cf, dht::token_range range);
+
+    // Wrapper for REPAIR_ROW_LEVEL_FILL verb
+    void register_repair_row_level_fill(std::function<future<repair_round_summary> (UUID session_id, stdx::optional<repair_row_position> bound)>&& func);
+    void unregister_repair_row_level_fill();
+    future<repair_round_summary> send_repair_row_level_fill(msg_addr id, UUID session_id, stdx::optional<repair_row_position> bound);
+
+    // Wrapper for REPAIR_ROW_LEVEL_SET_BOUND verb
+    void register_repair_row_level_set_bound(std::function<future<repair_hash> (UUID session_id, stdx::optional<repair_row_position> bound)>&& func);
+    void unregister_repair_row_level_set_bound();
+    future<repair_hash> send_repair_row_level_set_bound(msg_addr id, UUID session_id, stdx::optional<repair_row_position> bound);
+
+    // Wrapper for REPAIR_ROW_LEVEL_GET_HASHES verb
+    void register_repair_row_level_get_hashes(std::function<future<std::vector<repair_hash>> (UUID session_id)>&& func);
+    void unregister_repair_row_level_get_hashes();
+    future<std::vector<repair_hash>> send_repair_row_level_get_hashes(msg_addr id, UUID session_id);
+
+    // Wrapper for REPAIR_ROW_LEVEL_GET_ROWS verb
+    void register_repair_row_level_get_rows(std::function<future<std::vector<frozen_mutation>> (UUID session_id, std::vector<repair_hash> hashes)>&& func);
+    void unregister_repair_row_level_get_rows();
+    future<std::vector<frozen_mutation>> send_repair_row_level_get_rows(msg_addr id, UUID session_id, std::vector<repair_hash> hashes);
+
+    // Wrapper for REPAIR_ROW_LEVEL_PUT_ROWS verb
+    void register_repair_row_level_put_rows(std::function<future<> (UUID session_id, std::vector<frozen_mutation> rows)>&& func);
+    void unregister_repair_row_level_put_rows();
+    future<> send_repair_row_level_put_rows(msg_addr id, UUID session_id, std::vector<frozen_mutation> rows);
+
+    // Wrapper for REPAIR_ROW_LEVEL_STOP verb
+    void register_repair_row_level_stop(std::function<future<> (UUID session_id)>&& func);
+    void unregister_repair_row_level_stop();
+    future<> send_repair_row_level_stop(msg_addr id, UUID session_id);
+
     // Wrapper for GOSSIP_ECHO verb
     void register_gossip_echo(std::function<future<> ()>&& func);
     void unregister_gossip_echo();
@@ -302,6 +363,13 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     future<> send_mutation(msg_addr id, clock_type::time_point timeout, const frozen_mutation& fm, std::vector<inet_address> forward,
         inet_address reply_to, unsigned shard, response_id_type response_id, std::experimental::optional<tracing::trace_info> trace_info = std::experimental::nullopt);
 
+    // Wrapper for MUTATIONS
+    void register_mutations(std::function<future<rpc::no_wait_type> (const rpc::client_info&, rpc::opt_time_point, std::vector<frozen_mutation> fms, std::vector<inet_address> forward,
+        inet_address reply_to, unsigned shard, std::vector<response_id_type> response_ids, stdx::optional<tracing::trace_info> trace_info)>&& func);
+    void unregister_mutations();
+    future<> send_mutations(msg_addr id, clock_type::time_point timeout, const std::vector<lw_shared_ptr<const frozen_mutation>>& fms, std::vector<inet_address> forward,
+        inet_address reply_to, unsigned shard, const std::vector<response_id_type>& response_ids, stdx::optional<tracing::trace_info> trace_info = stdx::nullopt);
+
     // Wrapper for COUNTER_MUTATION
     void register_counter_mutation(std::function<future<> (const rpc::client_info&, rpc::opt_time_point, std::vector<frozen_mutation> fms, db::consistency_level cl, stdx::optional<tracing::trace_info> trace_info)>&& func);
     void unregister_counter_mutation();
@@ -312,6 +380,11 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     void unregister_mutation_done();
     future<> send_mutation_done(msg_addr id, unsigned shard, response_id_type response_id);
 
+    // Wrapper for MUTATIONS_DONE
+    void register_mutations_done(std::function<future<rpc::no_wait_type> (const rpc::client_info& cinfo, unsigned shard, std::vector<response_id_type> response_ids)>&& func);
+    void unregister_mutations_done();
+    future<> send_mutations_done(msg_addr id, unsigned shard, const std::vector<response_id_type>& response_ids);
+
     // Wrapper for MUTATION_FAILED
     void register_mutation_failed(std::function<future<rpc::no_wait_type> (const rpc::client_info& cinfo, unsigned shard, response_id_type response_id, size_t num_failed)>&& func);
     void unregister_mutation_failed();
@@ -323,6 +396,11 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     void unregister_read_data();
     future<query::result, rpc::optional<cache_temperature>> send_read_data(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr, query::digest_algorithm da);
 
+    // Wrapper for AGGREGATE
+    void register_aggregate(std::function<future<query::aggregate_result> (const rpc::client_info&, query::aggregate_request req)>&& func);
+    void unregister_aggregate();
+    future<query::aggregate_result> send_aggregate(msg_addr id, clock_type::time_point timeout, const query::aggregate_request& req);
+
     // Wrapper for GET_SCHEMA_VERSION
     void register_get_schema_version(std::function<future<frozen_schema>(unsigned, table_schema_version)>&& func);
     void unregister_get_schema_version();
@@ -339,9 +417,9 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     future<reconcilable_result, rpc::optional<cache_temperature>> send_read_mutation_data(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr);
 
     // Wrapper for READ_DIGEST
-    void register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr)>&& func);
+    void register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda)>&& func);
     void unregister_read_digest();
-    future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr);
+    future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr, query::digest_algorithm da);
 
     // Wrapper for TRUNCATE
     void register_truncate(std::function<future<>(sstring, sstring)>&& func);
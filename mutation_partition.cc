@@ -418,17 +418,19 @@ mutation_partition::apply_insert(const schema& s, clustering_key_view key, api::
 
 void mutation_partition::insert_row(const schema& s, const clustering_key& key, deletable_row&& row) {
     auto e = current_allocator().construct<rows_entry>(key, std::move(row));
+    e->compute_key_prefix(s);
     _rows.insert(_rows.end(), *e, rows_entry::compare(s));
 }
 
 void mutation_partition::insert_row(const schema& s, const clustering_key& key, const deletable_row& row) {
     auto e = current_allocator().construct<rows_entry>(key, row);
+    e->compute_key_prefix(s);
     _rows.insert(_rows.end(), *e, rows_entry::compare(s));
 }
 
 const row*
 mutation_partition::find_row(const schema& s, const clustering_key& key) const {
-    auto i = _rows.find(key, rows_entry::compare(s));
+    auto i = _rows.find(rows_entry::lookup_key(s, key), rows_entry::compare(s));
     if (i == _rows.end()) {
         return nullptr;
     }
@@ -437,9 +439,12 @@ mutation_partition::find_row(const schema& s, const clustering_key& key) const {
 
 deletable_row&
 mutation_partition::clustered_row(const schema& s, clustering_key&& key) {
-    auto i = _rows.find(key, rows_entry::compare(s));
+    rows_entry::lookup_key lk(s, key);
+    auto i = _rows.find(lk, rows_entry::compare(s));
     if (i == _rows.end()) {
+        auto prefix = lk.prefix();
         auto e = current_allocator().construct<rows_entry>(std::move(key));
+        e->_key_prefix = prefix;
         _rows.insert(i, *e, rows_entry::compare(s));
         return e->row();
     }
@@ -448,9 +453,11 @@ mutation_partition::clustered_row(const schema& s, clustering_key&& key) {
 
 deletable_row&
 mutation_partition::clustered_row(const schema& s, const clustering_key& key) {
-    auto i = _rows.find(key, rows_entry::compare(s));
+    rows_entry::lookup_key lk(s, key);
+    auto i = _rows.find(lk, rows_entry::compare(s));
     if (i == _rows.end()) {
         auto e = current_allocator().construct<rows_entry>(key);
+        e->_key_prefix = lk.prefix();
         _rows.insert(i, *e, rows_entry::compare(s));
         return e->row();
     }
@@ -462,6 +469,7 @@ mutation_partition::clustered_row(const schema& s, clustering_key_view key) {
     auto i = _rows.find(key, rows_entry::compare(s));
     if (i == _rows.end()) {
         auto e = current_allocator().construct<rows_entry>(key);
+        e->compute_key_prefix(s);
         _rows.insert(i, *e, rows_entry::compare(s));
         return e->row();
     }
@@ -606,7 +614,7 @@ void write_counter_cell(RowWriter& w, const query::partition_slice& slice, ::ato
 }
 
 // returns the timestamp of a latest update to the row
-static api::timestamp_type hash_row_slice(md5_hasher& hasher,
+static api::timestamp_type hash_row_slice(query::digester& hasher,
     const schema& s,
     column_kind kind,
     const row& cells,
@@ -1317,6 +1325,7 @@ mutation_partition::live_row_count(const schema& s, gc_clock::time_point query_t
 rows_entry::rows_entry(rows_entry&& o) noexcept
     : _link(std::move(o._link))
     , _key(std::move(o._key))
+    , _key_prefix(o._key_prefix)
     , _row(std::move(o._row))
     , _flags(std::move(o._flags))
 { }
@@ -1848,6 +1857,47 @@ class query_result_builder {
     }
 };
 
+// Creates the reader for a data or mutation query, along with the information
+// whether its partitions still need to be reversed while being consumed.
+//
+// Reversed single-partition queries read the partition backwards piece by
+// piece when the source knows how to split it, so that memory use and the
+// amount of data read scale with the limit rather than with the size of the
+// partition. Otherwise whole partitions are reversed in memory.
+static future<flat_mutation_reader, flat_mutation_reader::consume_reversed_partitions>
+make_query_reader(schema_ptr s,
+        const mutation_source& source,
+        const dht::partition_range& range,
+        const query::partition_slice& slice,
+        tracing::trace_state_ptr trace_ptr)
+{
+    using consume_reversed_partitions = flat_mutation_reader::consume_reversed_partitions;
+    auto& pc = service::get_local_sstable_query_read_priority();
+    auto make_forward_reader = [&] {
+        return source.make_flat_mutation_reader(s, range, slice, pc, std::move(trace_ptr),
+                                                streamed_mutation::forwarding::no, mutation_reader::forwarding::no);
+    };
+    auto is_reversed = slice.options.contains(query::partition_slice::option::reversed);
+    if (!is_reversed || !range.is_singular() || !range.start()->value().has_key()) {
+        return make_ready_future<flat_mutation_reader, consume_reversed_partitions>(make_forward_reader(),
+                                                                                   consume_reversed_partitions(is_reversed));
+    }
+    auto& rp = range.start()->value();
+    auto dk = dht::decorated_key{rp.token(), *rp.key()};
+    return source.get_clustering_split_points(s, dk, pc).then([s, source, &range, &slice, &pc, trace_ptr = std::move(trace_ptr)]
+            (mutation_source::clustering_split_points split_points) mutable {
+        if (split_points.empty()) {
+            return make_ready_future<flat_mutation_reader, consume_reversed_partitions>(
+                source.make_flat_mutation_reader(s, range, slice, pc, std::move(trace_ptr),
+                                                 streamed_mutation::forwarding::no, mutation_reader::forwarding::no),
+                consume_reversed_partitions::yes);
+        }
+        return make_ready_future<flat_mutation_reader, consume_reversed_partitions>(
+            make_reversing_reader(s, std::move(source), range, slice, std::move(split_points), pc, std::move(trace_ptr)),
+            consume_reversed_partitions::no);
+    });
+}
+
 future<> data_query(
         schema_ptr s,
         const mutation_source& source,
@@ -1857,22 +1907,35 @@ future<> data_query(
         uint32_t partition_limit,
         gc_clock::time_point query_time,
         query::result::builder& builder,
-        tracing::trace_state_ptr trace_ptr)
+        tracing::trace_state_ptr trace_ptr,
+        query::querier_cache_context cache_ctx)
 {
     if (row_limit == 0 || slice.partition_row_limit() == 0 || partition_limit == 0) {
         return make_ready_future<>();
     }
 
-    auto is_reversed = slice.options.contains(query::partition_slice::option::reversed);
-
     auto qrb = query_result_builder(*s, builder);
     auto cfq = make_stable_flattened_mutations_consumer<compact_for_query<emit_only_live_rows::yes, query_result_builder>>(
             *s, query_time, slice, row_limit, partition_limit, std::move(qrb));
 
-    return do_with(source.make_flat_mutation_reader(s, range, slice, service::get_local_sstable_query_read_priority(), std::move(trace_ptr),
-                                                    streamed_mutation::forwarding::no, mutation_reader::forwarding::no),
-                   [cfq = std::move(cfq), is_reversed] (flat_mutation_reader& reader) mutable {
-        return reader.consume(std::move(cfq), flat_mutation_reader::consume_reversed_partitions(is_reversed));
+    // Reversed queries read partitions backwards piece by piece, their
+    // readers can't be resumed.
+    if (cache_ctx && !slice.options.contains(query::partition_slice::option::reversed)) {
+        auto q = cache_ctx.lookup(*s, range, slice);
+        auto qp = q ? make_lw_shared<query::querier>(std::move(*q))
+                    : make_lw_shared<query::querier>(source, s, range, slice, std::move(trace_ptr));
+        return qp->consume_page(std::move(cfq)).then([qp, cache_ctx] () mutable {
+            if (qp->is_resumable()) {
+                cache_ctx.insert(std::move(*qp));
+            }
+        });
+    }
+
+    return make_query_reader(s, source, range, slice, std::move(trace_ptr)).then([cfq = std::move(cfq)]
+            (flat_mutation_reader reader, flat_mutation_reader::consume_reversed_partitions reversed) mutable {
+        return do_with(std::move(reader), [cfq = std::move(cfq), reversed] (flat_mutation_reader& reader) mutable {
+            return reader.consume(std::move(cfq), reversed);
+        });
     });
 }
 
@@ -1970,16 +2033,15 @@ static do_mutation_query(schema_ptr s,
         return make_ready_future<reconcilable_result>(reconcilable_result());
     }
 
-    auto is_reversed = slice.options.contains(query::partition_slice::option::reversed);
-
     auto rrb = reconcilable_result_builder(*s, slice, std::move(accounter));
     auto cfq = make_stable_flattened_mutations_consumer<compact_for_query<emit_only_live_rows::no, reconcilable_result_builder>>(
             *s, query_time, slice, row_limit, partition_limit, std::move(rrb));
 
-    return do_with(source.make_flat_mutation_reader(s, range, slice, service::get_local_sstable_query_read_priority(), std::move(trace_ptr),
-                                                    streamed_mutation::forwarding::no, mutation_reader::forwarding::no),
-                   [cfq = std::move(cfq), is_reversed] (flat_mutation_reader& reader) mutable {
-        return reader.consume(std::move(cfq), flat_mutation_reader::consume_reversed_partitions(is_reversed));
+    return make_query_reader(s, source, range, slice, std::move(trace_ptr)).then([cfq = std::move(cfq)]
+            (flat_mutation_reader reader, flat_mutation_reader::consume_reversed_partitions reversed) mutable {
+        return do_with(std::move(reader), [cfq = std::move(cfq), reversed] (flat_mutation_reader& reader) mutable {
+            return reader.consume(std::move(cfq), reversed);
+        });
     });
 }
 
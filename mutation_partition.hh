@@ -627,6 +627,8 @@ class deletable_row final {
 class rows_entry {
     intrusive_set_external_comparator_member_hook _link;
     clustering_key _key;
+    // Memcomparable prefix of _key, see key_prefix(). Zero when not known.
+    uint64_t _key_prefix = 0;
     deletable_row _row;
     struct flags {
         // _before_ck and _after_ck encode position_in_partition::weight
@@ -651,6 +653,7 @@ class rows_entry {
         _flags._continuous = bool(continuous);
         _flags._before_ck = pos.is_before_key();
         _flags._after_ck = pos.is_after_key();
+        compute_key_prefix(s);
     }
     rows_entry(const clustering_key& key, deletable_row&& row)
         : _key(key), _row(std::move(row))
@@ -664,9 +667,42 @@ class rows_entry {
     rows_entry(rows_entry&& o) noexcept;
     rows_entry(const rows_entry& e)
         : _key(e._key)
+        , _key_prefix(e._key_prefix)
         , _row(e._row)
         , _flags(e._flags)
     { }
+    // Returns the memcomparable prefix of given clustering key (see compound_type::memcomparable_prefix()),
+    // or 0 if the key is not full or clustering keys of given schema have no memcomparable form.
+    //
+    // Rows are ordered by non-zero prefixes when these differ, so most comparisons between
+    // rows which know their prefixes don't need to look at the keys.
+    static uint64_t key_prefix(const schema& s, clustering_key_view key) {
+        auto&& t = s.clustering_key_type();
+        if (!t->is_memcomparable() || !t->is_full(key.representation())) {
+            return 0;
+        }
+        return t->memcomparable_prefix(key.representation());
+    }
+    // Computes and keeps the memcomparable prefix of this entry's key.
+    // Has no effect on entries which don't represent a row with a full key.
+    void compute_key_prefix(const schema& s) {
+        if (!_flags._dummy && !_flags._before_ck && !_flags._after_ck) {
+            _key_prefix = key_prefix(s, _key);
+        }
+    }
+    // A clustering key along with its memcomparable prefix, for lookups
+    // which compare the same key with many rows.
+    class lookup_key {
+        const clustering_key& _key;
+        uint64_t _prefix;
+    public:
+        lookup_key(const schema& s, const clustering_key& key)
+            : _key(key)
+            , _prefix(key_prefix(s, key))
+        { }
+        const clustering_key& key() const { return _key; }
+        uint64_t prefix() const { return _prefix; }
+    };
     // Valid only if !dummy()
     clustering_key& key() {
         return _key;
@@ -701,9 +737,33 @@ class rows_entry {
     struct tri_compare {
         position_in_partition::tri_compare _c;
         explicit tri_compare(const schema& s) : _c(s) {}
+    private:
+        // Returns the order of two rows given their memcomparable prefixes, or 0 if unknown.
+        static int compare_prefixes(uint64_t p1, uint64_t p2) {
+            if (!p1 || !p2 || p1 == p2) {
+                return 0;
+            }
+            return p1 < p2 ? -1 : 1;
+        }
+    public:
         int operator()(const rows_entry& e1, const rows_entry& e2) const {
+            if (auto r = compare_prefixes(e1._key_prefix, e2._key_prefix)) {
+                return r;
+            }
             return _c(e1.position(), e2.position());
         }
+        int operator()(const lookup_key& key, const rows_entry& e) const {
+            if (auto r = compare_prefixes(key.prefix(), e._key_prefix)) {
+                return r;
+            }
+            return _c(position_in_partition_view::for_key(key.key()), e.position());
+        }
+        int operator()(const rows_entry& e, const lookup_key& key) const {
+            if (auto r = compare_prefixes(e._key_prefix, key.prefix())) {
+                return r;
+            }
+            return _c(e.position(), position_in_partition_view::for_key(key.key()));
+        }
         int operator()(const clustering_key& key, const rows_entry& e) const {
             return _c(position_in_partition_view::for_key(key), e.position());
         }
@@ -738,6 +798,12 @@ class rows_entry {
         bool operator()(const rows_entry& e, const clustering_key_view& key) const {
             return _c(e, key) < 0;
         }
+        bool operator()(const lookup_key& key, const rows_entry& e) const {
+            return _c(key, e) < 0;
+        }
+        bool operator()(const rows_entry& e, const lookup_key& key) const {
+            return _c(e, key) < 0;
+        }
         bool operator()(const rows_entry& e, position_in_partition_view p) const {
             return _c(e.position(), p) < 0;
         }
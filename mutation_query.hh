@@ -25,6 +25,7 @@
 #include "query-result.hh"
 #include "mutation_reader.hh"
 #include "frozen_mutation.hh"
+#include "querier.hh"
 
 class reconcilable_result;
 class frozen_reconcilable_result;
@@ -105,7 +106,8 @@ class reconcilable_result {
     printer pretty_printer(schema_ptr) const;
 };
 
-query::result to_data_query_result(const reconcilable_result&, schema_ptr, const query::partition_slice&, uint32_t row_limit, uint32_t partition_limit, query::result_request result_type = query::result_request::only_result);
+query::result to_data_query_result(const reconcilable_result&, schema_ptr, const query::partition_slice&, uint32_t row_limit, uint32_t partition_limit, query::result_request result_type = query::result_request::only_result,
+        query::digest_algorithm da = query::digest_algorithm::MD5);
 
 // Performs a query on given data source returning data in reconcilable form.
 //
@@ -138,7 +140,8 @@ future<> data_query(
     uint32_t partition_limit,
     gc_clock::time_point query_time,
     query::result::builder& builder,
-    tracing::trace_state_ptr trace_ptr = nullptr);
+    tracing::trace_state_ptr trace_ptr = nullptr,
+    query::querier_cache_context cache_ctx = { });
 
 // Performs a query for counter updates.
 future<mutation_opt> counter_write_query(schema_ptr, const mutation_source&,
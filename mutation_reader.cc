@@ -21,7 +21,9 @@
 
 #include <boost/range/algorithm/heap_algorithm.hpp>
 #include <boost/range/algorithm/reverse.hpp>
+#include <boost/range/algorithm/sort.hpp>
 #include <boost/move/iterator.hpp>
+#include <stack>
 
 #include "mutation_reader.hh"
 #include "core/future-util.hh"
@@ -740,3 +742,193 @@ future<streamed_mutation_opt> streamed_mutation_from_flat_mutation_reader(flat_m
         return rd();
     });
 }
+
+// Splits the clustering ranges of the slice at split points falling inside them.
+// Returns the resulting windows in descending order.
+static std::vector<query::clustering_range> reversed_read_windows(const schema& s,
+        const query::clustering_row_ranges& ranges,
+        const mutation_source::clustering_split_points& split_points) {
+    position_in_partition::less_compare less(s);
+    auto ascending_ranges = ranges;
+    // Reversed queries list their ranges in descending order. Don't depend on it.
+    boost::sort(ascending_ranges, [&] (const query::clustering_range& a, const query::clustering_range& b) {
+        return less(position_in_partition_view::for_range_end(a), position_in_partition_view::for_range_end(b));
+    });
+
+    std::vector<query::clustering_range> windows;
+    for (auto&& r : ascending_ranges) {
+        auto start = r.start();
+        bool split = false;
+        for (auto&& p : split_points) {
+            auto pos = position_in_partition_view(position_in_partition_view::range_tag_t(), bound_view(p, bound_kind::incl_start));
+            if (!less(position_in_partition_view::for_range_start(r), pos)) {
+                continue;
+            }
+            if (!less(pos, position_in_partition_view::for_range_end(r))) {
+                break;
+            }
+            windows.emplace_back(std::move(start), query::clustering_range::bound(p, false));
+            start = query::clustering_range::bound(p, true);
+            split = true;
+        }
+        if (!split) {
+            windows.emplace_back(r);
+        } else {
+            windows.emplace_back(std::move(start), r.end());
+        }
+    }
+    boost::reverse(windows);
+    return windows;
+}
+
+flat_mutation_reader make_reversing_reader(schema_ptr s,
+        mutation_source source,
+        const dht::partition_range& range,
+        const query::partition_slice& slice,
+        mutation_source::clustering_split_points split_points,
+        const io_priority_class& pc,
+        tracing::trace_state_ptr trace_state) {
+    class reversing_reader final : public flat_mutation_reader::impl {
+        mutation_source _source;
+        const dht::partition_range& _range;
+        const query::partition_slice& _slice;
+        const io_priority_class& _pc;
+        tracing::trace_state_ptr _trace_state;
+        std::vector<query::clustering_range> _windows;
+        std::vector<query::clustering_range>::const_iterator _next_window;
+        // Slice for the window being read. Must outlive _window_reader.
+        stdx::optional<query::partition_slice> _window_slice;
+        flat_mutation_reader_opt _window_reader;
+        bool _partition_started = false;
+        // Set while reading the window in which the partition was first seen.
+        bool _emit_static_row = false;
+        // Contents of the current window, waiting to be emitted in reverse.
+        std::stack<mutation_fragment> _rows;
+        range_tombstone_list _range_tombstones;
+    private:
+        // Emits buffered contents of the current window in reverse.
+        // Returns stop_iteration::yes when the buffer got full.
+        stop_iteration emit_window() {
+            auto emit_range_tombstone = [&] {
+                auto it = std::prev(_range_tombstones.tombstones().end());
+                auto& rt = *it;
+                _range_tombstones.tombstones().erase(it);
+                auto rt_owner = alloc_strategy_unique_ptr<range_tombstone>(&rt);
+                push_mutation_fragment(mutation_fragment(std::move(rt)));
+            };
+            position_in_partition::less_compare cmp(*_schema);
+            while (!_rows.empty() && !is_buffer_full()) {
+                auto& mf = _rows.top();
+                if (!_range_tombstones.empty() && !cmp(_range_tombstones.tombstones().rbegin()->end_position(), mf.position())) {
+                    emit_range_tombstone();
+                } else {
+                    push_mutation_fragment(std::move(mf));
+                    _rows.pop();
+                }
+            }
+            while (!_range_tombstones.empty() && !is_buffer_full()) {
+                emit_range_tombstone();
+            }
+            return stop_iteration(is_buffer_full());
+        }
+
+        void start_window() {
+            auto options = _slice.options;
+            options.remove<query::partition_slice::option::reversed>();
+            _window_slice.emplace(query::clustering_row_ranges{*_next_window}, _slice.static_columns, _slice.regular_columns,
+                options, nullptr, _slice.cql_format(), _slice.partition_row_limit());
+            _window_reader = _source.make_flat_mutation_reader(_schema, _range, *_window_slice, _pc, _trace_state,
+                streamed_mutation::forwarding::no, mutation_reader::forwarding::no);
+        }
+
+        void end_window() {
+            _range_tombstones.trim(*_schema, query::clustering_row_ranges{*_next_window});
+            _emit_static_row = false;
+            _window_reader = stdx::nullopt;
+            _window_slice = stdx::nullopt;
+            ++_next_window;
+        }
+
+        // Buffers the current window. Partition start and static row are
+        // emitted straight away, when seen in the first window.
+        future<> read_window() {
+            return _window_reader->consume_pausable([this] (mutation_fragment mf) {
+                if (mf.is_partition_start()) {
+                    if (!_partition_started) {
+                        push_mutation_fragment(std::move(mf));
+                        _partition_started = true;
+                        _emit_static_row = true;
+                    }
+                } else if (mf.is_static_row()) {
+                    if (_emit_static_row) {
+                        push_mutation_fragment(std::move(mf));
+                    }
+                } else if (mf.is_range_tombstone()) {
+                    _range_tombstones.apply(*_schema, std::move(mf.as_range_tombstone()));
+                } else if (mf.is_clustering_row()) {
+                    _rows.emplace(std::move(mf));
+                }
+                return stop_iteration::no;
+            }).then([this] {
+                end_window();
+            });
+        }
+    public:
+        reversing_reader(schema_ptr s, mutation_source source, const dht::partition_range& range,
+                const query::partition_slice& slice, mutation_source::clustering_split_points split_points,
+                const io_priority_class& pc, tracing::trace_state_ptr trace_state)
+            : impl(std::move(s))
+            , _source(std::move(source))
+            , _range(range)
+            , _slice(slice)
+            , _pc(pc)
+            , _trace_state(std::move(trace_state))
+            , _windows(reversed_read_windows(*_schema, slice.row_ranges(*_schema, *range.start()->value().key()), split_points))
+            , _next_window(_windows.cbegin())
+            , _range_tombstones(*_schema)
+        { }
+
+        virtual future<> fill_buffer() override {
+            return repeat([this] {
+                if (emit_window() || is_end_of_stream()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                if (_next_window == _windows.cend()) {
+                    if (_partition_started) {
+                        push_mutation_fragment(partition_end());
+                    }
+                    _end_of_stream = true;
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                start_window();
+                return read_window().then([] {
+                    return stop_iteration::no;
+                });
+            });
+        }
+
+        virtual void next_partition() override {
+            clear_buffer_to_next_partition();
+            if (is_buffer_empty()) {
+                while (!_rows.empty()) {
+                    _rows.pop();
+                }
+                _range_tombstones.clear();
+                _next_window = _windows.cend();
+                _partition_started = false;
+                _end_of_stream = true;
+            }
+        }
+
+        virtual future<> fast_forward_to(const dht::partition_range&) override {
+            throw std::bad_function_call();
+        }
+
+        virtual future<> fast_forward_to(position_range) override {
+            throw std::bad_function_call();
+        }
+    };
+
+    return make_flat_mutation_reader<reversing_reader>(std::move(s), std::move(source), range, slice,
+        std::move(split_points), pc, std::move(trace_state));
+}
@@ -488,6 +488,12 @@ class mutation_source {
                                                                         tracing::trace_state_ptr,
                                                                         streamed_mutation::forwarding,
                                                                         mutation_reader::forwarding)>;
+public:
+    using clustering_split_points = std::vector<clustering_key_prefix>;
+    using split_points_factory_type = std::function<future<clustering_split_points>(schema_ptr,
+                                                                                   const dht::decorated_key&,
+                                                                                   io_priority)>;
+private:
     class impl {
     public:
         virtual ~impl() { }
@@ -559,18 +565,23 @@ class mutation_source {
     // Probably not worth the effort though.
     shared_ptr<impl> _impl;
     lw_shared_ptr<std::function<partition_presence_checker()>> _presence_checker_factory;
+    lw_shared_ptr<split_points_factory_type> _split_points_factory;
 private:
     mutation_source() = default;
     explicit operator bool() const { return bool(_impl); }
     friend class optimized_optional<mutation_source>;
 public:
-    mutation_source(func_type fn, std::function<partition_presence_checker()> pcf = [] { return make_default_partition_presence_checker(); })
+    mutation_source(func_type fn, std::function<partition_presence_checker()> pcf = [] { return make_default_partition_presence_checker(); },
+                    split_points_factory_type spf = {})
         : _impl(seastar::make_shared<mutation_reader_mutation_source>(std::move(fn)))
         , _presence_checker_factory(make_lw_shared(std::move(pcf)))
+        , _split_points_factory(spf ? make_lw_shared(std::move(spf)) : nullptr)
     { }
-    mutation_source(flat_reader_factory_type fn, std::function<partition_presence_checker()> pcf = [] { return make_default_partition_presence_checker(); })
+    mutation_source(flat_reader_factory_type fn, std::function<partition_presence_checker()> pcf = [] { return make_default_partition_presence_checker(); },
+                    split_points_factory_type spf = {})
         : _impl(seastar::make_shared<flat_mutation_reader_mutation_source>(std::move(fn)))
         , _presence_checker_factory(make_lw_shared(std::move(pcf)))
+        , _split_points_factory(spf ? make_lw_shared(std::move(spf)) : nullptr)
     { }
     // For sources which don't care about the mutation_reader::forwarding flag (always fast forwardable)
     mutation_source(std::function<mutation_reader(schema_ptr s, partition_range range, const query::partition_slice& slice, io_priority pc, tracing::trace_state_ptr, streamed_mutation::forwarding)> fn)
@@ -643,8 +654,39 @@ class mutation_source {
     partition_presence_checker make_partition_presence_checker() {
         return (*_presence_checker_factory)();
     }
+
+    // Returns clustering prefixes, in ascending order, which divide given partition
+    // into pieces of bounded size. Used to read partitions backwards piece by piece,
+    // see make_reversing_reader(). Sources which don't know how their partitions are
+    // laid out return no split points.
+    future<clustering_split_points> get_clustering_split_points(schema_ptr s, const dht::decorated_key& dk, io_priority pc = default_priority_class()) const {
+        if (!_split_points_factory) {
+            return make_ready_future<clustering_split_points>();
+        }
+        return (*_split_points_factory)(std::move(s), dk, pc);
+    }
 };
 
+// Creates a reader which emits the single partition selected by `range` with
+// clustering rows and range tombstones in reversed order, as described for
+// flat_mutation_reader::consume_reversed_partitions.
+//
+// The partition is read backwards in windows of the clustering key space delimited
+// by `split_points`, obtained from mutation_source::get_clustering_split_points().
+// Each window is read forward from `source` with the slice restricted to it and
+// emitted in reverse, so memory use is bounded by the size of the largest window
+// rather than by the size of the partition, and nothing before the last window
+// consumed is read at all.
+//
+// `range` must be singular. The slice must remain live as long as the reader.
+flat_mutation_reader make_reversing_reader(schema_ptr s,
+        mutation_source source,
+        const dht::partition_range& range,
+        const query::partition_slice& slice,
+        mutation_source::clustering_split_points split_points,
+        const io_priority_class& pc = default_priority_class(),
+        tracing::trace_state_ptr trace_state = nullptr);
+
 // Returns a mutation_source which is the sum of given mutation_sources.
 //
 // Adding two mutation sources gives a mutation source which contains
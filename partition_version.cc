@@ -303,6 +303,10 @@ class partition_entry::rows_iterator final {
     const clustering_key& key() const {
         return _current_row[0].current_row->key();
     }
+    // Return the entry of the current row in source.
+    const rows_entry& entry() const {
+        return *_current_row[0].current_row;
+    }
     bool is_dummy() const {
         return bool(_current_row[0].current_row->dummy());
     }
@@ -396,10 +400,12 @@ class apply_incomplete_target final {
     // in a state such that the two still commute to the same value on retry.
     void apply(partition_entry::rows_iterator& src) {
         auto&& key = src.key();
-        while (!_heap.empty() && _rows_less_cmp(*_heap[0].current_row, key)) {
+        // Comparing entries rather than keys uses memcomparable key prefixes.
+        const rows_entry& src_e = src.entry();
+        while (!_heap.empty() && _rows_less_cmp(*_heap[0].current_row, src_e)) {
             boost::range::pop_heap(_heap, _version_cmp);
             auto& curr = _heap.back();
-            curr.current_row = curr.rows->lower_bound(key, _rows_less_cmp);
+            curr.current_row = curr.rows->lower_bound(src_e, _rows_less_cmp);
             if (curr.version_no == 0) {
                 _next_in_latest_version = curr.current_row;
             }
@@ -412,7 +418,7 @@ class apply_incomplete_target final {
 
         if (!_heap.empty()) {
             rows_entry& next_row = *_heap[0].current_row;
-            if (_rows_cmp(key, next_row) == 0) {
+            if (_rows_cmp(src_e, next_row) == 0) {
                 if (next_row.dummy()) {
                     return;
                 }
@@ -422,12 +428,13 @@ class apply_incomplete_target final {
         }
 
         mutation_partition::rows_type& rows = _pe.version()->partition().clustered_rows();
-        if (_next_in_latest_version != rows.end() && _rows_cmp(key, *_next_in_latest_version) == 0) {
+        if (_next_in_latest_version != rows.end() && _rows_cmp(src_e, *_next_in_latest_version) == 0) {
             src.consume_row([&] (deletable_row&& row) {
                 _next_in_latest_version->row().apply_monotonically(_schema, std::move(row));
             });
         } else {
             auto e = current_allocator().construct<rows_entry>(key);
+            e->compute_key_prefix(_schema);
             e->set_continuous(_heap.empty() ? is_continuous::yes : _heap[0].current_row->continuous());
             rows.insert_before(_next_in_latest_version, *e);
             src.consume_row([&] (deletable_row&& row) {
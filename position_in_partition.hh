@@ -270,6 +270,9 @@ class position_in_partition {
         }
     }
 
+    partition_region region() const { return _type; }
+    int bound_weight() const { return _bound_weight; }
+
     const clustering_key_prefix& key() const {
         return *_ck;
     }
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "querier.hh"
+#include "service/priority_manager.hh"
+#include "log.hh"
+
+namespace query {
+
+static logging::logger qlogger("querier_cache");
+
+const std::chrono::seconds querier_cache::default_entry_ttl{10};
+
+querier::querier(const mutation_source& source, schema_ptr s, const dht::partition_range& range,
+        const partition_slice& slice, tracing::trace_state_ptr trace_ptr)
+    : _schema(std::move(s))
+    , _range(std::make_unique<const dht::partition_range>(range))
+    , _slice(std::make_unique<const partition_slice>(slice))
+    , _reader(source.make_flat_mutation_reader(_schema, *_range, *_slice, service::get_local_sstable_query_read_priority(),
+            std::move(trace_ptr), streamed_mutation::forwarding::no, mutation_reader::forwarding::no))
+{ }
+
+void querier::start_partition(const dht::decorated_key& dk) {
+    _partition = dk;
+    _partition_open = false;
+    _partition_tombstone = {};
+    _static_row = stdx::nullopt;
+    _range_tombstones.clear();
+    _last_ckey = stdx::nullopt;
+    _stopped_in_partition = false;
+}
+
+void querier::record_range_tombstone(const range_tombstone& rt) {
+    if (_range_tombstones.size() >= max_range_tombstones) {
+        _resumable = false;
+        return;
+    }
+    _range_tombstones.push_back(rt);
+}
+
+static bool bounds_equal(const ::schema& s, const stdx::optional<dht::partition_range::bound>& a,
+        const stdx::optional<dht::partition_range::bound>& b) {
+    if (!a || !b) {
+        return !a && !b;
+    }
+    return a->is_inclusive() == b->is_inclusive() && a->value().equal(s, b->value());
+}
+
+bool querier::can_resume(const ::schema& s, const dht::partition_range& range, const partition_slice& slice) const {
+    if (!_resumable || s.version() != _schema->version() || !_partition) {
+        return false;
+    }
+    if (slice.static_columns != _slice->static_columns
+            || slice.regular_columns != _slice->regular_columns
+            || slice.options.mask() != _slice->options.mask()) {
+        return false;
+    }
+    if (!range.start() || _partition->tri_compare(s, range.start()->value()) != 0
+            || !bounds_equal(s, range.end(), _range->end())) {
+        return false;
+    }
+    if (!_partition_open) {
+        // The reader is at the next partition, which is where the page
+        // starts regardless of whether the range includes this one: its
+        // rows were all read already.
+        return true;
+    }
+    // The page has to start right after the last row read from the partition.
+    if (!range.start()->is_inclusive() || !_last_ckey) {
+        return false;
+    }
+    auto& row_ranges = slice.row_ranges(s, _partition->key());
+    if (row_ranges.empty()) {
+        return false;
+    }
+    auto& start = row_ranges.front().start();
+    return start && !start->is_inclusive() && clustering_key_prefix::equality(s)(start->value(), *_last_ckey);
+}
+
+querier_cache::querier_cache(std::function<bool()> is_short_of_resources, std::chrono::seconds entry_ttl)
+    : _is_short_of_resources(std::move(is_short_of_resources))
+    , _entry_ttl(entry_ttl)
+    , _expiry_timer([this] {
+        evict_expired();
+        evict_if_short_of_resources();
+    })
+{
+    _expiry_timer.arm_periodic(std::chrono::seconds(1));
+}
+
+void querier_cache::erase(entries::iterator it) {
+    _index.erase(it->key);
+    _entries.erase(it);
+    --_stats.population;
+}
+
+void querier_cache::evict_expired() {
+    auto now = lowres_clock::now();
+    while (!_entries.empty() && _entries.front().expires <= now) {
+        erase(_entries.begin());
+        ++_stats.time_based_evictions;
+    }
+}
+
+void querier_cache::insert(utils::UUID key, querier&& q) {
+    if (_is_short_of_resources()) {
+        // The reader would only add to the shortage.
+        ++_stats.resource_based_evictions;
+        return;
+    }
+    auto i = _index.find(key);
+    if (i != _index.end()) {
+        erase(i->second);
+    }
+    _entries.push_back(entry{key, std::move(q), lowres_clock::now() + _entry_ttl});
+    _index.emplace(key, std::prev(_entries.end()));
+    ++_stats.inserts;
+    ++_stats.population;
+}
+
+stdx::optional<querier> querier_cache::lookup(utils::UUID key, const schema& s, const dht::partition_range& range,
+        const partition_slice& slice) {
+    ++_stats.lookups;
+    auto i = _index.find(key);
+    if (i == _index.end()) {
+        ++_stats.misses;
+        return stdx::nullopt;
+    }
+    auto q = std::move(i->second->q);
+    erase(i->second);
+    if (!q.can_resume(s, range, slice)) {
+        qlogger.trace("Dropping querier of query {}, it doesn't match the page", key);
+        ++_stats.drops;
+        return stdx::nullopt;
+    }
+    return std::move(q);
+}
+
+void querier_cache::evict_if_short_of_resources() {
+    while (!_entries.empty() && _is_short_of_resources()) {
+        erase(_entries.begin());
+        ++_stats.resource_based_evictions;
+    }
+}
+
+void querier_cache::evict_all_for_table(const utils::UUID& cf_id) {
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        auto next = std::next(it);
+        if (it->q.schema()->id() == cf_id) {
+            erase(it);
+        }
+        it = next;
+    }
+}
+
+void querier_cache::evict_all() {
+    _entries.clear();
+    _index.clear();
+    _stats.population = 0;
+}
+
+void querier_cache::set_entry_ttl(std::chrono::seconds entry_ttl) {
+    _entry_ttl = entry_ttl;
+}
+
+querier_cache_context::querier_cache_context(querier_cache& cache, utils::UUID key, is_first_page first_page)
+    : _cache(key == utils::UUID() ? nullptr : &cache)
+    , _key(key)
+    , _is_first_page(first_page)
+{ }
+
+void querier_cache_context::insert(querier&& q) {
+    if (_cache) {
+        _cache->insert(_key, std::move(q));
+    }
+}
+
+stdx::optional<querier> querier_cache_context::lookup(const schema& s, const dht::partition_range& range,
+        const partition_slice& slice) {
+    if (!_cache || _is_first_page) {
+        return stdx::nullopt;
+    }
+    return _cache->lookup(_key, s, range, slice);
+}
+
+}
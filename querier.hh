@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <seastar/core/future-util.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/timer.hh>
+
+#include "flat_mutation_reader.hh"
+#include "mutation_reader.hh"
+#include "query-request.hh"
+#include "range_tombstone.hh"
+#include "schema.hh"
+#include "stdx.hh"
+#include "utils/UUID.hh"
+
+namespace query {
+
+// The reader of a paged data query, kept between two pages so that the next
+// page doesn't have to create its reader stack and skip to where the
+// previous page stopped.
+//
+// A page usually stops in the middle of a partition, once it has reached its
+// row limit. The querier then remembers the parts of that partition which the
+// next page needs in order to resume there: its key and tombstone, its static
+// row and the range tombstones seen so far. They are replayed to the consumer
+// of the next page before the rest of the partition is read.
+//
+// The querier owns the range and the slice its reader was created with,
+// because the reader refers to them.
+class querier {
+    template<typename Consumer>
+    class recording_consumer;
+
+    // Don't keep partitions with many range tombstones, replaying them
+    // would cost more than creating a new reader.
+    static constexpr size_t max_range_tombstones = 64;
+
+    schema_ptr _schema;
+    std::unique_ptr<const dht::partition_range> _range;
+    std::unique_ptr<const partition_slice> _slice;
+    flat_mutation_reader _reader;
+
+    // The last partition the reader entered.
+    stdx::optional<dht::decorated_key> _partition;
+    // Set if the page stopped inside _partition.
+    bool _partition_open = false;
+    tombstone _partition_tombstone;
+    stdx::optional<static_row> _static_row;
+    std::vector<range_tombstone> _range_tombstones;
+    stdx::optional<clustering_key_prefix> _last_ckey;
+    // Set when the consumer stopped the partition and the reader wasn't
+    // moved past it yet.
+    bool _stopped_in_partition = false;
+    bool _resumable = true;
+public:
+    querier(const mutation_source& source, schema_ptr s, const dht::partition_range& range,
+            const partition_slice& slice, tracing::trace_state_ptr trace_ptr);
+
+    querier(querier&&) = default;
+    querier& operator=(querier&&) = default;
+
+    const schema_ptr& schema() const {
+        return _schema;
+    }
+
+    // Returns true if a page for given range and slice continues exactly
+    // where the last page read with this querier stopped.
+    bool can_resume(const ::schema& s, const dht::partition_range& range, const partition_slice& slice) const;
+
+    bool is_exhausted() const {
+        return _reader.is_end_of_stream() && _reader.is_buffer_empty();
+    }
+
+    bool is_resumable() const {
+        return _resumable && !is_exhausted();
+    }
+
+    // Reads a page into consumer, which is a FlattenedConsumer.
+    // The querier must not be moved until the returned future resolves.
+    template<typename Consumer>
+    GCC6_CONCEPT(
+        requires FlattenedConsumer<Consumer>()
+    )
+    auto consume_page(Consumer consumer) {
+        if (_partition_open) {
+            if (replay_partition(consumer) == stop_iteration::yes) {
+                // The consumer doesn't want more of the partition, move on
+                // to the next one. The reader doesn't match the paging
+                // state anymore.
+                consumer.consume_end_of_partition();
+                _reader.next_partition();
+                _partition_open = false;
+                _resumable = false;
+                return futurize_apply([consumer = std::move(consumer)] () mutable {
+                    return consumer.consume_end_of_stream();
+                });
+            }
+        }
+        _stopped_in_partition = false;
+        return _reader.consume(recording_consumer<Consumer>(*this, std::move(consumer)));
+    }
+private:
+    void start_partition(const dht::decorated_key& dk);
+    void record_range_tombstone(const range_tombstone& rt);
+
+    template<typename Consumer>
+    stop_iteration replay_partition(Consumer& consumer) {
+        consumer.consume_new_partition(*_partition);
+        if (_partition_tombstone) {
+            consumer.consume(_partition_tombstone);
+        }
+        if (_static_row && consumer.consume(static_row(*_static_row)) == stop_iteration::yes) {
+            return stop_iteration::yes;
+        }
+        for (auto&& rt : _range_tombstones) {
+            if (consumer.consume(range_tombstone(rt)) == stop_iteration::yes) {
+                return stop_iteration::yes;
+            }
+        }
+        return stop_iteration::no;
+    }
+};
+
+// Passes fragments on to the consumer of a page while recording what the
+// querier needs to resume the partition in which the page stops.
+template<typename Consumer>
+class querier::recording_consumer {
+    querier& _q;
+    Consumer _consumer;
+
+    stop_iteration stopped(stop_iteration stop) {
+        _q._stopped_in_partition = bool(stop);
+        return stop;
+    }
+public:
+    recording_consumer(querier& q, Consumer consumer)
+        : _q(q)
+        , _consumer(std::move(consumer))
+    { }
+
+    void consume_new_partition(const dht::decorated_key& dk) {
+        _q.start_partition(dk);
+        _consumer.consume_new_partition(dk);
+    }
+    void consume(tombstone t) {
+        _q._partition_tombstone = t;
+        _consumer.consume(t);
+    }
+    stop_iteration consume(static_row&& sr) {
+        _q._static_row.emplace(sr);
+        return stopped(_consumer.consume(std::move(sr)));
+    }
+    stop_iteration consume(clustering_row&& cr) {
+        _q._last_ckey = cr.key();
+        return stopped(_consumer.consume(std::move(cr)));
+    }
+    stop_iteration consume(range_tombstone&& rt) {
+        _q.record_range_tombstone(rt);
+        return stopped(_consumer.consume(std::move(rt)));
+    }
+    stop_iteration consume_end_of_partition() {
+        auto stop = _consumer.consume_end_of_partition();
+        // If the consumer stopped inside the partition and the page ends
+        // here, the reader is still positioned inside it. Otherwise the
+        // reader has reached the end of the partition or will skip to it.
+        _q._partition_open = _q._stopped_in_partition && stop;
+        _q._stopped_in_partition = false;
+        return stop;
+    }
+    auto consume_end_of_stream() {
+        return _consumer.consume_end_of_stream();
+    }
+};
+
+// Keeps the queriers of paged queries between their pages, keyed by
+// read_command::query_uuid.
+//
+// Queriers are evicted once they have not been resumed for entry_ttl, and
+// oldest first when reads are short of resources, since a querier holds on
+// to the resources of its reader.
+class querier_cache {
+public:
+    static const std::chrono::seconds default_entry_ttl;
+
+    struct stats {
+        // Queriers stored after a page.
+        uint64_t inserts = 0;
+        // Pages which looked for a querier.
+        uint64_t lookups = 0;
+        // Lookups which didn't find a querier.
+        uint64_t misses = 0;
+        // Queriers found which couldn't resume the page.
+        uint64_t drops = 0;
+        uint64_t time_based_evictions = 0;
+        uint64_t resource_based_evictions = 0;
+        uint64_t population = 0;
+    };
+private:
+    struct entry {
+        utils::UUID key;
+        querier q;
+        lowres_clock::time_point expires;
+    };
+    using entries = std::list<entry>;
+
+    // Oldest first.
+    entries _entries;
+    std::unordered_map<utils::UUID, entries::iterator> _index;
+    std::function<bool()> _is_short_of_resources;
+    std::chrono::seconds _entry_ttl;
+    timer<lowres_clock> _expiry_timer;
+    stats _stats;
+
+    void erase(entries::iterator it);
+    void evict_expired();
+public:
+    explicit querier_cache(std::function<bool()> is_short_of_resources = [] { return false; },
+            std::chrono::seconds entry_ttl = default_entry_ttl);
+
+    querier_cache(const querier_cache&) = delete;
+    querier_cache(querier_cache&&) = delete;
+
+    // Stores the querier for the next page of the query, replacing any
+    // querier stored under key before.
+    void insert(utils::UUID key, querier&& q);
+
+    // Removes the querier stored under key and returns it if it can resume
+    // the page with given range and slice.
+    stdx::optional<querier> lookup(utils::UUID key, const schema& s, const dht::partition_range& range,
+            const partition_slice& slice);
+
+    // Evicts queriers, oldest first, while reads are short of resources.
+    // Called before starting a read, so that it doesn't have to wait for the
+    // resources idle queriers hold.
+    void evict_if_short_of_resources();
+
+    // Evicts the queriers reading from given table, which is going away.
+    void evict_all_for_table(const utils::UUID& cf_id);
+
+    void evict_all();
+
+    void set_entry_ttl(std::chrono::seconds entry_ttl);
+
+    const stats& get_stats() const {
+        return _stats;
+    }
+};
+
+// The querier cache of a query, as seen by data_query().
+class querier_cache_context {
+    querier_cache* _cache = nullptr;
+    utils::UUID _key;
+    is_first_page _is_first_page = is_first_page::no;
+public:
+    querier_cache_context() = default;
+    querier_cache_context(querier_cache& cache, utils::UUID key, is_first_page first_page);
+
+    explicit operator bool() const {
+        return _cache;
+    }
+
+    void insert(querier&& q);
+    stdx::optional<querier> lookup(const schema& s, const dht::partition_range& range, const partition_slice& slice);
+};
+
+}
@@ -29,6 +29,7 @@
 #include "enum_set.hh"
 #include "range.hh"
 #include "tracing/tracing.hh"
+#include "db/consistency_level_type.hh"
 
 namespace query {
 
@@ -160,6 +161,8 @@ class partition_slice {
 
 constexpr auto max_partitions = std::numeric_limits<uint32_t>::max();
 
+using is_first_page = bool_class<class is_first_page_tag>;
+
 // Full specification of a query to the database.
 // Intended for passing across replicas.
 // Can be accessed across cores.
@@ -172,6 +175,11 @@ class read_command {
     gc_clock::time_point timestamp;
     std::experimental::optional<tracing::trace_info> trace_info;
     uint32_t partition_limit; // The maximum number of live partitions to return.
+    // Identifies the pages of a paged query, so that replicas can keep their
+    // readers between pages (see query::querier_cache). Null if the query
+    // isn't paged.
+    utils::UUID query_uuid;
+    query::is_first_page is_first_page;
     api::timestamp_type read_timestamp; // not serialized
 public:
     read_command(utils::UUID cf_id,
@@ -181,6 +189,8 @@ class read_command {
                  gc_clock::time_point now = gc_clock::now(),
                  std::experimental::optional<tracing::trace_info> ti = std::experimental::nullopt,
                  uint32_t partition_limit = max_partitions,
+                 utils::UUID query_uuid = utils::UUID(),
+                 query::is_first_page is_first_page = query::is_first_page::no,
                  api::timestamp_type rt = api::missing_timestamp)
         : cf_id(std::move(cf_id))
         , schema_version(std::move(schema_version))
@@ -189,10 +199,40 @@ class read_command {
         , timestamp(now)
         , trace_info(std::move(ti))
         , partition_limit(partition_limit)
+        , query_uuid(query_uuid)
+        , is_first_page(is_first_page)
         , read_timestamp(rt)
     { }
 
     friend std::ostream& operator<<(std::ostream& out, const read_command& r);
 };
 
+// An aggregate function of an aggregation query, which replicas compute
+// over their part of the queried ranges.
+struct aggregation_info {
+    sstring function_keyspace;
+    sstring function_name;
+    // Arguments of the function, as indexes into aggregate_request::column_names.
+    std::vector<uint32_t> column_indexes;
+};
+
+// Request to compute partial states of aggregates (see
+// cql3::functions::aggregate_function::aggregate::compute_partial())
+// over given ranges of a table, read with given consistency level.
+// As for READ_DATA, replicas continue the tracing session of
+// cmd.trace_info, if set.
+struct aggregate_request {
+    std::vector<aggregation_info> aggregations;
+    // Names of the columns returned for cmd.slice, in order.
+    std::vector<bytes> column_names;
+    read_command cmd;
+    dht::partition_range_vector ranges;
+    db::consistency_level cl;
+};
+
+struct aggregate_result {
+    // One per aggregate_request::aggregations.
+    std::vector<bytes_opt> partial_states;
+};
+
 }
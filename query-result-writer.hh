@@ -48,8 +48,8 @@ class result::partition_writer {
     const clustering_row_ranges& _ranges;
     ser::query_result__partitions<bytes_ostream>& _pw;
     ser::vector_position _pos;
-    md5_hasher& _digest;
-    md5_hasher _digest_pos;
+    digester& _digest;
+    digester _digest_pos;
     uint32_t& _row_count;
     uint32_t& _partition_count;
     api::timestamp_type& _last_modified;
@@ -61,7 +61,7 @@ class result::partition_writer {
         ser::query_result__partitions<bytes_ostream>& pw,
         ser::vector_position pos,
         ser::after_qr_partition__key<bytes_ostream> w,
-        md5_hasher& digest,
+        digester& digest,
         uint32_t& row_count,
         uint32_t& partition_count,
         api::timestamp_type& last_modified)
@@ -104,7 +104,7 @@ class result::partition_writer {
     const partition_slice& slice() const {
         return _slice;
     }
-    md5_hasher& digest() {
+    digester& digest() {
         return _digest;
     }
     uint32_t& row_count() {
@@ -121,7 +121,7 @@ class result::partition_writer {
 
 class result::builder {
     bytes_ostream _out;
-    md5_hasher _digest;
+    digester _digest;
     const partition_slice& _slice;
     ser::query_result__partitions<bytes_ostream> _w;
     result_request _request;
@@ -131,8 +131,10 @@ class result::builder {
     short_read _short_read;
     result_memory_accounter _memory_accounter;
 public:
-    builder(const partition_slice& slice, result_request request, result_memory_accounter memory_accounter)
-        : _slice(slice)
+    builder(const partition_slice& slice, result_request request, result_memory_accounter memory_accounter,
+            digest_algorithm da = digest_algorithm::MD5)
+        : _digest(request == result_request::only_result ? digest_algorithm::none : da)
+        , _slice(slice)
         , _w(ser::writer_of_query_result<bytes_ostream>(_out).start_partitions())
         , _request(request)
         , _memory_accounter(std::move(memory_accounter))
@@ -26,6 +26,8 @@
 #include "bytes_ostream.hh"
 #include "query-request.hh"
 #include "md5_hasher.hh"
+#include "utils/xx_hasher.hh"
+#include "digest_algorithm.hh"
 #include <experimental/optional>
 #include <seastar/util/bool_class.hh>
 #include "seastarx.hh"
@@ -286,6 +288,45 @@ class result_digest {
     }
 };
 
+// Computes the digest of a query result with the algorithm chosen by the
+// coordinator. Digests compare equal only if computed with the same algorithm.
+class digester {
+    digest_algorithm _algo;
+    md5_hasher _md5;
+    xx_hasher _xx;
+public:
+    explicit digester(digest_algorithm algo) : _algo(algo) { }
+
+    digest_algorithm algorithm() const {
+        return _algo;
+    }
+
+    void update(const char* ptr, size_t length) {
+        switch (_algo) {
+        case digest_algorithm::none:
+            break;
+        case digest_algorithm::MD5:
+            _md5.update(ptr, length);
+            break;
+        case digest_algorithm::xxHash:
+            _xx.update(ptr, length);
+            break;
+        }
+    }
+
+    result_digest::type finalize_array() {
+        switch (_algo) {
+        case digest_algorithm::none:
+            break;
+        case digest_algorithm::MD5:
+            return _md5.finalize_array();
+        case digest_algorithm::xxHash:
+            return _xx.finalize_array();
+        }
+        return { };
+    }
+};
+
 //
 // The query results are stored in a serialized form. This is in order to
 // address the following problems, which a structured format has:
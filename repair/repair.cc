@@ -20,6 +20,7 @@
  */
 
 #include "repair.hh"
+#include "row_level.hh"
 #include "range_split.hh"
 
 #include "streaming/stream_plan.hh"
@@ -756,6 +757,22 @@ static future<uint64_t> estimate_partitions(seastar::sharded<database>& db, cons
     );
 }
 
+// Repair a single cf in a single local range by comparing and transferring
+// individual rows, see row_level.hh.
+static future<> repair_cf_range_rows(repair_info& ri,
+        sstring cf, ::dht::token_range range,
+        const std::vector<gms::inet_address>& neighbors) {
+    return repair_range_rows(ri.db, ri.keyspace, cf, range, neighbors, [&ri] {
+        check_in_shutdown();
+        ri.check_in_abort();
+    }).handle_exception([&ri, range] (std::exception_ptr eptr) {
+        // Like a failed sub range below, let the repair continue with other
+        // ranges and report the failure when it's done.
+        ri.nr_failed_ranges++;
+        rlogger.warn("Failed row-level repair of range {}: {}", range, eptr);
+    });
+}
+
 // Repair a single cf in a single local range.
 // Comparable to RepairJob in Origin.
 static future<> repair_cf_range(repair_info& ri,
@@ -767,6 +784,9 @@ static future<> repair_cf_range(repair_info& ri,
     }
 
     ri.check_in_abort();
+    if (service::get_local_storage_service().cluster_supports_row_level_repair()) {
+        return repair_cf_range_rows(ri, std::move(cf), std::move(range), neighbors);
+    }
     return estimate_partitions(ri.db, ri.keyspace, cf, range).then([&ri, cf, range, &neighbors] (uint64_t estimated_partitions) {
     range_splitter ranges(range, estimated_partitions, ri.target_partitions);
     return do_with(seastar::gate(), true, std::move(cf), std::move(ranges),
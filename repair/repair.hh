@@ -112,6 +112,26 @@ future<partition_checksum> checksum_range(seastar::sharded<database> &db,
         const sstring& keyspace, const sstring& cf,
         const ::dht::token_range& range, repair_checksum rt);
 
+// The hash of a single row compared by row-level repair, see repair/row_level.hh.
+using repair_hash = uint64_t;
+
+// A position in the data of a table, as exchanged by row-level repair.
+// Encodes a partition key and a position_in_partition inside it.
+struct repair_row_position {
+    partition_key key;
+    int8_t region;
+    int8_t bound_weight;
+    std::experimental::optional<clustering_key_prefix> ck;
+};
+
+// What a replica holds in one round of row-level repair: the rows up to
+// and including bound, or up to the end of the repaired range if bound is
+// disengaged, and the sum of their hashes.
+struct repair_round_summary {
+    std::experimental::optional<repair_row_position> bound;
+    repair_hash set_hash;
+};
+
 namespace std {
 template<>
 struct hash<partition_checksum> {
@@ -0,0 +1,593 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repair/row_level.hh"
+#include "message/messaging_service.hh"
+#include "frozen_mutation.hh"
+#include "flat_mutation_reader.hh"
+#include "mutation.hh"
+#include "utils/xx_hasher.hh"
+#include "log.hh"
+
+#include <deque>
+#include <unordered_set>
+#include <boost/range/irange.hpp>
+#include <boost/range/numeric.hpp>
+#include <boost/range/adaptor/map.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <seastar/core/thread.hh>
+#include <seastar/core/lowres_clock.hh>
+
+static logging::logger rlogger("row_level_repair");
+
+// The amount of row data a round reads on each replica.
+static constexpr size_t round_size = 4 * 1024 * 1024;
+// The amount of row data a span reader reads at once.
+static constexpr size_t read_size = 512 * 1024;
+// The amount of received row data a session buffers before writing it.
+static constexpr size_t flush_size = 32 * 1024 * 1024;
+// Sessions of neighbors not used for that long belong to a repair master
+// which went away.
+static constexpr std::chrono::minutes session_idle_timeout{10};
+
+namespace {
+
+struct shard_read_result {
+    std::vector<repair_row> rows;
+    bool end;
+};
+
+}
+
+static int compare(const schema& s, const repair_position& a, const repair_position& b) {
+    auto c = a.dk.tri_compare(s, b.dk);
+    return c ? c : position_in_partition::tri_compare(s)(a.pos, b.pos);
+}
+
+static bool bounds_equal(const schema& s, const stdx::optional<repair_position>& a, const stdx::optional<repair_position>& b) {
+    if (!a || !b) {
+        return !a && !b;
+    }
+    return compare(s, *a, *b) == 0;
+}
+
+static stdx::optional<repair_row_position> to_row_position(const stdx::optional<repair_position>& p) {
+    if (!p) {
+        return stdx::nullopt;
+    }
+    stdx::optional<clustering_key_prefix> ck;
+    if (p->pos.has_clustering_key()) {
+        ck = p->pos.key();
+    }
+    return repair_row_position{p->dk.key(), int8_t(p->pos.region()), int8_t(p->pos.bound_weight()), std::move(ck)};
+}
+
+static stdx::optional<repair_position> from_row_position(const schema& s, stdx::optional<repair_row_position> p) {
+    if (!p) {
+        return stdx::nullopt;
+    }
+    auto view = position_in_partition_view(partition_region(p->region), p->bound_weight, p->ck ? &*p->ck : nullptr);
+    auto pos = position_in_partition(view);
+    return repair_position{dht::global_partitioner().decorate_key(s, std::move(p->key)), std::move(pos)};
+}
+
+// Reads the rows of a span of the repaired range which belongs to a single
+// shard. Lives on that shard.
+class shard_row_reader {
+    schema_ptr _schema;
+    dht::partition_range_vector _ranges;
+    flat_mutation_reader _reader;
+    stdx::optional<dht::decorated_key> _dk;
+    bool _end = false;
+private:
+    repair_row make_row(const mutation_fragment& mf) {
+        mutation m(*_dk, _schema);
+        m.apply(mf);
+        xx_hasher h;
+        feed_hash(h, m);
+        auto fm = freeze(m);
+        auto size = fm.representation().size();
+        return repair_row{std::move(fm), h.finalize_uint64(), repair_position{*_dk, position_in_partition(mf.position())}, size};
+    }
+public:
+    shard_row_reader(column_family& cf, dht::partition_range range)
+        : _schema(cf.schema())
+        , _ranges{std::move(range)}
+        , _reader(cf.make_streaming_reader(_schema, _ranges))
+    { }
+
+    // Reads at least max_size bytes of rows, unless the span ends first.
+    future<shard_read_result> read(size_t max_size) {
+        return do_with(std::vector<repair_row>(), size_t(0), [this, max_size] (auto& rows, auto& size) {
+            return repeat([this, max_size, &rows, &size] {
+                if (size >= max_size) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                return _reader().then([this, &rows, &size] (mutation_fragment_opt mf) {
+                    if (!mf) {
+                        _end = true;
+                        return stop_iteration::yes;
+                    }
+                    if (mf->is_end_of_partition()) {
+                        return stop_iteration::no;
+                    }
+                    if (mf->is_partition_start()) {
+                        _dk = mf->as_partition_start().key();
+                        if (!mf->as_partition_start().partition_tombstone()) {
+                            return stop_iteration::no;
+                        }
+                    }
+                    rows.push_back(make_row(*mf));
+                    size += rows.back().size;
+                    return stop_iteration::no;
+                });
+            }).then([this, &rows] {
+                return shard_read_result{std::move(rows), _end};
+            });
+        });
+    }
+};
+
+// Writes rows received from other replicas, which belong to this shard, into
+// a new sstable.
+static future<> write_rows(column_family& cf, std::vector<frozen_mutation> rows) {
+    auto s = cf.schema();
+    std::vector<mutation> mutations;
+    mutations.reserve(rows.size());
+    for (auto& fm : rows) {
+        if (fm.schema_version() != s->version()) {
+            throw repair_exception(sprint("Schema of %s.%s changed during row-level repair", s->ks_name(), s->cf_name()));
+        }
+        mutations.push_back(fm.unfreeze(s));
+    }
+    rows.clear();
+    std::stable_sort(mutations.begin(), mutations.end(), [&s] (const mutation& a, const mutation& b) {
+        return a.decorated_key().less_compare(*s, b.decorated_key());
+    });
+    std::vector<mutation> partitions;
+    for (auto& m : mutations) {
+        if (!partitions.empty() && partitions.back().decorated_key().equal(*s, m.decorated_key())) {
+            partitions.back().apply(std::move(m));
+        } else {
+            partitions.push_back(std::move(m));
+        }
+    }
+    auto range = dht::partition_range::make({dht::ring_position(partitions.front().decorated_key()), true},
+            {dht::ring_position(partitions.back().decorated_key()), true});
+    auto estimated_partitions = partitions.size();
+    return cf.write_and_add_sstable(flat_mutation_reader_from_mutations(std::move(partitions)), estimated_partitions, {std::move(range)});
+}
+
+// Reads more rows into _pending. Resolves to false at the end of the range.
+future<bool> row_level_repair_session::read_more() {
+    if (!_reader) {
+        auto span = _sharder.next(*_schema);
+        if (!span) {
+            return make_ready_future<bool>(false);
+        }
+        return _db.invoke_on(span->shard, [keyspace = _keyspace, cf = _cf, range = std::move(span->ring_range)] (database& db) mutable {
+            return make_foreign(std::make_unique<shard_row_reader>(db.find_column_family(keyspace, cf), std::move(range)));
+        }).then([this] (foreign_ptr<std::unique_ptr<shard_row_reader>> reader) {
+            _reader = std::move(reader);
+            return true;
+        });
+    }
+    return smp::submit_to(_reader.get_owner_shard(), [reader = _reader.get()] {
+        return reader->read(read_size).then([] (shard_read_result result) {
+            return make_foreign(std::make_unique<shard_read_result>(std::move(result)));
+        });
+    }).then([this] (foreign_ptr<std::unique_ptr<shard_read_result>> result) {
+        if (result.get_owner_shard() == engine().cpu_id()) {
+            std::move(result->rows.begin(), result->rows.end(), std::back_inserter(_pending));
+        } else {
+            std::copy(result->rows.begin(), result->rows.end(), std::back_inserter(_pending));
+        }
+        if (result->end) {
+            _reader = {};
+        }
+        return true;
+    });
+}
+
+// Resolves to the next row not in the round, or nullptr at the end of
+// the range.
+future<repair_row*> row_level_repair_session::next_row() {
+    return repeat([this] {
+        if (!_pending.empty() || _range_end) {
+            return make_ready_future<stop_iteration>(stop_iteration::yes);
+        }
+        return read_more().then([this] (bool more) {
+            _range_end = !more;
+            return stop_iteration::no;
+        });
+    }).then([this] {
+        return _pending.empty() ? nullptr : &_pending.front();
+    });
+}
+
+repair_hash row_level_repair_session::set_hash() const {
+    return boost::accumulate(_round | boost::adaptors::transformed(std::mem_fn(&repair_row::hash)), repair_hash(0));
+}
+
+row_level_repair_session::row_level_repair_session(seastar::sharded<database>& db, sstring keyspace, sstring cf, const dht::token_range& range)
+    : _db(db)
+    , _keyspace(std::move(keyspace))
+    , _cf(std::move(cf))
+    , _schema(db.local().find_column_family(_keyspace, _cf).schema())
+    , _sharder(dht::to_partition_range(range))
+{ }
+
+row_level_repair_session::~row_level_repair_session() = default;
+
+future<stdx::optional<repair_position>> row_level_repair_session::fill(stdx::optional<repair_position> bound) {
+    _last_used = lowres_clock::now();
+    _round.clear();
+    _round_size = 0;
+    return do_with(std::move(bound), false, [this] (auto& bound, bool& limited) {
+        return repeat([this, &bound, &limited] {
+            return next_row().then([this, &bound, &limited] (repair_row* row) {
+                if (!row || (bound && compare(*_schema, row->position, *bound) > 0)) {
+                    return stop_iteration::yes;
+                }
+                // Rows at the same position have to end up in the same round.
+                if (_round_size >= round_size && compare(*_schema, row->position, _round.back().position) != 0) {
+                    limited = true;
+                    return stop_iteration::yes;
+                }
+                _round_size += row->size;
+                _round.push_back(std::move(*row));
+                _pending.pop_front();
+                return stop_iteration::no;
+            });
+        }).then([this, &bound, &limited] {
+            if (limited) {
+                return stdx::optional<repair_position>(_round.back().position);
+            }
+            return std::move(bound);
+        });
+    });
+}
+
+repair_hash row_level_repair_session::set_bound(const stdx::optional<repair_position>& bound) {
+    _last_used = lowres_clock::now();
+    if (bound) {
+        while (!_round.empty() && compare(*_schema, _round.back().position, *bound) > 0) {
+            _round_size -= _round.back().size;
+            _pending.push_front(std::move(_round.back()));
+            _round.pop_back();
+        }
+    }
+    return set_hash();
+}
+
+std::vector<repair_hash> row_level_repair_session::round_hashes() {
+    _last_used = lowres_clock::now();
+    return boost::copy_range<std::vector<repair_hash>>(_round | boost::adaptors::transformed(std::mem_fn(&repair_row::hash)));
+}
+
+std::vector<frozen_mutation> row_level_repair_session::get_rows(const std::vector<repair_hash>& hashes) {
+    _last_used = lowres_clock::now();
+    std::unordered_map<repair_hash, const repair_row*> rows;
+    for (auto& row : _round) {
+        rows.emplace(row.hash, &row);
+    }
+    std::vector<frozen_mutation> result;
+    result.reserve(hashes.size());
+    for (auto h : hashes) {
+        auto i = rows.find(h);
+        if (i == rows.end()) {
+            throw repair_exception(sprint("Row-level repair of %s.%s requested an unknown row", _keyspace, _cf));
+        }
+        result.push_back(i->second->fm);
+    }
+    return result;
+}
+
+future<> row_level_repair_session::put_rows(std::vector<frozen_mutation> rows) {
+    _last_used = lowres_clock::now();
+    for (auto& fm : rows) {
+        _received_size += fm.representation().size();
+        _received.push_back(std::move(fm));
+    }
+    if (_received_size >= flush_size) {
+        return flush_received();
+    }
+    return make_ready_future<>();
+}
+
+future<> row_level_repair_session::flush_received() {
+    std::unordered_map<unsigned, std::vector<frozen_mutation>> rows_per_shard;
+    for (auto& fm : _received) {
+        auto shard = dht::global_partitioner().shard_of(fm.decorated_key(*_schema).token());
+        rows_per_shard[shard].push_back(std::move(fm));
+    }
+    _received.clear();
+    _received_size = 0;
+    return do_with(std::move(rows_per_shard), [this] (auto& rows_per_shard) {
+        return parallel_for_each(rows_per_shard, [this] (auto& shard_rows) {
+            return _db.invoke_on(shard_rows.first, [keyspace = _keyspace, cf = _cf, rows = std::move(shard_rows.second)] (database& db) mutable {
+                return write_rows(db.find_column_family(keyspace, cf), std::move(rows));
+            });
+        });
+    });
+}
+
+future<> row_level_repair_session::stop() {
+    _round.clear();
+    _pending.clear();
+    _reader = {};
+    return flush_received();
+}
+
+// Sessions of the repairs this node is a neighbor in, on their home shard.
+static thread_local std::unordered_map<utils::UUID, lw_shared_ptr<row_level_repair_session>> neighbor_sessions;
+
+static unsigned session_shard(const utils::UUID& id) {
+    return std::hash<utils::UUID>()(id) % smp::count;
+}
+
+static lw_shared_ptr<row_level_repair_session> get_neighbor_session(const utils::UUID& id) {
+    auto i = neighbor_sessions.find(id);
+    if (i == neighbor_sessions.end()) {
+        throw repair_exception(sprint("Unknown row-level repair session %s", id));
+    }
+    return i->second;
+}
+
+static void remove_idle_neighbor_sessions() {
+    auto now = lowres_clock::now();
+    for (auto i = neighbor_sessions.begin(); i != neighbor_sessions.end();) {
+        if (now - i->second->last_used() > session_idle_timeout) {
+            rlogger.warn("Dropping idle row-level repair session {}", i->first);
+            i = neighbor_sessions.erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+// Runs func on the home shard of session id, with the session.
+template<typename Func>
+static auto with_neighbor_session(const utils::UUID& id, Func&& func) {
+    return smp::submit_to(session_shard(id), [id, func = std::forward<Func>(func)] () mutable {
+        auto session = get_neighbor_session(id);
+        return futurize_apply(func, *session).finally([session] { });
+    });
+}
+
+void row_level_repair_init_messaging_service_handler(seastar::sharded<database>& db) {
+    auto& ms = netw::get_local_messaging_service();
+    ms.register_repair_row_level_start([&db] (utils::UUID id, sstring keyspace, sstring cf, dht::token_range range) {
+        return smp::submit_to(session_shard(id), [&db, id, keyspace = std::move(keyspace), cf = std::move(cf), range = std::move(range)] {
+            remove_idle_neighbor_sessions();
+            neighbor_sessions.emplace(id, make_lw_shared<row_level_repair_session>(db, keyspace, cf, range));
+        });
+    });
+    ms.register_repair_row_level_fill([] (utils::UUID id, stdx::optional<repair_row_position> bound) {
+        return with_neighbor_session(id, [bound = std::move(bound)] (row_level_repair_session& session) mutable {
+            return session.fill(from_row_position(*session.schema(), std::move(bound))).then([&session] (stdx::optional<repair_position> reached) {
+                return repair_round_summary{to_row_position(reached), session.round_hash()};
+            });
+        });
+    });
+    ms.register_repair_row_level_set_bound([] (utils::UUID id, stdx::optional<repair_row_position> bound) {
+        return with_neighbor_session(id, [bound = std::move(bound)] (row_level_repair_session& session) mutable {
+            return session.set_bound(from_row_position(*session.schema(), std::move(bound)));
+        });
+    });
+    ms.register_repair_row_level_get_hashes([] (utils::UUID id) {
+        return with_neighbor_session(id, [] (row_level_repair_session& session) {
+            return session.round_hashes();
+        });
+    });
+    ms.register_repair_row_level_get_rows([] (utils::UUID id, std::vector<repair_hash> hashes) {
+        return with_neighbor_session(id, [hashes = std::move(hashes)] (row_level_repair_session& session) {
+            return session.get_rows(hashes);
+        });
+    });
+    ms.register_repair_row_level_put_rows([] (utils::UUID id, std::vector<frozen_mutation> rows) {
+        return with_neighbor_session(id, [rows = std::move(rows)] (row_level_repair_session& session) mutable {
+            return session.put_rows(std::move(rows));
+        });
+    });
+    ms.register_repair_row_level_stop([] (utils::UUID id) {
+        return smp::submit_to(session_shard(id), [id] {
+            auto session = get_neighbor_session(id);
+            neighbor_sessions.erase(id);
+            return session->stop().finally([session] { });
+        });
+    });
+}
+
+// A neighbor reached through the REPAIR_ROW_LEVEL_* verbs.
+class rpc_repair_neighbor : public row_level_repair_neighbor {
+    schema_ptr _schema;
+    netw::msg_addr _addr;
+    utils::UUID _id;
+public:
+    rpc_repair_neighbor(schema_ptr s, gms::inet_address node, utils::UUID id)
+        : _schema(std::move(s))
+        , _addr{node}
+        , _id(id)
+    { }
+    virtual future<stdx::optional<repair_position>, repair_hash> fill(const stdx::optional<repair_position>& bound) override {
+        return netw::get_local_messaging_service().send_repair_row_level_fill(_addr, _id, to_row_position(bound)).then([this] (repair_round_summary summary) {
+            return make_ready_future<stdx::optional<repair_position>, repair_hash>(from_row_position(*_schema, std::move(summary.bound)), summary.set_hash);
+        });
+    }
+    virtual future<repair_hash> set_bound(const stdx::optional<repair_position>& bound) override {
+        return netw::get_local_messaging_service().send_repair_row_level_set_bound(_addr, _id, to_row_position(bound));
+    }
+    virtual future<std::vector<repair_hash>> round_hashes() override {
+        return netw::get_local_messaging_service().send_repair_row_level_get_hashes(_addr, _id);
+    }
+    virtual future<std::vector<frozen_mutation>> get_rows(std::vector<repair_hash> hashes) override {
+        return netw::get_local_messaging_service().send_repair_row_level_get_rows(_addr, _id, std::move(hashes));
+    }
+    virtual future<> put_rows(std::vector<frozen_mutation> rows) override {
+        return netw::get_local_messaging_service().send_repair_row_level_put_rows(_addr, _id, std::move(rows));
+    }
+};
+
+bool repair_round(row_level_repair_session& master, const std::vector<row_level_repair_neighbor*>& neighbors) {
+    auto& s = *master.schema();
+    auto nodes = boost::irange<size_t>(0, neighbors.size());
+
+    auto master_bound = master.fill(stdx::nullopt).get0();
+    auto master_hash = master.round_hash();
+    std::vector<stdx::optional<repair_position>> bounds(neighbors.size());
+    std::vector<repair_hash> hashes(neighbors.size());
+    auto bound = master_bound;
+    parallel_for_each(nodes, [&] (size_t i) {
+        return neighbors[i]->fill(master_bound).then([&, i] (stdx::optional<repair_position> reached, repair_hash h) {
+            bounds[i] = std::move(reached);
+            hashes[i] = h;
+        });
+    }).get();
+
+    // The round ends at the smallest bound reached, so that every replica
+    // has all of its rows up to it.
+    for (auto& b : bounds) {
+        if (b && (!bound || compare(s, *b, *bound) < 0)) {
+            bound = b;
+        }
+    }
+    if (!bounds_equal(s, master_bound, bound)) {
+        master_hash = master.set_bound(bound);
+    }
+    parallel_for_each(nodes, [&] (size_t i) {
+        if (bounds_equal(s, bounds[i], bound)) {
+            return make_ready_future<>();
+        }
+        return neighbors[i]->set_bound(bound).then([&, i] (repair_hash h) {
+            hashes[i] = h;
+        });
+    }).get();
+
+    std::vector<size_t> differing;
+    for (auto i : nodes) {
+        if (hashes[i] != master_hash) {
+            differing.push_back(i);
+        }
+    }
+    if (differing.empty()) {
+        return bool(bound);
+    }
+    rlogger.debug("Rows differ on {} of {} neighbors in round of {}.{}", differing.size(), neighbors.size(), s.ks_name(), s.cf_name());
+
+    // Collect the hashes of the differing replicas and fetch the rows the
+    // master lacks, each from one replica.
+    auto master_hashes = master.round_hashes();
+    std::unordered_set<repair_hash> known(master_hashes.begin(), master_hashes.end());
+    std::vector<std::unordered_set<repair_hash>> neighbor_rows(neighbors.size());
+    parallel_for_each(differing, [&] (size_t i) {
+        return neighbors[i]->round_hashes().then([&, i] (std::vector<repair_hash> row_hashes) {
+            neighbor_rows[i].insert(row_hashes.begin(), row_hashes.end());
+        });
+    }).get();
+    std::vector<std::vector<repair_hash>> to_fetch(neighbors.size());
+    std::unordered_set<repair_hash> fetching;
+    for (auto i : differing) {
+        for (auto h : neighbor_rows[i]) {
+            if (!known.count(h) && fetching.insert(h).second) {
+                to_fetch[i].push_back(h);
+            }
+        }
+    }
+    std::unordered_map<repair_hash, frozen_mutation> fetched;
+    parallel_for_each(differing, [&] (size_t i) {
+        if (to_fetch[i].empty()) {
+            return make_ready_future<>();
+        }
+        return neighbors[i]->get_rows(to_fetch[i]).then([&, i] (std::vector<frozen_mutation> rows) {
+            if (rows.size() != to_fetch[i].size()) {
+                throw repair_exception(sprint("Row-level repair got %d rows from a neighbor, requested %d", rows.size(), to_fetch[i].size()));
+            }
+            for (size_t j = 0; j < rows.size(); ++j) {
+                fetched.emplace(to_fetch[i][j], std::move(rows[j]));
+            }
+        });
+    }).get();
+
+    // Send each differing replica the rows it lacks.
+    auto master_rows = master.get_rows(master_hashes);
+    parallel_for_each(differing, [&] (size_t i) {
+        std::vector<frozen_mutation> rows;
+        for (size_t j = 0; j < master_hashes.size(); ++j) {
+            if (!neighbor_rows[i].count(master_hashes[j])) {
+                rows.push_back(master_rows[j]);
+            }
+        }
+        for (auto& x : fetched) {
+            if (!neighbor_rows[i].count(x.first)) {
+                rows.push_back(x.second);
+            }
+        }
+        if (rows.empty()) {
+            return make_ready_future<>();
+        }
+        return neighbors[i]->put_rows(std::move(rows));
+    }).get();
+    master.put_rows(boost::copy_range<std::vector<frozen_mutation>>(fetched | boost::adaptors::map_values)).get();
+    return bool(bound);
+}
+
+future<> repair_range_rows(seastar::sharded<database>& db, sstring keyspace, sstring cf,
+        dht::token_range range, std::vector<gms::inet_address> neighbors,
+        std::function<void()> check_in_abort) {
+    return seastar::async([&db, keyspace = std::move(keyspace), cf = std::move(cf), range = std::move(range),
+            neighbors = std::move(neighbors), check_in_abort = std::move(check_in_abort)] {
+        auto& ms = netw::get_local_messaging_service();
+        auto id = utils::make_random_uuid();
+        row_level_repair_session master(db, keyspace, cf, range);
+        auto rpc_neighbors = boost::copy_range<std::vector<rpc_repair_neighbor>>(neighbors | boost::adaptors::transformed([&] (gms::inet_address node) {
+            return rpc_repair_neighbor(master.schema(), node, id);
+        }));
+        auto neighbor_ptrs = boost::copy_range<std::vector<row_level_repair_neighbor*>>(rpc_neighbors | boost::adaptors::transformed([] (rpc_repair_neighbor& n) {
+            return static_cast<row_level_repair_neighbor*>(&n);
+        }));
+        rlogger.debug("Starting row-level repair session {} of {}.{} range {} with {}", id, keyspace, cf, range, neighbors);
+        std::exception_ptr ex;
+        try {
+            parallel_for_each(neighbors, [&] (gms::inet_address node) {
+                return ms.send_repair_row_level_start(netw::msg_addr{node}, id, keyspace, cf, range);
+            }).get();
+            do {
+                check_in_abort();
+            } while (repair_round(master, neighbor_ptrs));
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        // Stop the sessions even after a failure, so that the neighbors
+        // write the rows they received and drop their state.
+        auto stopped = when_all(parallel_for_each(neighbors, [&] (gms::inet_address node) {
+            return ms.send_repair_row_level_stop(netw::msg_addr{node}, id);
+        }), master.stop()).get0();
+        if (ex) {
+            std::get<0>(stopped).ignore_ready_future();
+            std::get<1>(stopped).ignore_ready_future();
+            std::rethrow_exception(ex);
+        }
+        std::get<0>(stopped).get();
+        std::get<1>(stopped).get();
+        rlogger.debug("Finished row-level repair session {}", id);
+    });
+}
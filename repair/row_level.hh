@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/lowres_clock.hh>
+
+#include "repair/repair.hh"
+#include "dht/i_partitioner.hh"
+#include "frozen_mutation.hh"
+#include "gms/inet_address.hh"
+#include "position_in_partition.hh"
+
+// Row-level repair compares the rows of a range between the replicas and
+// transfers only the rows some replica is missing, instead of streaming
+// every partition of a sub-range whose checksum differs.
+//
+// The node which runs the repair (the master) and each neighbor open a
+// session on the range, which reads the range once, in ring order and on
+// the shards owning its data. The range is processed in rounds, which
+// cover the rows up to a common bound. A round holds a bounded amount of
+// data, so memory use doesn't depend on the size of the partitions.
+//
+// In each round, the replicas first exchange the sum of the hashes of the
+// rows in the round. Only the replicas whose sum differs from the master's
+// send the hashes of their rows, after which the master fetches the rows it
+// lacks and sends each neighbor the rows the neighbor lacks. Received rows
+// are written into new sstables directly, rather than applied to memtables.
+
+// The position of a row: a partition and the position of the row in it.
+struct repair_position {
+    dht::decorated_key dk;
+    position_in_partition pos;
+};
+
+// A row, as compared and transferred by row-level repair: the partition
+// tombstone, the static row, a clustering row or a range tombstone of a
+// partition, in a mutation of its own.
+struct repair_row {
+    frozen_mutation fm;
+    repair_hash hash;
+    repair_position position;
+    size_t size;
+};
+
+class shard_row_reader;
+
+// The state of one replica in the row-level repair of a range.
+//
+// Rows are read into _pending in position order, span after span, and move
+// into _round when a round takes them. All methods but the constructor must
+// be called one at a time.
+class row_level_repair_session {
+    seastar::sharded<database>& _db;
+    sstring _keyspace;
+    sstring _cf;
+    schema_ptr _schema;
+    dht::ring_position_range_sharder _sharder;
+    foreign_ptr<std::unique_ptr<shard_row_reader>> _reader;
+    bool _range_end = false;
+    std::deque<repair_row> _pending;
+    std::vector<repair_row> _round;
+    size_t _round_size = 0;
+    std::vector<frozen_mutation> _received;
+    size_t _received_size = 0;
+    lowres_clock::time_point _last_used = lowres_clock::now();
+private:
+    future<bool> read_more();
+    future<repair_row*> next_row();
+    repair_hash set_hash() const;
+public:
+    row_level_repair_session(seastar::sharded<database>& db, sstring keyspace, sstring cf, const dht::token_range& range);
+    ~row_level_repair_session();
+
+    const schema_ptr& schema() const {
+        return _schema;
+    }
+
+    lowres_clock::time_point last_used() const {
+        return _last_used;
+    }
+
+    // Starts the next round, with the rows following the previous one up to
+    // bound, if given, or up to the end of the range. Stops early once the
+    // round holds round_size bytes of rows. Resolves to the bound the round
+    // reached, disengaged if it reached the end of the range.
+    future<stdx::optional<repair_position>> fill(stdx::optional<repair_position> bound);
+
+    // Shrinks the round to the rows up to bound.
+    repair_hash set_bound(const stdx::optional<repair_position>& bound);
+
+    repair_hash round_hash() const {
+        return set_hash();
+    }
+
+    std::vector<repair_hash> round_hashes();
+
+    // Returns the rows of the round with given hashes, in the same order.
+    std::vector<frozen_mutation> get_rows(const std::vector<repair_hash>& hashes);
+
+    // Stores rows other replicas have and this one lacks.
+    future<> put_rows(std::vector<frozen_mutation> rows);
+
+    // Writes the received rows, each on the shard which owns it.
+    future<> flush_received();
+
+    // Ends the session, writing the rows it received.
+    future<> stop();
+};
+
+// A neighbor of the repair master, as seen by repair_round(). Each method
+// does what the row_level_repair_session method of the same name does on
+// the neighbor.
+class row_level_repair_neighbor {
+public:
+    virtual ~row_level_repair_neighbor() { }
+    // Resolves to the bound the round reached and the hash of the round.
+    virtual future<stdx::optional<repair_position>, repair_hash> fill(const stdx::optional<repair_position>& bound) = 0;
+    virtual future<repair_hash> set_bound(const stdx::optional<repair_position>& bound) = 0;
+    virtual future<std::vector<repair_hash>> round_hashes() = 0;
+    virtual future<std::vector<frozen_mutation>> get_rows(std::vector<repair_hash> hashes) = 0;
+    virtual future<> put_rows(std::vector<frozen_mutation> rows) = 0;
+};
+
+// One round of the repair master: agrees with the neighbors on the bound of
+// the round and exchanges the rows which differ. Returns false once the
+// round reached the end of the range. Runs in a seastar thread.
+bool repair_round(row_level_repair_session& master, const std::vector<row_level_repair_neighbor*>& neighbors);
+
+// Repairs the rows of table keyspace.cf in range between this node and
+// neighbors. check_in_abort is called between rounds and aborts the repair
+// by throwing.
+future<> repair_range_rows(seastar::sharded<database>& db, sstring keyspace, sstring cf,
+        dht::token_range range, std::vector<gms::inet_address> neighbors,
+        std::function<void()> check_in_abort);
+
+// Starts handling the row-level repair verbs, for which this node is a
+// neighbor of the repair master.
+void row_level_repair_init_messaging_service_handler(seastar::sharded<database>& db);
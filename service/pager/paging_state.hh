@@ -45,6 +45,7 @@
 
 #include "bytes.hh"
 #include "keys.hh"
+#include "utils/UUID.hh"
 
 namespace service {
 
@@ -54,9 +55,10 @@ class paging_state final {
     partition_key _partition_key;
     std::experimental::optional<clustering_key> _clustering_key;
     uint32_t _remaining;
+    utils::UUID _query_uuid;
 
 public:
-    paging_state(partition_key pk, std::experimental::optional<clustering_key> ck, uint32_t rem);
+    paging_state(partition_key pk, std::experimental::optional<clustering_key> ck, uint32_t rem, utils::UUID query_uuid);
 
     /**
      * Last processed key, i.e. where to start from in next paging round
@@ -77,6 +79,13 @@ class paging_state final {
     uint32_t get_remaining() const {
         return _remaining;
     }
+    /**
+     * Identifies the query across its pages, see query::read_command::query_uuid.
+     * Null if the paging state comes from a node which doesn't send it.
+     */
+    utils::UUID get_query_uuid() const {
+        return _query_uuid;
+    }
 
     static ::shared_ptr<paging_state> deserialize(bytes_opt bytes);
     bytes_opt serialize() const;
@@ -77,8 +77,19 @@ class service::pager::query_pagers::impl : public query_pager {
             _max = state->get_remaining();
             _last_pkey = state->get_partition_key();
             _last_ckey = state->get_clustering_key();
+            _query_uuid = state->get_query_uuid();
         }
 
+        // Replicas keep their readers between the pages of a query with the
+        // same UUID, see query::querier_cache.
+        auto first_page = query::is_first_page::no;
+        if (_query_uuid == utils::UUID()) {
+            _query_uuid = utils::make_random_uuid();
+            first_page = query::is_first_page::yes;
+        }
+        _cmd->query_uuid = _query_uuid;
+        _cmd->is_first_page = first_page;
+
         if (_last_pkey) {
             auto dpk = dht::global_partitioner().decorate_key(*_schema, *_last_pkey);
             dht::ring_position lo(dpk);
@@ -303,7 +314,7 @@ class service::pager::query_pagers::impl : public query_pager {
         return _exhausted ?
                         nullptr :
                         ::make_shared<const paging_state>(*_last_pkey,
-                                        _last_ckey, _max);
+                                        _last_ckey, _max, _query_uuid);
     }
 
 private:
@@ -314,6 +325,7 @@ class service::pager::query_pagers::impl : public query_pager {
 
     std::experimental::optional<partition_key> _last_pkey;
     std::experimental::optional<clustering_key> _last_ckey;
+    utils::UUID _query_uuid;
 
     schema_ptr _schema;
     ::shared_ptr<cql3::selection::selection> _selection;
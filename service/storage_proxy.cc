@@ -55,12 +55,18 @@
 #include "db/read_repair_decision.hh"
 #include "db/config.hh"
 #include "db/batchlog_manager.hh"
+#include "cql3/functions/functions.hh"
+#include "cql3/functions/aggregate_function.hh"
+#include "cql3/selection/selection.hh"
+#include "cql3/result_set.hh"
+#include "service/pager/query_pagers.hh"
 #include "exceptions/exceptions.hh"
 #include <boost/range/algorithm_ext/push_back.hpp>
 #include <boost/iterator/counting_iterator.hpp>
 #include <boost/range/adaptors.hpp>
 #include <boost/algorithm/cxx11/any_of.hpp>
 #include <boost/algorithm/cxx11/none_of.hpp>
+#include <boost/algorithm/cxx11/all_of.hpp>
 #include <boost/range/algorithm/count_if.hpp>
 #include <boost/range/algorithm/find.hpp>
 #include <boost/range/algorithm/find_if.hpp>
@@ -69,6 +75,7 @@
 #include <boost/range/numeric.hpp>
 #include <boost/range/algorithm/sort.hpp>
 #include <boost/range/empty.hpp>
+#include <boost/range/irange.hpp>
 #include <boost/range/algorithm/min_element.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 #include "utils/latency.hh"
@@ -120,6 +127,15 @@ sstring get_local_dc() {
     return get_dc(local_addr);
 }
 
+// Old nodes know only MD5, so xxHash can be requested only once the whole
+// cluster supports it.
+static inline
+query::digest_algorithm digest_algorithm() {
+    return service::get_local_storage_service().cluster_supports_xxhash_digest_algorithm()
+            ? query::digest_algorithm::xxHash
+            : query::digest_algorithm::MD5;
+}
+
 class mutation_holder {
 protected:
     size_t _size = 0;
@@ -542,7 +558,7 @@ inline uint64_t& storage_proxy::split_stats::get_ep_stat(gms::inet_address ep) {
 }
 
 storage_proxy::~storage_proxy() {}
-storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
+storage_proxy::storage_proxy(distributed<database>& db) : _db(db), _hints_manager(db.local().get_config(), db.local()) {
     namespace sm = seastar::metrics;
     _metrics.add_group(COORDINATOR_STATS_CATEGORY, {
         sm::make_histogram("read_latency", sm::description("The general read latency histogram"), [this]{ return _stats.estimated_read.get_histogram(16, 20);}),
@@ -559,6 +575,21 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
         sm::make_total_operations("throttled_writes", [this] { return _stats.throttled_writes; },
                        sm::description("number of throttled write requests")),
 
+        sm::make_total_operations("multi_mutation_messages", [this] { return _stats.multi_mutation_messages; },
+                       sm::description("number of messages sent to replicas which carried more than one write")),
+
+        sm::make_total_operations("multi_mutation_writes", [this] { return _stats.multi_mutation_writes; },
+                       sm::description("number of writes sent to replicas in messages carrying more than one write")),
+
+        sm::make_total_operations("aggregate_queries", [this] { return _stats.aggregate_queries; },
+                       sm::description("number of aggregation queries whose aggregates were computed by replicas")),
+
+        sm::make_total_operations("aggregate_requests", [this] { return _stats.aggregate_requests; },
+                       sm::description("number of requests to compute partial aggregates sent to replicas")),
+
+        sm::make_total_operations("aggregate_fallbacks", [this] { return _stats.aggregate_fallbacks; },
+                       sm::description("number of requests to compute partial aggregates which failed, and whose ranges were read by the coordinator instead")),
+
         sm::make_current_bytes("queued_write_bytes", [this] { return _stats.queued_write_bytes; },
                        sm::description("number of bytes in pending write requests")),
 
@@ -630,6 +661,9 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
         sm::make_total_operations("reads", _stats.replica_digest_reads,
                        sm::description("number of remote digest read requests this Node received"), {storage_proxy::split_stats::op_type_label("digest")}),
 
+        sm::make_total_operations("aggregate_requests", _stats.replica_aggregate_requests,
+                       sm::description("number of requests to compute partial aggregates this Node received")),
+
     });
 }
 
@@ -1121,7 +1155,7 @@ storage_proxy::create_write_response_handler(const mutation& m, db::consistency_
         // The idea is that if we have over maxHintsInProgress hints in flight, this is probably due to
         // a small number of nodes causing problems, so we should avoid shutting down writes completely to
         // healthy nodes.  Any node with no hintsInProgress is considered healthy.
-        throw overloaded_exception(_total_hints_in_progress);
+        throw overloaded_exception(_hints_manager.hints_in_progress());
     }
 
     // filter live endpoints from dead ones
@@ -1189,7 +1223,10 @@ future<std::vector<storage_proxy::unique_response_handler>> storage_proxy::mutat
 
 future<> storage_proxy::mutate_begin(std::vector<unique_response_handler> ids, db::consistency_level cl,
                                      stdx::optional<clock_type::time_point> timeout_opt) {
-    return parallel_for_each(ids, [this, cl, timeout_opt] (unique_response_handler& protected_response) {
+    auto timeout = timeout_opt.value_or(clock_type::now() + std::chrono::milliseconds(_db.local().get_config().write_request_timeout_in_ms()));
+    std::vector<response_id_type> response_ids;
+    response_ids.reserve(ids.size());
+    auto f = parallel_for_each(ids, [this, cl, timeout, &response_ids] (unique_response_handler& protected_response) {
         auto response_id = protected_response.id;
         // it is better to send first and hint afterwards to reduce latency
         // but request may complete before hint_to_dead_endpoints() is called and
@@ -1197,12 +1234,14 @@ future<> storage_proxy::mutate_begin(std::vector<unique_response_handler> ids, d
         // frozen_mutation copy, or manage handler live time differently.
         hint_to_dead_endpoints(response_id, cl);
 
-        auto timeout = timeout_opt.value_or(clock_type::now() + std::chrono::milliseconds(_db.local().get_config().write_request_timeout_in_ms()));
         // call before send_to_live_endpoints() for the same reason as above
         auto f = response_wait(response_id, timeout);
-        send_to_live_endpoints(protected_response.release(), timeout); // response is now running and it will either complete or timeout
+        response_ids.push_back(protected_response.release());
         return std::move(f);
     });
+    // All writes are sent together, so that those going to the same replicas share a message.
+    send_to_live_endpoints(std::move(response_ids), timeout); // responses are now running and they will either complete or timeout
+    return f;
 }
 
 // this function should be called with a future that holds result of mutation attempt (usually
@@ -1435,6 +1474,8 @@ storage_proxy::mutate_atomically(std::vector<mutation> mutations, db::consistenc
 
         const utils::UUID _batch_uuid;
         const std::unordered_set<gms::inet_address> _batchlog_endpoints;
+        // Deletes the batch from the batchlog it was written to.
+        stdx::optional<mutation> _batchlog_remove_mutation;
 
     public:
         context(storage_proxy & p, std::vector<mutation>&& mutations, db::consistency_level cl, tracing::trace_state_ptr tr_state)
@@ -1472,20 +1513,21 @@ storage_proxy::mutate_atomically(std::vector<mutation> mutations, db::consistenc
             });
         }
         future<> sync_write_to_batchlog() {
-            auto m = db::get_batchlog_manager().local().get_batch_log_mutation_for(_mutations, _batch_uuid, netw::messaging_service::current_version);
+            auto& bm = db::get_batchlog_manager().local();
+            auto m = bm.get_batch_log_mutation_for(_mutations, _batch_uuid, netw::messaging_service::current_version);
+            _batchlog_remove_mutation = bm.get_batch_log_remove_mutation_for(m);
             tracing::trace(_trace_state, "Sending a batchlog write mutation");
             return send_batchlog_mutation(std::move(m));
         };
+        // Still needed with system.batchlog_v2: the replaying node can't tell a
+        // batch whose mutations were all written from one whose coordinator
+        // failed, so without this delete every batch would be replayed once it
+        // is due. The delete is one row tombstone, which the table's zero grace
+        // period lets replays and compaction purge, while replays drop whole
+        // buckets rather than adding a tombstone per batch.
         future<> async_remove_from_batchlog() {
-            // delete batch
-            auto schema = _p._db.local().find_schema(db::system_keyspace::NAME, db::system_keyspace::BATCHLOG);
-            auto key = partition_key::from_exploded(*schema, {uuid_type->decompose(_batch_uuid)});
-            auto now = service::client_state(service::client_state::internal_tag()).get_timestamp();
-            mutation m(key, schema);
-            m.partition().apply_delete(*schema, clustering_key_prefix::make_empty(), tombstone(now, gc_clock::now()));
-
             tracing::trace(_trace_state, "Sending a batchlog remove mutation");
-            return send_batchlog_mutation(std::move(m), db::consistency_level::ANY).handle_exception([] (std::exception_ptr eptr) {
+            return send_batchlog_mutation(std::move(*_batchlog_remove_mutation), db::consistency_level::ANY).handle_exception([] (std::exception_ptr eptr) {
                 slogger.error("Failed to remove mutations from batchlog: {}", eptr);
             });
         };
@@ -1516,7 +1558,7 @@ storage_proxy::mutate_atomically(std::vector<mutation> mutations, db::consistenc
 }
 
 bool storage_proxy::cannot_hint(gms::inet_address target) {
-    return _total_hints_in_progress > _max_hints_in_progress
+    return _hints_manager.hints_in_progress() > _max_hints_in_progress
             && (get_hints_in_progress_for(target) > 0 && should_hint(target));
 }
 
@@ -1535,6 +1577,45 @@ future<> storage_proxy::send_to_endpoint(mutation m, gms::inet_address target, d
         });
 }
 
+// Splits targets of a write into groups, each sent as one message. The last
+// endpoint in a group is the coordinator, which receives the mutation and
+// forwards it to the rest of the group.
+std::vector<std::vector<gms::inet_address>> storage_proxy::get_write_groups(abstract_write_response_handler& handler) {
+    // extra-datacenter replicas, grouped by dc
+    std::unordered_map<sstring, std::vector<gms::inet_address>> dc_groups;
+    std::vector<std::vector<gms::inet_address>> groups;
+    groups.reserve(3);
+
+    for(auto dest: handler.get_targets()) {
+        sstring dc = get_dc(dest);
+        // read repair writes do not go through coordinator since mutations are per destination
+        if (handler.read_repair_write() || dc == get_local_dc()) {
+            groups.emplace_back(std::vector<gms::inet_address>({dest}));
+        } else {
+            dc_groups[dc].push_back(dest);
+        }
+    }
+    for (auto& dc_targets : dc_groups) {
+        groups.push_back(std::move(dc_targets.second));
+    }
+    return groups;
+}
+
+static void log_write_error(gms::inet_address coordinator, std::exception_ptr eptr) {
+    try {
+        std::rethrow_exception(eptr);
+    } catch(rpc::closed_error&) {
+        // ignore, disconnect will be logged by gossiper
+    } catch(seastar::gate_closed_exception&) {
+        // may happen during shutdown, ignore it
+    } catch(timed_out_error&) {
+        // from lmutate(). Ignore so that logs are not flooded
+        // database total_writes_timedout counter was incremented.
+    } catch(...) {
+        slogger.error("exception during mutation write to {}: {}", coordinator, std::current_exception());
+    }
+}
+
 /**
  * Send the mutations to the right targets, write it locally if it corresponds or writes a hint when the node
  * is not available.
@@ -1552,25 +1633,59 @@ future<> storage_proxy::send_to_endpoint(mutation m, gms::inet_address target, d
  // returned future is ready when sent is complete, not when mutation is executed on all (or any) targets!
 void storage_proxy::send_to_live_endpoints(storage_proxy::response_id_type response_id, clock_type::time_point timeout)
 {
-    // extra-datacenter replicas, grouped by dc
-    std::unordered_map<sstring, std::vector<gms::inet_address>> dc_groups;
-    std::vector<std::pair<const sstring, std::vector<gms::inet_address>>> local;
-    local.reserve(3);
-
     auto handler_ptr = get_write_response_handler(response_id);
-    auto& handler = *handler_ptr;
+    for (auto& group : get_write_groups(*handler_ptr)) {
+        send_to_endpoints(handler_ptr, std::move(group), timeout);
+    }
+}
 
-    for(auto dest: handler.get_targets()) {
-        sstring dc = get_dc(dest);
-        // read repair writes do not go through coordinator since mutations are per destination
-        if (handler.read_repair_write() || dc == get_local_dc()) {
-            local.emplace_back("", std::vector<gms::inet_address>({dest}));
+// Sends writes started together, e.g. by one unlogged batch. Writes going to
+// the same group of replicas are sent in a single MUTATIONS message, if the
+// coordinator of the group supports it.
+void storage_proxy::send_to_live_endpoints(std::vector<storage_proxy::response_id_type> response_ids, clock_type::time_point timeout)
+{
+    if (response_ids.size() == 1) {
+        send_to_live_endpoints(response_ids.front(), timeout);
+        return;
+    }
+
+    auto& ss = get_local_storage_service();
+    auto my_address = utils::fb_utilities::get_broadcast_address();
+
+    // Handlers are held here because sending to other groups may fail and remove them.
+    std::vector<std::pair<shared_ptr<abstract_write_response_handler>, std::vector<std::vector<gms::inet_address>>>> writes;
+    writes.reserve(response_ids.size());
+    for (auto response_id : response_ids) {
+        auto handler_ptr = get_write_response_handler(response_id);
+        auto groups = get_write_groups(*handler_ptr);
+        writes.emplace_back(std::move(handler_ptr), std::move(groups));
+    }
+
+    // The coordinator of a group forwards the message as a whole, so every
+    // replica in the group must understand it.
+    auto can_batch = [&ss, my_address] (const shared_ptr<abstract_write_response_handler>& handler_ptr, const std::vector<gms::inet_address>& group) {
+        return group.back() != my_address && !handler_ptr->read_repair_write()
+                && boost::algorithm::all_of(group, [&ss] (gms::inet_address ep) { return ss.node_supports_multi_mutation_writes(ep); });
+    };
+    auto send_single = [this, timeout] (const shared_ptr<abstract_write_response_handler>& handler_ptr, std::vector<gms::inet_address> group) {
+        send_to_endpoints(handler_ptr, std::move(group), timeout);
+    };
+    auto batches = group_writes(std::move(writes), can_batch, send_single);
+
+    for (auto& batch : batches) {
+        if (batch.second.size() == 1) {
+            send_to_endpoints(std::move(batch.second.front()), batch.first, timeout);
         } else {
-            dc_groups[dc].push_back(dest);
+            send_to_endpoints(std::move(batch.second), batch.first, timeout);
         }
     }
+}
 
-    auto all = boost::range::join(local, dc_groups);
+void storage_proxy::send_to_endpoints(shared_ptr<abstract_write_response_handler> handler_ptr, std::vector<gms::inet_address> forward,
+        clock_type::time_point timeout)
+{
+    auto& handler = *handler_ptr;
+    auto response_id = handler.id();
     auto my_address = utils::fb_utilities::get_broadcast_address();
 
     // lambda for applying mutation locally
@@ -1600,52 +1715,84 @@ void storage_proxy::send_to_live_endpoints(storage_proxy::response_id_type respo
         });
     };
 
-    // OK, now send and/or apply locally
-    for (typename decltype(dc_groups)::value_type& dc_targets : all) {
-        auto& forward = dc_targets.second;
-        // last one in forward list is a coordinator
-        auto coordinator = forward.back();
-        forward.pop_back();
+    // last one in forward list is a coordinator
+    auto coordinator = forward.back();
+    forward.pop_back();
 
-        size_t forward_size = forward.size();
-        future<> f = make_ready_future<>();
+    size_t forward_size = forward.size();
+    future<> f = make_ready_future<>();
 
 
-        lw_shared_ptr<const frozen_mutation> m = handler.get_mutation_for(coordinator);
+    lw_shared_ptr<const frozen_mutation> m = handler.get_mutation_for(coordinator);
 
-        if (!m || (handler.is_counter() && coordinator == my_address)) {
-            got_response(response_id, coordinator);
+    if (!m || (handler.is_counter() && coordinator == my_address)) {
+        got_response(response_id, coordinator);
+    } else {
+        if (!handler.read_repair_write()) {
+            ++_stats.writes_attempts.get_ep_stat(coordinator);
         } else {
-            if (!handler.read_repair_write()) {
-                ++_stats.writes_attempts.get_ep_stat(coordinator);
-            } else {
-                ++_stats.read_repair_write_attempts.get_ep_stat(coordinator);
-            }
+            ++_stats.read_repair_write_attempts.get_ep_stat(coordinator);
+        }
 
-            if (coordinator == my_address) {
-                f = futurize<void>::apply(lmutate, std::move(m));
-            } else {
-                f = futurize<void>::apply(rmutate, coordinator, std::move(forward), *m);
-            }
+        if (coordinator == my_address) {
+            f = futurize<void>::apply(lmutate, std::move(m));
+        } else {
+            f = futurize<void>::apply(rmutate, coordinator, std::move(forward), *m);
         }
+    }
 
-        f.handle_exception([response_id, forward_size, coordinator, handler_ptr, p = shared_from_this()] (std::exception_ptr eptr) {
+    f.handle_exception([response_id, forward_size, coordinator, handler_ptr, p = shared_from_this()] (std::exception_ptr eptr) {
+        ++p->_stats.writes_errors.get_ep_stat(coordinator);
+        p->got_failure_response(response_id, coordinator, forward_size + 1);
+        log_write_error(coordinator, std::move(eptr));
+    });
+}
+
+void storage_proxy::send_to_endpoints(std::vector<shared_ptr<abstract_write_response_handler>> handlers, std::vector<gms::inet_address> forward,
+        clock_type::time_point timeout)
+{
+    auto& ms = netw::get_local_messaging_service();
+    auto my_address = utils::fb_utilities::get_broadcast_address();
+
+    // last one in forward list is a coordinator
+    auto coordinator = forward.back();
+    forward.pop_back();
+    size_t forward_size = forward.size();
+
+    std::vector<lw_shared_ptr<const frozen_mutation>> mutations;
+    std::vector<response_id_type> response_ids;
+    mutations.reserve(handlers.size());
+    response_ids.reserve(handlers.size());
+    size_t msize = 0;
+    for (auto& h : handlers) {
+        auto m = h->get_mutation_for(coordinator);
+        msize += m->representation().size();
+        mutations.push_back(std::move(m));
+        response_ids.push_back(h->id());
+        ++_stats.writes_attempts.get_ep_stat(coordinator);
+    }
+    _stats.queued_write_bytes += msize;
+    ++_stats.multi_mutation_messages;
+    _stats.multi_mutation_writes += handlers.size();
+
+    // All writes sent together were started by the same request.
+    auto tr_state = handlers.front()->get_trace_state();
+    tracing::trace(tr_state, "Sending {} mutations to /{}", mutations.size(), coordinator);
+
+    auto f = futurize<void>::apply([&] {
+        return ms.send_mutations(netw::messaging_service::msg_addr{coordinator, 0}, timeout, mutations,
+                std::move(forward), my_address, engine().cpu_id(), response_ids, tracing::make_trace_info(tr_state));
+    });
+    f.finally([this, p = shared_from_this(), handlers = std::move(handlers), msize] {
+        _stats.queued_write_bytes -= msize;
+        unthrottle();
+    }).handle_exception([response_ids = std::move(response_ids), forward_size, coordinator, p = shared_from_this()] (std::exception_ptr eptr) {
+        for (auto response_id : response_ids) {
             ++p->_stats.writes_errors.get_ep_stat(coordinator);
             p->got_failure_response(response_id, coordinator, forward_size + 1);
-            try {
-                std::rethrow_exception(eptr);
-            } catch(rpc::closed_error&) {
-                // ignore, disconnect will be logged by gossiper
-            } catch(seastar::gate_closed_exception&) {
-                // may happen during shutdown, ignore it
-            } catch(timed_out_error&) {
-                // from lmutate(). Ignore so that logs are not flooded
-                // database total_writes_timedout counter was incremented.
-            } catch(...) {
-                slogger.error("exception during mutation write to {}: {}", coordinator, std::current_exception());
-            }
-        });
-    }
+        }
+        log_write_error(coordinator, std::move(eptr));
+    });
 }
 
 // returns number of hints stored
@@ -1657,43 +1804,17 @@ size_t storage_proxy::hint_to_dead_endpoints(std::unique_ptr<mutation_holder>& m
 }
 
 size_t storage_proxy::get_hints_in_progress_for(gms::inet_address target) {
-    auto it = _hints_in_progress.find(target);
-
-    if (it == _hints_in_progress.end()) {
-        return 0;
-    }
-
-    return it->second;
+    return _hints_manager.hints_in_progress_for(target);
 }
 
 bool storage_proxy::submit_hint(std::unique_ptr<mutation_holder>& mh, gms::inet_address target)
 {
-    warn(unimplemented::cause::HINT);
-    // local write that time out should be handled by LocalMutationRunnable
-    assert(is_me(target));
-    return false;
-#if 0
-    HintRunnable runnable = new HintRunnable(target)
-    {
-        public void runMayThrow()
-        {
-            int ttl = HintedHandOffManager.calculateHintTTL(mutation);
-            if (ttl > 0)
-            {
-                slogger.debug("Adding hint for {}", target);
-                writeHintForMutation(mutation, System.currentTimeMillis(), ttl, target);
-                // Notify the handler only for CL == ANY
-                if (responseHandler != null && responseHandler.consistencyLevel == ConsistencyLevel.ANY)
-                    responseHandler.response(null);
-            } else
-            {
-                slogger.debug("Skipped writing hint for {} (ttl {})", target, ttl);
-            }
-        }
-    };
-
-    return submitHint(runnable);
-#endif
+    auto m = mh->get_mutation_for(target);
+    if (!m) {
+        return false;
+    }
+    slogger.debug("Adding hint for {}", target);
+    return _hints_manager.store_hint(target, mh->schema(), std::move(m));
 }
 
 #if 0
@@ -2518,12 +2639,15 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
     promise<foreign_ptr<lw_shared_ptr<query::result>>> _result_promise;
     tracing::trace_state_ptr _trace_state;
     lw_shared_ptr<column_family> _cf;
+    // Data and digest replies are compared with each other, so all replicas
+    // have to compute their digest with the same algorithm.
+    query::digest_algorithm _digest_algorithm;
 
 public:
     abstract_read_executor(schema_ptr s, lw_shared_ptr<column_family> cf, shared_ptr<storage_proxy> proxy, lw_shared_ptr<query::read_command> cmd, dht::partition_range pr, db::consistency_level cl, size_t block_for,
             std::vector<gms::inet_address> targets, tracing::trace_state_ptr trace_state) :
                            _schema(std::move(s)), _proxy(std::move(proxy)), _cmd(std::move(cmd)), _partition_range(std::move(pr)), _cl(cl), _block_for(block_for), _targets(std::move(targets)), _trace_state(std::move(trace_state)),
-                           _cf(std::move(cf)) {
+                           _cf(std::move(cf)), _digest_algorithm(digest_algorithm()) {
         _proxy->_stats.reads++;
     }
     virtual ~abstract_read_executor() {
@@ -2550,11 +2674,11 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
         if (is_me(ep)) {
             tracing::trace(_trace_state, "read_data: querying locally");
             auto qrr = want_digest ? query::result_request::result_and_digest : query::result_request::only_result;
-            return _proxy->query_result_local(_schema, _cmd, _partition_range, qrr, _trace_state);
+            return _proxy->query_result_local(_schema, _cmd, _partition_range, qrr, _digest_algorithm, _trace_state);
         } else {
             auto& ms = netw::get_local_messaging_service();
             tracing::trace(_trace_state, "read_data: sending a message to /{}", ep);
-            auto da = want_digest ? query::digest_algorithm::MD5 : query::digest_algorithm::none;
+            auto da = want_digest ? _digest_algorithm : query::digest_algorithm::none;
             return ms.send_read_data(netw::messaging_service::msg_addr{ep, 0}, timeout, *_cmd, _partition_range, da).then([this, ep](query::result&& result, rpc::optional<cache_temperature> hit_rate) {
                 tracing::trace(_trace_state, "read_data: got response from /{}", ep);
                 return make_ready_future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature>(make_foreign(::make_lw_shared<query::result>(std::move(result))), hit_rate.value_or(cache_temperature::invalid()));
@@ -2565,11 +2689,11 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
         ++_proxy->_stats.digest_read_attempts.get_ep_stat(ep);
         if (is_me(ep)) {
             tracing::trace(_trace_state, "read_digest: querying locally");
-            return _proxy->query_result_local_digest(_schema, _cmd, _partition_range, _trace_state);
+            return _proxy->query_result_local_digest(_schema, _cmd, _partition_range, _digest_algorithm, _trace_state);
         } else {
             auto& ms = netw::get_local_messaging_service();
             tracing::trace(_trace_state, "read_digest: sending a message to /{}", ep);
-            return ms.send_read_digest(netw::messaging_service::msg_addr{ep, 0}, timeout, *_cmd, _partition_range).then([this, ep] (query::result_digest d, rpc::optional<api::timestamp_type> t,
+            return ms.send_read_digest(netw::messaging_service::msg_addr{ep, 0}, timeout, *_cmd, _partition_range, _digest_algorithm).then([this, ep] (query::result_digest d, rpc::optional<api::timestamp_type> t,
                     rpc::optional<cache_temperature> hit_rate) {
                 tracing::trace(_trace_state, "read_digest: got response from /{}", ep);
                 return make_ready_future<query::result_digest, api::timestamp_type, cache_temperature>(d, t ? t.value() : api::missing_timestamp, hit_rate.value_or(cache_temperature::invalid()));
@@ -2949,27 +3073,29 @@ ::shared_ptr<abstract_read_executor> storage_proxy::get_read_executor(lw_shared_
 }
 
 future<query::result_digest, api::timestamp_type, cache_temperature>
-storage_proxy::query_result_local_digest(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, tracing::trace_state_ptr trace_state, uint64_t max_size) {
-    return query_result_local(std::move(s), std::move(cmd), pr, query::result_request::only_digest, std::move(trace_state), max_size).then([] (foreign_ptr<lw_shared_ptr<query::result>> result, cache_temperature hit_rate) {
+storage_proxy::query_result_local_digest(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, query::digest_algorithm da,
+        tracing::trace_state_ptr trace_state, uint64_t max_size) {
+    return query_result_local(std::move(s), std::move(cmd), pr, query::result_request::only_digest, da, std::move(trace_state), max_size).then([] (foreign_ptr<lw_shared_ptr<query::result>> result, cache_temperature hit_rate) {
         return make_ready_future<query::result_digest, api::timestamp_type, cache_temperature>(*result->digest(), result->last_modified(), hit_rate);
     });
 }
 
 future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature>
-storage_proxy::query_result_local(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, query::result_request request, tracing::trace_state_ptr trace_state, uint64_t max_size) {
+storage_proxy::query_result_local(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, query::result_request request,
+        query::digest_algorithm da, tracing::trace_state_ptr trace_state, uint64_t max_size) {
     if (pr.is_singular()) {
         unsigned shard = _db.local().shard_of(pr.start()->value().token());
-        return _db.invoke_on(shard, [max_size, gs = global_schema_ptr(s), prv = dht::partition_range_vector({pr}) /* FIXME: pr is copied */, cmd, request, gt = tracing::global_trace_state_ptr(std::move(trace_state))] (database& db) mutable {
+        return _db.invoke_on(shard, [max_size, gs = global_schema_ptr(s), prv = dht::partition_range_vector({pr}) /* FIXME: pr is copied */, cmd, request, da, gt = tracing::global_trace_state_ptr(std::move(trace_state))] (database& db) mutable {
             tracing::trace(gt, "Start querying the token range that starts with {}", seastar::value_of([&prv] { return prv.begin()->start()->value().token(); }));
-            return db.query(gs, *cmd, request, prv, gt, max_size).then([trace_state = gt.get()](auto&& f, cache_temperature ht) {
+            return db.query(gs, *cmd, request, prv, gt, max_size, da).then([trace_state = gt.get()](auto&& f, cache_temperature ht) {
                 tracing::trace(trace_state, "Querying is done");
                 return make_ready_future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature>(make_foreign(std::move(f)), ht);
             });
         });
     } else {
-        return query_nonsingular_mutations_locally(s, cmd, {pr}, std::move(trace_state), max_size).then([s, cmd, request] (foreign_ptr<lw_shared_ptr<reconcilable_result>>&& r, cache_temperature&& ht) {
+        return query_nonsingular_mutations_locally(s, cmd, {pr}, std::move(trace_state), max_size).then([s, cmd, request, da] (foreign_ptr<lw_shared_ptr<reconcilable_result>>&& r, cache_temperature&& ht) {
             return make_ready_future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature>(
-                    ::make_foreign(::make_lw_shared(to_data_query_result(*r, s, cmd->slice,  cmd->row_limit, cmd->partition_limit, request))), ht);
+                    ::make_foreign(::make_lw_shared(to_data_query_result(*r, s, cmd->slice,  cmd->row_limit, cmd->partition_limit, request, da))), ht);
         });
     }
 }
@@ -3113,6 +3239,9 @@ storage_proxy::query_partition_key_range_concurrent(storage_proxy::clock_type::t
         exec.push_back(::make_shared<range_slice_read_executor>(schema, cf.shared_from_this(), p, cmd, std::move(range), cl, std::move(filtered_endpoints), trace_state));
     }
 
+    size_t ranges_queried = std::distance(concurrent_fetch_starting_index, i);
+    auto round_start = clock_type::now();
+
     query::result_merger merger(cmd->row_limit, cmd->partition_limit);
     merger.reserve(exec.size());
 
@@ -3121,19 +3250,23 @@ storage_proxy::query_partition_key_range_concurrent(storage_proxy::clock_type::t
     }, std::move(merger));
 
     return f.then([p, exec = std::move(exec), results = std::move(results), i = std::move(i), ranges = std::move(ranges),
-                   cl, cmd, concurrency_factor, timeout, remaining_row_count, remaining_partition_count, trace_state = std::move(trace_state)]
-                   (foreign_ptr<lw_shared_ptr<query::result>>&& result) mutable {
+                   cl, cmd, concurrency_factor, timeout, remaining_row_count, remaining_partition_count, trace_state = std::move(trace_state),
+                   ranges_queried, round_start] (foreign_ptr<lw_shared_ptr<query::result>>&& result) mutable {
         result->ensure_counts();
         remaining_row_count -= result->row_count().value();
         remaining_partition_count -= result->partition_count().value();
+        auto next_concurrency_factor = p->next_range_concurrency_factor(concurrency_factor, ranges_queried, *result,
+                clock_type::now() - round_start, timeout, remaining_row_count, std::distance(i, ranges.end()));
+        // A short read means the merged result is cut at this point, so there's no use in reading further ranges.
+        bool short_read = result->is_short_read();
         results.emplace_back(std::move(result));
-        if (i == ranges.end() || !remaining_row_count || !remaining_partition_count) {
+        if (i == ranges.end() || !remaining_row_count || !remaining_partition_count || short_read) {
             return make_ready_future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>>(std::move(results));
         } else {
             cmd->row_limit = remaining_row_count;
             cmd->partition_limit = remaining_partition_count;
             return p->query_partition_key_range_concurrent(timeout, std::move(results), cmd, cl, std::move(i),
-                    std::move(ranges), concurrency_factor * 2, std::move(trace_state), remaining_row_count, remaining_partition_count);
+                    std::move(ranges), next_concurrency_factor, std::move(trace_state), remaining_row_count, remaining_partition_count);
         }
     }).handle_exception([p] (std::exception_ptr eptr) {
         p->handle_read_error(eptr, true);
@@ -3141,6 +3274,39 @@ storage_proxy::query_partition_key_range_concurrent(storage_proxy::clock_type::t
     });
 }
 
+int storage_proxy::next_range_concurrency_factor(int concurrency_factor, size_t ranges_queried, const query::result& result,
+        clock_type::duration latency, clock_type::time_point timeout, uint32_t remaining_row_count, size_t remaining_ranges) {
+    size_t wanted;
+    auto rows = result.row_count().value();
+    if (rows == 0 || ranges_queried == 0) {
+        // Nothing to extrapolate from, the ranges read so far were empty.
+        wanted = size_t(concurrency_factor) * 2;
+    } else {
+        // Underestimate how many rows we will get per range in order to increase the likelihood that we'll
+        // fetch enough rows in the next round.
+        float rows_per_range = float(rows) / ranges_queried;
+        rows_per_range -= rows_per_range * CONCURRENT_SUBREQUESTS_MARGIN;
+        wanted = std::ceil(remaining_row_count / std::max(rows_per_range, 1.0f));
+    }
+
+    // Keep the results of the in-flight reads within the reader memory budget.
+    auto bytes_per_range = result.buf().size() / std::max<size_t>(ranges_queried, 1);
+    if (bytes_per_range) {
+        wanted = std::min(wanted, std::max<size_t>(database::max_memory_concurrent_reads() / bytes_per_range, 1));
+    }
+
+    // Don't grow if the replicas are slow to respond, so that the next round doesn't risk timing out.
+    auto now = clock_type::now();
+    if (timeout <= now || latency * 4 > timeout - now) {
+        wanted = std::min(wanted, size_t(concurrency_factor));
+    }
+
+    wanted = std::max<size_t>(1, std::min({wanted, remaining_ranges, size_t(std::numeric_limits<int>::max())}));
+    slogger.trace("Range read of {} ranges returned {} rows, {} bytes in {} ms; next concurrency factor: {}",
+            ranges_queried, rows, result.buf().size(), std::chrono::duration_cast<std::chrono::milliseconds>(latency).count(), wanted);
+    return int(wanted);
+}
+
 future<foreign_ptr<lw_shared_ptr<query::result>>>
 storage_proxy::query_partition_key_range(lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector partition_ranges, db::consistency_level cl, tracing::trace_state_ptr trace_state) {
     schema_ptr schema = local_schema_registry().get(cmd->schema_version);
@@ -3260,6 +3426,206 @@ storage_proxy::do_query(schema_ptr s,
     });
 }
 
+// Aggregates of the functions of an aggregate_request.
+class partial_aggregates {
+    cql_serialization_format _sf;
+    std::vector<std::unique_ptr<cql3::functions::aggregate_function::aggregate>> _aggregates;
+public:
+    partial_aggregates(const schema& s, const query::aggregate_request& req)
+        : _sf(req.cmd.slice.cql_format())
+    {
+        for (auto&& a : req.aggregations) {
+            std::vector<data_type> arg_types;
+            for (auto idx : a.column_indexes) {
+                auto def = s.get_column_definition(req.column_names.at(idx));
+                if (!def) {
+                    throw std::runtime_error(sprint("unknown column %s in aggregation request for %s.%s", req.column_names[idx], s.ks_name(), s.cf_name()));
+                }
+                arg_types.push_back(def->type);
+            }
+            auto name = cql3::functions::function_name(a.function_keyspace, a.function_name);
+            auto f = dynamic_pointer_cast<cql3::functions::aggregate_function>(cql3::functions::functions::find(name, arg_types));
+            if (!f || !f->is_reducible()) {
+                throw std::runtime_error(sprint("%s is not a reducible aggregate function", name));
+            }
+            _aggregates.push_back(f->new_aggregate());
+        }
+    }
+
+    void add_input(const query::aggregate_request& req, const std::vector<bytes_opt>& row) {
+        std::vector<bytes_opt> args;
+        for (unsigned i = 0; i < _aggregates.size(); ++i) {
+            args.clear();
+            for (auto idx : req.aggregations[i].column_indexes) {
+                args.push_back(row[idx]);
+            }
+            _aggregates[i]->add_input(_sf, args);
+        }
+    }
+
+    void merge(const query::aggregate_result& r) {
+        for (unsigned i = 0; i < _aggregates.size(); ++i) {
+            _aggregates[i]->merge_partial(_sf, r.partial_states.at(i));
+        }
+    }
+
+    query::aggregate_result partial() {
+        query::aggregate_result r;
+        for (auto&& a : _aggregates) {
+            r.partial_states.push_back(a->compute_partial(_sf));
+        }
+        return r;
+    }
+
+    std::vector<bytes_opt> compute() {
+        std::vector<bytes_opt> r;
+        for (auto&& a : _aggregates) {
+            r.push_back(a->compute(_sf));
+        }
+        return r;
+    }
+};
+
+future<std::vector<bytes_opt>>
+storage_proxy::query_aggregate(schema_ptr s, query::aggregate_request req, tracing::trace_state_ptr trace_state) {
+    keyspace& ks = _db.local().find_keyspace(s->ks_name());
+    auto my_address = utils::fb_utilities::get_broadcast_address();
+
+    std::unordered_map<gms::inet_address, dht::partition_range_vector> ranges_per_endpoint;
+    if (ks.get_replication_strategy().get_type() == locator::replication_strategy_type::local) {
+        ranges_per_endpoint.emplace(my_address, std::move(req.ranges));
+    } else {
+        for (auto&& r : req.ranges) {
+            for (auto&& rr : get_restricted_ranges(*s, std::move(r))) {
+                // The closest replica reads the range, which is usually itself.
+                // Without live replicas, the local query fails as it should.
+                auto live_endpoints = get_live_sorted_endpoints(ks, end_token(rr));
+                auto ep = live_endpoints.empty() ? my_address : live_endpoints.front();
+                ranges_per_endpoint[ep].push_back(std::move(rr));
+            }
+        }
+    }
+    req.ranges.clear();
+    req.cmd.trace_info = tracing::make_trace_info(trace_state);
+
+    ++_stats.aggregate_queries;
+    tracing::trace(trace_state, "Aggregating on {} endpoints", ranges_per_endpoint.size());
+    auto merged = make_lw_shared<partial_aggregates>(*s, req);
+    auto p = shared_from_this();
+    auto timeout = clock_type::now() + std::chrono::milliseconds(_db.local().get_config().read_request_timeout_in_ms());
+    return do_with(std::move(req), std::move(ranges_per_endpoint), [p, s, merged, my_address, timeout, trace_state] (auto& req, auto& ranges_per_endpoint) {
+        return parallel_for_each(ranges_per_endpoint, [p, s, &req, merged, my_address, timeout, trace_state] (auto& ep_ranges) {
+            auto ep_req = query::aggregate_request{req.aggregations, req.column_names, req.cmd, std::move(ep_ranges.second), req.cl};
+            if (ep_ranges.first == my_address) {
+                return p->query_aggregate_locally(s, std::move(ep_req), trace_state).then([merged] (query::aggregate_result r) {
+                    merged->merge(r);
+                });
+            }
+            ++p->_stats.aggregate_requests;
+            tracing::trace(trace_state, "Sending an aggregate request to /{}", ep_ranges.first);
+            return do_with(std::move(ep_req), [p, s, merged, ep = ep_ranges.first, timeout, trace_state] (auto& ep_req) {
+                return netw::get_local_messaging_service().send_aggregate(netw::messaging_service::msg_addr{ep, 0}, timeout, ep_req).then([merged, ep, trace_state] (query::aggregate_result r) {
+                    tracing::trace(trace_state, "Got an aggregate response from /{}", ep);
+                    merged->merge(r);
+                }).handle_exception([p, s, merged, ep, &ep_req, trace_state] (std::exception_ptr eptr) {
+                    // The replica may have failed part way, so none of its result is used.
+                    // Its ranges are read as by any range scan instead, one at a time.
+                    slogger.debug("Aggregation on {} failed: {}; reading its {} ranges instead", ep, eptr, ep_req.ranges.size());
+                    tracing::trace(trace_state, "Aggregation on /{} failed: {}; reading its ranges instead", ep, eptr);
+                    ++p->_stats.aggregate_fallbacks;
+                    return do_for_each(ep_req.ranges, [p, s, merged, &ep_req, trace_state] (const dht::partition_range& range) {
+                        return p->query_aggregate_on_shard(s, ep_req, {range}, trace_state).then([merged] (query::aggregate_result r) {
+                            merged->merge(r);
+                        });
+                    });
+                });
+            });
+        });
+    }).then([merged] {
+        return merged->compute();
+    });
+}
+
+// Aggregates the parts of req.ranges owned by each shard on that shard.
+future<query::aggregate_result>
+storage_proxy::query_aggregate_locally(schema_ptr s, query::aggregate_request req, tracing::trace_state_ptr trace_state) {
+    std::map<unsigned, dht::partition_range_vector> ranges_per_shard;
+    for (auto&& r : req.ranges) {
+        for (auto&& e : dht::split_range_to_shards(std::move(r), *s)) {
+            auto& ranges = ranges_per_shard[e.first];
+            std::move(e.second.begin(), e.second.end(), std::back_inserter(ranges));
+        }
+    }
+    req.ranges.clear();
+
+    auto merged = make_lw_shared<partial_aggregates>(*s, req);
+    return do_with(std::move(req), std::move(ranges_per_shard), [s, merged, trace_state] (auto& req, auto& ranges_per_shard) {
+        return parallel_for_each(ranges_per_shard, [s, &req, merged, trace_state] (auto& shard_ranges) {
+            return get_storage_proxy().invoke_on(shard_ranges.first, [gs = global_schema_ptr(s), &req, ranges = std::move(shard_ranges.second),
+                    gt = tracing::global_trace_state_ptr(trace_state)] (storage_proxy& p) mutable {
+                return p.query_aggregate_on_shard(gs, req, std::move(ranges), gt.get()).then([] (query::aggregate_result r) {
+                    return make_foreign(std::make_unique<query::aggregate_result>(std::move(r)));
+                });
+            }).then([merged] (foreign_ptr<std::unique_ptr<query::aggregate_result>> r) {
+                merged->merge(*r);
+            });
+        });
+    }).then([merged] {
+        return merged->partial();
+    });
+}
+
+// Reads ranges page by page with the consistency level of req, as the
+// coordinator of an aggregation query does, and aggregates the rows.
+future<query::aggregate_result>
+storage_proxy::query_aggregate_on_shard(schema_ptr s, const query::aggregate_request& req, dht::partition_range_vector ranges,
+        tracing::trace_state_ptr trace_state) {
+    static constexpr uint32_t page_size = 10000;
+
+    struct aggregation_state {
+        service::query_state state;
+        cql3::query_options options;
+        partial_aggregates aggregates;
+
+        aggregation_state(const schema& s, const query::aggregate_request& req, tracing::trace_state_ptr trace_state)
+            : state(service::client_state::for_internal_calls())
+            , options(req.cl, std::vector<cql3::raw_value>())
+            , aggregates(s, req)
+        {
+            // The pages are read on behalf of the traced query.
+            state.get_trace_state() = std::move(trace_state);
+        }
+    };
+
+    std::vector<const column_definition*> columns;
+    for (auto&& name : req.column_names) {
+        auto def = s->get_column_definition(name);
+        if (!def) {
+            throw std::runtime_error(sprint("unknown column %s in aggregation request for %s.%s", name, s->ks_name(), s->cf_name()));
+        }
+        columns.push_back(def);
+    }
+    auto selection = cql3::selection::selection::for_columns(s, std::move(columns));
+    auto st = make_lw_shared<aggregation_state>(*s, req, std::move(trace_state));
+    auto cmd = make_lw_shared<query::read_command>(req.cmd);
+    cmd->slice.options.set<query::partition_slice::option::allow_short_read>();
+    auto now = cmd->timestamp;
+    auto pager = service::pager::query_pagers::pager(s, selection, st->state, st->options, cmd, std::move(ranges));
+    return do_until([pager] { return pager->is_exhausted(); }, [&req, pager, selection, st, now] {
+        return do_with(cql3::selection::result_set_builder(*selection, now, req.cmd.slice.cql_format()),
+                [&req, pager, st, now] (auto& builder) {
+            return pager->fetch_page(builder, page_size, now).then([&req, &builder, st] {
+                auto rs = builder.build();
+                for (auto&& row : rs->rows()) {
+                    st->aggregates.add_input(req, row);
+                }
+            });
+        });
+    }).then([st] {
+        return st->aggregates.partial();
+    });
+}
+
 #if 0
     private static List<Row> readWithPaxos(List<ReadCommand> commands, ConsistencyLevel consistencyLevel, ClientState state)
     throws InvalidRequestException, UnavailableException, ReadTimeoutException
@@ -3496,32 +3862,7 @@ bool storage_proxy::should_hint(gms::inet_address ep) noexcept {
         return false;
     }
 
-    return false;
-#if 0
-    if (DatabaseDescriptor.shouldHintByDC())
-    {
-        final String dc = DatabaseDescriptor.getEndpointSnitch().getDatacenter(ep);
-        //Disable DC specific hints
-        if(!DatabaseDescriptor.hintedHandoffEnabled(dc))
-        {
-            HintedHandOffManager.instance.metrics.incrPastWindow(ep);
-            return false;
-        }
-    }
-    else if (!DatabaseDescriptor.hintedHandoffEnabled())
-    {
-        HintedHandOffManager.instance.metrics.incrPastWindow(ep);
-        return false;
-    }
-
-    boolean hintWindowExpired = Gossiper.instance.getEndpointDowntime(ep) > DatabaseDescriptor.getMaxHintWindow();
-    if (hintWindowExpired)
-    {
-        HintedHandOffManager.instance.metrics.incrPastWindow(ep);
-        Tracing.trace("Not hinting {} which has been down {}ms", ep, Gossiper.instance.getEndpointDowntime(ep));
-    }
-    return !hintWindowExpired;
-#endif
+    return _hints_manager.can_hint_for(ep);
 }
 
 future<> storage_proxy::truncate_blocking(sstring keyspace, sstring cfname) {
@@ -3846,6 +4187,130 @@ void storage_proxy::init_messaging_service() {
             });
         });
     });
+    ms.register_mutations([] (const rpc::client_info& cinfo, rpc::opt_time_point t, std::vector<frozen_mutation> in, std::vector<gms::inet_address> forward, gms::inet_address reply_to, unsigned shard, std::vector<storage_proxy::response_id_type> response_ids, stdx::optional<tracing::trace_info> trace_info) {
+        tracing::trace_state_ptr trace_state_ptr;
+        auto src_addr = netw::messaging_service::get_source(cinfo);
+
+        if (trace_info) {
+            trace_state_ptr = tracing::tracing::get_local_tracing_instance().create_session(*trace_info);
+            tracing::begin(trace_state_ptr);
+            tracing::trace(trace_state_ptr, "Message with {} mutations received from /{}", in.size(), src_addr.addr);
+        }
+
+        storage_proxy::clock_type::time_point timeout;
+        if (!t) {
+            auto timeout_in_ms = get_local_shared_storage_proxy()->_db.local().get_config().write_request_timeout_in_ms();
+            timeout = clock_type::now() + std::chrono::milliseconds(timeout_in_ms);
+        } else {
+            timeout = *t;
+        }
+
+        std::vector<lw_shared_ptr<const frozen_mutation>> mutations;
+        mutations.reserve(in.size());
+        for (auto&& fm : in) {
+            mutations.push_back(make_lw_shared<const frozen_mutation>(std::move(fm)));
+        }
+
+        // Outcome of each write, reported separately to reply_to.
+        struct write_status {
+            bool applied = false;
+            size_t errors = 0;
+        };
+
+        return do_with(std::move(mutations), std::move(response_ids), std::vector<write_status>(in.size()), get_local_shared_storage_proxy(),
+                [src_addr = std::move(src_addr), forward = std::move(forward), reply_to, shard, trace_state_ptr, timeout]
+                (const std::vector<lw_shared_ptr<const frozen_mutation>>& mutations, const std::vector<storage_proxy::response_id_type>& response_ids,
+                 std::vector<write_status>& status, shared_ptr<storage_proxy>& p) mutable {
+            p->_stats.received_mutations += mutations.size();
+            p->_stats.forwarded_mutations += forward.size() * mutations.size();
+            return when_all(
+                parallel_for_each(boost::irange<size_t>(0, mutations.size()), [&mutations, &status, &p, src_addr, reply_to, shard, timeout] (size_t i) {
+                    // mutate_locally() may throw, putting it into apply() converts exception to a future.
+                    return futurize<void>::apply([&mutations, &p, i, src_addr, timeout] () mutable {
+                        auto& m = *mutations[i];
+                        // FIXME: get_schema_for_write() doesn't timeout
+                        return get_schema_for_write(m.schema_version(), std::move(src_addr)).then([&m, &p, timeout] (schema_ptr s) {
+                            return p->mutate_locally(std::move(s), m, timeout);
+                        });
+                    }).then([&status, i] {
+                        status[i].applied = true;
+                    }).handle_exception([&status, i, reply_to, shard] (std::exception_ptr eptr) {
+                        seastar::log_level l = seastar::log_level::warn;
+                        try {
+                            std::rethrow_exception(eptr);
+                        } catch (timed_out_error&) {
+                            // ignore timeouts so that logs are not flooded.
+                            // database total_writes_timedout counter was incremented.
+                            l = seastar::log_level::debug;
+                        } catch (...) {
+                            // ignore
+                        }
+                        slogger.log(l, "Failed to apply mutation from {}#{}: {}", reply_to, shard, eptr);
+                        status[i].errors++;
+                    });
+                }).then([&response_ids, &status, reply_to, shard, trace_state_ptr] {
+                    std::vector<storage_proxy::response_id_type> done;
+                    for (size_t i = 0; i < status.size(); ++i) {
+                        if (status[i].applied) {
+                            done.push_back(response_ids[i]);
+                        }
+                    }
+                    if (done.empty()) {
+                        return make_ready_future<>();
+                    }
+                    auto& ms = netw::get_local_messaging_service();
+                    // As for MUTATION, wait for mutations_done to be sent so that we don't accumulate unsent responses.
+                    tracing::trace(trace_state_ptr, "Sending mutations_done for {} mutations to /{}", done.size(), reply_to);
+                    return ms.send_mutations_done(netw::messaging_service::msg_addr{reply_to, shard}, shard, done).then_wrapped([] (future<> f) {
+                        f.ignore_ready_future();
+                    });
+                }),
+                parallel_for_each(forward.begin(), forward.end(), [&mutations, &response_ids, &status, &p, reply_to, shard, trace_state_ptr, timeout] (gms::inet_address forward) {
+                    auto& ms = netw::get_local_messaging_service();
+                    if (!get_local_storage_service().node_supports_multi_mutation_writes(forward)) {
+                        // The coordinator checked the group, but the replica may have been downgraded since.
+                        tracing::trace(trace_state_ptr, "Forwarding {} mutations to /{} one by one", mutations.size(), forward);
+                        return parallel_for_each(boost::irange<size_t>(0, mutations.size()), [&ms, &mutations, &response_ids, &status, &p, forward, reply_to, shard, trace_state_ptr, timeout] (size_t i) {
+                            return ms.send_mutation(netw::messaging_service::msg_addr{forward, 0}, timeout, *mutations[i], {}, reply_to, shard, response_ids[i], tracing::make_trace_info(trace_state_ptr)).then_wrapped([&status, &p, i] (future<> f) {
+                                if (f.failed()) {
+                                    ++p->_stats.forwarding_errors;
+                                    status[i].errors++;
+                                };
+                                f.ignore_ready_future();
+                            });
+                        });
+                    }
+                    tracing::trace(trace_state_ptr, "Forwarding {} mutations to /{}", mutations.size(), forward);
+                    return ms.send_mutations(netw::messaging_service::msg_addr{forward, 0}, timeout, mutations, {}, reply_to, shard, response_ids, tracing::make_trace_info(trace_state_ptr)).then_wrapped([&status, &p] (future<> f) {
+                        if (f.failed()) {
+                            ++p->_stats.forwarding_errors;
+                            for (auto& s : status) {
+                                s.errors++;
+                            }
+                        };
+                        f.ignore_ready_future();
+                    });
+                })
+            ).then_wrapped([&response_ids, &status, reply_to, shard, trace_state_ptr] (future<std::tuple<future<>, future<>>>&& f) {
+                // ignore results, since we'll be returning them via MUTATIONS_DONE/MUTATION_FAILURE verbs
+                f.ignore_ready_future();
+                return parallel_for_each(boost::irange<size_t>(0, status.size()), [&response_ids, &status, reply_to, shard, trace_state_ptr] (size_t i) {
+                    if (!status[i].errors) {
+                        return make_ready_future<>();
+                    }
+                    tracing::trace(trace_state_ptr, "Sending mutation_failure with {} failures to /{}", status[i].errors, reply_to);
+                    auto& ms = netw::get_local_messaging_service();
+                    return ms.send_mutation_failed(netw::messaging_service::msg_addr{reply_to, shard}, shard, response_ids[i], status[i].errors).then_wrapped([] (future<> f) {
+                        f.ignore_ready_future();
+                    });
+                }).then([] {
+                    return netw::messaging_service::no_wait();
+                }).finally([trace_state_ptr] {
+                    tracing::trace(trace_state_ptr, "Mutations handling is done");
+                });
+            });
+        });
+    });
     ms.register_mutation_done([] (const rpc::client_info& cinfo, unsigned shard, storage_proxy::response_id_type response_id) {
         auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
         return get_storage_proxy().invoke_on(shard, [from, response_id] (storage_proxy& sp) {
@@ -3853,6 +4318,15 @@ void storage_proxy::init_messaging_service() {
             return netw::messaging_service::no_wait();
         });
     });
+    ms.register_mutations_done([] (const rpc::client_info& cinfo, unsigned shard, std::vector<storage_proxy::response_id_type> response_ids) {
+        auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
+        return get_storage_proxy().invoke_on(shard, [from, response_ids = std::move(response_ids)] (storage_proxy& sp) {
+            for (auto response_id : response_ids) {
+                sp.got_response(response_id, from);
+            }
+            return netw::messaging_service::no_wait();
+        });
+    });
     ms.register_mutation_failed([] (const rpc::client_info& cinfo, unsigned shard, storage_proxy::response_id_type response_id, size_t num_failed) {
         auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
         return get_storage_proxy().invoke_on(shard, [from, response_id, num_failed] (storage_proxy& sp) {
@@ -3860,6 +4334,24 @@ void storage_proxy::init_messaging_service() {
             return netw::messaging_service::no_wait();
         });
     });
+    ms.register_aggregate([] (const rpc::client_info& cinfo, query::aggregate_request req) {
+        tracing::trace_state_ptr trace_state_ptr;
+        auto src_addr = netw::messaging_service::get_source(cinfo);
+        if (req.cmd.trace_info) {
+            trace_state_ptr = tracing::tracing::get_local_tracing_instance().create_session(*req.cmd.trace_info);
+            tracing::begin(trace_state_ptr);
+            tracing::trace(trace_state_ptr, "aggregate: message received from /{}", src_addr.addr);
+        }
+        auto p = get_local_shared_storage_proxy();
+        p->_stats.replica_aggregate_requests++;
+        auto schema_version = req.cmd.schema_version;
+        auto src_ip = src_addr.addr;
+        return get_schema_for_read(schema_version, std::move(src_addr)).then([p, req = std::move(req), trace_state_ptr] (schema_ptr s) mutable {
+            return p->query_aggregate_locally(std::move(s), std::move(req), trace_state_ptr);
+        }).finally([trace_state_ptr, src_ip] {
+            tracing::trace(trace_state_ptr, "aggregate handling is done, sending a response to /{}", src_ip);
+        });
+    });
     ms.register_read_data([] (const rpc::client_info& cinfo, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda) {
         tracing::trace_state_ptr trace_state_ptr;
         auto src_addr = netw::messaging_service::get_source(cinfo);
@@ -3885,10 +4377,11 @@ void storage_proxy::init_messaging_service() {
                     qrr = query::result_request::only_result;
                     break;
                 case query::digest_algorithm::MD5:
+                case query::digest_algorithm::xxHash:
                     qrr = query::result_request::result_and_digest;
                     break;
                 }
-                return p->query_result_local(std::move(s), cmd, std::move(pr2.first), qrr, trace_state_ptr, max_size);
+                return p->query_result_local(std::move(s), cmd, std::move(pr2.first), qrr, da, trace_state_ptr, max_size);
             }).finally([&trace_state_ptr, src_ip] () mutable {
                 tracing::trace(trace_state_ptr, "read_data handling is done, sending a response to /{}", src_ip);
             });
@@ -3922,7 +4415,7 @@ void storage_proxy::init_messaging_service() {
             });
         });
     });
-    ms.register_read_digest([] (const rpc::client_info& cinfo, query::read_command cmd, compat::wrapping_partition_range pr) {
+    ms.register_read_digest([] (const rpc::client_info& cinfo, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda) {
         tracing::trace_state_ptr trace_state_ptr;
         auto src_addr = netw::messaging_service::get_source(cinfo);
         if (cmd.trace_info) {
@@ -3930,17 +4423,18 @@ void storage_proxy::init_messaging_service() {
             tracing::begin(trace_state_ptr);
             tracing::trace(trace_state_ptr, "read_digest: message received from /{}", src_addr.addr);
         }
+        auto da = oda.value_or(query::digest_algorithm::MD5);
         auto max_size = cinfo.retrieve_auxiliary<uint64_t>("max_result_size");
-        return do_with(std::move(pr), get_local_shared_storage_proxy(), std::move(trace_state_ptr), [&cinfo, cmd = make_lw_shared<query::read_command>(std::move(cmd)), src_addr = std::move(src_addr), max_size] (compat::wrapping_partition_range& pr, shared_ptr<storage_proxy>& p, tracing::trace_state_ptr& trace_state_ptr) mutable {
+        return do_with(std::move(pr), get_local_shared_storage_proxy(), std::move(trace_state_ptr), [&cinfo, cmd = make_lw_shared<query::read_command>(std::move(cmd)), src_addr = std::move(src_addr), da, max_size] (compat::wrapping_partition_range& pr, shared_ptr<storage_proxy>& p, tracing::trace_state_ptr& trace_state_ptr) mutable {
             p->_stats.replica_digest_reads++;
             auto src_ip = src_addr.addr;
-            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, &pr, &p, &trace_state_ptr, max_size] (schema_ptr s) {
+            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, da, &pr, &p, &trace_state_ptr, max_size] (schema_ptr s) {
                 auto pr2 = compat::unwrap(std::move(pr), *s);
                 if (pr2.second) {
                     // this function assumes singular queries but doesn't validate
                     throw std::runtime_error("READ_DIGEST called with wrapping range");
                 }
-                return p->query_result_local_digest(std::move(s), cmd, std::move(pr2.first), trace_state_ptr, max_size);
+                return p->query_result_local_digest(std::move(s), cmd, std::move(pr2.first), da, trace_state_ptr, max_size);
             }).finally([&trace_state_ptr, src_ip] () mutable {
                 tracing::trace(trace_state_ptr, "read_digest handling is done, sending a response to /{}", src_ip);
             });
@@ -3967,7 +4461,10 @@ void storage_proxy::uninit_messaging_service() {
     auto& ms = netw::get_local_messaging_service();
     ms.unregister_mutation();
     ms.unregister_mutation_done();
+    ms.unregister_mutations();
+    ms.unregister_mutations_done();
     ms.unregister_mutation_failed();
+    ms.unregister_aggregate();
     ms.unregister_read_data();
     ms.unregister_read_mutation_data();
     ms.unregister_read_digest();
@@ -4308,10 +4805,15 @@ storage_proxy::query_nonsingular_mutations_locally(schema_ptr s, lw_shared_ptr<q
     });
 }
 
+future<>
+storage_proxy::start_hints_manager() {
+    return _hints_manager.start(shared_from_this());
+}
+
 future<>
 storage_proxy::stop() {
     uninit_messaging_service();
-    return make_ready_future<>();
+    return _hints_manager.stop();
 }
 
 }
@@ -53,6 +53,7 @@
 #include "tracing/trace_state.hh"
 #include <seastar/core/metrics.hh>
 #include "frozen_mutation.hh"
+#include "db/hints/manager.hh"
 
 namespace compat {
 
@@ -183,6 +184,12 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
         uint64_t background_reads = 0; // client no longer waits for the read
         uint64_t read_retries = 0; // read is retried with new limit
         uint64_t throttled_writes = 0; // total number of writes ever delayed due to throttling
+        uint64_t multi_mutation_messages = 0; // MUTATIONS messages sent to replicas
+        uint64_t multi_mutation_writes = 0; // writes sent in MUTATIONS messages
+        uint64_t aggregate_queries = 0; // aggregation queries computed by replicas
+        uint64_t aggregate_requests = 0; // AGGREGATE requests sent to replicas
+        uint64_t aggregate_fallbacks = 0; // AGGREGATE requests which failed, and whose ranges were read instead
+        uint64_t replica_aggregate_requests = 0; // AGGREGATE requests received as a replica
         uint64_t speculative_digest_reads = 0;
         uint64_t speculative_data_reads = 0;
 
@@ -217,8 +224,7 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     // just skip an entry if request no longer exists.
     circular_buffer<response_id_type> _throttled_writes;
     constexpr static size_t _max_hints_in_progress = 128; // origin multiplies by FBUtilities.getAvailableProcessors() but we already sharded
-    size_t _total_hints_in_progress = 0;
-    std::unordered_map<gms::inet_address, size_t> _hints_in_progress;
+    db::hints::manager _hints_manager;
     stats _stats;
     static constexpr float CONCURRENT_SUBREQUESTS_MARGIN = 0.10;
     // for read repair chance calculation
@@ -238,7 +244,12 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
             const std::vector<gms::inet_address>& pending_endpoints, std::vector<gms::inet_address>, tracing::trace_state_ptr tr_state);
     response_id_type create_write_response_handler(const mutation&, db::consistency_level cl, db::write_type type, tracing::trace_state_ptr tr_state);
     response_id_type create_write_response_handler(const std::unordered_map<gms::inet_address, std::experimental::optional<mutation>>&, db::consistency_level cl, db::write_type type, tracing::trace_state_ptr tr_state);
+    std::vector<std::vector<gms::inet_address>> get_write_groups(abstract_write_response_handler& handler);
     void send_to_live_endpoints(response_id_type response_id, clock_type::time_point timeout);
+    void send_to_live_endpoints(std::vector<response_id_type> response_ids, clock_type::time_point timeout);
+    void send_to_endpoints(shared_ptr<abstract_write_response_handler> handler, std::vector<gms::inet_address> forward, clock_type::time_point timeout);
+    void send_to_endpoints(std::vector<shared_ptr<abstract_write_response_handler>> handlers, std::vector<gms::inet_address> forward,
+            clock_type::time_point timeout);
     template<typename Range>
     size_t hint_to_dead_endpoints(std::unique_ptr<mutation_holder>& mh, const Range& targets) noexcept;
     void hint_to_dead_endpoints(response_id_type, db::consistency_level);
@@ -252,12 +263,17 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     ::shared_ptr<abstract_read_executor> get_read_executor(lw_shared_ptr<query::read_command> cmd, dht::partition_range pr, db::consistency_level cl, tracing::trace_state_ptr trace_state);
     future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> query_result_local(schema_ptr, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr,
                                                                            query::result_request request,
+                                                                           query::digest_algorithm da,
                                                                            tracing::trace_state_ptr trace_state,
                                                                            uint64_t max_size = query::result_memory_limiter::maximum_result_size);
-    future<query::result_digest, api::timestamp_type, cache_temperature> query_result_local_digest(schema_ptr, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, tracing::trace_state_ptr trace_state,
+    future<query::result_digest, api::timestamp_type, cache_temperature> query_result_local_digest(schema_ptr, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr,
+                                                                                  query::digest_algorithm da, tracing::trace_state_ptr trace_state,
                                                                                   uint64_t max_size  = query::result_memory_limiter::maximum_result_size);
     future<foreign_ptr<lw_shared_ptr<query::result>>> query_partition_key_range(lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector partition_ranges, db::consistency_level cl, tracing::trace_state_ptr trace_state);
     dht::partition_range_vector get_restricted_ranges(const schema& s, dht::partition_range range);
+    future<query::aggregate_result> query_aggregate_locally(schema_ptr s, query::aggregate_request req, tracing::trace_state_ptr trace_state);
+    future<query::aggregate_result> query_aggregate_on_shard(schema_ptr s, const query::aggregate_request& req,
+            dht::partition_range_vector ranges, tracing::trace_state_ptr trace_state);
     float estimate_result_rows_per_range(lw_shared_ptr<query::read_command> cmd, keyspace& ks);
     static std::vector<gms::inet_address> intersection(const std::vector<gms::inet_address>& l1, const std::vector<gms::inet_address>& l2);
     future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>> query_partition_key_range_concurrent(clock_type::time_point timeout,
@@ -304,6 +320,11 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
         return _db;
     }
 
+    // Picks how many ranges to read concurrently in the next round of a range scan, based on the
+    // size of the results of the previous round and on how long it took.
+    static int next_range_concurrency_factor(int concurrency_factor, size_t ranges_queried, const query::result& result,
+            clock_type::duration latency, clock_type::time_point timeout, uint32_t remaining_row_count, size_t remaining_ranges);
+
     void init_messaging_service();
 
     // Applies mutation on this node.
@@ -396,6 +417,22 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
             tracing::trace_state_ptr trace_state = nullptr,
             uint64_t max_size = query::result_memory_limiter::maximum_result_size);
 
+    /*
+     * Computes the aggregations of an aggregation query, instead of fetching
+     * all rows to the coordinator. The ranges are split by the nodes owning
+     * them, each node aggregates its part on the shards owning it, reading with
+     * the request's consistency level, and the partial aggregates are merged.
+     * A node which doesn't answer within the read timeout, or fails, has its
+     * ranges read by this coordinator instead, range by range.
+     *
+     * The replicas continue the tracing session of trace_state.
+     *
+     * Returns the value of each aggregation in req.aggregations.
+     */
+    future<std::vector<bytes_opt>> query_aggregate(schema_ptr s, query::aggregate_request req, tracing::trace_state_ptr trace_state = nullptr);
+
+    // Starts storing hints for unavailable replicas and delivering them.
+    future<> start_hints_manager();
 
     future<> stop();
 
@@ -403,6 +440,10 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
         return _stats;
     }
 
+    db::hints::manager& get_hints_manager() {
+        return _hints_manager;
+    }
+
     friend class abstract_read_executor;
     friend class abstract_write_response_handler;
     friend class speculating_read_executor;
@@ -425,4 +466,31 @@ inline shared_ptr<storage_proxy> get_local_shared_storage_proxy() {
 dht::partition_range_vector get_restricted_ranges(locator::token_metadata&,
     const schema&, dht::partition_range);
 
+// Writes going to the same group of replicas, keyed by the group, with its
+// coordinator last and the rest sorted.
+template <typename Write>
+using write_batches = std::map<std::vector<gms::inet_address>, std::vector<Write>>;
+
+// Groups writes started together by the replicas they go to, for sending each
+// group's writes in a single MUTATIONS message. Each write comes with the
+// groups of replicas it goes to, coordinator last, as returned by
+// storage_proxy::get_write_groups(). Writes to a group which can_batch()
+// rejects are passed to send_single() instead.
+template <typename Write, typename CanBatch, typename SendSingle>
+write_batches<Write> group_writes(std::vector<std::pair<Write, std::vector<std::vector<gms::inet_address>>>> writes,
+        CanBatch&& can_batch, SendSingle&& send_single) {
+    write_batches<Write> batches;
+    for (auto& w : writes) {
+        for (auto& group : w.second) {
+            if (!can_batch(w.first, group)) {
+                send_single(w.first, std::move(group));
+            } else {
+                std::sort(group.begin(), std::prev(group.end()));
+                batches[std::move(group)].push_back(w.first);
+            }
+        }
+    }
+    return batches;
+}
+
 }
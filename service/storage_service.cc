@@ -91,6 +91,13 @@ static const sstring CORRECT_COUNTER_ORDER_FEATURE = "CORRECT_COUNTER_ORDER";
 static const sstring SCHEMA_TABLES_V3 = "SCHEMA_TABLES_V3";
 static const sstring CORRECT_NON_COMPOUND_RANGE_TOMBSTONES = "CORRECT_NON_COMPOUND_RANGE_TOMBSTONES";
 static const sstring WRITE_FAILURE_REPLY_FEATURE = "WRITE_FAILURE_REPLY";
+static const sstring MULTI_MUTATION_WRITES_FEATURE = "MULTI_MUTATION_WRITES";
+static const sstring AGGREGATE_PUSHDOWN_FEATURE = "AGGREGATE_PUSHDOWN";
+static const sstring XXHASH_FEATURE = "XXHASH";
+static const sstring ROW_LEVEL_REPAIR_FEATURE = "ROW_LEVEL_REPAIR";
+static const sstring WHOLE_SSTABLE_STREAMING_FEATURE = "WHOLE_SSTABLE_STREAMING";
+static const sstring SHARDED_BATCHLOG_FEATURE = "SHARDED_BATCHLOG";
+static const sstring ZSTD_COMPRESSION_FEATURE = "ZSTD_COMPRESSION";
 
 distributed<storage_service> _the_storage_service;
 
@@ -138,6 +145,13 @@ sstring storage_service::get_config_supported_features() {
         SCHEMA_TABLES_V3,
         CORRECT_NON_COMPOUND_RANGE_TOMBSTONES,
         WRITE_FAILURE_REPLY_FEATURE,
+        MULTI_MUTATION_WRITES_FEATURE,
+        AGGREGATE_PUSHDOWN_FEATURE,
+        XXHASH_FEATURE,
+        ROW_LEVEL_REPAIR_FEATURE,
+        WHOLE_SSTABLE_STREAMING_FEATURE,
+        SHARDED_BATCHLOG_FEATURE,
+        ZSTD_COMPRESSION_FEATURE,
     };
     if (service::get_local_storage_service()._db.local().get_config().experimental()) {
         features.push_back(MATERIALIZED_VIEWS_FEATURE);
@@ -350,6 +364,13 @@ void storage_service::register_features() {
     _schema_tables_v3 = gms::feature(SCHEMA_TABLES_V3);
     _correct_non_compound_range_tombstones = gms::feature(CORRECT_NON_COMPOUND_RANGE_TOMBSTONES);
     _write_failure_reply_feature = gms::feature(WRITE_FAILURE_REPLY_FEATURE);
+    _multi_mutation_writes_feature = gms::feature(MULTI_MUTATION_WRITES_FEATURE);
+    _aggregate_pushdown_feature = gms::feature(AGGREGATE_PUSHDOWN_FEATURE);
+    _xxhash_feature = gms::feature(XXHASH_FEATURE);
+    _row_level_repair_feature = gms::feature(ROW_LEVEL_REPAIR_FEATURE);
+    _whole_sstable_streaming_feature = gms::feature(WHOLE_SSTABLE_STREAMING_FEATURE);
+    _sharded_batchlog_feature = gms::feature(SHARDED_BATCHLOG_FEATURE);
+    _zstd_compression_feature = gms::feature(ZSTD_COMPRESSION_FEATURE);
 
     if (_db.local().get_config().experimental()) {
         _materialized_views_feature = gms::feature(MATERIALIZED_VIEWS_FEATURE);
@@ -978,9 +999,6 @@ void storage_service::on_alive(gms::inet_address endpoint, gms::endpoint_state s
         slogger.warn("Fail to pull schema from {}: {}", endpoint, ep);
     });
     if (_token_metadata.is_member(endpoint)) {
-#if 0
-        HintedHandOffManager.instance.scheduleHintDelivery(endpoint, true);
-#endif
         get_storage_service().invoke_on_all([endpoint] (auto&& ss) {
             for (auto&& subscriber : ss._lifecycle_subscribers) {
                 try {
@@ -1229,7 +1247,7 @@ future<> storage_service::drain_on_shutdown() {
             slogger.info("Drain on shutdown: flush column_families done");
 
             ss.db().invoke_on_all([] (auto& db) {
-                return db.commitlog()->shutdown();
+                return db.shutdown_commitlogs();
             }).get();
             slogger.info("Drain on shutdown: shutdown commitlog done");
 
@@ -2314,7 +2332,7 @@ future<> storage_service::drain() {
 #endif
 
             ss.db().invoke_on_all([] (auto& db) {
-                return db.commitlog()->shutdown();
+                return db.shutdown_commitlogs();
             }).get();
 
             ss.set_mode(mode::DRAINED, true);
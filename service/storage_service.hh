@@ -271,6 +271,13 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
     gms::feature _schema_tables_v3;
     gms::feature _correct_non_compound_range_tombstones;
     gms::feature _write_failure_reply_feature;
+    gms::feature _multi_mutation_writes_feature;
+    gms::feature _aggregate_pushdown_feature;
+    gms::feature _xxhash_feature;
+    gms::feature _row_level_repair_feature;
+    gms::feature _whole_sstable_streaming_feature;
+    gms::feature _sharded_batchlog_feature;
+    gms::feature _zstd_compression_feature;
 public:
     void enable_all_features() {
         _range_tombstones_feature.enable();
@@ -283,6 +290,13 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
         _schema_tables_v3.enable();
         _correct_non_compound_range_tombstones.enable();
         _write_failure_reply_feature.enable();
+        _multi_mutation_writes_feature.enable();
+        _aggregate_pushdown_feature.enable();
+        _xxhash_feature.enable();
+        _row_level_repair_feature.enable();
+        _whole_sstable_streaming_feature.enable();
+        _sharded_batchlog_feature.enable();
+        _zstd_compression_feature.enable();
     }
 
     void finish_bootstrapping() {
@@ -2255,6 +2269,34 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
     bool node_supports_write_failure_reply(gms::inet_address ep) const {
         return gms::get_local_gossiper().node_has_feature(ep, _write_failure_reply_feature);
     }
+
+    bool node_supports_multi_mutation_writes(gms::inet_address ep) const {
+        return gms::get_local_gossiper().node_has_feature(ep, _multi_mutation_writes_feature);
+    }
+
+    bool cluster_supports_aggregate_pushdown() const {
+        return bool(_aggregate_pushdown_feature);
+    }
+
+    bool cluster_supports_xxhash_digest_algorithm() const {
+        return bool(_xxhash_feature);
+    }
+
+    bool cluster_supports_row_level_repair() const {
+        return bool(_row_level_repair_feature);
+    }
+
+    bool cluster_supports_whole_sstable_streaming() const {
+        return bool(_whole_sstable_streaming_feature);
+    }
+
+    bool cluster_supports_sharded_batchlog() const {
+        return bool(_sharded_batchlog_feature);
+    }
+
+    bool cluster_supports_zstd_compression() const {
+        return bool(_zstd_compression_feature);
+    }
 };
 
 inline future<> init_storage_service(distributed<database>& db, sharded<auth::service>& auth_service) {
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chunk_cache.hh"
+
+namespace sstables {
+
+void chunk_cache::insert(uint64_t sstable_id, uint64_t chunk_offset, const temporary_buffer<char>& data) {
+    if (data.size() > capacity()) {
+        return;
+    }
+    emplace(sstable_id, chunk_offset, bytes_view(reinterpret_cast<const int8_t*>(data.get()), data.size()));
+}
+
+chunk_cache& global_chunk_cache() {
+    static thread_local chunk_cache cache;
+    return cache;
+}
+
+}
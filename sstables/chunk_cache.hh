@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <seastar/core/temporary_buffer.hh>
+#include "bytes.hh"
+#include "sstables/sstable_cache.hh"
+
+namespace sstables {
+
+// Decompressed contents of a single chunk of a compressed Data.db.
+class chunk_cache_entry : public sstable_cache_entry {
+    uint64_t _chunk_offset;
+    managed_bytes _data;
+public:
+    // Offset of the chunk in the compressed file.
+    using key_type = uint64_t;
+    using value_type = temporary_buffer<char>;
+
+    chunk_cache_entry(uint64_t sstable_id, uint64_t chunk_offset, bytes_view data)
+        : sstable_cache_entry(sstable_id)
+        , _chunk_offset(chunk_offset)
+        , _data(data)
+    { }
+
+    chunk_cache_entry(chunk_cache_entry&&) noexcept = default;
+
+    uint64_t cache_key() const { return _chunk_offset; }
+
+    static int tri_compare_keys(uint64_t a, uint64_t b) {
+        return a < b ? -1 : (a > b ? 1 : 0);
+    }
+
+    // Must be called with a linearization context active.
+    temporary_buffer<char> value() const {
+        return temporary_buffer<char>(reinterpret_cast<const char*>(_data.data()), _data.size());
+    }
+};
+
+// Per-shard cache of decompressed chunks of compressed sstables, keyed by
+// (sstable, offset of the chunk in the compressed file).
+//
+// Used by compressed_file_data_source so that reads of partitions sharing a
+// chunk with a recently read one pay neither for the I/O nor for the
+// decompression again. Bounded by chunk_cache_size_in_mb.
+class chunk_cache : public sstable_cache<chunk_cache_entry> {
+public:
+    // Caches decompressed contents of a chunk.
+    void insert(uint64_t sstable_id, uint64_t chunk_offset, const temporary_buffer<char>& data);
+};
+
+chunk_cache& global_chunk_cache();
+
+}
@@ -189,6 +189,23 @@ class compaction {
         sst->open_data().get0();
         _info->end_size += sst->bytes_on_disk();
     }
+
+    virtual flat_mutation_reader make_sstable_reader(lw_shared_ptr<sstables::sstable_set> ssts) const {
+        return flat_mutation_reader_from_mutation_reader(_cf.schema(), ::make_range_sstable_reader(_cf.schema(),
+                std::move(ssts),
+                query::full_partition_range,
+                _cf.schema()->full_slice(),
+                service::get_local_compaction_priority(),
+                no_resource_tracking(),
+                nullptr,
+                ::streamed_mutation::forwarding::no,
+                ::mutation_reader::forwarding::no), ::streamed_mutation::forwarding::no);
+    }
+
+    // Output sstables which should be deleted if compaction fails.
+    virtual std::vector<shared_sstable> uncommitted_sstables() const {
+        return _info->new_sstables;
+    }
 public:
     compaction& operator=(const compaction&) = delete;
     compaction(const compaction&) = delete;
@@ -237,15 +254,7 @@ class compaction {
         _info->cf = schema->cf_name();
         report_start(formatted_msg);
 
-        return flat_mutation_reader_from_mutation_reader(_cf.schema(), ::make_range_sstable_reader(_cf.schema(),
-                ssts,
-                query::full_partition_range,
-                _cf.schema()->full_slice(),
-                service::get_local_compaction_priority(),
-                no_resource_tracking(),
-                nullptr,
-                ::streamed_mutation::forwarding::no,
-                ::mutation_reader::forwarding::no), ::streamed_mutation::forwarding::no);
+        return make_sstable_reader(std::move(ssts));
     }
 
     compaction_info finish(std::chrono::time_point<db_clock> started_at, std::chrono::time_point<db_clock> ended_at) {
@@ -337,22 +346,116 @@ void compacting_sstable_writer::consume_end_of_stream() {
 class regular_compaction : public compaction {
     std::function<shared_sstable()> _creator;
     // store a clone of sstable set for column family, which needs to be alive for incremental selector.
-    const sstable_set _set;
+    sstable_set _set;
     // used to incrementally calculate max purgeable timestamp, as we iterate through decorated keys.
-    sstable_set::incremental_selector _selector;
+    stdx::optional<sstable_set::incremental_selector> _selector;
     // sstable being currently written.
     shared_sstable _sst;
     stdx::optional<sstable_writer> _writer;
+    // Set for incremental compaction.
+    sstable_replacer_fn _replacer;
+    // Sealed outputs which didn't replace any input yet.
+    std::vector<shared_sstable> _unreplaced_outputs;
+    // Outputs which were handed over to the column family by _replacer.
+    std::unordered_set<shared_sstable> _replaced_outputs;
+    // All inputs, including those released already.
+    std::unordered_set<shared_sstable> _compacting;
+    // An input which shares a key with other inputs, one of which may hold a
+    // purged tombstone shadowing the others' data for that key, can't be
+    // released before all of them are. Maps such an input to the greatest
+    // last key of the inputs it shares keys with.
+    std::unordered_map<shared_sstable, dht::decorated_key> _release_barrier;
+private:
+    bool can_release(const shared_sstable& sst, const dht::decorated_key& sealed_up_to) const {
+        if (sst->get_last_decorated_key().tri_compare(*schema(), sealed_up_to) > 0) {
+            return false;
+        }
+        auto it = _release_barrier.find(sst);
+        return it == _release_barrier.end() || it->second.tri_compare(*schema(), sealed_up_to) <= 0;
+    }
+
+    void note_shared_key(const dht::decorated_key& dk) {
+        auto hk = sstables::sstable::make_hashed_key(*schema(), dk.key());
+        std::vector<const shared_sstable*> holders;
+        for (auto& sst : _sstables) {
+            if (sst->filter_has_key(hk)) {
+                holders.push_back(&sst);
+            }
+        }
+        if (holders.size() < 2) {
+            return;
+        }
+        auto barrier = (*holders.front())->get_last_decorated_key();
+        for (auto sst : holders) {
+            if ((*sst)->get_last_decorated_key().tri_compare(*schema(), barrier) > 0) {
+                barrier = (*sst)->get_last_decorated_key();
+            }
+        }
+        for (auto sst : holders) {
+            auto it = _release_barrier.find(*sst);
+            if (it == _release_barrier.end()) {
+                _release_barrier.emplace(*sst, barrier);
+            } else if (barrier.tri_compare(*schema(), it->second) > 0) {
+                it->second = barrier;
+            }
+        }
+    }
+
+    // Replaces inputs which contain no keys past sealed_up_to (all of them if
+    // it's null) with outputs sealed so far.
+    void replace_exhausted_sstables(const dht::decorated_key* sealed_up_to) {
+        auto exhausted_end = boost::partition(_sstables, [&] (const shared_sstable& sst) {
+            return sealed_up_to && !can_release(sst, *sealed_up_to);
+        });
+        std::vector<shared_sstable> exhausted(exhausted_end, _sstables.end());
+        if (exhausted.empty() && (sealed_up_to || _unreplaced_outputs.empty())) {
+            return;
+        }
+        _sstables.erase(exhausted_end, _sstables.end());
+        clogger.debug("Replacing {} exhausted sstables of {}.{} with {} sealed ones",
+            exhausted.size(), _info->ks, _info->cf, _unreplaced_outputs.size());
+        _replaced_outputs.insert(_unreplaced_outputs.begin(), _unreplaced_outputs.end());
+        _replacer(std::move(exhausted), std::exchange(_unreplaced_outputs, {}));
+        // Our clone of the sstable set references the exhausted sstables,
+        // keeping their files open, so switch to the current one.
+        _selector = stdx::nullopt;
+        _set = _cf.get_sstable_set();
+        _selector.emplace(_set.make_incremental_selector());
+    }
 public:
     regular_compaction(column_family& cf, std::vector<shared_sstable> sstables, std::function<shared_sstable()> creator,
-            uint64_t max_sstable_size, uint32_t sstable_level, seastar::thread_scheduling_group* tsg)
+            uint64_t max_sstable_size, uint32_t sstable_level, seastar::thread_scheduling_group* tsg,
+            sstable_replacer_fn replacer = {})
         : compaction(cf, std::move(sstables), max_sstable_size, sstable_level, tsg)
         , _creator(std::move(creator))
         , _set(cf.get_sstable_set())
         , _selector(_set.make_incremental_selector())
+        , _replacer(std::move(replacer))
+        , _compacting(_sstables.begin(), _sstables.end())
     {
     }
 
+    // Unlike the range sstable reader, which keeps all sstables alive until
+    // it's destroyed, the combined reader drops readers which reached their
+    // end, so that exhausted inputs can be closed and their space reclaimed.
+    virtual flat_mutation_reader make_sstable_reader(lw_shared_ptr<sstables::sstable_set> ssts) const override {
+        if (!_replacer) {
+            return compaction::make_sstable_reader(std::move(ssts));
+        }
+        auto readers = boost::copy_range<std::vector<flat_mutation_reader>>(_sstables
+                | boost::adaptors::transformed([this] (const shared_sstable& sst) {
+            return sst->read_range_rows_flat(_cf.schema(), query::full_partition_range, _cf.schema()->full_slice(),
+                    service::get_local_compaction_priority(), no_resource_tracking(),
+                    ::streamed_mutation::forwarding::no, ::mutation_reader::forwarding::no);
+        }));
+        return make_combined_reader(_cf.schema(), std::move(readers), ::streamed_mutation::forwarding::no, ::mutation_reader::forwarding::no);
+    }
+
+    virtual std::vector<shared_sstable> uncommitted_sstables() const override {
+        return boost::copy_range<std::vector<shared_sstable>>(_info->new_sstables
+                | boost::adaptors::filtered([this] (const shared_sstable& sst) { return !_replaced_outputs.count(sst); }));
+    }
+
     void report_start(const sstring& formatted_msg) const override {
         clogger.info("Compacting {}", formatted_msg);
     }
@@ -362,9 +465,14 @@ class regular_compaction : public compaction {
     }
 
     virtual std::function<api::timestamp_type(const dht::decorated_key&)> max_purgeable_func() override {
-        std::unordered_set<shared_sstable> compacting(_sstables.begin(), _sstables.end());
-        return [this, compacting = std::move(compacting)] (const dht::decorated_key& dk) {
-            return get_max_purgeable_timestamp(_cf, _selector, compacting, dk);
+        return [this] (const dht::decorated_key& dk) {
+            // Incremental compaction may purge a tombstone of one input which
+            // shadows data of another. Releasing the former first would
+            // bring the data back, so they are released together.
+            if (_replacer) {
+                note_shared_key(dk);
+            }
+            return get_max_purgeable_timestamp(_cf, *_selector, _compacting, dk);
         };
     }
 
@@ -389,20 +497,28 @@ class regular_compaction : public compaction {
 
     virtual void stop_sstable_writer() override {
         finish_new_sstable(_writer, _sst);
+        if (_replacer) {
+            _unreplaced_outputs.push_back(_sst);
+            replace_exhausted_sstables(&_sst->get_last_decorated_key());
+        }
     }
 
     virtual void finish_sstable_writer() override {
         if (_writer) {
             stop_sstable_writer();
         }
+        if (_replacer) {
+            replace_exhausted_sstables(nullptr);
+        }
     }
 };
 
 class cleanup_compaction final : public regular_compaction {
 public:
     cleanup_compaction(column_family& cf, std::vector<shared_sstable> sstables, std::function<shared_sstable()> creator,
-            uint64_t max_sstable_size, uint32_t sstable_level, seastar::thread_scheduling_group* tsg)
-        : regular_compaction(cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level, tsg)
+            uint64_t max_sstable_size, uint32_t sstable_level, seastar::thread_scheduling_group* tsg,
+            sstable_replacer_fn replacer = {})
+        : regular_compaction(cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level, tsg, std::move(replacer))
     {
         _info->type = compaction_type::Cleanup;
     }
@@ -500,7 +616,8 @@ future<compaction_info> compaction::run(std::unique_ptr<compaction> c) {
         try {
             reader.consume_in_thread(std::move(cfc), c->filter_func());
         } catch (...) {
-            delete_sstables_for_interrupted_compaction(c->_info->new_sstables, c->_info->ks, c->_info->cf);
+            auto uncommitted = c->uncommitted_sstables();
+            delete_sstables_for_interrupted_compaction(uncommitted, c->_info->ks, c->_info->cf);
             c = nullptr; // make sure writers are stopped while running in thread context
             throw;
         }
@@ -520,11 +637,12 @@ static std::unique_ptr<compaction> make_compaction(bool cleanup, Params&&... par
 
 future<compaction_info>
 compact_sstables(std::vector<shared_sstable> sstables, column_family& cf, std::function<shared_sstable()> creator,
-        uint64_t max_sstable_size, uint32_t sstable_level, bool cleanup, seastar::thread_scheduling_group *tsg) {
+        uint64_t max_sstable_size, uint32_t sstable_level, bool cleanup, seastar::thread_scheduling_group *tsg,
+        sstable_replacer_fn replacer) {
     if (sstables.empty()) {
         throw std::runtime_error(sprint("Called compaction with empty set on behalf of {}.{}", cf.schema()->ks_name(), cf.schema()->cf_name()));
     }
-    auto c = make_compaction(cleanup, cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level, tsg);
+    auto c = make_compaction(cleanup, cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level, tsg, std::move(replacer));
     return compaction::run(std::move(c));
 }
 
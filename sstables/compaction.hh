@@ -36,6 +36,10 @@ namespace sstables {
         int level;
         // Threshold size for sstable(s) to be created.
         uint64_t max_sstable_bytes;
+        // Called with the input sstables which an incremental compaction
+        // released before finishing, so that whoever tracks the compacting
+        // sstables can drop its references to them.
+        std::function<void(const std::vector<sstables::shared_sstable>&)> release_exhausted;
 
         compaction_descriptor() = default;
 
@@ -102,6 +106,10 @@ namespace sstables {
         }
     };
 
+    // Called by incremental compaction to replace input sstables, all of whose
+    // data was already merged, with the sealed output sstables containing it.
+    using sstable_replacer_fn = std::function<void(std::vector<shared_sstable> exhausted, std::vector<shared_sstable> sealed)>;
+
     // Compact a list of N sstables into M sstables.
     // Returns info about the finished compaction, which includes vector to new sstables.
     //
@@ -113,10 +121,15 @@ namespace sstables {
     // If cleanup is true, mutation that doesn't belong to current node will be
     // cleaned up, log messages will inform the user that compact_sstables runs for
     // cleaning operation, and compaction history will not be updated.
+    // If replacer is given, compaction is incremental: every time an output
+    // sstable is sealed, input sstables whose last key it covers are replaced
+    // with the outputs sealed so far by calling replacer, and the compaction
+    // drops its own references to them. By the time compaction finishes, all
+    // inputs and outputs were passed to replacer.
     future<compaction_info> compact_sstables(std::vector<shared_sstable> sstables,
             column_family& cf, std::function<shared_sstable()> creator,
             uint64_t max_sstable_size, uint32_t sstable_level, bool cleanup = false,
-            seastar::thread_scheduling_group* tsg = nullptr);
+            seastar::thread_scheduling_group* tsg = nullptr, sstable_replacer_fn replacer = {});
 
     // Compacts a set of N shared sstables into M sstables. For every shard involved,
     // i.e. which owns any of the sstables, a new unshared sstable is created.
@@ -23,6 +23,7 @@
 #include "sstables/sstables.hh"
 #include "database.hh"
 #include <seastar/core/metrics.hh>
+#include <boost/range/algorithm/remove_if.hpp>
 #include "exceptions.hh"
 #include <cmath>
 
@@ -62,6 +63,16 @@ class compacting_sstable_registration {
             _cm->deregister_compacting_sstables(_compacting);
         }
     }
+
+    // Stops tracking sstables which incremental compaction is done with.
+    void release_compacting(const std::vector<sstables::shared_sstable>& sstables) {
+        _cm->deregister_compacting_sstables(sstables);
+        std::unordered_set<sstables::shared_sstable> s(sstables.begin(), sstables.end());
+        auto e = boost::range::remove_if(_compacting, [&] (const sstables::shared_sstable& sst) {
+            return s.count(sst);
+        });
+        _compacting.erase(e, _compacting.end());
+    }
 };
 
 class compaction_weight_registration {
@@ -294,9 +305,13 @@ future<> compaction_manager::submit_major_compaction(column_family* cf) {
             // FIXME: we need to make major compaction compaction strategy aware. For example,
             // leveled strategy may want to promote the merged sstables of a level N.
             auto sstables = get_candidates(*cf);
-            auto compacting = compacting_sstable_registration(this, sstables);
+            auto compacting = make_lw_shared<compacting_sstable_registration>(this, sstables);
+            auto descriptor = sstables::compaction_descriptor(std::move(sstables));
+            descriptor.release_exhausted = [compacting] (const std::vector<sstables::shared_sstable>& exhausted) {
+                compacting->release_compacting(exhausted);
+            };
 
-            return cf->compact_sstables(sstables::compaction_descriptor(std::move(sstables))).then([compacting = std::move(compacting)] {});
+            return cf->compact_sstables(std::move(descriptor)).then([compacting] {});
         });
     }).then_wrapped([this, task] (future<> f) {
         _stats.active_tasks--;
@@ -473,7 +488,10 @@ void compaction_manager::submit(column_family* cf) {
                     descriptor.sstables.size(), weight, cf.schema()->ks_name(), cf.schema()->cf_name());
                 return make_ready_future<stop_iteration>(stop_iteration::yes);
             }
-            auto compacting = compacting_sstable_registration(this, descriptor.sstables);
+            auto compacting = make_lw_shared<compacting_sstable_registration>(this, descriptor.sstables);
+            descriptor.release_exhausted = [compacting] (const std::vector<sstables::shared_sstable>& exhausted) {
+                compacting->release_compacting(exhausted);
+            };
             auto c_weight = compaction_weight_registration(this, &cf, weight);
             cmlog.debug("Accepted compaction job ({} sstable(s)) of weight {} for {}.{}",
                 descriptor.sstables.size(), weight, cf.schema()->ks_name(), cf.schema()->cf_name());
@@ -39,6 +39,7 @@
 
 #include <vector>
 #include <chrono>
+#include <cmath>
 
 #include "sstables.hh"
 #include "compaction.hh"
@@ -349,12 +350,56 @@ compaction_strategy_impl::get_resharding_jobs(column_family& cf, std::vector<sst
     return jobs;
 }
 
+void tiered_backlog_tracker::add_sstable(const shared_sstable& sst) {
+    auto size = sst->data_size();
+    _sstables++;
+    _total_bytes += size;
+    if (size) {
+        _sum_s_log_s += size * std::log(double(size));
+    }
+}
+
+void tiered_backlog_tracker::remove_sstable(const shared_sstable& sst) {
+    auto size = sst->data_size();
+    if (!--_sstables) {
+        // Don't let rounding errors accumulate across generations of sstables.
+        _total_bytes = 0;
+        _sum_s_log_s = 0;
+        return;
+    }
+    _total_bytes -= size;
+    if (size) {
+        _sum_s_log_s -= size * std::log(double(size));
+    }
+}
+
+uint64_t tiered_backlog_tracker::backlog(const schema& s) const {
+    if (!_total_bytes) {
+        return 0;
+    }
+    auto fanout = std::max(2, s.min_compaction_threshold());
+    auto backlog = (_total_bytes * std::log(double(_total_bytes)) - _sum_s_log_s) / std::log(double(fanout));
+    return std::llround(std::max(backlog, 0.0));
+}
+
 //
 // Null compaction strategy is the default compaction strategy.
 // As the name implies, it does nothing.
 //
 class null_compaction_strategy : public compaction_strategy_impl {
+    class null_backlog_tracker final : public compaction_backlog_tracker {
+    public:
+        virtual void add_sstable(const shared_sstable& sst) override { }
+        virtual void remove_sstable(const shared_sstable& sst) override { }
+        virtual uint64_t backlog(const schema& s) const override {
+            return 0;
+        }
+    };
 public:
+    null_compaction_strategy() {
+        _backlog_tracker = std::make_unique<null_backlog_tracker>();
+    }
+
     virtual compaction_descriptor get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) override {
         return sstables::compaction_descriptor();
     }
@@ -373,7 +418,29 @@ class null_compaction_strategy : public compaction_strategy_impl {
 //
 class major_compaction_strategy : public compaction_strategy_impl {
     static constexpr size_t min_compact_threshold = 2;
+
+    // Everything is rewritten, once there's something to compact.
+    class major_backlog_tracker final : public compaction_backlog_tracker {
+        size_t _sstables = 0;
+        uint64_t _total_bytes = 0;
+    public:
+        virtual void add_sstable(const shared_sstable& sst) override {
+            _sstables++;
+            _total_bytes += sst->data_size();
+        }
+        virtual void remove_sstable(const shared_sstable& sst) override {
+            _sstables--;
+            _total_bytes -= sst->data_size();
+        }
+        virtual uint64_t backlog(const schema& s) const override {
+            return _sstables < min_compact_threshold ? 0 : _total_bytes;
+        }
+    };
 public:
+    major_compaction_strategy() {
+        _backlog_tracker = std::make_unique<major_backlog_tracker>();
+    }
+
     virtual compaction_descriptor get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) override {
         // At least, two sstables must be available for compaction to take place.
         if (cfs.sstables_count() < min_compact_threshold) {
@@ -423,10 +490,30 @@ int64_t compaction_strategy::estimated_pending_compactions(column_family& cf) co
     return _compaction_strategy_impl->estimated_pending_compactions(cf);
 }
 
+compaction_backlog_tracker& compaction_strategy::get_backlog_tracker() {
+    return _compaction_strategy_impl->get_backlog_tracker();
+}
+
+uint64_t compaction_strategy::compaction_backlog(column_family& cf) const {
+    return _compaction_strategy_impl->get_backlog_tracker().backlog(*cf.schema());
+}
+
 bool compaction_strategy::use_clustering_key_filter() const {
     return _compaction_strategy_impl->use_clustering_key_filter();
 }
 
+bool compaction_strategy::incremental() const {
+    return _compaction_strategy_impl->incremental();
+}
+
+uint64_t compaction_strategy::incremental_fragment_size() const {
+    return _compaction_strategy_impl->incremental_fragment_size();
+}
+
+bool compaction_strategy::run_aware() const {
+    return _compaction_strategy_impl->run_aware();
+}
+
 sstable_set
 compaction_strategy::make_sstable_set(schema_ptr schema) const {
     return sstable_set(
@@ -27,18 +27,56 @@ namespace sstables {
 
 class sstable_set_impl;
 
+// Keeps track of how many bytes a compaction strategy still has to rewrite
+// for the table to be in the shape the strategy wants. The table tells the
+// tracker about every sstable it adds or removes, so the estimate is kept
+// up to date without looking at all sstables again.
+class compaction_backlog_tracker {
+public:
+    virtual ~compaction_backlog_tracker() {}
+    virtual void add_sstable(const shared_sstable& sst) = 0;
+    virtual void remove_sstable(const shared_sstable& sst) = 0;
+    virtual uint64_t backlog(const schema& s) const = 0;
+};
+
+// Backlog of sstables which are merged into tiers of min_compaction_threshold
+// until they're all in one: each byte is rewritten once per tier it has to
+// climb, so an sstable of size s out of total T contributes s * log_fanout(T / s).
+// Summed up, that's (T * ln(T) - sum(s * ln(s))) / ln(fanout), so only T and
+// sum(s * ln(s)) have to be kept.
+class tiered_backlog_tracker final : public compaction_backlog_tracker {
+    size_t _sstables = 0;
+    uint64_t _total_bytes = 0;
+    double _sum_s_log_s = 0;
+public:
+    virtual void add_sstable(const shared_sstable& sst) override;
+    virtual void remove_sstable(const shared_sstable& sst) override;
+    virtual uint64_t backlog(const schema& s) const override;
+
+    bool empty() const {
+        return !_sstables;
+    }
+};
+
 class compaction_strategy_impl {
     static constexpr float DEFAULT_TOMBSTONE_THRESHOLD = 0.2f;
     // minimum interval needed to perform tombstone removal compaction in seconds, default 86400 or 1 day.
     static constexpr std::chrono::seconds DEFAULT_TOMBSTONE_COMPACTION_INTERVAL() { return std::chrono::seconds(86400); }
+    static constexpr long DEFAULT_INCREMENTAL_FRAGMENT_SIZE_IN_MB = 1000;
 protected:
     const sstring TOMBSTONE_THRESHOLD_OPTION = "tombstone_threshold";
     const sstring TOMBSTONE_COMPACTION_INTERVAL_OPTION = "tombstone_compaction_interval";
+    const sstring INCREMENTAL_COMPACTION_OPTION = "incremental_compaction";
+    const sstring INCREMENTAL_FRAGMENT_SIZE_OPTION = "incremental_fragment_size_in_mb";
 
     bool _use_clustering_key_filter = false;
     bool _disable_tombstone_compaction = false;
     float _tombstone_threshold = DEFAULT_TOMBSTONE_THRESHOLD;
     db_clock::duration _tombstone_compaction_interval = DEFAULT_TOMBSTONE_COMPACTION_INTERVAL();
+    bool _incremental = false;
+    uint64_t _incremental_fragment_size = uint64_t(DEFAULT_INCREMENTAL_FRAGMENT_SIZE_IN_MB) << 20;
+    // By default, sstables are assumed to be merged in tiers of min_compaction_threshold.
+    std::unique_ptr<compaction_backlog_tracker> _backlog_tracker = std::make_unique<tiered_backlog_tracker>();
 public:
     static stdx::optional<sstring> get_value(const std::map<sstring, sstring>& options, const sstring& name) {
         auto it = options.find(name);
@@ -59,6 +97,13 @@ class compaction_strategy_impl {
         auto interval = property_definitions::to_long(TOMBSTONE_COMPACTION_INTERVAL_OPTION, tmp_value, DEFAULT_TOMBSTONE_COMPACTION_INTERVAL().count());
         _tombstone_compaction_interval = db_clock::duration(std::chrono::seconds(interval));
 
+        tmp_value = get_value(options, INCREMENTAL_COMPACTION_OPTION);
+        _incremental = tmp_value && *tmp_value == "true";
+
+        tmp_value = get_value(options, INCREMENTAL_FRAGMENT_SIZE_OPTION);
+        auto fragment_size_in_mb = property_definitions::to_long(INCREMENTAL_FRAGMENT_SIZE_OPTION, tmp_value, DEFAULT_INCREMENTAL_FRAGMENT_SIZE_IN_MB);
+        _incremental_fragment_size = uint64_t(std::max(fragment_size_in_mb, 1L)) << 20;
+
         // FIXME: validate options.
     }
 public:
@@ -70,6 +115,13 @@ class compaction_strategy_impl {
     virtual bool parallel_compaction() const {
         return true;
     }
+    // Whether the strategy picks the output sstables of one compaction
+    // independently of each other, as those of a sorted run. Only then can
+    // compaction cut its output into fragments without the next compaction
+    // picking them again merely because they are small.
+    virtual bool run_aware() const {
+        return false;
+    }
     virtual int64_t estimated_pending_compactions(column_family& cf) const = 0;
     virtual std::unique_ptr<sstable_set_impl> make_sstable_set(schema_ptr schema) const;
 
@@ -77,6 +129,18 @@ class compaction_strategy_impl {
         return _use_clustering_key_filter;
     }
 
+    bool incremental() const {
+        return _incremental;
+    }
+
+    uint64_t incremental_fragment_size() const {
+        return _incremental_fragment_size;
+    }
+
+    compaction_backlog_tracker& get_backlog_tracker() {
+        return *_backlog_tracker;
+    }
+
     // Check if a given sstable is entitled for tombstone compaction based on its
     // droppable tombstone histogram and gc_before.
     bool worth_dropping_tombstones(const shared_sstable& sst, gc_clock::time_point gc_before) {
@@ -23,16 +23,23 @@
 #include <cstdlib>
 
 #include <boost/range/algorithm/find_if.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/numeric.hpp>
 #include <seastar/core/align.hh>
 #include <seastar/core/bitops.hh>
 #include <seastar/core/byteorder.hh>
 #include <seastar/core/fstream.hh>
 
 #include "compress.hh"
+#include "chunk_cache.hh"
+#include "exceptions.hh"
 
 #include <lz4.h>
 #include <zlib.h>
 #include <snappy-c.h>
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+#include <zdict.h>
 
 #include "unimplemented.hh"
 #include "stdx.hh"
@@ -258,6 +265,10 @@ void compression::segmented_offsets::push_back(uint64_t offset) {
     ++_size;
 }
 
+static bytes to_option_bytes(sstring_view s) {
+    return bytes(reinterpret_cast<const int8_t*>(s.data()), s.size());
+}
+
 void compression::update(uint64_t compressed_file_length) {
     // FIXME: also process _compression.options (just for crc-check frequency)
      if (name.value == "LZ4Compressor") {
@@ -266,6 +277,22 @@ void compression::update(uint64_t compressed_file_length) {
          _uncompress = uncompress_snappy;
      } else if (name.value == "DeflateCompressor") {
          _uncompress = uncompress_deflate;
+     } else if (name.value == "ZstdCompressor") {
+         int level = compression_parameters::DEFAULT_ZSTD_COMPRESSION_LEVEL;
+         bytes dictionary;
+         for (auto&& opt : options.elements) {
+             if (opt.key.value == to_option_bytes(zstd_compression::LEVEL_OPTION)) {
+                 auto value = std::string(reinterpret_cast<const char*>(opt.value.value.data()), opt.value.value.size());
+                 try {
+                     level = std::stoi(value);
+                 } catch (const std::exception&) {
+                     throw malformed_sstable_exception(sprint("Invalid value '%s' of compression option %s", value, sstring(zstd_compression::LEVEL_OPTION)));
+                 }
+             } else if (opt.key.value == to_option_bytes(zstd_compression::DICTIONARY_OPTION)) {
+                 dictionary = opt.value.value;
+             }
+         }
+         _zstd = std::make_shared<zstd_compression>(level, std::move(dictionary));
      } else {
          throw std::runtime_error("unsupported compression type");
      }
@@ -286,11 +313,33 @@ void compression::set_compressor(compressor c) {
          _compress = compress_deflate;
          _compress_max_size = compress_max_size_deflate;
          name.value = "DeflateCompressor";
+     } else if (c == compressor::zstd) {
+         _zstd = std::make_shared<zstd_compression>(compression_parameters::DEFAULT_ZSTD_COMPRESSION_LEVEL, bytes());
+         name.value = "ZstdCompressor";
      } else {
          throw std::runtime_error("unsupported compressor type");
      }
 }
 
+void compression::set_compressor(const compression_parameters& cp) {
+    set_compressor(cp.get_compressor());
+    if (cp.get_compressor() == compressor::zstd) {
+        _zstd = std::make_shared<zstd_compression>(cp.compression_level(), bytes());
+        _dictionary_size = cp.dictionary_size();
+        options.elements.push_back({to_option_bytes(zstd_compression::LEVEL_OPTION), to_option_bytes(to_sstring(cp.compression_level()))});
+    }
+}
+
+void compression::set_dictionary(bytes dictionary) {
+    assert(_zstd);
+    _dictionary_size = 0;
+    if (dictionary.empty()) {
+        return;
+    }
+    _zstd = std::make_shared<zstd_compression>(_zstd->level(), dictionary);
+    options.elements.push_back({to_option_bytes(zstd_compression::DICTIONARY_OPTION), std::move(dictionary)});
+}
+
 // locate() takes a byte position in the uncompressed stream, and finds the
 // the location of the compressed chunk on disk which contains it, and the
 // offset in this chunk.
@@ -426,6 +475,121 @@ size_t compress_snappy(const char* input, size_t input_len,
     return output_len;
 }
 
+// zstd contexts are expensive to create, so each shard keeps one of each,
+// and attaches the dictionary of the sstable to it for each chunk.
+// Referencing a digested dictionary is cheap, unlike loading a raw one.
+struct zstd_contexts {
+    struct cctx_deleter {
+        void operator()(ZSTD_CCtx* ctx) const { ZSTD_freeCCtx(ctx); }
+    };
+    struct dctx_deleter {
+        void operator()(ZSTD_DCtx* ctx) const { ZSTD_freeDCtx(ctx); }
+    };
+    std::unique_ptr<ZSTD_CCtx, cctx_deleter> cctx{ZSTD_createCCtx()};
+    std::unique_ptr<ZSTD_DCtx, dctx_deleter> dctx{ZSTD_createDCtx()};
+};
+
+static thread_local zstd_contexts local_zstd_contexts;
+
+struct sstables::zstd_compression::impl {
+    struct cdict_deleter {
+        void operator()(ZSTD_CDict* d) const { ZSTD_freeCDict(d); }
+    };
+    struct ddict_deleter {
+        void operator()(ZSTD_DDict* d) const { ZSTD_freeDDict(d); }
+    };
+    std::unique_ptr<ZSTD_CDict, cdict_deleter> cdict;
+    std::unique_ptr<ZSTD_DDict, ddict_deleter> ddict;
+};
+
+sstables::zstd_compression::zstd_compression(int level, bytes dictionary)
+        : _level(level)
+        , _dictionary(std::move(dictionary))
+        , _impl(std::make_unique<impl>()) {
+    if (!_dictionary.empty()) {
+        // The dictionary is owned by us, so zstd can reference it instead of copying.
+        _impl->cdict.reset(ZSTD_createCDict_byReference(_dictionary.data(), _dictionary.size(), _level));
+        _impl->ddict.reset(ZSTD_createDDict_byReference(_dictionary.data(), _dictionary.size()));
+        if (!_impl->cdict || !_impl->ddict) {
+            throw std::runtime_error("zstd dictionary load failure");
+        }
+    }
+}
+
+sstables::zstd_compression::~zstd_compression() = default;
+
+size_t sstables::zstd_compression::compress(const char* input, size_t input_len,
+        char* output, size_t output_len) const {
+    auto cctx = local_zstd_contexts.cctx.get();
+    size_t ret;
+    if (_impl->cdict) {
+        ret = ZSTD_compress_usingCDict(cctx, output, output_len, input, input_len, _impl->cdict.get());
+    } else {
+        ret = ZSTD_compressCCtx(cctx, output, output_len, input, input_len, _level);
+    }
+    if (ZSTD_isError(ret)) {
+        throw std::runtime_error(sprint("zstd compression failure: %s", ZSTD_getErrorName(ret)));
+    }
+    return ret;
+}
+
+size_t sstables::zstd_compression::uncompress(const char* input, size_t input_len,
+        char* output, size_t output_len) const {
+    auto dctx = local_zstd_contexts.dctx.get();
+    size_t ret;
+    if (_impl->ddict) {
+        ret = ZSTD_decompress_usingDDict(dctx, output, output_len, input, input_len, _impl->ddict.get());
+    } else {
+        ret = ZSTD_decompressDCtx(dctx, output, output_len, input, input_len);
+    }
+    if (ZSTD_isError(ret)) {
+        throw std::runtime_error(sprint("zstd uncompression failure: %s", ZSTD_getErrorName(ret)));
+    }
+    return ret;
+}
+
+size_t sstables::zstd_compression::compress_max_size(size_t input_len) const {
+    return ZSTD_compressBound(input_len);
+}
+
+bytes sstables::train_zstd_dictionary(const std::vector<temporary_buffer<char>>& samples, size_t max_size) {
+    // Below that, zstd gives up or trains a useless dictionary.
+    static constexpr size_t min_samples = 8;
+    static constexpr size_t min_training_bytes_per_dictionary_byte = 10;
+    // Chunks are cut into samples of at most that size, so that a bounded
+    // amount of big chunks still gives zstd enough samples to work with.
+    static constexpr size_t max_sample_size = 4096;
+
+    auto total_size = std::min(max_zstd_training_bytes,
+            boost::accumulate(samples | boost::adaptors::transformed(std::mem_fn(&temporary_buffer<char>::size)), size_t(0)));
+    max_size = std::min(max_size, total_size / min_training_bytes_per_dictionary_byte);
+    if (!max_size) {
+        return bytes();
+    }
+    bytes sample_data(bytes::initialized_later(), total_size);
+    std::vector<size_t> sample_sizes;
+    auto out = sample_data.begin();
+    for (auto&& s : samples) {
+        for (size_t pos = 0; pos < s.size() && out != sample_data.end(); ) {
+            auto size = std::min({s.size() - pos, max_sample_size, size_t(sample_data.end() - out)});
+            out = std::copy_n(reinterpret_cast<const int8_t*>(s.get() + pos), size, out);
+            sample_sizes.push_back(size);
+            pos += size;
+        }
+    }
+    if (sample_sizes.size() < min_samples) {
+        return bytes();
+    }
+    bytes dictionary(bytes::initialized_later(), max_size);
+    auto ret = ZDICT_trainFromBuffer(dictionary.begin(), dictionary.size(), sample_data.begin(), sample_sizes.data(), sample_sizes.size());
+    if (ZDICT_isError(ret)) {
+        sstlog.debug("Failed to train zstd dictionary from {} samples: {}", sample_sizes.size(), ZDICT_getErrorName(ret));
+        return bytes();
+    }
+    dictionary.resize(ret);
+    return dictionary;
+}
+
 size_t compress_max_size_lz4(size_t input_len) {
     return LZ4_COMPRESSBOUND(input_len) + 4;
 }
@@ -450,16 +614,53 @@ size_t compress_max_size_snappy(size_t input_len) {
 }
 
 class compressed_file_data_source_impl : public data_source_impl {
+    file _file;
+    file_input_stream_options _options;
+    // Opened on the first chunk which isn't in the chunk cache, so that
+    // reads served from the cache don't issue any I/O, read-ahead included.
     stdx::optional<input_stream<char>> _input_stream;
     sstables::compression* _compression_metadata;
+    // Position in the compressed file of the next chunk to return.
     uint64_t _underlying_pos;
+    // Position of _input_stream, which lags behind _underlying_pos after
+    // chunks were found in the cache or skipped.
+    uint64_t _stream_pos;
+    uint64_t _underlying_end_pos;
     uint64_t _pos;
     uint64_t _beg_pos;
     uint64_t _end_pos;
+    stdx::optional<uint64_t> _chunk_cache_id;
+private:
+    // Reads the compressed chunk at addr, catching the stream up with it first.
+    future<temporary_buffer<char>> read_chunk(const sstables::compression::chunk_and_offset& addr) {
+        auto f = make_ready_future<>();
+        if (!_input_stream) {
+            _input_stream = make_file_input_stream(std::move(_file), addr.chunk_start,
+                    _underlying_end_pos - addr.chunk_start, std::move(_options));
+        } else if (addr.chunk_start != _stream_pos) {
+            f = _input_stream->skip(addr.chunk_start - _stream_pos);
+        }
+        _stream_pos = addr.chunk_start + addr.chunk_len;
+        return f.then([this, len = addr.chunk_len] {
+            return _input_stream->read_exactly(len);
+        });
+    }
+
+    // Returns the part of the uncompressed chunk which we need to return
+    // to the reader and advances the cursors past the chunk.
+    temporary_buffer<char> consume_chunk(temporary_buffer<char> out, const sstables::compression::chunk_and_offset& addr) {
+        out.trim_front(addr.offset);
+        _pos += out.size();
+        _underlying_pos += addr.chunk_len;
+        return out;
+    }
 public:
     compressed_file_data_source_impl(file f, sstables::compression* cm,
-                uint64_t pos, size_t len, file_input_stream_options options)
-            : _compression_metadata(cm)
+                uint64_t pos, size_t len, file_input_stream_options options, stdx::optional<uint64_t> chunk_cache_id)
+            : _file(std::move(f))
+            , _options(std::move(options))
+            , _compression_metadata(cm)
+            , _chunk_cache_id(chunk_cache_id)
     {
         _beg_pos = pos;
         if (pos > _compression_metadata->uncompressed_file_length()) {
@@ -477,14 +678,11 @@ class compressed_file_data_source_impl : public data_source_impl {
         }
         // _beg_pos and _end_pos specify positions in the compressed stream.
         // We need to translate them into a range of uncompressed chunks,
-        // and open a file_input_stream to read that range.
+        // which a file_input_stream will read when needed.
         auto start = _compression_metadata->locate(_beg_pos);
         auto end = _compression_metadata->locate(_end_pos - 1);
-        _input_stream = make_file_input_stream(std::move(f),
-                start.chunk_start,
-                end.chunk_start + end.chunk_len - start.chunk_start,
-                std::move(options));
-        _underlying_pos = start.chunk_start;
+        _underlying_end_pos = end.chunk_start + end.chunk_len;
+        _underlying_pos = _stream_pos = start.chunk_start;
         _pos = _beg_pos;
     }
     virtual future<temporary_buffer<char>> get() override {
@@ -497,7 +695,13 @@ class compressed_file_data_source_impl : public data_source_impl {
         if (_pos != _beg_pos && addr.offset != 0) {
             throw std::runtime_error("compressed reader out of sync");
         }
-        return _input_stream->read_exactly(addr.chunk_len).
+        if (_chunk_cache_id) {
+            auto cached = sstables::global_chunk_cache().find(*_chunk_cache_id, addr.chunk_start);
+            if (cached) {
+                return make_ready_future<temporary_buffer<char>>(consume_chunk(std::move(*cached), addr));
+            }
+        }
+        return read_chunk(addr).
             then([this, addr](temporary_buffer<char> buf) {
                 // The last 4 bytes of the chunk are the adler32 checksum
                 // of the rest of the (compressed) chunk.
@@ -519,10 +723,10 @@ class compressed_file_data_source_impl : public data_source_impl {
                         buf.get(), compressed_len,
                         out.get_write(), out.size());
                 out.trim(len);
-                out.trim_front(addr.offset);
-                _pos += out.size();
-                _underlying_pos += addr.chunk_len;
-                return out;
+                if (_chunk_cache_id) {
+                    sstables::global_chunk_cache().insert(*_chunk_cache_id, addr.chunk_start, out);
+                }
+                return consume_chunk(std::move(out), addr);
         });
     }
 
@@ -540,28 +744,26 @@ class compressed_file_data_source_impl : public data_source_impl {
             return make_ready_future<temporary_buffer<char>>();
         }
         auto addr = _compression_metadata->locate(_pos);
-        auto underlying_n = addr.chunk_start - _underlying_pos;
+        // The stream catches up on the next chunk read from it.
         _underlying_pos = addr.chunk_start;
         _beg_pos = _pos;
-        return _input_stream->skip(underlying_n).then([] {
-            return make_ready_future<temporary_buffer<char>>();
-        });
+        return make_ready_future<temporary_buffer<char>>();
     }
 };
 
 class compressed_file_data_source : public data_source {
 public:
     compressed_file_data_source(file f, sstables::compression* cm,
-            uint64_t offset, size_t len, file_input_stream_options options)
+            uint64_t offset, size_t len, file_input_stream_options options, stdx::optional<uint64_t> chunk_cache_id)
         : data_source(std::make_unique<compressed_file_data_source_impl>(
-                std::move(f), cm, offset, len, std::move(options)))
+                std::move(f), cm, offset, len, std::move(options), chunk_cache_id))
         {}
 };
 
 input_stream<char> make_compressed_file_input_stream(
         file f, sstables::compression* cm, uint64_t offset, size_t len,
-        file_input_stream_options options)
+        file_input_stream_options options, stdx::optional<uint64_t> chunk_cache_id)
 {
     return input_stream<char>(compressed_file_data_source(
-            std::move(f), cm, offset, len, std::move(options)));
+            std::move(f), cm, offset, len, std::move(options), chunk_cache_id));
 }
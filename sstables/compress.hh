@@ -36,6 +36,9 @@
 // Cassandra supports three different compression algorithms for the chunks,
 // LZ4, Snappy, and Deflate - the default (and therefore most important) is
 // LZ4. Each compressor is an implementation of the "compressor" class.
+// We additionally support Zstd, which unlike the others is parametrized:
+// its level and an optional dictionary, trained from the first chunks of
+// the sstable, are stored as options in the "Compression Info" file.
 //
 // Each compressed chunk is followed by a 4-byte checksum of the compressed
 // data, using the Adler32 algorithm. In Cassandra, there is a parameter
@@ -83,6 +86,48 @@ compress_max_size_func compress_max_size_lz4;
 compress_max_size_func compress_max_size_snappy;
 compress_max_size_func compress_max_size_deflate;
 
+namespace sstables {
+
+// Compression and decompression state of the ZstdCompressor.
+//
+// Immutable once created, so it can be used by all the shards which share
+// the sstable components. The (mutable) zstd contexts are per-thread.
+class zstd_compression {
+    int _level;
+    bytes _dictionary;
+    struct impl;
+    std::unique_ptr<impl> _impl;
+public:
+    static constexpr auto LEVEL_OPTION = "compression_level";
+    static constexpr auto DICTIONARY_OPTION = "zstd_dictionary";
+
+    zstd_compression(int level, bytes dictionary);
+    ~zstd_compression();
+
+    int level() const {
+        return _level;
+    }
+    const bytes& dictionary() const {
+        return _dictionary;
+    }
+    size_t compress(const char* input, size_t input_len, char* output, size_t output_len) const;
+    size_t uncompress(const char* input, size_t input_len, char* output, size_t output_len) const;
+    size_t compress_max_size(size_t input_len) const;
+};
+
+// Training is a single call into zstd which runs in the reactor and can't be
+// preempted, and its cost grows with the amount of input, so no more than
+// that many bytes of samples are used.
+constexpr size_t max_zstd_training_bytes = 128 * 1024;
+
+// Trains a dictionary of at most max_size bytes from the given samples, of
+// which only the first max_zstd_training_bytes are used. The dictionary is
+// also kept small relative to the input, for zstd to find enough repetitions.
+// Returns an empty dictionary if there isn't enough data to train one.
+bytes train_zstd_dictionary(const std::vector<temporary_buffer<char>>& samples, size_t max_size);
+
+}
+
 inline uint32_t init_checksum_adler32() {
     return adler32(0, Z_NULL, 0);
 }
@@ -315,14 +360,29 @@ struct compression {
     // Variables *not* found in the "Compression Info" file (added by update()):
     uint64_t _compressed_file_length = 0;
     uint32_t _full_checksum;
+    // Set for ZstdCompressor, instead of the function pointers above.
+    std::shared_ptr<const zstd_compression> _zstd;
+    // Set by the writer when a dictionary should be trained before
+    // compressing the first chunk.
+    size_t _dictionary_size = 0;
 public:
     // Set the compressor algorithm, please check the definition of enum compressor.
     void set_compressor(compressor c);
+    // Like set_compressor(compressor), also applying the compressor specific parameters.
+    void set_compressor(const compression_parameters& cp);
+    // Maximum size of the dictionary the writer should train, if any.
+    size_t pending_dictionary_size() const {
+        return _dictionary_size;
+    }
+    // Installs the dictionary trained by the writer and records it in the
+    // options, so that it's written to the "Compression Info" file.
+    // An empty dictionary means compressing without one.
+    void set_dictionary(bytes dictionary);
     // After changing _compression, update() must be called to update
     // additional variables depending on it.
     void update(uint64_t compressed_file_length);
     operator bool() const {
-        return _uncompress != nullptr;
+        return _uncompress != nullptr || _zstd;
     }
     // locate() locates in the compressed file the given byte position of
     // the uncompressed data:
@@ -377,6 +437,9 @@ struct compression {
     size_t uncompress(
             const char* input, size_t input_len,
             char* output, size_t output_len) const {
+        if (_zstd) {
+            return _zstd->uncompress(input, input_len, output, output_len);
+        }
         if (!_uncompress) {
             throw std::runtime_error("uncompress is not supported");
         }
@@ -385,12 +448,18 @@ struct compression {
     size_t compress(
             const char* input, size_t input_len,
             char* output, size_t output_len) const {
+        if (_zstd) {
+            return _zstd->compress(input, input_len, output, output_len);
+        }
         if (!_compress) {
             throw std::runtime_error("compress is not supported");
         }
         return _compress(input, input_len, output, output_len);
     }
     size_t compress_max_size(size_t input_len) const {
+        if (_zstd) {
+            return _zstd->compress_max_size(input_len);
+        }
         return _compress_max_size(input_len);
     }
     friend class sstable;
@@ -404,5 +473,9 @@ struct compression {
 // are open streams on it. This should happen naturally on a higher level -
 // as long as we have *sstables* work in progress, we need to keep the whole
 // sstable alive, and the compression metadata is only a part of it.
+//
+// If chunk_cache_id is given, decompressed chunks are looked up in and added
+// to the shard's chunk_cache under that sstable identifier.
 input_stream<char> make_compressed_file_input_stream(
-        file f, sstables::compression *cm, uint64_t offset, size_t len, class file_input_stream_options options);
+        file f, sstables::compression *cm, uint64_t offset, size_t len, class file_input_stream_options options,
+        stdx::optional<uint64_t> chunk_cache_id = stdx::nullopt);
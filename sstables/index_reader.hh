@@ -146,25 +146,46 @@ class index_consume_entry_context : public data_consumer::continuous_data_consum
 };
 
 // Less-comparator for lookups in the partition index.
+//
+// When constructed for a given position, the key of that position is converted
+// to the sstable format once, so that comparing it with keys of index entries
+// is a memcmp. Such comparator may be used only with the position it was
+// constructed for.
 class index_comparator {
     dht::ring_position_comparator _tri_cmp;
+    stdx::optional<key> _key;
+private:
+    int tri_compare(dht::ring_position_view rp, decorated_key_view e) const {
+        if (_key) {
+            return _tri_cmp(rp, key_view(*_key), e);
+        }
+        return _tri_cmp(rp, e);
+    }
 public:
     index_comparator(const schema& s) : _tri_cmp(s) {}
 
+    index_comparator(const schema& s, dht::ring_position_view rp)
+        : _tri_cmp(s)
+    {
+        if (rp.key()) {
+            _key = key::from_partition_key(s, *rp.key());
+        }
+    }
+
     bool operator()(const summary_entry& e, dht::ring_position_view rp) const {
-        return _tri_cmp(e.get_decorated_key(), rp) < 0;
+        return tri_compare(rp, e.get_decorated_key()) > 0;
     }
 
     bool operator()(const index_entry& e, dht::ring_position_view rp) const {
-        return _tri_cmp(e.get_decorated_key(), rp) < 0;
+        return tri_compare(rp, e.get_decorated_key()) > 0;
     }
 
     bool operator()(dht::ring_position_view rp, const summary_entry& e) const {
-        return _tri_cmp(e.get_decorated_key(), rp) > 0;
+        return tri_compare(rp, e.get_decorated_key()) < 0;
     }
 
     bool operator()(dht::ring_position_view rp, const index_entry& e) const {
-        return _tri_cmp(e.get_decorated_key(), rp) > 0;
+        return tri_compare(rp, e.get_decorated_key()) < 0;
     }
 };
 
@@ -214,9 +235,62 @@ class index_reader {
     uint64_t _current_pi_idx = 0; // Points to upper bound of the cursor.
     uint64_t _data_file_position = 0;
     indexable_element _element = indexable_element::partition;
+
+    // Engaged when the cursor was positioned on a partition using the key cache,
+    // without reading the index page which contains it.
+    stdx::optional<cached_index_entry> _cached;
+    // Engaged when the cursor was moved from a partition found in the key cache
+    // to the next one using the position recorded in the cache. The index page
+    // is read lazily, by looking up the first partition after this key.
+    stdx::optional<dht::decorated_key> _reposition_after;
 private:
+    dht::decorated_key cached_partition_key() const {
+        auto& s = *_sstable->_schema;
+        return dht::global_partitioner().decorate_key(s, _cached->entry.get_key().to_partition_key(s));
+    }
+
+    // Brings the cursor back to the regular, page-based mode.
+    void drop_cached() {
+        _cached = stdx::nullopt;
+        _reposition_after = stdx::nullopt;
+        _data_file_position = 0;
+        _current_pi_idx = 0;
+        _element = indexable_element::partition;
+    }
+
+    // Loads the index page for the partition which the cursor was moved to
+    // after a key cache hit. Must be called when _reposition_after is engaged.
+    future<> reposition() {
+        sstlog.trace("index {}: reposition()", this);
+        auto dk = std::move(*_reposition_after);
+        drop_cached();
+        return do_with(std::move(dk), [this] (const dht::decorated_key& dk) {
+            return advance_to(dht::ring_position_view::for_after_key(dk));
+        });
+    }
+
+    // Returns the data file position of the partition following the current
+    // one, if it can be determined from the current page.
+    stdx::optional<uint64_t> next_partition_position() const {
+        if (_current_index_idx + 1 < _current_list->size()) {
+            return (*_current_list)[_current_index_idx + 1].position();
+        }
+        if (_current_summary_idx + 1 >= _sstable->get_summary().header.size) {
+            return data_file_end();
+        }
+        return stdx::nullopt;
+    }
+
+    bool use_key_cache() const {
+        return !_current_list && !_cached && !_reposition_after
+            && global_key_cache().enabled()
+            && _sstable->_schema->caching_options().key_cache_enabled();
+    }
+
     future<> advance_to_end() {
         sstlog.trace("index {}: advance_to_end()", this);
+        _cached = stdx::nullopt;
+        _reposition_after = stdx::nullopt;
         _data_file_position = data_file_end();
         _element = indexable_element::partition;
         _prev_list = std::move(_current_list);
@@ -322,12 +396,17 @@ class index_reader {
         , _current_pi_idx(r._current_pi_idx)
         , _data_file_position(r._data_file_position)
         , _element(r._element)
+        , _cached(r._cached)
+        , _reposition_after(r._reposition_after)
     {
         sstlog.trace("index {}: index_reader for {}", this, _sstable->get_filename());
     }
 
     // Valid if partition_data_ready()
     index_entry& current_partition_entry() {
+        if (_cached) {
+            return _cached->entry;
+        }
         assert(_current_list);
         return (*_current_list)[_current_index_idx];
     }
@@ -361,7 +440,7 @@ class index_reader {
     // if it is readily available, and if it is not, we're better off obtaining
     // them by continuing reading from sstable.
     bool partition_data_ready() const {
-        return static_cast<bool>(_current_list);
+        return _current_list || _cached;
     }
 
     // Ensures that partition_data_ready() returns true.
@@ -371,6 +450,9 @@ class index_reader {
         if (partition_data_ready()) {
             return make_ready_future<>();
         }
+        if (_reposition_after) {
+            return reposition();
+        }
         // The only case when _current_list may be missing is when the cursor is at the beginning
         assert(_current_summary_idx == 0);
         return advance_to_page(0);
@@ -489,14 +571,35 @@ class index_reader {
     }
 
     // Like advance_to(dht::ring_position_view), but returns information whether the key was found
+    //
+    // When called on a fresh cursor, the partition is looked up in the key cache first.
     future<bool> advance_and_check_if_present(dht::ring_position_view key) {
-        return advance_to(key).then([this, key] {
+        bool populate = false;
+        if (key.key() && use_key_cache()) {
+            const schema& s = *_sstable->_schema;
+            auto sst_key = sstables::key::from_partition_key(s, *key.key());
+            auto e = global_key_cache().find(_sstable->_cache_id, bytes_view(sst_key));
+            if (e && index_comparator(s)(key, e->entry) == 0) {
+                sstlog.trace("index {}: key cache hit, pos={}", this, e->entry.position());
+                _data_file_position = e->entry.position();
+                _element = indexable_element::partition;
+                _current_pi_idx = 0;
+                _cached = std::move(e);
+                return make_ready_future<bool>(true);
+            }
+            populate = true;
+        }
+        return advance_to(key).then([this, key, populate] {
             if (eof()) {
                 return make_ready_future<bool>(false);
             }
-            return read_partition_data().then([this, key] {
+            return read_partition_data().then([this, key, populate] {
                 index_comparator cmp(*_sstable->_schema);
-                return cmp(key, current_partition_entry()) == 0;
+                bool present = cmp(key, current_partition_entry()) == 0;
+                if (present && populate && _current_list) {
+                    global_key_cache().insert(_sstable->_cache_id, current_partition_entry(), next_partition_position());
+                }
+                return present;
             });
         });
     }
@@ -505,6 +608,24 @@ class index_reader {
     // Can be called only when !eof().
     future<> advance_to_next_partition() {
         sstlog.trace("index {}: advance_to_next_partition()", this);
+        if (_cached) {
+            if (_cached->next_position) {
+                _reposition_after = cached_partition_key();
+                _data_file_position = *_cached->next_position;
+                _element = indexable_element::partition;
+                _current_pi_idx = 0;
+                _cached = stdx::nullopt;
+                return make_ready_future<>();
+            }
+            _reposition_after = cached_partition_key();
+            _cached = stdx::nullopt;
+            return reposition();
+        }
+        if (_reposition_after) {
+            return reposition().then([this] {
+                return advance_to_next_partition();
+            });
+        }
         if (!_current_list) {
             return advance_to_page(0).then([this] {
                 return advance_to_next_partition();
@@ -529,6 +650,11 @@ class index_reader {
     future<> advance_to(dht::ring_position_view pos) {
         sstlog.trace("index {}: advance_to({}), _previous_summary_idx={}, _current_summary_idx={}", this, pos, _previous_summary_idx, _current_summary_idx);
 
+        if (_cached || _reposition_after) {
+            // No index page was read yet, so we can start from scratch.
+            drop_cached();
+        }
+
         if (pos.is_min()) {
             sstlog.trace("index {}: first entry", this);
             return make_ready_future<>();
@@ -537,8 +663,9 @@ class index_reader {
         }
 
         auto& summary = _sstable->get_summary();
+        index_comparator cmp(*_sstable->_schema, pos);
         _previous_summary_idx = std::distance(std::begin(summary.entries),
-            std::lower_bound(summary.entries.begin() + _previous_summary_idx, summary.entries.end(), pos, index_comparator(*_sstable->_schema)));
+            std::lower_bound(summary.entries.begin() + _previous_summary_idx, summary.entries.end(), pos, cmp));
 
         if (_previous_summary_idx == 0) {
             sstlog.trace("index {}: first entry", this);
@@ -569,10 +696,10 @@ class index_reader {
             return make_ready_future<>();
         }
 
-        return advance_to_page(summary_idx).then([this, pos, summary_idx] {
+        return advance_to_page(summary_idx).then([this, pos, summary_idx, cmp = std::move(cmp)] {
             index_list& il = *_current_list;
             sstlog.trace("index {}: old page index = {}", this, _current_index_idx);
-            auto i = std::lower_bound(il.begin() + _current_index_idx, il.end(), pos, index_comparator(*_sstable->_schema));
+            auto i = std::lower_bound(il.begin() + _current_index_idx, il.end(), pos, cmp);
             if (i == il.end()) {
                 sstlog.trace("index {}: not found", this);
                 return advance_to_page(summary_idx + 1);
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "key_cache.hh"
+
+namespace sstables {
+
+cached_index_entry key_cache_entry::value() const {
+    auto copy = [] (const managed_bytes& b) {
+        return temporary_buffer<char>(reinterpret_cast<const char*>(b.data()), b.size());
+    };
+    stdx::optional<uint64_t> next;
+    if (_next_position != unknown_position) {
+        next = _next_position;
+    }
+    return cached_index_entry{index_entry(copy(_key), _position, copy(_promoted_index)), next};
+}
+
+void key_cache::insert(uint64_t sstable_id, const index_entry& entry, stdx::optional<uint64_t> next_position) {
+    if (entry.get_promoted_index_bytes().size() > max_promoted_index_size) {
+        return;
+    }
+    emplace(sstable_id, entry.get_key_bytes(), entry.position(), next_position, entry.get_promoted_index_bytes());
+}
+
+key_cache& global_key_cache() {
+    static thread_local key_cache cache;
+    return cache;
+}
+
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "types.hh"
+#include "sstables/sstable_cache.hh"
+
+namespace sstables {
+
+// Result of a successful key cache lookup. Owns copies of the cached data,
+// so it stays valid after the cache is modified.
+struct cached_index_entry {
+    index_entry entry;
+    // Position in the data file of the partition which follows the cached
+    // one, or data_size() if it's the last partition. Disengaged when not
+    // known at the time the entry was cached.
+    stdx::optional<uint64_t> next_position;
+};
+
+// Cached Index.db entry of a single partition in a single sstable.
+class key_cache_entry : public sstable_cache_entry {
+    static constexpr uint64_t unknown_position = std::numeric_limits<uint64_t>::max();
+
+    managed_bytes _key;
+    uint64_t _position;
+    uint64_t _next_position;
+    managed_bytes _promoted_index;
+public:
+    // The partition key, in the sstable (Index.db) serialization format.
+    using key_type = bytes_view;
+    using value_type = cached_index_entry;
+
+    key_cache_entry(uint64_t sstable_id, bytes_view key, uint64_t position,
+            stdx::optional<uint64_t> next_position, bytes_view promoted_index)
+        : sstable_cache_entry(sstable_id)
+        , _key(key)
+        , _position(position)
+        , _next_position(next_position.value_or(unknown_position))
+        , _promoted_index(promoted_index)
+    { }
+
+    key_cache_entry(key_cache_entry&&) noexcept = default;
+
+    // Must be called with a linearization context active.
+    bytes_view cache_key() const { return _key; }
+
+    static int tri_compare_keys(bytes_view a, bytes_view b) {
+        return compare_unsigned(a, b);
+    }
+
+    cached_index_entry value() const;
+
+    size_t external_memory_usage() const {
+        return _key.external_memory_usage() + _promoted_index.external_memory_usage();
+    }
+};
+
+// Per-shard cache of partition index entries, keyed by (sstable, partition key).
+//
+// Consulted by index_reader before reading an Index.db page from disk, so that
+// single-partition reads of partitions which were recently looked up don't
+// need to touch the index file at all. Bounded by key_cache_size_in_mb.
+class key_cache : public sstable_cache<key_cache_entry> {
+public:
+    // Promoted indexes bigger than that are not worth keeping in memory, such
+    // partitions are big enough for the Index.db read to not matter.
+    static constexpr size_t max_promoted_index_size = 64 * 1024;
+
+    // Caches the index entry for given partition of given sstable.
+    // The cache may choose not to store the entry.
+    void insert(uint64_t sstable_id, const index_entry& entry, stdx::optional<uint64_t> next_position);
+};
+
+key_cache& global_key_cache();
+
+}
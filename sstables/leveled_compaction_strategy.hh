@@ -27,6 +27,28 @@ namespace sstables {
 
 class leveled_compaction_strategy : public compaction_strategy_impl {
     static constexpr int32_t DEFAULT_MAX_SSTABLE_SIZE_IN_MB = 160;
+
+    class leveled_backlog_tracker final : public compaction_backlog_tracker {
+        uint64_t _max_sstable_size_in_bytes;
+        std::vector<uint64_t> _bytes_per_level;
+    public:
+        explicit leveled_backlog_tracker(uint64_t max_sstable_size_in_bytes)
+            : _max_sstable_size_in_bytes(max_sstable_size_in_bytes) {}
+        virtual void add_sstable(const shared_sstable& sst) override {
+            auto level = sst->get_sstable_level();
+            if (level >= _bytes_per_level.size()) {
+                _bytes_per_level.resize(level + 1);
+            }
+            _bytes_per_level[level] += sst->data_size();
+        }
+        virtual void remove_sstable(const shared_sstable& sst) override {
+            _bytes_per_level[sst->get_sstable_level()] -= sst->data_size();
+        }
+        virtual uint64_t backlog(const schema& s) const override {
+            return leveled_manifest::get_backlog(_bytes_per_level, _max_sstable_size_in_bytes);
+        }
+    };
+
     const sstring SSTABLE_SIZE_OPTION = "sstable_size_in_mb";
 
     int32_t _max_sstable_size_in_mb = DEFAULT_MAX_SSTABLE_SIZE_IN_MB;
@@ -50,6 +72,7 @@ class leveled_compaction_strategy : public compaction_strategy_impl {
                 "improves up to 160MB", _max_sstable_size_in_mb);
         }
         _compaction_counter.resize(leveled_manifest::MAX_LEVELS);
+        _backlog_tracker = std::make_unique<leveled_backlog_tracker>(uint64_t(_max_sstable_size_in_mb) * 1024 * 1024);
     }
 
     virtual compaction_descriptor get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) override;
@@ -68,6 +91,10 @@ class leveled_compaction_strategy : public compaction_strategy_impl {
         return false;
     }
 
+    virtual bool run_aware() const override {
+        return true;
+    }
+
     virtual compaction_strategy_type type() const {
         return compaction_strategy_type::leveled;
     }
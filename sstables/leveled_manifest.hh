@@ -76,6 +76,9 @@ class leveled_manifest {
 
     static constexpr int MAX_LEVELS = 9; // log10(1000^3);
 
+    // Each level is allowed to be this many times bigger than the previous one.
+    static constexpr int level_fanout = 10;
+
     // Lowest score (score is about how much data a level contains vs its ideal amount) for a
     // level to be considered worth compacting.
     static constexpr float TARGET_SCORE = 1.001f;
@@ -146,7 +149,7 @@ class leveled_manifest {
         if (level == 0) {
             return 4L * max_sstable_size_in_bytes;
         }
-        double bytes = pow(10, level) * max_sstable_size_in_bytes;
+        double bytes = pow(level_fanout, level) * max_sstable_size_in_bytes;
         if (bytes > std::numeric_limits<int64_t>::max()) {
             throw std::runtime_error(sprint("At most %ld bytes may be in a compaction level; your maxSSTableSize must be absurdly high to compute %f", 
                 std::numeric_limits<int64_t>::max(), bytes));
@@ -525,6 +528,26 @@ class leveled_manifest {
         return tasks;
     }
 
+    // Estimated number of bytes to be rewritten to bring all levels, of given sizes, within
+    // their limits. Everything in L0 has to be merged into L1, and every byte a higher level
+    // is over its limit is merged with about as many bytes of the next level as its fan-out.
+    static uint64_t get_backlog(const std::vector<uint64_t>& bytes_per_level, uint64_t max_sstable_size_in_bytes) {
+        uint64_t backlog = 0;
+
+        for (int i = 0; i < static_cast<int>(bytes_per_level.size()); i++) {
+            uint64_t total_bytes_for_this_level = bytes_per_level[i];
+            if (i == 0) {
+                backlog += total_bytes_for_this_level;
+                continue;
+            }
+            uint64_t max_bytes_for_this_level = max_bytes_for_level(i, max_sstable_size_in_bytes);
+            if (total_bytes_for_this_level > max_bytes_for_this_level) {
+                backlog += (total_bytes_for_this_level - max_bytes_for_this_level) * (level_fanout + 1);
+            }
+        }
+        return backlog;
+    }
+
     static int get_next_level(const std::vector<sstables::shared_sstable>& sstables, bool can_promote = true) {
         int maximum_level = std::numeric_limits<int>::min();
         int minimum_level = std::numeric_limits<int>::max();
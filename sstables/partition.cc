@@ -1181,6 +1181,42 @@ sstable::read_range_rows_flat(schema_ptr schema,
         shared_from_this(), std::move(schema), range, slice, pc, std::move(resource_tracker), fwd, fwd_mr);
 }
 
+future<std::vector<clustering_key_prefix>>
+sstable::clustering_split_points(const dht::decorated_key& dk, const io_priority_class& pc) {
+    auto ix = get_index_reader(pc);
+    auto f = ix->advance_and_check_if_present(dk);
+    return f.then([this, &ix = *ix] (bool present) {
+        std::vector<clustering_key_prefix> points;
+        if (!present) {
+            return points;
+        }
+        const schema& s = *_schema;
+        promoted_index* pi = nullptr;
+        try {
+            pi = ix.current_partition_entry().get_promoted_index(s);
+        } catch (...) {
+            sstlog.error("Failed to get promoted index for sstable {}: {}", get_filename(), std::current_exception());
+        }
+        if (!pi || pi->entries.size() < 2) {
+            return points;
+        }
+        // The first block starts at the beginning of the partition, so it doesn't split anything.
+        points.reserve(pi->entries.size() - 1);
+        for (auto it = std::next(pi->entries.begin()); it != pi->entries.end(); ++it) {
+            if (it->start.is_static()) {
+                continue;
+            }
+            auto components = it->start.explode();
+            components.resize(std::min<size_t>(components.size(), s.clustering_key_size()));
+            points.push_back(clustering_key_prefix::from_exploded_view(components));
+        }
+        return points;
+    }).finally([ix = std::move(ix)] () mutable {
+        auto& r = *ix;
+        return r.close().finally([ix = std::move(ix)] { });
+    });
+}
+
 row_consumer::proceed
 mp_row_consumer::push_ready_fragments_with_ready_set() {
     // We're merging two streams here, one is _range_tombstones
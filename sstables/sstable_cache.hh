@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/intrusive/list.hpp>
+#include <boost/intrusive/set.hpp>
+#include "utils/logalloc.hh"
+#include "utils/managed_bytes.hh"
+#include "utils/allocation_strategy.hh"
+#include "utils/histogram.hh"
+#include "stdx.hh"
+
+namespace sstables {
+
+namespace bi = boost::intrusive;
+
+// Returns an identifier for a new sstable, unique within this shard. The
+// sstable's entries are kept under it in every sstable_cache.
+inline uint64_t new_sstable_cache_id() {
+    static thread_local uint64_t next_id = 0;
+    return next_id++;
+}
+
+template <typename Entry>
+class sstable_cache;
+
+// Base of the entries of an sstable_cache: the sstable the entry belongs to
+// and the links of the entry in the cache.
+//
+// Lives in the cache's LSA region.
+class sstable_cache_entry {
+    using lru_link_type = bi::list_member_hook<bi::link_mode<bi::auto_unlink>>;
+    using cache_link_type = bi::set_member_hook<bi::link_mode<bi::auto_unlink>>;
+
+    uint64_t _sstable_id;
+    lru_link_type _lru_link;
+    cache_link_type _cache_link;
+
+    template <typename Entry>
+    friend class sstable_cache;
+public:
+    using lru_type = bi::list<sstable_cache_entry,
+        bi::member_hook<sstable_cache_entry, lru_link_type, &sstable_cache_entry::_lru_link>,
+        bi::constant_time_size<false>>; // we need this to have bi::auto_unlink on hooks
+    using cache_hook_type = bi::member_hook<sstable_cache_entry, cache_link_type, &sstable_cache_entry::_cache_link>;
+
+    explicit sstable_cache_entry(uint64_t sstable_id)
+        : _sstable_id(sstable_id)
+    { }
+
+    sstable_cache_entry(sstable_cache_entry&& o) noexcept
+        : _sstable_id(o._sstable_id)
+    {
+        if (o._lru_link.is_linked()) {
+            auto prev = o._lru_link.prev_;
+            o._lru_link.unlink();
+            lru_type::node_algorithms::link_after(prev, _lru_link.this_ptr());
+        }
+
+        {
+            // The algorithms don't depend on how the entries are ordered.
+            using container_type = bi::rbtree<sstable_cache_entry, cache_hook_type, bi::constant_time_size<false>>;
+            container_type::node_algorithms::replace_node(o._cache_link.this_ptr(), _cache_link.this_ptr());
+            container_type::node_algorithms::init(o._cache_link.this_ptr());
+        }
+    }
+
+    uint64_t sstable_id() const { return _sstable_id; }
+};
+
+// Per-shard LRU cache of data of sstables, keyed by (sstable, Entry::key_type).
+//
+// Entries are kept in an LSA region which is evictable, so that the cache
+// shrinks under memory pressure in the same way as the row cache does. In
+// addition, the cache is bounded by a configurable capacity.
+//
+// Entry derives from sstable_cache_entry and provides:
+//   - key_type, a cheap view of its key within the sstable, ordered by
+//     static int tri_compare_keys(key_type, key_type),
+//   - key_type cache_key() const,
+//   - value_type and value_type value() const, which copies the cached data
+//     out of the region,
+//   - a constructor taking the sstable id and the key first.
+template <typename Entry>
+class sstable_cache {
+public:
+    using key_type = typename Entry::key_type;
+    using value_type = typename Entry::value_type;
+
+    struct stats {
+        utils::timed_rate_moving_average hits;
+        utils::timed_rate_moving_average misses;
+        uint64_t insertions = 0;
+        uint64_t evictions = 0;
+        uint64_t removals = 0;
+        uint64_t entries = 0;
+    };
+private:
+    static int tri_compare(uint64_t id_a, key_type key_a, uint64_t id_b, key_type key_b) {
+        if (id_a != id_b) {
+            return id_a < id_b ? -1 : 1;
+        }
+        return Entry::tri_compare_keys(key_a, key_b);
+    }
+    static const Entry& entry(const sstable_cache_entry& e) {
+        return static_cast<const Entry&>(e);
+    }
+
+    struct entry_compare {
+        bool operator()(const sstable_cache_entry& a, const sstable_cache_entry& b) const {
+            return tri_compare(a._sstable_id, entry(a).cache_key(), b._sstable_id, entry(b).cache_key()) < 0;
+        }
+    };
+
+    struct lookup_key {
+        uint64_t sstable_id;
+        key_type key;
+    };
+
+    struct lookup_compare {
+        bool operator()(const sstable_cache_entry& e, const lookup_key& k) const {
+            return tri_compare(e._sstable_id, entry(e).cache_key(), k.sstable_id, k.key) < 0;
+        }
+        bool operator()(const lookup_key& k, const sstable_cache_entry& e) const {
+            return tri_compare(k.sstable_id, k.key, e._sstable_id, entry(e).cache_key()) < 0;
+        }
+    };
+
+    struct sstable_compare {
+        bool operator()(const sstable_cache_entry& e, uint64_t sstable_id) const {
+            return e._sstable_id < sstable_id;
+        }
+        bool operator()(uint64_t sstable_id, const sstable_cache_entry& e) const {
+            return sstable_id < e._sstable_id;
+        }
+    };
+
+    using lru_type = sstable_cache_entry::lru_type;
+    using entries_type = bi::set<sstable_cache_entry, sstable_cache_entry::cache_hook_type,
+        bi::constant_time_size<false>, // we need this to have bi::auto_unlink on hooks
+        bi::compare<entry_compare>>;
+
+    logalloc::region _region;
+    logalloc::allocating_section _read_section;
+    logalloc::allocating_section _populate_section;
+    entries_type _entries;
+    lru_type _lru;
+    size_t _capacity = 0;
+    stats _stats;
+private:
+    typename entries_type::iterator lower_bound(uint64_t sstable_id, key_type key) {
+        return _entries.lower_bound(lookup_key{sstable_id, key}, lookup_compare());
+    }
+
+    bool matches(typename entries_type::iterator i, uint64_t sstable_id, key_type key) {
+        return i != _entries.end() && tri_compare(i->_sstable_id, entry(*i).cache_key(), sstable_id, key) == 0;
+    }
+
+    // Must be called with the region's allocator and linearization context active.
+    void evict_one() {
+        _lru.pop_back_and_dispose([] (sstable_cache_entry* e) {
+            current_allocator().destroy(static_cast<Entry*>(e));
+        });
+        --_stats.entries;
+        ++_stats.evictions;
+    }
+
+    void shrink_to_capacity() {
+        with_allocator(_region.allocator(), [this] {
+            with_linearized_managed_bytes([this] {
+                while (!_lru.empty() && _region.occupancy().used_space() > _capacity) {
+                    evict_one();
+                }
+            });
+        });
+    }
+
+    template <typename Iterator>
+    Iterator erase(Iterator i) {
+        --_stats.entries;
+        ++_stats.removals;
+        return _entries.erase_and_dispose(i, [] (sstable_cache_entry* e) {
+            current_allocator().destroy(static_cast<Entry*>(e));
+        });
+    }
+public:
+    sstable_cache() {
+        _region.make_evictable([this] {
+            if (_lru.empty()) {
+                return memory::reclaiming_result::reclaimed_nothing;
+            }
+            return with_allocator(_region.allocator(), [this] {
+              // Removing an entry may require reading large keys when we rebalance
+              // the rbtree, so linearize anything we read
+              return with_linearized_managed_bytes([&] {
+               try {
+                evict_one();
+                return memory::reclaiming_result::reclaimed_something;
+               } catch (std::bad_alloc&) {
+                // Linearization during removal failed. Drop the entire cache so we
+                // can make forward progress.
+                clear();
+                return memory::reclaiming_result::reclaimed_something;
+               }
+              });
+            });
+        });
+    }
+
+    ~sstable_cache() {
+        clear();
+    }
+
+    sstable_cache(sstable_cache&&) = delete;
+    sstable_cache(const sstable_cache&) = delete;
+
+    // Returns a copy of the cached data under given key of given sstable.
+    stdx::optional<value_type> find(uint64_t sstable_id, key_type key) {
+        if (!enabled()) {
+            return stdx::nullopt;
+        }
+        auto result = _read_section(_region, [&] {
+            return with_linearized_managed_bytes([&] () -> stdx::optional<value_type> {
+                auto i = lower_bound(sstable_id, key);
+                if (!matches(i, sstable_id, key)) {
+                    return stdx::nullopt;
+                }
+                _lru.erase(_lru.iterator_to(*i));
+                _lru.push_front(*i);
+                return entry(*i).value();
+            });
+        });
+        if (result) {
+            _stats.hits.mark();
+        } else {
+            _stats.misses.mark();
+        }
+        return result;
+    }
+
+    // Caches Entry(sstable_id, key, args...), unless the key is already cached.
+    template <typename... Args>
+    void emplace(uint64_t sstable_id, key_type key, Args&&... args) {
+        if (!enabled()) {
+            return;
+        }
+        _populate_section(_region, [&] {
+            with_allocator(_region.allocator(), [&] {
+                with_linearized_managed_bytes([&] {
+                    auto i = lower_bound(sstable_id, key);
+                    if (matches(i, sstable_id, key)) {
+                        return;
+                    }
+                    auto e = current_allocator().construct<Entry>(sstable_id, key, args...);
+                    _entries.insert_before(i, *e);
+                    _lru.push_front(*e);
+                    ++_stats.entries;
+                    ++_stats.insertions;
+                });
+            });
+        });
+        shrink_to_capacity();
+    }
+
+    // Removes all entries belonging to given sstable.
+    void invalidate(uint64_t sstable_id) {
+        with_allocator(_region.allocator(), [&] {
+            with_linearized_managed_bytes([&] {
+                auto i = _entries.lower_bound(sstable_id, sstable_compare());
+                while (i != _entries.end() && i->_sstable_id == sstable_id) {
+                    i = erase(i);
+                }
+            });
+        });
+    }
+
+    // Removes all entries.
+    void clear() {
+        with_allocator(_region.allocator(), [this] {
+            with_linearized_managed_bytes([this] {
+                _entries.clear_and_dispose([] (sstable_cache_entry* e) {
+                    current_allocator().destroy(static_cast<Entry*>(e));
+                });
+            });
+        });
+        _stats.removals += _stats.entries;
+        _stats.entries = 0;
+    }
+
+    // Sets the limit on memory used by the cache on this shard. Zero disables the cache.
+    void set_capacity(size_t bytes) {
+        _capacity = bytes;
+        shrink_to_capacity();
+    }
+    size_t capacity() const { return _capacity; }
+    bool enabled() const { return _capacity > 0; }
+
+    const stats& get_stats() const { return _stats; }
+    uint64_t entries() const { return _stats.entries; }
+    const logalloc::region& region() const { return _region; }
+};
+
+}
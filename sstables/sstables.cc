@@ -63,6 +63,7 @@
 #include "checked-file-impl.hh"
 #include "integrity_checked_file_impl.hh"
 #include "service/storage_service.hh"
+#include "service/priority_manager.hh"
 
 thread_local disk_error_signal_type sstable_read_error;
 thread_local disk_error_signal_type sstable_write_error;
@@ -1347,43 +1348,92 @@ future<> sstable::create_data() {
 }
 
 future<> sstable::read_filter(const io_priority_class& pc) {
+    return read_filter_component(pc).then([this] (utils::filter_ptr filter) {
+        _components->filter = std::move(filter);
+    });
+}
+
+future<utils::filter_ptr> sstable::read_filter_component(const io_priority_class& pc) {
     if (!has_component(sstable::component_type::Filter)) {
-        _components->filter = std::make_unique<utils::filter::always_present_filter>();
-        return make_ready_future<>();
+        return make_ready_future<utils::filter_ptr>(std::make_unique<utils::filter::always_present_filter>());
     }
 
     return do_with(sstables::filter(), [this, &pc] (auto& filter) {
         return this->read_simple<sstable::component_type::Filter>(filter, pc).then([this, &filter] {
+            auto format = utils::filter_format::classic;
+            if (has_scylla_component() && _components->scylla_metadata->has_feature(sstable_feature::BlockedBloomFilter)) {
+                if (!(filter.hashes & sstables::filter::blocked_format_flag)) {
+                    throw malformed_sstable_exception("blocked bloom filter is missing its format flag", filename(component_type::Filter));
+                }
+                format = utils::filter_format::blocked;
+            }
+            auto hashes = filter.hashes & ~sstables::filter::blocked_format_flag;
             large_bitset bs(filter.buckets.elements.size() * 64);
             bs.load(filter.buckets.elements.begin(), filter.buckets.elements.end());
-            _components->filter = utils::filter::create_filter(filter.hashes, std::move(bs));
+            return utils::filter::create_filter(hashes, std::move(bs), format);
         });
     });
 }
 
+bool sstable::filter_ready() {
+    if (_components->filter_state.loaded()) {
+        return true;
+    }
+    // Default priority, as this is on behalf of whoever wanted to consult the filter.
+    load_filter().handle_exception([] (auto ep) { });
+    return false;
+}
+
+future<> sstable::load_filter(const io_priority_class& pc) {
+    if (!_components->filter_state.start_loading()) {
+        return make_ready_future<>();
+    }
+    // The sstable may be gone by the time the read completes, keep it alive.
+    return read_filter_component(pc).then_wrapped([this, self = shared_from_this(), op = background_jobs().start()] (future<utils::filter_ptr> f) {
+        try {
+            _components->filter = f.get0();
+        } catch (...) {
+            sstlog.warn("Failed to load filter {}: {}. All keys will be considered present in this sstable",
+                filename(component_type::Filter), std::current_exception());
+            _components->filter = std::make_unique<utils::filter::always_present_filter>();
+        }
+        _components->filter_state.mark_loaded();
+    });
+}
+
 void sstable::write_filter(const io_priority_class& pc) {
     if (!has_component(sstable::component_type::Filter)) {
         return;
     }
 
-    auto f = static_cast<utils::filter::murmur3_bloom_filter *>(_components->filter.get());
+    auto f = static_cast<utils::filter::bloom_filter *>(_components->filter.get());
 
     auto&& bs = f->bits();
     utils::chunked_vector<uint64_t> v(align_up(bs.size(), size_t(64)) / 64);
     bs.save(v.begin());
-    auto filter = sstables::filter(f->num_hashes(), std::move(v));
+    uint32_t hashes = f->num_hashes();
+    if (f->format() == utils::filter_format::blocked) {
+        hashes |= sstables::filter::blocked_format_flag;
+    }
+    auto filter = sstables::filter(hashes, std::move(v));
     write_simple<sstable::component_type::Filter>(filter, pc);
 }
 
 // This interface is only used during tests, snapshot loading and early initialization.
 // No need to set tunable priorities for it.
-future<> sstable::load(const io_priority_class& pc) {
-    return read_toc().then([this, &pc] {
+future<> sstable::load(const io_priority_class& pc, bool lazy_filter) {
+    return read_toc().then([this, &pc, lazy_filter] {
         return seastar::when_all_succeed(
                 read_statistics(pc),
                 read_compression(pc),
-                read_scylla_metadata(pc),
-                read_filter(pc),
+                // The filter format is recorded in the scylla metadata
+                read_scylla_metadata(pc).then([this, &pc, lazy_filter] {
+                    if (lazy_filter && has_component(component_type::Filter)) {
+                        _components->filter_state.set_not_loaded();
+                        return make_ready_future<>();
+                    }
+                    return read_filter(pc);
+                }),
                 read_summary(pc)).then([this] {
             validate_min_max_metadata();
             set_clustering_components_ranges();
@@ -1404,9 +1454,9 @@ future<> sstable::load(sstables::foreign_sstable_open_info info) {
 }
 
 future<sstable_open_info> sstable::load_shared_components(const schema_ptr& s, sstring dir, int generation, version_types v, format_types f,
-        const io_priority_class& pc) {
+        const io_priority_class& pc, bool lazy_filter) {
     auto sst = sstables::make_sstable(s, dir, generation, v, f);
-    return sst->load(pc).then([sst] () mutable {
+    return sst->load(pc, lazy_filter).then([sst] () mutable {
         auto info = sstable_open_info{make_lw_shared<shareable_components>(std::move(*sst->_components)),
             std::move(sst->_shards), std::move(sst->_data_file), std::move(sst->_index_file)};
         return make_ready_future<sstable_open_info>(std::move(info));
@@ -1923,7 +1973,7 @@ static void seal_summary(summary& s,
 
 static void prepare_compression(compression& c, const schema& schema) {
     const auto& cp = schema.get_compressor_params();
-    c.set_compressor(cp.get_compressor());
+    c.set_compressor(cp);
     c.set_uncompressed_chunk_length(cp.chunk_length());
     // FIXME: crc_check_chance can be configured by the user.
     // probability to verify the checksum of a compressed chunk we read.
@@ -1966,8 +2016,8 @@ create_sharding_metadata(schema_ptr schema, const dht::decorated_key& first_key,
             auto&& right_token = right.token();
             auto right_exclusive = !right.has_key() && right.bound() == dht::ring_position::token_bound::start;
             sm.token_ranges.elements.push_back(disk_token_range{
-                {left_exclusive, to_bytes(bytes_view(left_token._data))},
-                {right_exclusive, to_bytes(bytes_view(right_token._data))}});
+                {left_exclusive, to_bytes(left_token.data())},
+                {right_exclusive, to_bytes(right_token.data())}});
         }
     }
     return sm;
@@ -2061,7 +2111,8 @@ components_writer::components_writer(sstable& sst, const schema& s, file_writer&
     , _tombstone_written(false)
     , _summary_byte_cost(summary_byte_cost())
 {
-    _sst._components->filter = utils::i_filter::get_filter(estimated_partitions, _schema.bloom_filter_fp_chance());
+    auto filter_format = get_config().sstable_blocked_bloom_filter() ? utils::filter_format::blocked : utils::filter_format::classic;
+    _sst._components->filter = utils::i_filter::get_filter(estimated_partitions, _schema.bloom_filter_fp_chance(), filter_format);
     _sst._pi_write.desired_block_size = cfg.promoted_index_block_size.value_or(get_config().column_index_size_in_kb() * 1024);
     _sst._correctly_serialize_non_compound_range_tombstones = cfg.correctly_serialize_non_compound_range_tombstones;
 
@@ -2309,6 +2360,10 @@ void sstable_writer::consume_end_of_stream()
     if (!_correctly_serialize_non_compound_range_tombstones) {
         features.disable(sstable_feature::NonCompoundRangeTombstones);
     }
+    auto f = dynamic_cast<utils::filter::bloom_filter*>(_sst._components->filter.get());
+    if (!f || f->format() != utils::filter_format::blocked) {
+        features.disable(sstable_feature::BlockedBloomFilter);
+    }
     _sst.write_scylla_metadata(_pc, _shard, std::move(features));
 
     _monitor->on_write_completed();
@@ -2602,8 +2657,14 @@ input_stream<char> sstable::data_stream(uint64_t pos, size_t len, const io_prior
 
     input_stream<char> stream;
     if (_components->compression) {
+        // Compaction and streaming read everything once, caching their chunks
+        // would only push out the ones which user reads keep coming back to.
+        stdx::optional<uint64_t> chunk_cache_id;
+        if (&pc != &service::get_local_compaction_priority() && &pc != &service::get_local_streaming_read_priority()) {
+            chunk_cache_id = _cache_id;
+        }
         return make_compressed_file_input_stream(f, &_components->compression,
-                pos, len, std::move(options));
+                pos, len, std::move(options), chunk_cache_id);
 
     }
 
@@ -2726,6 +2787,8 @@ int sstable::compare_by_max_timestamp(const sstable& other) const {
 }
 
 sstable::~sstable() {
+    global_key_cache().invalidate(_cache_id);
+    global_chunk_cache().invalidate(_cache_id);
     if (_index_file) {
         _index_file.close().handle_exception([save = _index_file, op = background_jobs().start()] (auto ep) {
             sstlog.warn("sstable close index_file failed: {}", ep);
@@ -2954,8 +3017,8 @@ sstable::compute_shards_for_this_sstable() const {
                 dht::ring_position::ending_at(get_last_decorated_key().token())));
     } else {
         auto disk_token_range_to_ring_position_range = [] (const disk_token_range& dtr) {
-            auto t1 = dht::token(dht::token::kind::key, managed_bytes(bytes_view(dtr.left.token)));
-            auto t2 = dht::token(dht::token::kind::key, managed_bytes(bytes_view(dtr.right.token)));
+            auto t1 = dht::token(dht::token::kind::key, bytes_view(dtr.left.token));
+            auto t2 = dht::token(dht::token::kind::key, bytes_view(dtr.right.token));
             return dht::partition_range::make(
                     (dtr.left.exclusive ? dht::ring_position::ending_at : dht::ring_position::starting_at)(std::move(t1)),
                     (dtr.right.exclusive ? dht::ring_position::starting_at : dht::ring_position::ending_at)(std::move(t2)));
@@ -3039,6 +3102,28 @@ future<> init_metrics() {
             sm::description("Index page requests which initiated a read from disk")),
         sm::make_derive("index_page_blocks", [] { return shared_index_lists::shard_stats().blocks; },
             sm::description("Index page requests which needed to wait due to page not being loaded yet")),
+        sm::make_derive("key_cache_hits", [] { return global_key_cache().get_stats().hits.count(); },
+            sm::description("Partition index lookups which were satisfied from the key cache")),
+        sm::make_derive("key_cache_misses", [] { return global_key_cache().get_stats().misses.count(); },
+            sm::description("Partition index lookups which were not found in the key cache")),
+        sm::make_derive("key_cache_insertions", [] { return global_key_cache().get_stats().insertions; },
+            sm::description("Number of index entries added to the key cache")),
+        sm::make_derive("key_cache_evictions", [] { return global_key_cache().get_stats().evictions; },
+            sm::description("Number of index entries evicted from the key cache")),
+        sm::make_gauge("key_cache_entries", [] { return global_key_cache().entries(); },
+            sm::description("Number of index entries currently in the key cache")),
+        sm::make_gauge("key_cache_bytes_used", [] { return global_key_cache().region().occupancy().used_space(); },
+            sm::description("Memory used by the key cache")),
+        sm::make_derive("chunk_cache_hits", [] { return global_chunk_cache().get_stats().hits.count(); },
+            sm::description("Compressed chunk reads which were satisfied from the chunk cache")),
+        sm::make_derive("chunk_cache_misses", [] { return global_chunk_cache().get_stats().misses.count(); },
+            sm::description("Compressed chunk reads which had to read and decompress the chunk")),
+        sm::make_derive("chunk_cache_insertions", [] { return global_chunk_cache().get_stats().insertions; },
+            sm::description("Number of decompressed chunks added to the chunk cache")),
+        sm::make_derive("chunk_cache_evictions", [] { return global_chunk_cache().get_stats().evictions; },
+            sm::description("Number of decompressed chunks evicted from the chunk cache")),
+        sm::make_gauge("chunk_cache_bytes_used", [] { return global_chunk_cache().region().occupancy().used_space(); },
+            sm::description("Memory used by the chunk cache")),
     });
   });
 }
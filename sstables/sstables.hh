@@ -34,6 +34,7 @@
 #include <seastar/core/shared_ptr_incomplete.hh>
 #include <unordered_set>
 #include <unordered_map>
+#include <atomic>
 #include "types.hh"
 #include "clustering_key_filter.hh"
 #include "core/enum.hh"
@@ -55,6 +56,8 @@
 #include "disk-error-handler.hh"
 #include "atomic_deletion.hh"
 #include "sstables/shared_index_lists.hh"
+#include "sstables/key_cache.hh"
+#include "sstables/chunk_cache.hh"
 #include "sstables/progress_monitor.hh"
 #include "db/commitlog/replay_position.hh"
 #include "flat_mutation_reader.hh"
@@ -260,7 +263,10 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     // load all components from disk
     // this variant will be useful for testing purposes and also when loading
     // a new sstable from scratch for sharing its components.
-    future<> load(const io_priority_class& pc = default_priority_class());
+    // If lazy_filter is true, the filter is not read until it's first needed
+    // (or until load_filter() is called), and all keys are considered present
+    // in the meantime.
+    future<> load(const io_priority_class& pc = default_priority_class(), bool lazy_filter = false);
     future<> open_data();
     future<> update_info_for_opened_data();
 
@@ -288,6 +294,12 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         return read_row_flat(std::move(schema), std::move(key), full_slice);
     }
 
+    // Returns the clustering prefixes at which the promoted index blocks of
+    // given partition start, excluding the first one, in ascending order.
+    // Returns no split points if the partition is absent or has no promoted index.
+    future<std::vector<clustering_key_prefix>> clustering_split_points(const dht::decorated_key& dk,
+        const io_priority_class& pc = default_priority_class());
+
     // Returns a mutation_reader for given range of partitions
     flat_mutation_reader read_range_rows_flat(
         schema_ptr schema,
@@ -390,7 +402,7 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     }
 
     uint64_t filter_memory_size() const {
-        return _components->filter->memory_size();
+        return _components->filter_state.loaded() ? _components->filter->memory_size() : 0;
     }
 
     // Returns the total bytes of all components.
@@ -446,9 +458,36 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     }
 
     // Immutable components that can be shared among shards.
+    // Tracks whether the filter of an sstable opened with a lazily loaded
+    // filter was read from disk yet. Atomic, because shareable_components
+    // are accessed from all shards owning the sstable.
+    class filter_load_state {
+        enum class state : uint8_t { loaded, not_loaded, loading };
+        std::atomic<state> _state{state::loaded};
+    public:
+        filter_load_state() = default;
+        filter_load_state(filter_load_state&& o) noexcept
+            : _state(o._state.load(std::memory_order_relaxed)) { }
+        filter_load_state& operator=(filter_load_state&& o) noexcept {
+            _state.store(o._state.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return *this;
+        }
+        bool loaded() const { return _state.load(std::memory_order_acquire) == state::loaded; }
+        void set_not_loaded() { _state.store(state::not_loaded, std::memory_order_relaxed); }
+        // Returns true if the caller won the right to load the filter.
+        bool start_loading() {
+            auto expected = state::not_loaded;
+            return _state.compare_exchange_strong(expected, state::loading, std::memory_order_acq_rel);
+        }
+        // Publishes the filter to all shards.
+        void mark_loaded() { _state.store(state::loaded, std::memory_order_release); }
+    };
+
     struct shareable_components {
         sstables::compression compression;
         utils::filter_ptr filter;
+        // filter must not be accessed unless filter_state.loaded()
+        filter_load_state filter_state;
         sstables::summary summary;
         sstables::statistics statistics;
         stdx::optional<sstables::scylla_metadata> scylla_metadata;
@@ -465,6 +504,8 @@ class sstable : public enable_lw_shared_from_this<sstable> {
 
     foreign_ptr<lw_shared_ptr<shareable_components>> _components = make_foreign(make_lw_shared<shareable_components>());
     shared_index_lists _index_lists;
+    // Identifies this sstable's entries in the shard's key_cache and chunk_cache.
+    uint64_t _cache_id = new_sstable_cache_id();
     bool _shared = true;  // across shards; safe default
     // NOTE: _collector and _c_stats are used to generation of statistics file
     // when writing a new sstable.
@@ -551,6 +592,11 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     void write_scylla_metadata(const io_priority_class& pc, shard_id shard, sstable_enabled_features features);
 
     future<> read_filter(const io_priority_class& pc);
+    future<utils::filter_ptr> read_filter_component(const io_priority_class& pc);
+
+    // Returns true if the filter can be consulted. Otherwise starts loading
+    // it in the background.
+    bool filter_ready();
 
     void write_filter(const io_priority_class& pc);
 
@@ -648,13 +694,17 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     }
 
     bool filter_has_key(const key& key) {
-        return _components->filter->is_present(bytes_view(key));
+        return !filter_ready() || _components->filter->is_present(bytes_view(key));
     }
 
     bool filter_has_key(utils::hashed_key key) {
-        return _components->filter->is_present(key);
+        return !filter_ready() || _components->filter->is_present(key);
     }
 
+    // Reads the filter of an sstable which was loaded with a lazy filter.
+    // No-op if the filter is already loaded or being loaded.
+    future<> load_filter(const io_priority_class& pc = default_priority_class());
+
     bool filter_has_key(const schema& s, partition_key_view key) {
         return filter_has_key(key::from_partition_key(s, key));
     }
@@ -739,7 +789,7 @@ class sstable : public enable_lw_shared_from_this<sstable> {
 
     // returns all info needed for a sstable to be shared with other shards.
     static future<sstable_open_info> load_shared_components(const schema_ptr& s, sstring dir, int generation, version_types v, format_types f,
-        const io_priority_class& pc = default_priority_class());
+        const io_priority_class& pc = default_priority_class(), bool lazy_filter = false);
 
     // Allow the test cases from sstable_test.cc to test private methods. We use
     // a placeholder to avoid cluttering this class too much. The sstable_test class
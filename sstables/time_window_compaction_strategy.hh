@@ -116,6 +116,39 @@ class time_window_compaction_strategy_options {
 using timestamp_type = api::timestamp_type;
 
 class time_window_compaction_strategy : public compaction_strategy_impl {
+    // Sstables are only merged with the ones from the same window.
+    class time_window_backlog_tracker final : public compaction_backlog_tracker {
+        std::chrono::seconds _sstable_window_size;
+        std::unordered_map<timestamp_type, tiered_backlog_tracker> _windows;
+
+        timestamp_type window_of(const shared_sstable& sst) const {
+            return get_window_lower_bound(_sstable_window_size, sst->get_stats_metadata().max_timestamp);
+        }
+    public:
+        explicit time_window_backlog_tracker(std::chrono::seconds sstable_window_size)
+            : _sstable_window_size(sstable_window_size) {}
+        virtual void add_sstable(const shared_sstable& sst) override {
+            _windows[window_of(sst)].add_sstable(sst);
+        }
+        virtual void remove_sstable(const shared_sstable& sst) override {
+            auto it = _windows.find(window_of(sst));
+            if (it == _windows.end()) {
+                return;
+            }
+            it->second.remove_sstable(sst);
+            if (it->second.empty()) {
+                _windows.erase(it);
+            }
+        }
+        virtual uint64_t backlog(const schema& s) const override {
+            uint64_t backlog = 0;
+            for (auto& window : _windows) {
+                backlog += window.second.backlog(s);
+            }
+            return backlog;
+        }
+    };
+
     time_window_compaction_strategy_options _options;
     int64_t _estimated_remaining_tasks = 0;
     db_clock::time_point _last_expired_check;
@@ -132,6 +165,7 @@ class time_window_compaction_strategy : public compaction_strategy_impl {
             clogger.debug("Enabling tombstone compactions for TWCS");
         }
         _use_clustering_key_filter = true;
+        _backlog_tracker = std::make_unique<time_window_backlog_tracker>(_options.sstable_window_size);
     }
 
     virtual compaction_descriptor get_sstables_for_compaction(column_family& cf, std::vector<shared_sstable> candidates) override {
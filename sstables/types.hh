@@ -77,6 +77,11 @@ struct option {
 };
 
 struct filter {
+    // Set in the hash count of blocked filters, so that versions which
+    // don't know about them read the filter as always present instead of
+    // probing the wrong bits.
+    static constexpr uint32_t blocked_format_flag = 0x80000000;
+
     uint32_t hashes;
     disk_array<uint32_t, uint64_t> buckets;
 
@@ -366,7 +371,8 @@ struct sharding_metadata {
 enum sstable_feature : uint8_t {
     NonCompoundPIEntries = 0,       // See #2993
     NonCompoundRangeTombstones = 1, // See #2986
-    End = 2
+    BlockedBloomFilter = 2,         // Filter.db uses utils::filter_format::blocked
+    End = 3
 };
 
 // Scylla-specific features enabled for a particular sstable.
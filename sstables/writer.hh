@@ -189,17 +189,35 @@ output_stream<char> make_checksummed_file_output_stream(file f, struct checksum&
 // compressed_file_data_sink_impl works as a filter for a file output stream,
 // where the buffer flushed will be compressed and its checksum computed, then
 // the result passed to a regular output stream.
+//
+// If the compressor wants a dictionary, the first chunks are held back until
+// enough of them are available to train it, and compressed afterwards.
 class compressed_file_data_sink_impl : public data_sink_impl {
+    // zstd recommends about 100 times the dictionary size as training input,
+    // within the bound on what training may use.
+    static constexpr size_t training_bytes_per_dictionary_byte = 100;
+
     output_stream<char> _out;
     sstables::compression* _compression_metadata;
     size_t _pos = 0;
-public:
-    compressed_file_data_sink_impl(file f, sstables::compression* cm, file_output_stream_options options)
-            : _out(make_file_output_stream(std::move(f), options))
-            , _compression_metadata(cm) {}
+    std::vector<temporary_buffer<char>> _training_chunks;
+    size_t _training_bytes = 0;
+private:
+    size_t training_bytes_needed() const {
+        return std::min(_compression_metadata->pending_dictionary_size() * training_bytes_per_dictionary_byte, max_zstd_training_bytes);
+    }
 
-    future<> put(net::packet data) { abort(); }
-    virtual future<> put(temporary_buffer<char> buf) override {
+    future<> train_and_compress_held_chunks() {
+        _compression_metadata->set_dictionary(train_zstd_dictionary(_training_chunks, _compression_metadata->pending_dictionary_size()));
+        _training_bytes = 0;
+        return do_for_each(_training_chunks, [this] (temporary_buffer<char>& buf) {
+            return compress_and_write(std::move(buf));
+        }).then([this] {
+            _training_chunks.clear();
+        });
+    }
+
+    future<> compress_and_write(temporary_buffer<char> buf) {
         auto output_len = _compression_metadata->compress_max_size(buf.size());
         // account space for checksum that goes after compressed data.
         temporary_buffer<char> compressed(output_len + 4);
@@ -229,8 +247,29 @@ class compressed_file_data_sink_impl : public data_sink_impl {
         auto f = _out.write(compressed.get(), compressed.size());
         return f.then([compressed = std::move(compressed)] {});
     }
+public:
+    compressed_file_data_sink_impl(file f, sstables::compression* cm, file_output_stream_options options)
+            : _out(make_file_output_stream(std::move(f), options))
+            , _compression_metadata(cm) {}
+
+    future<> put(net::packet data) { abort(); }
+    virtual future<> put(temporary_buffer<char> buf) override {
+        if (_compression_metadata->pending_dictionary_size()) {
+            _training_bytes += buf.size();
+            _training_chunks.push_back(std::move(buf));
+            if (_training_bytes < training_bytes_needed()) {
+                return make_ready_future<>();
+            }
+            return train_and_compress_held_chunks();
+        }
+        return compress_and_write(std::move(buf));
+    }
     virtual future<> close() override {
-        return _out.close();
+        // Small sstables may not reach the training size, use what we have.
+        auto f = _compression_metadata->pending_dictionary_size() ? train_and_compress_held_chunks() : make_ready_future<>();
+        return f.then([this] {
+            return _out.close();
+        });
     }
 };
 
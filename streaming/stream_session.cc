@@ -58,6 +58,11 @@
 #include "service/priority_manager.hh"
 #include "query-request.hh"
 #include "schema_registry.hh"
+#include "sstables/sstables.hh"
+#include "sstables/remove.hh"
+#include <seastar/core/fstream.hh>
+#include <seastar/core/gate.hh>
+#include <boost/range/adaptor/map.hpp>
 
 namespace streaming {
 
@@ -150,32 +155,50 @@ void stream_session::init_messaging_service_handler() {
         const auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
         return smp::submit_to(dst_cpu_id, [ranges = std::move(ranges), plan_id, cf_id, from] () mutable {
             auto session = get_session(plan_id, from, "STREAM_MUTATION_DONE", cf_id);
-            return session->get_db().invoke_on_all([ranges = std::move(ranges), plan_id, from, cf_id] (database& db) {
-                if (!db.column_family_exists(cf_id)) {
-                    sslog.warn("[Stream #{}] STREAM_MUTATION_DONE from {}: cf_id={} is missing, assume the table is dropped",
-                                plan_id, from, cf_id);
-                    return make_ready_future<>();
-                }
-                dht::partition_range_vector query_ranges;
-                try {
-                    auto& cf = db.find_column_family(cf_id);
-                    query_ranges.reserve(ranges.size());
-                    for (auto& range : ranges) {
-                        query_ranges.push_back(dht::to_partition_range(range));
+            return session->load_received_sstables(cf_id).then([session, ranges = std::move(ranges), plan_id, from, cf_id] () mutable {
+                return session->get_db().invoke_on_all([ranges = std::move(ranges), plan_id, from, cf_id] (database& db) {
+                    if (!db.column_family_exists(cf_id)) {
+                        sslog.warn("[Stream #{}] STREAM_MUTATION_DONE from {}: cf_id={} is missing, assume the table is dropped",
+                                    plan_id, from, cf_id);
+                        return make_ready_future<>();
                     }
-                    return cf.flush_streaming_mutations(plan_id, std::move(query_ranges));
-                } catch (no_such_column_family&) {
-                    sslog.warn("[Stream #{}] STREAM_MUTATION_DONE from {}: cf_id={} is missing, assume the table is dropped",
-                                plan_id, from, cf_id);
-                    return make_ready_future<>();
-                } catch (...) {
-                    throw;
-                }
+                    dht::partition_range_vector query_ranges;
+                    try {
+                        auto& cf = db.find_column_family(cf_id);
+                        query_ranges.reserve(ranges.size());
+                        for (auto& range : ranges) {
+                            query_ranges.push_back(dht::to_partition_range(range));
+                        }
+                        return cf.flush_streaming_mutations(plan_id, std::move(query_ranges));
+                    } catch (no_such_column_family&) {
+                        sslog.warn("[Stream #{}] STREAM_MUTATION_DONE from {}: cf_id={} is missing, assume the table is dropped",
+                                    plan_id, from, cf_id);
+                        return make_ready_future<>();
+                    } catch (...) {
+                        throw;
+                    }
+                });
             }).then([session, cf_id] {
                 session->receive_task_completed(cf_id);
             });
         });
     });
+    ms().register_stream_sstable_component([] (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, UUID sstable_id,
+            sstring file_name, bytes data, bool last, unsigned dst_cpu_id) {
+        const auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
+        return smp::submit_to(dst_cpu_id, [plan_id, cf_id, sstable_id, file_name = std::move(file_name), data = std::move(data), last, from] () mutable {
+            auto session = get_session(plan_id, from, "STREAM_SSTABLE_COMPONENT", cf_id);
+            get_local_stream_manager().update_progress(plan_id, from, progress_info::direction::IN, data.size());
+            return session->receive_sstable_component(cf_id, sstable_id, std::move(file_name), std::move(data), last).finally([session] { });
+        });
+    });
+    ms().register_stream_sstable_done([] (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, UUID sstable_id, unsigned dst_cpu_id) {
+        const auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
+        return smp::submit_to(dst_cpu_id, [plan_id, cf_id, sstable_id, from] {
+            auto session = get_session(plan_id, from, "STREAM_SSTABLE_DONE", cf_id);
+            return session->seal_received_sstable(sstable_id).finally([session] { });
+        });
+    });
     ms().register_complete_message([] (const rpc::client_info& cinfo, UUID plan_id, unsigned dst_cpu_id, rpc::optional<bool> failed) {
         const auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
         if (failed && *failed) {
@@ -452,6 +475,137 @@ void stream_session::add_transfer_ranges(sstring keyspace, dht::token_range_vect
     }
 }
 
+struct stream_session::incoming_sstable {
+    UUID cf_id;
+    sstring ks;
+    sstring cf;
+    sstring dir;
+    int64_t generation;
+    sstables::sstable::version_types version;
+    sstables::sstable::format_types format;
+    // Component files being written, by the name the sender gave them.
+    std::unordered_map<sstring, output_stream<char>> files;
+    // Guards the writes to files.
+    seastar::gate writes;
+    bool sealed = false;
+
+    incoming_sstable(const column_family& table, int64_t generation_, const sstables::entry_descriptor& desc)
+        : cf_id(table.schema()->id())
+        , ks(table.schema()->ks_name())
+        , cf(table.schema()->cf_name())
+        , dir(table.dir())
+        , generation(generation_)
+        , version(desc.version)
+        , format(desc.format)
+    { }
+
+    sstring filename(sstables::sstable::component_type component) const {
+        return sstables::sstable::filename(dir, ks, cf, version, generation, format, component);
+    }
+};
+
+future<> stream_session::receive_sstable_component(UUID cf_id, UUID sstable_id, sstring file_name, bytes data, bool last) {
+    if (_is_aborted) {
+        throw std::runtime_error(sprint("[Stream #%s] Got component %s of sstable %s for aborted session", plan_id(), file_name, sstable_id));
+    }
+    auto& table = get_local_db().find_column_family(cf_id);
+    auto desc = sstables::entry_descriptor::make_descriptor(file_name);
+    auto i = _incoming_sstables.find(sstable_id);
+    if (i == _incoming_sstables.end()) {
+        auto in = make_lw_shared<incoming_sstable>(table, table.calculate_generation_for_new_table(), desc);
+        i = _incoming_sstables.emplace(sstable_id, std::move(in)).first;
+    }
+    auto in = i->second;
+    if (in->sealed) {
+        throw std::runtime_error(sprint("[Stream #%s] Got component %s of sealed sstable %s", plan_id(), file_name, sstable_id));
+    }
+    // Until it's sealed, the sstable has a temporary TOC, so that it's
+    // removed if the node restarts before that.
+    auto component = desc.component == sstables::sstable::component_type::TOC ? sstables::sstable::component_type::TemporaryTOC : desc.component;
+    return with_gate(in->writes, [in, file_name = std::move(file_name), data = std::move(data), last, component] () mutable {
+        auto f = make_ready_future<>();
+        if (!in->files.count(file_name)) {
+            auto oflags = open_flags::wo | open_flags::create | open_flags::exclusive;
+            f = open_file_dma(in->filename(component), oflags).then([in, file_name] (file f) {
+                file_output_stream_options options;
+                options.buffer_size = 128 * 1024;
+                options.io_priority_class = service::get_local_streaming_write_priority();
+                in->files.emplace(file_name, make_file_output_stream(std::move(f), options));
+            });
+        }
+        return f.then([in, file_name = std::move(file_name), data = std::move(data), last] () mutable {
+            auto& out = in->files.at(file_name);
+            return out.write(reinterpret_cast<const char*>(data.begin()), data.size()).then([in, file_name, last, &out] {
+                if (!last) {
+                    return make_ready_future<>();
+                }
+                return out.flush().then([&out] {
+                    return out.close();
+                }).then([in, file_name] {
+                    in->files.erase(file_name);
+                });
+            });
+        });
+    });
+}
+
+future<> stream_session::seal_received_sstable(UUID sstable_id) {
+    auto i = _incoming_sstables.find(sstable_id);
+    if (i == _incoming_sstables.end() || !i->second->files.empty()) {
+        throw std::runtime_error(sprint("[Stream #%s] sstable %s was not fully received", plan_id(), sstable_id));
+    }
+    auto in = i->second;
+    return sync_directory(in->dir).then([in] {
+        return engine().rename_file(in->filename(sstables::sstable::component_type::TemporaryTOC),
+                in->filename(sstables::sstable::component_type::TOC));
+    }).then([in] {
+        return sync_directory(in->dir);
+    }).then([this, in] {
+        in->sealed = true;
+        sslog.debug("[Stream #{}] Received sstable {} of {}.{}", plan_id(), in->filename(sstables::sstable::component_type::TOC), in->ks, in->cf);
+    });
+}
+
+future<> stream_session::load_received_sstables(UUID cf_id) {
+    std::vector<sstables::entry_descriptor> descs;
+    sstring ks, cf;
+    for (auto i = _incoming_sstables.begin(); i != _incoming_sstables.end();) {
+        auto& in = *i->second;
+        if (in.cf_id == cf_id && in.sealed) {
+            ks = in.ks;
+            cf = in.cf;
+            descs.emplace_back(in.ks, in.cf, in.version, in.generation, in.format, sstables::sstable::component_type::TOC);
+            i = _incoming_sstables.erase(i);
+        } else {
+            ++i;
+        }
+    }
+    if (descs.empty()) {
+        return make_ready_future<>();
+    }
+    sslog.info("[Stream #{}] Loading {} sstables received for {}.{}", plan_id(), descs.size(), ks, cf);
+    // Takes care of resharding the sstables which don't belong to a
+    // single shard of this node.
+    return distributed_loader::load_new_sstables(get_db(), ks, cf, std::move(descs));
+}
+
+future<> stream_session::remove_incoming_sstables() {
+    auto incoming = std::move(_incoming_sstables);
+    _incoming_sstables.clear();
+    return parallel_for_each(incoming | boost::adaptors::map_values, [] (lw_shared_ptr<incoming_sstable> in) {
+        return in->writes.close().then([in] {
+            return parallel_for_each(in->files | boost::adaptors::map_values, [] (output_stream<char>& out) {
+                return out.close();
+            });
+        }).then([in] {
+            if (in->sealed) {
+                return sstables::remove_by_toc_name(in->filename(sstables::sstable::component_type::TOC));
+            }
+            return sstables::sstable::remove_sstable_with_temp_toc(in->ks, in->cf, in->dir, in->generation, in->version, in->format);
+        });
+    });
+}
+
 future<> stream_session::receiving_failed(UUID cf_id)
 {
     return get_db().invoke_on_all([cf_id, plan_id = plan_id()] (database& db) {
@@ -482,6 +636,9 @@ void stream_session::close_session(stream_session_state final_state) {
                 receiving_failed(x.first);
                 task.abort();
             }
+            remove_incoming_sstables().handle_exception([plan_id = plan_id()] (auto ep) {
+                sslog.warn("[Stream #{}] Failed to remove partially received sstables: {}", plan_id, ep);
+            }).finally([self = shared_from_this()] { });
             send_failed_complete_message();
         }
 
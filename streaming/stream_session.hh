@@ -184,6 +184,10 @@ class stream_session : public enable_shared_from_this<stream_session> {
     lowres_clock::time_point _last_stream_progress;
 
     session_info _session_info;
+
+    // sstables received as whole files, by the id the sender gave them.
+    struct incoming_sstable;
+    std::unordered_map<UUID, lw_shared_ptr<incoming_sstable>> _incoming_sstables;
 public:
     void start_keep_alive_timer() {
         _keep_alive.rearm(lowres_clock::now() + _keep_alive_interval);
@@ -332,7 +336,15 @@ class stream_session : public enable_shared_from_this<stream_session> {
 
     void receive_task_completed(UUID cf_id);
     void transfer_task_completed(UUID cf_id);
+
+    // Writes a chunk of a component file of an sstable sent as a whole.
+    future<> receive_sstable_component(UUID cf_id, UUID sstable_id, sstring file_name, bytes data, bool last);
+    // Makes an sstable whose components were all received durable.
+    future<> seal_received_sstable(UUID sstable_id);
+    // Adds the sealed sstables received for a table to it.
+    future<> load_received_sstables(UUID cf_id);
 private:
+    future<> remove_incoming_sstables();
     void send_failed_complete_message();
     bool maybe_completed();
     void prepare_receiving(stream_summary& summary);
@@ -50,6 +50,10 @@
 #include "service/priority_manager.hh"
 #include <boost/range/irange.hpp>
 #include "service/storage_service.hh"
+#include "sstables/sstables.hh"
+#include <seastar/core/fstream.hh>
+#include <boost/algorithm/cxx11/any_of.hpp>
+#include <boost/range/algorithm/remove.hpp>
 #include <boost/icl/interval.hpp>
 #include <boost/icl/interval_set.hpp>
 
@@ -65,6 +69,39 @@ stream_transfer_task::stream_transfer_task(shared_ptr<stream_session> session, U
 
 stream_transfer_task::~stream_transfer_task() = default;
 
+// The size of the chunks in which sstable component files are sent.
+static constexpr size_t sstable_chunk_size = 128 * 1024;
+// The number of sstables a shard sends to a peer at once.
+static constexpr size_t sstables_in_flight = 4;
+
+// Selects the sstables of this shard which can be sent as whole files:
+// those which belong only to this shard and whose data lies entirely
+// within one of the ranges to transfer.
+static std::vector<sstables::shared_sstable> select_whole_sstables(const column_family& cf, const dht::partition_range_vector& prs) {
+    std::vector<sstables::shared_sstable> result;
+    if (!service::get_local_storage_service().cluster_supports_whole_sstable_streaming()) {
+        return result;
+    }
+    auto& s = *cf.schema();
+    auto cmp = dht::ring_position_comparator(s);
+    for (auto&& sst : *cf.get_sstables()) {
+        auto& shards = sst->get_shards_for_this_sstable();
+        if (shards.size() != 1 || shards[0] != engine().cpu_id()) {
+            continue;
+        }
+        // The receiver refuses to load those, see distributed_loader::flush_upload_dir().
+        if (s.is_counter() && !sst->has_scylla_component()) {
+            continue;
+        }
+        auto first = dht::ring_position(sst->get_first_decorated_key());
+        auto last = dht::ring_position(sst->get_last_decorated_key());
+        if (boost::algorithm::any_of(prs, [&] (const dht::partition_range& pr) { return pr.contains(first, cmp) && pr.contains(last, cmp); })) {
+            result.push_back(sst);
+        }
+    }
+    return result;
+}
+
 struct send_info {
     database& db;
     utils::UUID plan_id;
@@ -75,6 +112,8 @@ struct send_info {
     size_t mutations_nr{0};
     semaphore mutations_done{0};
     bool error_logged = false;
+    // Sent as whole files, not read by reader.
+    std::vector<sstables::shared_sstable> whole_sstables;
     flat_mutation_reader reader;
     send_info(database& db_, utils::UUID plan_id_, utils::UUID cf_id_,
               dht::partition_range_vector prs_, netw::messaging_service::msg_addr id_,
@@ -85,13 +124,82 @@ struct send_info {
         , prs(std::move(prs_))
         , id(id_)
         , dst_cpu_id(dst_cpu_id_)
+        , whole_sstables(select_whole_sstables(db.find_column_family(cf_id), prs))
         , reader([&] {
             auto& cf = db.find_column_family(cf_id);
-            return cf.make_streaming_reader(cf.schema(), prs);
+            return cf.make_streaming_reader(cf.schema(), prs, whole_sstables);
         }())
     { }
 };
 
+// Reads one component file of an sstable, in chunks, in order.
+static future<> for_each_component_chunk(sstring file_name, size_t chunk_size, const sstable_chunk_sender& send_chunk) {
+    auto base_name = file_name.substr(file_name.find_last_of('/') + 1);
+    return open_file_dma(file_name, open_flags::ro).then([chunk_size, &send_chunk, base_name = std::move(base_name)] (file f) {
+        file_input_stream_options options;
+        options.buffer_size = chunk_size;
+        options.read_ahead = 2;
+        options.io_priority_class = service::get_local_streaming_read_priority();
+        auto in = make_file_input_stream(std::move(f), 0, options);
+        return do_with(std::move(in), [chunk_size, &send_chunk, base_name] (input_stream<char>& in) {
+            return repeat([chunk_size, &send_chunk, base_name, &in] {
+                return in.read_exactly(chunk_size).then([chunk_size, &send_chunk, base_name] (temporary_buffer<char> buf) {
+                    auto last = buf.size() < chunk_size;
+                    bytes data(reinterpret_cast<const int8_t*>(buf.get()), buf.size());
+                    return send_chunk(base_name, std::move(data), last).then([last] {
+                        return stop_iteration(last);
+                    });
+                });
+            }).finally([&in] {
+                return in.close();
+            });
+        });
+    });
+}
+
+future<> for_each_sstable_chunk(sstables::shared_sstable sst, size_t chunk_size, sstable_chunk_sender send_chunk) {
+    // The TOC goes first, the receiver treats the sstable as temporary
+    // until it's sealed.
+    auto files = sst->component_filenames();
+    auto toc = sst->toc_filename();
+    files.erase(boost::remove(files, toc), files.end());
+    return do_with(std::move(send_chunk), std::move(files), [sst, chunk_size, toc] (sstable_chunk_sender& send_chunk, std::vector<sstring>& files) {
+        return for_each_component_chunk(toc, chunk_size, send_chunk).then([chunk_size, &send_chunk, &files] {
+            return parallel_for_each(files, [chunk_size, &send_chunk] (const sstring& file_name) {
+                return for_each_component_chunk(file_name, chunk_size, send_chunk);
+            });
+        });
+    });
+}
+
+// Sends the sstables selected to be sent as whole files. The receiver loads
+// them when it gets STREAM_MUTATION_DONE.
+future<> send_whole_sstables(lw_shared_ptr<send_info> si) {
+    return do_with(semaphore(sstables_in_flight), [si] (semaphore& sem) {
+        return parallel_for_each(si->whole_sstables, [si, &sem] (sstables::shared_sstable sst) {
+            return with_semaphore(sem, 1, [si, sst] {
+                if (!si->db.column_family_exists(si->cf_id)) {
+                    return make_ready_future<>();
+                }
+                auto sstable_id = utils::make_random_uuid();
+                sslog.debug("[Stream #{}] SEND STREAM_SSTABLE_COMPONENT to {}, cf_id={}, sstable={}", si->plan_id, si->id, si->cf_id, sst->get_filename());
+                return for_each_sstable_chunk(sst, sstable_chunk_size, [si, sstable_id] (sstring file_name, bytes data, bool last) {
+                    auto size = data.size();
+                    return netw::get_local_messaging_service().send_stream_sstable_component(si->id, si->plan_id, si->cf_id, sstable_id,
+                            std::move(file_name), std::move(data), last, si->dst_cpu_id).then([si, size] {
+                        get_local_stream_manager().update_progress(si->plan_id, si->id.addr, progress_info::direction::OUT, size);
+                    });
+                }).then([si, sstable_id] {
+                    return netw::get_local_messaging_service().send_stream_sstable_done(si->id, si->plan_id, si->cf_id, sstable_id, si->dst_cpu_id);
+                });
+            });
+        });
+    }).handle_exception([si] (auto ep) {
+        sslog.warn("[Stream #{}] stream_transfer_task: Fail to send sstables to {}: {}", si->plan_id, si->id, ep);
+        return make_exception_future<>(ep);
+    });
+}
+
 future<stop_iteration> do_send_mutations(lw_shared_ptr<send_info> si, frozen_mutation fm, bool fragmented) {
     return get_local_stream_manager().mutation_send_limiter().wait().then([si, fragmented, fm = std::move(fm)] () mutable {
         sslog.debug("[Stream #{}] SEND STREAM_MUTATION to {}, cf_id={}", si->plan_id, si->id, si->cf_id);
@@ -146,7 +254,15 @@ void stream_transfer_task::start() {
         auto& prs = item.second;
         return session->get_db().invoke_on(shard, [plan_id, cf_id, id, dst_cpu_id, prs = std::move(prs)] (database& db) mutable {
             auto si = make_lw_shared<send_info>(db, plan_id, cf_id, prs, id, dst_cpu_id);
-            return send_mutations(std::move(si));
+            return when_all(send_whole_sstables(si), send_mutations(si)).then([] (auto results) {
+                auto& sstables_sent = std::get<0>(results);
+                auto& mutations_sent = std::get<1>(results);
+                if (sstables_sent.failed()) {
+                    mutations_sent.ignore_ready_future();
+                    return std::move(sstables_sent);
+                }
+                return std::move(mutations_sent);
+            });
         });
     }).then([this, plan_id, cf_id, id] {
         sslog.debug("[Stream #{}] SEND STREAM_MUTATION_DONE to {}, cf_id={}", plan_id, id, cf_id);
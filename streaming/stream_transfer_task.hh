@@ -43,12 +43,22 @@
 #include "streaming/stream_detail.hh"
 #include <map>
 #include <seastar/core/semaphore.hh>
+#include "sstables/shared_sstable.hh"
+#include "bytes.hh"
 
 namespace streaming {
 
 class stream_session;
 class send_info;
 
+// Receives the chunks of the component files of an sstable sent as a whole,
+// with the base name of the file, and whether the chunk is its last one.
+using sstable_chunk_sender = std::function<future<> (sstring file_name, bytes data, bool last)>;
+
+// Reads the component files of sst, the TOC first, and passes them to
+// send_chunk in chunks of chunk_size bytes, in order within each file.
+future<> for_each_sstable_chunk(sstables::shared_sstable sst, size_t chunk_size, sstable_chunk_sender send_chunk);
+
 /**
  * StreamTransferTask sends sections of SSTable files in certain ColumnFamily.
  */
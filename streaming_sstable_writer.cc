@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <seastar/core/future-util.hh>
+
+#include "streaming_sstable_writer.hh"
+#include "sstables/sstables.hh"
+#include "log.hh"
+
+static logging::logger sslog("streaming_sstable_writer");
+
+// The reader write_components() consumes. It is fed by the writer, and
+// keeps at most a buffer's worth of fragments: a push() which fills the
+// buffer waits until the sstable writer has drained it.
+class streaming_sstable_writer::queue_reader final : public flat_mutation_reader::impl {
+    lw_shared_ptr<queue_reader*> _slot;
+    // Set while the sstable writer waits for fragments.
+    stdx::optional<promise<>> _not_empty;
+    // Set while push() waits for the buffer to be drained.
+    stdx::optional<promise<>> _not_full;
+    std::exception_ptr _ex;
+private:
+    void wake_consumer() {
+        if (_not_empty) {
+            auto p = std::move(*_not_empty);
+            _not_empty = { };
+            if (_ex) {
+                p.set_exception(_ex);
+            } else {
+                p.set_value();
+            }
+        }
+    }
+public:
+    queue_reader(schema_ptr s, lw_shared_ptr<queue_reader*> slot)
+        : impl(std::move(s))
+        , _slot(std::move(slot)) {
+        *_slot = this;
+    }
+    ~queue_reader() {
+        *_slot = nullptr;
+        if (_not_full) {
+            _not_full->set_exception(std::runtime_error("streaming sstable writer stopped"));
+        }
+    }
+    virtual future<> fill_buffer() override {
+        if (_ex) {
+            return make_exception_future<>(_ex);
+        }
+        if (_not_full) {
+            auto p = std::move(*_not_full);
+            _not_full = { };
+            p.set_value();
+        }
+        if (!is_buffer_empty() || is_end_of_stream()) {
+            return make_ready_future<>();
+        }
+        _not_empty.emplace();
+        return _not_empty->get_future();
+    }
+    virtual void next_partition() override {
+        throw std::bad_function_call();
+    }
+    virtual future<> fast_forward_to(const dht::partition_range&) override {
+        throw std::bad_function_call();
+    }
+    virtual future<> fast_forward_to(position_range) override {
+        throw std::bad_function_call();
+    }
+    future<> push(mutation_fragment mf) {
+        push_mutation_fragment(std::move(mf));
+        wake_consumer();
+        if (!is_buffer_full()) {
+            return make_ready_future<>();
+        }
+        _not_full.emplace();
+        return _not_full->get_future();
+    }
+    void push_end_of_stream() {
+        _end_of_stream = true;
+        wake_consumer();
+    }
+    void abort(std::exception_ptr ex) {
+        _ex = std::move(ex);
+        wake_consumer();
+    }
+};
+
+streaming_sstable_writer::streaming_sstable_writer(schema_ptr s, sstables::shared_sstable sst, uint64_t estimated_partitions,
+        const sstables::sstable_writer_config& cfg, const io_priority_class& pc, semaphore_units<> memory)
+    : _schema(std::move(s))
+    , _sst(std::move(sst))
+    , _queue(make_lw_shared<queue_reader*>(nullptr))
+    , _written(make_ready_future<>())
+    , _memory(std::move(memory)) {
+    auto reader = make_flat_mutation_reader<queue_reader>(_schema, _queue);
+    _written = _sst->write_components(std::move(reader), estimated_partitions, _schema, cfg, pc);
+}
+
+future<> streaming_sstable_writer::push(mutation m) {
+    _last_key = m.decorated_key();
+    ++_partitions;
+    return with_semaphore(_push_sem, 1, [this, m = std::move(m)] () mutable {
+        return do_with(flat_mutation_reader_from_mutations({std::move(m)}), [this] (flat_mutation_reader& rd) {
+            return repeat([this, &rd] {
+                return rd().then([this] (mutation_fragment_opt mfo) {
+                    if (!mfo) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    if (!*_queue) {
+                        return make_exception_future<stop_iteration>(std::runtime_error(
+                                sprint("streaming sstable writer for %s stopped", _sst->get_filename())));
+                    }
+                    return (*_queue)->push(std::move(*mfo)).then([] {
+                        return stop_iteration::no;
+                    });
+                });
+            });
+        });
+    });
+}
+
+future<sstables::shared_sstable> streaming_sstable_writer::finish() {
+    return with_semaphore(_push_sem, 1, [this] {
+        if (*_queue) {
+            (*_queue)->push_end_of_stream();
+        }
+        return std::move(_written).then([this] {
+            return _sst;
+        }).handle_exception([this] (auto ep) {
+            sslog.error("failed to write streamed sstable {}: {}", _sst->get_filename(), ep);
+            _sst->mark_for_deletion();
+            return make_exception_future<sstables::shared_sstable>(ep);
+        });
+    });
+}
+
+future<> streaming_sstable_writer::abort() {
+    if (*_queue) {
+        (*_queue)->abort(std::make_exception_ptr(std::runtime_error("streaming sstable write aborted")));
+    }
+    _push_sem.broken();
+    _sst->mark_for_deletion();
+    return std::move(_written).handle_exception([] (auto ep) { });
+}
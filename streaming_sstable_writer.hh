@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/semaphore.hh>
+
+#include "dht/i_partitioner.hh"
+#include "flat_mutation_reader.hh"
+#include "mutation.hh"
+#include "schema.hh"
+#include "sstables/shared_sstable.hh"
+#include "stdx.hh"
+
+namespace sstables {
+struct sstable_writer_config;
+}
+
+// Writes partitions received by streaming into a new sstable as they
+// arrive, instead of accumulating them in a memtable first.
+//
+// The partitions have to be pushed in ring order. The sstable is written in
+// the background, and push() waits while the writer is behind, so a fast
+// sender is throttled by the disk rather than by memory.
+//
+// The sstable is left unsealed; the owner seals it and makes it visible once
+// the stream it belongs to has completed.
+class streaming_sstable_writer {
+    class queue_reader;
+
+    schema_ptr _schema;
+    sstables::shared_sstable _sst;
+    // Shared with the reader, which clears it when it is destroyed together
+    // with the sstable write.
+    lw_shared_ptr<queue_reader*> _queue;
+    future<> _written;
+    // Serializes push()es, which are each suspended while the writer is
+    // busy, so that the partitions reach the sstable in the order they
+    // were pushed.
+    semaphore _push_sem{1};
+    stdx::optional<dht::decorated_key> _last_key;
+    uint64_t _partitions = 0;
+    // Accounts for the memory of the writer, and is released with it.
+    semaphore_units<> _memory;
+public:
+    streaming_sstable_writer(schema_ptr s, sstables::shared_sstable sst, uint64_t estimated_partitions,
+            const sstables::sstable_writer_config& cfg, const io_priority_class& pc, semaphore_units<> memory);
+    streaming_sstable_writer(const streaming_sstable_writer&) = delete;
+    streaming_sstable_writer(streaming_sstable_writer&&) = delete;
+
+    // The key of the last partition pushed, if any. The next partition must
+    // be greater.
+    const stdx::optional<dht::decorated_key>& last_key() const {
+        return _last_key;
+    }
+
+    uint64_t partitions() const {
+        return _partitions;
+    }
+
+    const sstables::shared_sstable& sstable() const {
+        return _sst;
+    }
+
+    const schema_ptr& schema() const {
+        return _schema;
+    }
+
+    // Appends m to the sstable. m's schema must be the writer's.
+    //
+    // The resulting future resolves once m has been handed to the writer;
+    // m's key becomes last_key() immediately.
+    future<> push(mutation m);
+
+    // Ends the sstable and waits for it to be written. Nothing may be pushed
+    // afterwards.
+    future<sstables::shared_sstable> finish();
+
+    // Stops writing and marks the sstable for deletion.
+    future<> abort();
+};
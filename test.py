@@ -52,6 +52,7 @@ boost_tests = [
     'UUID_test',
     'compound_test',
     'murmur_hash_test',
+    'xx_hasher_test',
     'partitioner_test',
     'frozen_mutation_test',
     'canonical_mutation_test',
@@ -61,6 +62,9 @@ boost_tests = [
     'network_topology_strategy_test',
     'query_processor_test',
     'batchlog_manager_test',
+    'hints_manager_test',
+    'row_level_repair_test',
+    'sstable_streaming_test',
     'logalloc_test',
     'log_heap_test',
     'crc_test',
@@ -95,6 +99,7 @@ boost_tests = [
     'aggregate_fcts_test',
     'role_manager_test',
     'caching_options_test',
+    'bloom_filter_test',
 ]
 
 other_tests = [
@@ -32,10 +32,13 @@
 
 #include "core/future-util.hh"
 #include "core/shared_ptr.hh"
+#include "core/thread.hh"
 #include "transport/messages/result_message.hh"
 #include "cql3/query_processor.hh"
 #include "cql3/untyped_result_set.hh"
 #include "db/batchlog_manager.hh"
+#include "db/system_keyspace.hh"
+#include "utils/UUID_gen.hh"
 
 #include "message/messaging_service.hh"
 
@@ -81,3 +84,127 @@ SEASTAR_TEST_CASE(test_execute_batch) {
     });
 }
 
+
+SEASTAR_TEST_CASE(test_replay_keeps_fresh_batches) {
+    return do_with_cql_env([] (cql_test_env& e) {
+        return seastar::async([&e] {
+            auto& qp = e.local_qp();
+            auto& bp = db::get_batchlog_manager().local();
+
+            e.execute_cql("create table cf (p1 varchar, c1 int, r1 int, PRIMARY KEY (p1, c1));").get();
+            auto s = e.local_db().find_schema("ks", "cf");
+            const column_definition& r1_col = *s->get_column_definition("r1");
+
+            auto make_batch = [&] (sstring key, db_clock::time_point written_at) {
+                auto pkey = partition_key::from_exploded(*s, {to_bytes(key)});
+                auto ckey = clustering_key::from_exploded(*s, {int32_type->decompose(1)});
+                mutation m(pkey, s);
+                m.set_clustered_cell(ckey, r1_col, make_atomic_cell(int32_type->decompose(100)));
+                auto bm = bp.get_batch_log_mutation_for({ m }, utils::UUID_gen::get_time_UUID(), netw::messaging_service::current_version, written_at);
+                BOOST_REQUIRE_EQUAL(bm.schema()->cf_name(), db::system_keyspace::BATCHLOG_V2);
+                qp.proxy().local().mutate_locally(bm).get();
+            };
+
+            using namespace std::chrono_literals;
+            make_batch("old1", db_clock::now() - 3h);
+            make_batch("old2", db_clock::now() - 3h - 1s);
+            make_batch("fresh", db_clock::now());
+            BOOST_REQUIRE_EQUAL(bp.count_all_batches().get0(), 3u);
+
+            auto dropped_buckets = [] {
+                return db::get_batchlog_manager().map_reduce0([] (db::batchlog_manager& bm) {
+                    return bm.get_dropped_buckets();
+                }, uint64_t(0), std::plus<uint64_t>()).get0();
+            };
+
+            bp.do_batch_log_replay().get();
+            BOOST_REQUIRE_EQUAL(bp.count_all_batches().get0(), 1u);
+            // The old batches went with their buckets.
+            auto dropped = dropped_buckets();
+            BOOST_REQUIRE_GE(dropped, 1u);
+
+            auto rs = qp.execute_internal("select p1 from ks.cf;").get0();
+            BOOST_REQUIRE_EQUAL(rs->size(), 2u);
+
+            // Later replays skip the dropped buckets.
+            bp.do_batch_log_replay().get();
+            BOOST_REQUIRE_EQUAL(bp.count_all_batches().get0(), 1u);
+            BOOST_REQUIRE_EQUAL(dropped_buckets(), dropped);
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_replay_spares_late_batches) {
+    return do_with_cql_env([] (cql_test_env& e) {
+        return seastar::async([&e] {
+            auto& qp = e.local_qp();
+            auto& bp = db::get_batchlog_manager().local();
+
+            e.execute_cql("create table cf (p1 varchar, c1 int, r1 int, PRIMARY KEY (p1, c1));").get();
+            auto s = e.local_db().find_schema("ks", "cf");
+            const column_definition& r1_col = *s->get_column_definition("r1");
+
+            auto make_batch = [&] (sstring key, db_clock::time_point written_at) {
+                auto pkey = partition_key::from_exploded(*s, {to_bytes(key)});
+                auto ckey = clustering_key::from_exploded(*s, {int32_type->decompose(1)});
+                mutation m(pkey, s);
+                m.set_clustered_cell(ckey, r1_col, make_atomic_cell(int32_type->decompose(100)));
+                auto bm = bp.get_batch_log_mutation_for({ m }, utils::UUID_gen::get_time_UUID(), netw::messaging_service::current_version, written_at);
+                qp.proxy().local().mutate_locally(bm).get();
+            };
+
+            using namespace std::chrono_literals;
+            auto old = db_clock::now() - 3h;
+            auto bucket = old - old.time_since_epoch() % 1min;
+
+            make_batch("first", bucket + 30s);
+            bp.do_batch_log_replay().get();
+            BOOST_REQUIRE_EQUAL(bp.count_all_batches().get0(), 0u);
+
+            // Reaches the bucket after the replay, and sorts before the batch
+            // which was replayed.
+            make_batch("late", bucket + 20s);
+            BOOST_REQUIRE_EQUAL(bp.count_all_batches().get0(), 1u);
+
+            bp.do_batch_log_replay().get();
+            BOOST_REQUIRE_EQUAL(bp.count_all_batches().get0(), 0u);
+            auto rs = qp.execute_internal("select p1 from ks.cf;").get0();
+            BOOST_REQUIRE_EQUAL(rs->size(), 2u);
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_replay_resumes_inside_bucket) {
+    return do_with_cql_env([] (cql_test_env& e) {
+        return seastar::async([&e] {
+            auto& qp = e.local_qp();
+            auto& bp = db::get_batchlog_manager().local();
+
+            e.execute_cql("create table cf (p1 varchar, c1 int, r1 blob, PRIMARY KEY (p1, c1));").get();
+            auto s = e.local_db().find_schema("ks", "cf");
+            const column_definition& r1_col = *s->get_column_definition("r1");
+
+            using namespace std::chrono_literals;
+            auto old = db_clock::now() - 3h;
+            auto bucket = old - old.time_since_epoch() % 1min;
+
+            // Large enough for a read of the bucket to be cut short.
+            const unsigned batches = 40;
+            for (unsigned i = 0; i < batches; i++) {
+                auto pkey = partition_key::from_exploded(*s, {to_bytes(sprint("key%d", i))});
+                auto ckey = clustering_key::from_exploded(*s, {int32_type->decompose(1)});
+                mutation m(pkey, s);
+                m.set_clustered_cell(ckey, r1_col, make_atomic_cell(bytes(64 * 1024, 'x')));
+                auto bm = bp.get_batch_log_mutation_for({ m }, utils::UUID_gen::get_time_UUID(), netw::messaging_service::current_version,
+                        bucket + std::chrono::milliseconds(i));
+                qp.proxy().local().mutate_locally(bm).get();
+            }
+            BOOST_REQUIRE_EQUAL(bp.count_all_batches().get0(), batches);
+
+            bp.do_batch_log_replay().get();
+            BOOST_REQUIRE_EQUAL(bp.count_all_batches().get0(), 0u);
+            auto rs = qp.execute_internal("select p1 from ks.cf;").get0();
+            BOOST_REQUIRE_EQUAL(rs->size(), batches);
+        });
+    });
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+
+#include "utils/bloom_filter.hh"
+#include "utils/chunked_vector.hh"
+
+static bytes make_key(int i) {
+    return to_bytes(sprint("key%d", i));
+}
+
+static void test_no_false_negatives(utils::filter_format format) {
+    constexpr int nr_keys = 10000;
+    auto f = utils::i_filter::get_filter(nr_keys, 0.01, format);
+    for (int i = 0; i < nr_keys; i++) {
+        f->add(make_key(i));
+    }
+    for (int i = 0; i < nr_keys; i++) {
+        BOOST_REQUIRE(f->is_present(make_key(i)));
+        BOOST_REQUIRE(f->is_present(utils::make_hashed_key(make_key(i))));
+    }
+
+    int false_positives = 0;
+    for (int i = nr_keys; i < 2 * nr_keys; i++) {
+        false_positives += f->is_present(make_key(i));
+    }
+    // Blocked filters are somewhat worse than the requested 1%,
+    // but not by an order of magnitude.
+    BOOST_REQUIRE_LT(false_positives, nr_keys / 20);
+}
+
+BOOST_AUTO_TEST_CASE(test_classic_filter) {
+    test_no_false_negatives(utils::filter_format::classic);
+}
+
+BOOST_AUTO_TEST_CASE(test_blocked_filter) {
+    test_no_false_negatives(utils::filter_format::blocked);
+}
+
+BOOST_AUTO_TEST_CASE(test_blocked_filter_reload) {
+    constexpr int nr_keys = 1000;
+    auto f = utils::i_filter::get_filter(nr_keys, 0.01, utils::filter_format::blocked);
+    for (int i = 0; i < nr_keys; i++) {
+        f->add(make_key(i));
+    }
+
+    auto bf = static_cast<utils::filter::bloom_filter*>(f.get());
+    BOOST_REQUIRE(bf->format() == utils::filter_format::blocked);
+    BOOST_REQUIRE_EQUAL(bf->bits().size() % utils::filter::blocked_bloom_filter::block_bits, 0);
+
+    utils::chunked_vector<uint64_t> v(bf->bits().size() / 64);
+    bf->bits().save(v.begin());
+    large_bitset bs(v.size() * 64);
+    bs.load(v.begin(), v.end());
+    auto loaded = utils::filter::create_filter(bf->num_hashes(), std::move(bs), utils::filter_format::blocked);
+    for (int i = 0; i < nr_keys; i++) {
+        BOOST_REQUIRE(loaded->is_present(make_key(i)));
+    }
+}
@@ -22,6 +22,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <boost/range/adaptor/map.hpp>
+#include <boost/range/irange.hpp>
 
 #include <stdlib.h>
 #include <iostream>
@@ -30,15 +31,21 @@
 #include <set>
 
 #include "tests/test-utils.hh"
+#include "tests/cql_test_env.hh"
+#include "tests/cql_assertions.hh"
 #include "core/future-util.hh"
 #include "core/do_with.hh"
 #include "core/scollectd_api.hh"
 #include "core/file.hh"
 #include "core/reactor.hh"
+#include "core/thread.hh"
 #include "utils/UUID_gen.hh"
 #include "tmpdir.hh"
 #include "db/commitlog/commitlog.hh"
 #include "db/commitlog/rp_set.hh"
+#include "db/commitlog/commitlog_entry.hh"
+#include "db/commitlog/commitlog_replayer.hh"
+#include "database.hh"
 #include "log.hh"
 
 using namespace db;
@@ -100,6 +107,69 @@ SEASTAR_TEST_CASE(test_commitlog_written_to_disk_batch){
         });
 }
 
+SEASTAR_TEST_CASE(test_commitlog_batch_group_commit){
+    commitlog::config cfg;
+    cfg.mode = commitlog::sync_mode::BATCH;
+    cfg.batch_window_in_ms = 1;
+    return cl_test(cfg, [](commitlog& log) {
+        return seastar::async([&log] {
+            auto uuid = utils::UUID_gen::get_time_UUID();
+            std::set<db::replay_position> rps;
+            auto write = [&] (int i) {
+                sstring tmp = sprint("hej bubba cow %d", i);
+                return log.add_mutation(uuid, tmp.size(), [tmp](db::commitlog::output& dst) {
+                    dst.write(tmp.begin(), tmp.end());
+                }).then([&] (rp_handle h) {
+                    rps.insert(h.release());
+                });
+            };
+            auto write_alone = [&] (int n) {
+                for (int i = 0; i < n; ++i) {
+                    write(i).get();
+                }
+            };
+
+            // A lone writer doesn't wait: each write is synced by itself.
+            auto flushes = log.get_flush_count();
+            write_alone(20);
+            BOOST_REQUIRE_GE(log.get_flush_count() - flushes, 20u);
+            BOOST_REQUIRE_EQUAL(log.get_batch_window().count(), 0);
+
+            // Concurrent writers share syncs, which opens the window, so
+            // that batches get larger than the lone writer's.
+            // The last writers may be alone again, so look at the widest window.
+            flushes = log.get_flush_count();
+            std::chrono::microseconds widest_window{0};
+            parallel_for_each(boost::irange(0, 10), [&] (int writer) {
+                return do_for_each(boost::irange(0, 20), [&] (int i) {
+                    return write(writer * 20 + i).then([&] {
+                        widest_window = std::max(widest_window, log.get_batch_window());
+                    });
+                });
+            }).get();
+            BOOST_REQUIRE_LT(log.get_flush_count() - flushes, 200u);
+            BOOST_REQUIRE_GT(widest_window.count(), 0);
+            BOOST_REQUIRE_LE(widest_window.count(), 1000);
+
+            // Once writes stop arriving concurrently, the window closes again.
+            write_alone(20);
+            BOOST_REQUIRE_EQUAL(log.get_batch_window().count(), 0);
+            BOOST_REQUIRE_EQUAL(rps.size(), 240u);
+
+            // Every acknowledged write is on disk.
+            std::set<db::replay_position> read;
+            for (auto&& seg : log.get_active_segment_names()) {
+                auto s = db::commitlog::read_log_file(seg, [&read](temporary_buffer<char> buf, db::replay_position rp) {
+                    read.insert(rp);
+                    return make_ready_future<>();
+                }).get0();
+                s->done().get();
+            }
+            BOOST_REQUIRE(read == rps);
+        });
+    });
+}
+
 SEASTAR_TEST_CASE(test_commitlog_written_to_disk_periodic){
     return cl_test([](commitlog& log) {
             auto state = make_lw_shared(false);
@@ -353,6 +423,41 @@ SEASTAR_TEST_CASE(test_commitlog_reader){
         });
 }
 
+SEASTAR_TEST_CASE(test_commitlog_compressed_reader){
+    return do_for_each(std::vector<compressor>{compressor::lz4, compressor::zstd}, [] (compressor c) {
+        commitlog::config cfg;
+        cfg.commitlog_segment_size_in_mb = 1;
+        cfg.compression = c;
+        return cl_test(cfg, [](commitlog& log) {
+            return seastar::async([&log] {
+                auto uuid = utils::UUID_gen::get_time_UUID();
+                std::map<db::replay_position, sstring> written;
+                // Enough for several chunks, in more than one segment.
+                for (int i = 0; i < 20000; ++i) {
+                    auto tmp = sprint("hej bubba cow %d hej bubba cow", i);
+                    auto h = log.add_mutation(uuid, tmp.size(), [tmp](db::commitlog::output& dst) {
+                        dst.write(tmp.begin(), tmp.end());
+                    }).get0();
+                    written.emplace(h.release(), tmp);
+                }
+                log.sync_all_segments().get();
+
+                auto segments = log.get_active_segment_names();
+                BOOST_REQUIRE(segments.size() > 1);
+                std::map<db::replay_position, sstring> read;
+                for (auto&& seg : segments) {
+                    auto s = db::commitlog::read_log_file(seg, [&read](temporary_buffer<char> buf, db::replay_position rp) {
+                        read.emplace(rp, sstring(buf.get(), buf.size()));
+                        return make_ready_future<>();
+                    }).get0();
+                    s->done().get();
+                }
+                BOOST_REQUIRE(read == written);
+            });
+        });
+    });
+}
+
 static future<> corrupt_segment(sstring seg, uint64_t off, uint32_t value) {
     return open_file_dma(seg, open_flags::rw).then([off, value](file f) {
         size_t size = align_up<size_t>(off, 4096);
@@ -510,6 +615,69 @@ SEASTAR_TEST_CASE(test_commitlog_counters) {
     });
 }
 
+// Segments of all shards are replayed together; their entries are sent to
+// the shards owning them in batches of up to 128 entries or 256KB.
+SEASTAR_TEST_CASE(test_commitlog_replay_applies_each_entry_once) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table ks.cf (p int, c int, v blob, primary key (p, c));").get();
+        // Many small entries fill batches by count, and large ones by size.
+        static constexpr int32_t small_entries = 300;
+        static constexpr int32_t large_entries = 12;
+        static constexpr size_t large_entry_size = 100 * 1024;
+
+        tmpdir tmp;
+        auto write_segments = [&tmp, &e] {
+            return seastar::async([&tmp, &e] {
+                commitlog::config cfg;
+                cfg.commit_log_location = tmp.path;
+                cfg.commitlog_segment_size_in_mb = 1;
+                // The node's own commitlog has the metrics.
+                cfg.metrics_category_name = "";
+                auto log = commitlog::create_commitlog(cfg).get0();
+                auto s = e.local_db().find_schema("ks", "cf");
+                auto write = [&] (int32_t p, size_t size) {
+                    mutation m(partition_key::from_single_value(*s, int32_type->decompose(p)), s);
+                    m.set_clustered_cell(clustering_key::from_single_value(*s, int32_type->decompose(p)), "v", data_value(bytes(size, 'x')), 1);
+                    auto fm = freeze(m);
+                    commitlog_entry_writer cew(s, fm);
+                    // Released, so the segment stays dirty and is left on disk.
+                    log.add_entry(s->id(), cew, commitlog::timeout_clock::time_point::max()).get0().release();
+                };
+                // Each shard writes keys owned by all shards.
+                auto first = int32_t(engine().cpu_id()) * (small_entries + large_entries);
+                for (auto i = 0; i < small_entries; i++) {
+                    write(first + i, 16);
+                }
+                log.force_new_active_segment().get();
+                for (auto i = 0; i < large_entries; i++) {
+                    write(first + small_entries + i, large_entry_size);
+                }
+                log.shutdown().get();
+                return log.get_active_segment_names();
+            });
+        };
+        auto segments = map_reduce(smp::all_cpus(), [&write_segments] (unsigned shard) {
+            return smp::submit_to(shard, write_segments);
+        }, std::vector<sstring>(), [] (std::vector<sstring> all, std::vector<sstring> names) {
+            std::move(names.begin(), names.end(), std::back_inserter(all));
+            return all;
+        }).get0();
+        BOOST_REQUIRE_GE(segments.size(), 3 * smp::count);
+
+        auto rp = db::commitlog_replayer::create_replayer(e.qp()).get0();
+        rp.recover(segments).get();
+
+        auto written = int64_t(smp::count) * (small_entries + large_entries);
+        auto applied = e.db().map_reduce0([] (database& db) {
+            return db.find_column_family("ks", "cf").get_stats().writes.hist.count;
+        }, int64_t(0), std::plus<int64_t>()).get0();
+        BOOST_REQUIRE_EQUAL(applied, written);
+        assert_that(e.execute_cql("select count(*) from ks.cf;").get0()).is_rows().with_rows({
+            {long_type->decompose(written)}
+        });
+    });
+}
+
 #ifndef DEFAULT_ALLOCATOR
 
 SEASTAR_TEST_CASE(test_allocation_failure){
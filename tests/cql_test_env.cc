@@ -44,6 +44,8 @@
 #include "gms/gossiper.hh"
 #include "service/storage_service.hh"
 #include "auth/service.hh"
+#include "streaming/stream_session.hh"
+#include "streaming/stream_manager.hh"
 
 namespace sstables {
 
@@ -291,6 +293,7 @@ class single_node_cql_env : public cql_test_env {
             cfg->shutdown_announce_in_ms() = 0;
             boost::filesystem::create_directories((data_dir.path + "/system").c_str());
             boost::filesystem::create_directories(cfg->commitlog_directory().c_str());
+            boost::filesystem::create_directories(database::system_commitlog_directory(*cfg).c_str());
 
             const gms::inet_address listen("127.0.0.1");
             auto& ms = netw::get_messaging_service();
@@ -337,6 +340,12 @@ class single_node_cql_env : public cql_test_env {
             bm.start(std::ref(qp)).get();
             auto stop_bm = defer([&bm] { bm.stop().get(); });
 
+            streaming::stream_session::init_streaming_service(*db).get();
+            auto stop_streaming = defer([] {
+                gms::get_local_gossiper().unregister_(streaming::get_local_stream_manager().shared_from_this());
+                streaming::get_stream_manager().stop().get();
+            });
+
             distributed_loader::init_system_keyspace(*db).get();
 
             auto& ks = db->local().find_keyspace(db::system_keyspace::NAME);
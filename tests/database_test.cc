@@ -21,6 +21,7 @@
 
 
 #include <seastar/core/thread.hh>
+#include <seastar/util/defer.hh>
 #include <seastar/tests/test-utils.hh>
 
 #include "tests/cql_test_env.hh"
@@ -29,6 +30,8 @@
 #include "database.hh"
 #include "partition_slice_builder.hh"
 #include "frozen_mutation.hh"
+#include "db/system_keyspace.hh"
+#include "db/commitlog/commitlog.hh"
 
 SEASTAR_TEST_CASE(test_querying_with_limits) {
     return do_with_cql_env([](cql_test_env& e) {
@@ -74,3 +77,211 @@ SEASTAR_TEST_CASE(test_querying_with_limits) {
         });
     });
 }
+
+SEASTAR_TEST_CASE(test_paged_query_resumes_reader) {
+    return do_with_cql_env([](cql_test_env& e) {
+        return seastar::async([&] {
+            e.execute_cql("create table ks.wide (pk int, ck int, s int static, v int, primary key (pk, ck));").get();
+            e.execute_cql("insert into ks.wide (pk, s) values (0, 7);").get();
+            for (int32_t ck = 0; ck < 100; ++ck) {
+                e.execute_cql(sprint("insert into ks.wide (pk, ck, v) values (0, %d, %d);", ck, ck)).get();
+            }
+            e.execute_cql("delete from ks.wide where pk = 0 and ck >= 40 and ck < 60;").get();
+
+            auto& db = e.local_db();
+            auto s = db.find_schema("ks", "wide");
+            auto pk = partition_key::from_single_value(*s, int32_type->decompose(0));
+            auto dk = dht::global_partitioner().decorate_key(*s, pk);
+            dht::partition_range_vector pranges{dht::partition_range::make_singular(dk)};
+            auto max_size = std::numeric_limits<size_t>::max();
+            auto& stats = db.get_querier_cache().get_stats();
+            auto lookups = stats.lookups;
+            auto misses = stats.misses;
+            auto drops = stats.drops;
+
+            auto query_uuid = utils::make_random_uuid();
+            stdx::optional<clustering_key> last_ckey;
+            std::vector<int32_t> cks;
+            unsigned pages = 0;
+            while (true) {
+                auto slice = partition_slice_builder(*s).build();
+                slice.options.set<query::partition_slice::option::send_partition_key>();
+                slice.options.set<query::partition_slice::option::send_clustering_key>();
+                if (last_ckey) {
+                    slice.set_range(*s, pk, {query::clustering_range(query::clustering_range::bound(*last_ckey, false), {})});
+                }
+                auto cmd = query::read_command(s->id(), s->version(), std::move(slice), 7, gc_clock::now(), stdx::nullopt,
+                        query::max_partitions, query_uuid, query::is_first_page(pages == 0));
+                auto result = db.query(s, cmd, query::result_request::only_result, pranges, nullptr, max_size).get0();
+                auto rs = query::result_set::from_raw_result(s, cmd.slice, *result);
+                ++pages;
+                for (auto&& row : rs.rows()) {
+                    BOOST_REQUIRE_EQUAL(row.get_nonnull<int32_t>("s"), 7);
+                    BOOST_REQUIRE_EQUAL(row.get_nonnull<int32_t>("v"), row.get_nonnull<int32_t>("ck"));
+                    cks.push_back(row.get_nonnull<int32_t>("ck"));
+                }
+                if (rs.rows().size() < 7) {
+                    break;
+                }
+                last_ckey = clustering_key::from_single_value(*s, int32_type->decompose(cks.back()));
+            }
+
+            std::vector<int32_t> expected;
+            for (int32_t ck = 0; ck < 100; ++ck) {
+                if (ck < 40 || ck >= 60) {
+                    expected.push_back(ck);
+                }
+            }
+            BOOST_REQUIRE(cks == expected);
+            // Every page but the first one resumed the reader of the previous page.
+            BOOST_REQUIRE_EQUAL(stats.lookups - lookups, pages - 1);
+            BOOST_REQUIRE_EQUAL(stats.misses - misses, 0);
+            BOOST_REQUIRE_EQUAL(stats.drops - drops, 0);
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_querier_cache_evicts_before_reads_queue) {
+    return do_with_cql_env([](cql_test_env& e) {
+        return seastar::async([&] {
+            e.execute_cql("create table ks.paged (pk int, ck int, v int, primary key (pk, ck));").get();
+            for (int32_t ck = 0; ck < 20; ++ck) {
+                e.execute_cql(sprint("insert into ks.paged (pk, ck, v) values (0, %d, %d);", ck, ck)).get();
+            }
+
+            auto& db = e.local_db();
+            auto s = db.find_schema("ks", "paged");
+            auto pk = partition_key::from_single_value(*s, int32_type->decompose(0));
+            dht::partition_range_vector pranges{dht::partition_range::make_singular(dht::global_partitioner().decorate_key(*s, pk))};
+            auto& stats = db.get_querier_cache().get_stats();
+
+            auto query_first_page = [&] {
+                auto cmd = query::read_command(s->id(), s->version(), partition_slice_builder(*s).build(), 7, gc_clock::now(), stdx::nullopt,
+                        query::max_partitions, utils::make_random_uuid(), query::is_first_page::yes);
+                auto result = db.query(s, cmd, query::result_request::only_result, pranges, nullptr, std::numeric_limits<size_t>::max()).get0();
+                assert_that(query::result_set::from_raw_result(s, cmd.slice, *result)).has_size(7);
+            };
+
+            query_first_page();
+            BOOST_REQUIRE_EQUAL(stats.population, 1u);
+            auto evictions = stats.resource_based_evictions;
+
+            // Leaves less than the reserve free, while no read is queued yet.
+            auto& sem = db.read_concurrency_sem();
+            auto taken = sem.available_units() - ssize_t(database::querier_cache_read_reserve / 2);
+            sem.consume(taken);
+            auto release = defer([&sem, taken] { sem.signal(taken); });
+
+            query_first_page();
+            BOOST_REQUIRE_EQUAL(stats.population, 0u);
+            BOOST_REQUIRE_GT(stats.resource_based_evictions, evictions);
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_streamed_mutations_are_written_to_sstables) {
+    return do_with_cql_env([](cql_test_env& e) {
+        return seastar::async([&] {
+            e.execute_cql("create table ks.streamed (k int, v int, primary key (k));").get();
+            auto& db = e.local_db();
+            auto s = db.find_schema("ks", "streamed");
+            auto& cf = db.find_column_family(s);
+
+            std::vector<mutation> muts;
+            for (int32_t k = 0; muts.size() < 40; ++k) {
+                auto pkey = partition_key::from_single_value(*s, int32_type->decompose(k));
+                mutation m(pkey, s);
+                if (dht::shard_of(m.token()) != engine().cpu_id()) {
+                    continue;
+                }
+                m.set_clustered_cell(clustering_key_prefix::make_empty(), "v", data_value(k), 1);
+                muts.push_back(std::move(m));
+            }
+            std::sort(muts.begin(), muts.end(), mutation_decorated_key_less_comparator());
+
+            // Two interleaved runs, like those of two shards of a sender.
+            auto plan_id = utils::make_random_uuid();
+            for (size_t i = 0; i < muts.size() / 2; ++i) {
+                db.apply_streaming_mutation(s, plan_id, freeze(muts[i]), false).get();
+                db.apply_streaming_mutation(s, plan_id, freeze(muts[muts.size() / 2 + i]), false).get();
+            }
+
+            auto sstables = cf.sstables_count();
+            auto cmd = query::read_command(s->id(), s->version(), partition_slice_builder(*s).build(), query::max_rows);
+            auto query = [&] {
+                auto result = db.query(s, cmd, query::result_request::only_result, {query::full_partition_range}, nullptr,
+                        std::numeric_limits<size_t>::max()).get0();
+                return query::result_set::from_raw_result(s, cmd.slice, *result);
+            };
+            // Nothing is visible before the stream is complete.
+            assert_that(query()).is_empty();
+
+            cf.flush_streaming_mutations(plan_id).get();
+            BOOST_REQUIRE_EQUAL(cf.sstables_count(), sstables + 2);
+            assert_that(query()).has_size(muts.size());
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_streaming_rolls_writers_on_schema_change) {
+    return do_with_cql_env([](cql_test_env& e) {
+        return seastar::async([&] {
+            e.execute_cql("create table ks.streamed (k int, v int, primary key (k));").get();
+            auto& db = e.local_db();
+            auto s = db.find_schema("ks", "streamed");
+            auto& cf = db.find_column_family(s);
+
+            std::vector<mutation> muts;
+            for (int32_t k = 0; muts.size() < 20; ++k) {
+                auto pkey = partition_key::from_single_value(*s, int32_type->decompose(k));
+                mutation m(pkey, s);
+                if (dht::shard_of(m.token()) != engine().cpu_id()) {
+                    continue;
+                }
+                m.set_clustered_cell(clustering_key_prefix::make_empty(), "v", data_value(k), 1);
+                muts.push_back(std::move(m));
+            }
+            std::sort(muts.begin(), muts.end(), mutation_decorated_key_less_comparator());
+
+            auto plan_id = utils::make_random_uuid();
+            auto sstables = cf.sstables_count();
+            for (size_t i = 0; i < muts.size() / 2; ++i) {
+                db.apply_streaming_mutation(s, plan_id, freeze(muts[i]), false).get();
+            }
+            e.execute_cql("alter table ks.streamed add w int;").get();
+            BOOST_REQUIRE(cf.schema() != s);
+            for (size_t i = muts.size() / 2; i < muts.size(); ++i) {
+                db.apply_streaming_mutation(s, plan_id, freeze(muts[i]), false).get();
+            }
+
+            cf.flush_streaming_mutations(plan_id).get();
+            // The writer opened with the old schema was finished, and another
+            // one opened with the new schema.
+            BOOST_REQUIRE_EQUAL(cf.sstables_count(), sstables + 2);
+            auto cmd = query::read_command(s->id(), cf.schema()->version(), partition_slice_builder(*cf.schema()).build(), query::max_rows);
+            auto result = db.query(cf.schema(), cmd, query::result_request::only_result, {query::full_partition_range}, nullptr,
+                    std::numeric_limits<size_t>::max()).get0();
+            assert_that(query::result_set::from_raw_result(cf.schema(), cmd.slice, *result)).has_size(muts.size());
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_system_keyspaces_use_their_own_commitlog) {
+    return do_with_cql_env([](cql_test_env& e) {
+        return seastar::async([&] {
+            e.execute_cql("create table ks.cf (k int, v int, primary key (k));").get();
+            auto& db = e.local_db();
+            BOOST_REQUIRE(db.system_commitlog() != nullptr);
+            BOOST_REQUIRE(db.system_commitlog() != db.commitlog());
+
+            auto& cf = db.find_column_family("ks", "cf");
+            BOOST_REQUIRE_EQUAL(cf.commitlog(), db.commitlog());
+            auto& local = db.find_column_family(db::system_keyspace::NAME, db::system_keyspace::LOCAL);
+            BOOST_REQUIRE_EQUAL(local.commitlog(), db.system_commitlog());
+
+            auto size = db.system_commitlog()->get_total_size();
+            e.execute_cql("insert into ks.cf (k, v) values (1, 1);").get();
+            BOOST_REQUIRE_EQUAL(db.system_commitlog()->get_total_size(), size);
+        });
+    });
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+
+#include "database.hh"
+
+#include "tests/test-utils.hh"
+#include "tests/cql_test_env.hh"
+#include "tests/cql_assertions.hh"
+#include "tests/tmpdir.hh"
+
+#include "core/sleep.hh"
+#include "db/config.hh"
+#include "db/hints/manager.hh"
+#include "service/storage_proxy.hh"
+#include "utils/fb_utilities.hh"
+
+using namespace std::literals::chrono_literals;
+
+template<typename EventuallySucceedingFunction>
+static void eventually(EventuallySucceedingFunction&& f) {
+    constexpr unsigned max_attempts = 10;
+    unsigned attempts = 0;
+    while (true) {
+        try {
+            f();
+            break;
+        } catch (...) {
+            if (++attempts < max_attempts) {
+                sleep(std::chrono::milliseconds(1 << attempts)).get0();
+            } else {
+                throw;
+            }
+        }
+    }
+}
+
+// Runs func in a cql environment whose hints are stored in a temporary directory.
+// The hints managers are started by func, so that it can check what happens before.
+static future<> do_with_hints_env(std::function<void(cql_test_env&)> func) {
+    return do_with(tmpdir(), [func = std::move(func)] (tmpdir& hints_dir) {
+        db::config cfg;
+        cfg.hints_directory() = hints_dir.path;
+        return do_with_cql_env_thread(func, cfg);
+    });
+}
+
+static void start_hints_managers() {
+    service::get_storage_proxy().invoke_on_all([] (service::storage_proxy& p) {
+        return p.start_hints_manager();
+    }).get();
+}
+
+static db::hints::manager& local_hints_manager() {
+    return service::get_local_storage_proxy().get_hints_manager();
+}
+
+static void wait_for_hints_written(db::hints::manager& hm) {
+    eventually([&hm] {
+        BOOST_REQUIRE_EQUAL(hm.hints_in_progress(), 0);
+    });
+}
+
+static lw_shared_ptr<const frozen_mutation> make_hint(schema_ptr s, int32_t p, int32_t v) {
+    mutation m(partition_key::from_single_value(*s, int32_type->decompose(p)), s);
+    auto ckey = clustering_key::from_single_value(*s, int32_type->decompose(0));
+    m.set_clustered_cell(ckey, *s->get_column_definition("v"), atomic_cell::make_live(api::new_timestamp(), int32_type->decompose(v)));
+    return make_lw_shared<const frozen_mutation>(freeze(m));
+}
+
+SEASTAR_TEST_CASE(test_hints_are_replayed_on_up) {
+    return do_with_hints_env([] (cql_test_env& e) {
+        start_hints_managers();
+        e.execute_cql("create table cf (p int, c int, v int, primary key (p, c));").get();
+        auto s = e.local_db().find_schema("ks", "cf");
+        auto& hm = local_hints_manager();
+        // Hints for ourselves are delivered like any other, and this node is always alive.
+        auto me = utils::fb_utilities::get_broadcast_address();
+
+        BOOST_REQUIRE(hm.store_hint(me, s, make_hint(s, 1, 10)));
+        BOOST_REQUIRE(hm.store_hint(me, s, make_hint(s, 2, 20)));
+        wait_for_hints_written(hm);
+        BOOST_REQUIRE_EQUAL(hm.created_hints_count(me), 2);
+        BOOST_REQUIRE(hm.endpoints_pending_hints() == std::vector<gms::inet_address>{me});
+        assert_that(e.execute_cql("select v from cf;").get0()).is_rows().is_empty();
+
+        hm.on_up(me);
+        eventually([&hm] {
+            BOOST_REQUIRE_EQUAL(hm.get_stats().sent, 2);
+            BOOST_REQUIRE(hm.endpoints_pending_hints().empty());
+        });
+        assert_that(e.execute_cql("select v from cf;").get0()).is_rows().with_rows_ignore_order({
+            {int32_type->decompose(10)},
+            {int32_type->decompose(20)},
+        });
+
+        // The hints log stays open, later hints go to a new segment.
+        BOOST_REQUIRE(hm.store_hint(me, s, make_hint(s, 3, 30)));
+        wait_for_hints_written(hm);
+        hm.on_up(me);
+        eventually([&hm] {
+            BOOST_REQUIRE_EQUAL(hm.get_stats().sent, 3);
+            BOOST_REQUIRE(hm.endpoints_pending_hints().empty());
+        });
+        assert_that(e.execute_cql("select v from cf where p = 3;").get0()).is_rows().with_rows({
+            {int32_type->decompose(30)},
+        });
+    });
+}
+
+// storage_proxy counts the hints which were accepted towards CL=ANY, so
+// store_hint() must not accept a hint which won't be written.
+SEASTAR_TEST_CASE(test_hints_accounting) {
+    return do_with_hints_env([] (cql_test_env& e) {
+        e.execute_cql("create table cf (p int, c int, v int, primary key (p, c));").get();
+        auto s = e.local_db().find_schema("ks", "cf");
+        auto& hm = local_hints_manager();
+        auto ep = gms::inet_address("127.0.0.2");
+
+        BOOST_REQUIRE(!hm.can_hint_for(ep));
+        BOOST_REQUIRE(!hm.store_hint(ep, s, make_hint(s, 1, 10)));
+        BOOST_REQUIRE_EQUAL(hm.get_stats().dropped, 1);
+        BOOST_REQUIRE_EQUAL(hm.created_hints_count(ep), 0);
+
+        start_hints_managers();
+        BOOST_REQUIRE(hm.can_hint_for(ep));
+        BOOST_REQUIRE(hm.store_hint(ep, s, make_hint(s, 1, 10)));
+        wait_for_hints_written(hm);
+        BOOST_REQUIRE_EQUAL(hm.get_stats().written, 1);
+        BOOST_REQUIRE_EQUAL(hm.get_stats().errors, 0);
+        BOOST_REQUIRE_EQUAL(hm.created_hints_count(ep), 1);
+        BOOST_REQUIRE_EQUAL(hm.not_stored_hints_count(ep), 0);
+
+        hm.truncate_hints(ep).get();
+        BOOST_REQUIRE(hm.endpoints_pending_hints().empty());
+    });
+}
+
+SEASTAR_TEST_CASE(test_hints_wait_for_endpoint) {
+    return do_with_hints_env([] (cql_test_env& e) {
+        start_hints_managers();
+        e.execute_cql("create table cf (p int, c int, v int, primary key (p, c));").get();
+        auto s = e.local_db().find_schema("ks", "cf");
+        auto& hm = local_hints_manager();
+        auto me = utils::fb_utilities::get_broadcast_address();
+        auto dead = gms::inet_address("127.0.0.2");
+
+        BOOST_REQUIRE(hm.store_hint(dead, s, make_hint(s, 1, 10)));
+        BOOST_REQUIRE(hm.store_hint(me, s, make_hint(s, 2, 20)));
+        wait_for_hints_written(hm);
+
+        // Nothing is sent to an endpoint which is down, or while delivery is paused.
+        hm.pause_delivery(true);
+        hm.schedule_delivery(dead);
+        hm.on_up(me);
+        sleep(100ms).get();
+        BOOST_REQUIRE_EQUAL(hm.get_stats().sent, 0);
+        auto pending = hm.endpoints_pending_hints();
+        BOOST_REQUIRE_EQUAL(pending.size(), 2);
+        assert_that(e.execute_cql("select v from cf;").get0()).is_rows().is_empty();
+
+        // Hints queued for one endpoint don't hold back the others.
+        hm.pause_delivery(false);
+        hm.schedule_delivery(dead);
+        hm.on_up(me);
+        eventually([&hm, dead] {
+            BOOST_REQUIRE_EQUAL(hm.get_stats().sent, 1);
+            BOOST_REQUIRE(hm.endpoints_pending_hints() == std::vector<gms::inet_address>{dead});
+        });
+        assert_that(e.execute_cql("select v from cf;").get0()).is_rows().with_rows({
+            {int32_type->decompose(20)},
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_hints_for_dropped_table_are_discarded) {
+    return do_with_hints_env([] (cql_test_env& e) {
+        start_hints_managers();
+        e.execute_cql("create table cf (p int, c int, v int, primary key (p, c));").get();
+        auto s = e.local_db().find_schema("ks", "cf");
+        auto& hm = local_hints_manager();
+        auto me = utils::fb_utilities::get_broadcast_address();
+
+        BOOST_REQUIRE(hm.store_hint(me, s, make_hint(s, 1, 10)));
+        wait_for_hints_written(hm);
+        e.execute_cql("drop table cf;").get();
+
+        hm.on_up(me);
+        eventually([&hm] {
+            BOOST_REQUIRE_EQUAL(hm.get_stats().discarded, 1);
+            BOOST_REQUIRE(hm.endpoints_pending_hints().empty());
+        });
+        BOOST_REQUIRE_EQUAL(hm.get_stats().sent, 0);
+        BOOST_REQUIRE_EQUAL(hm.get_stats().send_errors, 0);
+    });
+}
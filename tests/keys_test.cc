@@ -155,3 +155,66 @@ BOOST_AUTO_TEST_CASE(test_serialization) {
 
     BOOST_REQUIRE(key.equal(*s, reserialize(key)));
 }
+
+BOOST_AUTO_TEST_CASE(test_memcomparable_form) {
+    auto s = schema_builder("ks", "cf")
+            .with_column("pk", bytes_type, column_kind::partition_key)
+            .with_column("c1", int32_type, column_kind::clustering_key)
+            .with_column("c2", utf8_type, column_kind::clustering_key)
+            .with_column("c3", reversed_type_impl::get_instance(long_type), column_kind::clustering_key)
+            .with_column("c4", boolean_type, column_kind::clustering_key)
+            .with_column("v", bytes_type)
+            .build();
+
+    auto&& t = s->clustering_key_type();
+    BOOST_REQUIRE(t->is_memcomparable());
+
+    std::vector<bytes> c1s = { bytes(), int32_type->decompose(std::numeric_limits<int32_t>::min()),
+        int32_type->decompose(-1), int32_type->decompose(0), int32_type->decompose(1), int32_type->decompose(256) };
+    std::vector<bytes> c2s = { bytes(), to_bytes("a"), to_bytes(sstring("a\0", 2)), to_bytes(sstring("a\0b", 3)), to_bytes("ab"), to_bytes("abcdefghij"), to_bytes("b") };
+    std::vector<bytes> c3s = { bytes(), long_type->decompose(int64_t(-5)), long_type->decompose(int64_t(5)) };
+    std::vector<bytes> c4s = { bytes(), bytes(1, int8_t(0)), bytes(1, int8_t(1)), bytes(1, int8_t(2)) };
+
+    std::vector<clustering_key_prefix> keys;
+    keys.push_back(clustering_key_prefix::make_empty());
+    for (auto&& c1 : c1s) {
+        keys.push_back(clustering_key_prefix::from_exploded(*s, {c1}));
+        for (auto&& c2 : c2s) {
+            keys.push_back(clustering_key_prefix::from_exploded(*s, {c1, c2}));
+            for (auto&& c3 : c3s) {
+                for (auto&& c4 : c4s) {
+                    keys.push_back(clustering_key_prefix::from_exploded(*s, {c1, c2, c3, c4}));
+                }
+            }
+        }
+    }
+
+    auto sign = [] (int x) { return x < 0 ? -1 : x > 0 ? 1 : 0; };
+    for (auto&& k1 : keys) {
+        auto f1 = t->memcomparable_form(k1.representation());
+        auto p1 = t->memcomparable_prefix(k1.representation());
+        uint64_t expected_prefix = 0;
+        for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+            expected_prefix = (expected_prefix << 8) | (i < f1.size() ? uint8_t(f1[i]) : 0);
+        }
+        BOOST_REQUIRE_EQUAL(p1, expected_prefix);
+        for (auto&& k2 : keys) {
+            auto f2 = t->memcomparable_form(k2.representation());
+            auto p2 = t->memcomparable_prefix(k2.representation());
+            auto expected = sign(t->compare(k1.representation(), k2.representation()));
+            BOOST_REQUIRE_EQUAL(sign(compare_unsigned(f1, f2)), expected);
+            if (t->is_full(k1.representation()) && t->is_full(k2.representation()) && p1 != p2) {
+                BOOST_REQUIRE_EQUAL(p1 < p2 ? -1 : 1, expected);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_memcomparable_form_unsupported_types) {
+    BOOST_REQUIRE(!double_type->is_memcomparable());
+    BOOST_REQUIRE(!varint_type->is_memcomparable());
+    BOOST_REQUIRE(!timeuuid_type->is_memcomparable());
+
+    compound_type<allow_prefixes::yes> t({int32_type, uuid_type});
+    BOOST_REQUIRE(!t.is_memcomparable());
+}
@@ -23,6 +23,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <boost/algorithm/cxx11/all_of.hpp>
+#include <random>
 
 #include "dht/i_partitioner.hh"
 #include "dht/murmur3_partitioner.hh"
@@ -55,7 +56,7 @@ static dht::token token_from_long(uint64_t value) {
 
 static int64_t long_from_token(dht::token token) {
     int64_t data;
-    std::copy_n(token._data.data(), 8, reinterpret_cast<char*>(&data));
+    std::copy_n(token.data().data(), 8, reinterpret_cast<char*>(&data));
     return net::ntoh(data);
 }
 
@@ -98,6 +99,35 @@ BOOST_AUTO_TEST_CASE(test_token_wraparound_2) {
     BOOST_REQUIRE_EQUAL(midpoint, token_from_long(0x7800'0000'0000'0000));
 }
 
+BOOST_AUTO_TEST_CASE(test_long_tokens) {
+    dht::murmur3_partitioner partitioner;
+    auto t1 = token_from_long(-1);
+    auto t2 = token_from_long(1);
+    BOOST_REQUIRE(t1.has_long_value());
+    BOOST_REQUIRE_EQUAL(t1.long_value(), -1);
+    BOOST_REQUIRE_EQUAL(long_from_token(t1), -1);
+    // Tokens are signed, even though their byte representation isn't
+    BOOST_REQUIRE(t1 < t2);
+    BOOST_REQUIRE_EQUAL(dht::tri_compare(t1, t2), partitioner.tri_compare(t1, t2));
+    BOOST_REQUIRE(dht::token::from_int64(-1) == t1);
+    BOOST_REQUIRE_EQUAL(std::hash<dht::token>()(dht::token::from_int64(-1)), std::hash<dht::token>()(t1));
+    BOOST_REQUIRE(dht::minimum_token() < t1);
+    BOOST_REQUIRE(t2 < dht::maximum_token());
+
+    // Tokens of other partitioners which happen to be 8 bytes long keep their ordering
+    dht::set_global_partitioner(to_sstring("org.apache.cassandra.dht.ByteOrderedPartitioner"));
+    dht::byte_ordered_partitioner bop;
+    auto b1 = bop.from_sstring("0000000000000001");
+    auto b2 = bop.from_sstring("ff00000000000000");
+    auto b3 = bop.from_sstring("ff0000000000000000");
+    BOOST_REQUIRE(b1.has_long_value());
+    BOOST_REQUIRE(!b3.has_long_value());
+    BOOST_REQUIRE(b1 < b2);
+    BOOST_REQUIRE(b2 < b3);
+    BOOST_REQUIRE_EQUAL(bop.to_sstring(b2), "ff00000000000000");
+    dht::set_global_partitioner(to_sstring("org.apache.cassandra.dht.Murmur3Partitioner"));
+}
+
 BOOST_AUTO_TEST_CASE(test_ring_position_is_comparable_with_decorated_key) {
     auto s = schema_builder("ks", "cf")
         .with_column("pk", bytes_type, column_kind::partition_key)
@@ -369,8 +399,8 @@ BOOST_AUTO_TEST_CASE(test_bop_token_midpoint1) {
     auto mid_expected = partitioner.from_sstring("008010");
 
     BOOST_REQUIRE(t1 < t2);
-    BOOST_REQUIRE(mid_expected._data.size() == 3);
-    BOOST_REQUIRE(mid._data.size() == 3);
+    BOOST_REQUIRE(mid_expected.data().size() == 3);
+    BOOST_REQUIRE(mid.data().size() == 3);
     BOOST_REQUIRE(mid == mid_expected);
 
     dht::set_global_partitioner(to_sstring("org.apache.cassandra.dht.Murmur3Partitioner"));
@@ -633,6 +663,29 @@ BOOST_AUTO_TEST_CASE(test_murmur3_sharding_with_ignorebits) {
     test_partitioner_sharding(mm3p2s4i, 2, mm3p2s_shard_limits, prev_token, 4);
 }
 
+// Checks that the algorithm published to shard-aware clients, as described
+// in docs/protocol-extensions.md, agrees with shard_of().
+BOOST_AUTO_TEST_CASE(test_murmur3_published_sharding_algorithm) {
+    auto client_shard_of = [] (int64_t token, unsigned nr_shards, unsigned ignore_msb) {
+        uint64_t biased_token = uint64_t(token) + (uint64_t(1) << 63);
+        biased_token <<= ignore_msb;
+        return unsigned((unsigned __int128)biased_token * nr_shards >> 64);
+    };
+    std::default_random_engine rnd;
+    std::uniform_int_distribution<int64_t> dist(std::numeric_limits<int64_t>::min() + 1, std::numeric_limits<int64_t>::max());
+    for (auto nr_shards : {1u, 2u, 7u, 32u}) {
+        for (auto ignore_msb : {0u, 2u, 12u}) {
+            dht::murmur3_partitioner partitioner(nr_shards, ignore_msb);
+            BOOST_REQUIRE_EQUAL(partitioner.sharding_algorithm_name(), "biased-token-round-robin");
+            auto published_ignore_msb = partitioner.sharding_ignore_msb();
+            for (int i = 0; i < 1000; ++i) {
+                auto t = dist(rnd);
+                BOOST_REQUIRE_EQUAL(partitioner.shard_of(token_from_long(t)), client_shard_of(t, nr_shards, published_ignore_msb));
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_random_partitioner) {
     using int128 = boost::multiprecision::int128_t;
     auto prev_token = [] (const dht::i_partitioner& part, dht::token token) {
@@ -668,7 +721,7 @@ BOOST_AUTO_TEST_CASE(test_random_partitioner) {
 
 BOOST_AUTO_TEST_CASE(test_byte_ordered_partitioner) {
     auto prev_token = [] (const dht::i_partitioner& part, dht::token token) {
-        auto& bytes = token._data;
+        auto bytes = to_bytes(token.data());
         for (auto i = 0u; i < bytes.size(); ++i) {
             auto& b = bytes[bytes.size() - 1 - i];
             auto bfore = b;
@@ -677,10 +730,10 @@ BOOST_AUTO_TEST_CASE(test_byte_ordered_partitioner) {
                 break;
             }
         }
-        return token;
+        return dht::token(dht::token::kind::key, bytes);
     };
     auto make_token_vector = [] (dht::i_partitioner& part, std::vector<int> v) {
-        auto from_byte = [&] (bytes::value_type b) { return dht::token(dht::token::kind::key, managed_bytes({b})); };
+        auto from_byte = [&] (bytes::value_type b) { return dht::token(dht::token::kind::key, bytes(1, b)); };
         return boost::copy_range<std::vector<dht::token>>(
                 v | boost::adaptors::transformed(from_byte));
     };
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <random>
+#include "perf.hh"
+#include "schema_builder.hh"
+#include "mutation_partition.hh"
+
+volatile int black_hole;
+
+static const unsigned n_keys = 1024;
+
+int main(int argc, char* argv[]) {
+    auto s = schema_builder("ks", "cf")
+        .with_column("pk", bytes_type, column_kind::partition_key)
+        .with_column("ck1", int32_type, column_kind::clustering_key)
+        .with_column("ck2", utf8_type, column_kind::clustering_key)
+        .with_column("v", bytes_type)
+        .build();
+
+    std::mt19937 rnd(0);
+    std::uniform_int_distribution<int32_t> dist(0, 1000);
+    std::vector<clustering_key> keys;
+    for (unsigned i = 0; i < n_keys; ++i) {
+        keys.push_back(clustering_key::from_exploded(*s, {
+            int32_type->decompose(dist(rnd)),
+            utf8_type->decompose(sprint("ck-%d", dist(rnd)))
+        }));
+    }
+
+    auto&& t = s->clustering_key_type();
+    std::vector<bytes> forms;
+    std::vector<rows_entry> plain_entries;
+    std::vector<rows_entry> prefixed_entries;
+    for (auto&& k : keys) {
+        forms.push_back(t->memcomparable_form(k.representation()));
+        plain_entries.emplace_back(k);
+        prefixed_entries.emplace_back(k);
+        prefixed_entries.back().compute_key_prefix(*s);
+    }
+
+    int sink = 0;
+    unsigned i = 0;
+    auto next = [&] {
+        i = (i + 1) % n_keys;
+        return i;
+    };
+
+    std::cout << "Timing compound_type::compare()...\n";
+    time_it([&] {
+        auto a = next();
+        sink += t->compare(keys[a].representation(), keys[(a * 7) % n_keys].representation());
+    });
+
+    std::cout << "Timing compare_unsigned() of memcomparable forms...\n";
+    time_it([&] {
+        auto a = next();
+        sink += compare_unsigned(forms[a], forms[(a * 7) % n_keys]);
+    });
+
+    rows_entry::tri_compare cmp(*s);
+
+    std::cout << "Timing rows_entry::tri_compare without key prefixes...\n";
+    time_it([&] {
+        auto a = next();
+        sink += cmp(plain_entries[a], plain_entries[(a * 7) % n_keys]);
+    });
+
+    std::cout << "Timing rows_entry::tri_compare with key prefixes...\n";
+    time_it([&] {
+        auto a = next();
+        sink += cmp(prefixed_entries[a], prefixed_entries[(a * 7) % n_keys]);
+    });
+
+    mutation_partition mp(s);
+    for (auto&& k : keys) {
+        mp.clustered_row(*s, k);
+    }
+
+    std::cout << "Timing mutation_partition::find_row()...\n";
+    time_it([&] {
+        sink += mp.find_row(*s, keys[next()]) != nullptr;
+    });
+
+    std::cout << "Timing mutation_partition::clustered_row() of existing rows...\n";
+    time_it([&] {
+        sink += mp.clustered_row(*s, keys[next()]).empty();
+    });
+
+    black_hole = sink;
+}
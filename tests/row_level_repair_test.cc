@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+#include <boost/range/algorithm/sort.hpp>
+#include <boost/range/numeric.hpp>
+
+#include "database.hh"
+#include "repair/row_level.hh"
+
+#include "tests/test-utils.hh"
+#include "tests/cql_test_env.hh"
+#include "tests/cql_assertions.hh"
+
+static dht::token_range full_range() {
+    return dht::token_range::make_open_ended_both_sides();
+}
+
+static void flush_all(cql_test_env& e) {
+    e.db().invoke_on_all([] (database& db) {
+        return db.flush_all_memtables();
+    }).get();
+}
+
+static std::vector<frozen_mutation> convert_rows(std::vector<frozen_mutation> rows, const schema_ptr& from, const schema_ptr& to) {
+    std::vector<frozen_mutation> result;
+    for (auto& fm : rows) {
+        auto m = fm.unfreeze(from);
+        result.push_back(freeze(mutation(to, m.decorated_key(), std::move(m.partition()))));
+    }
+    return result;
+}
+
+// A neighbor whose replica of the repaired table is another table of this
+// node, with the same definition.
+class local_repair_neighbor : public row_level_repair_neighbor {
+    row_level_repair_session& _session;
+    schema_ptr _master_schema;
+public:
+    local_repair_neighbor(row_level_repair_session& session, schema_ptr master_schema)
+        : _session(session)
+        , _master_schema(std::move(master_schema))
+    { }
+    virtual future<stdx::optional<repair_position>, repair_hash> fill(const stdx::optional<repair_position>& bound) override {
+        return _session.fill(bound).then([this] (stdx::optional<repair_position> reached) {
+            return make_ready_future<stdx::optional<repair_position>, repair_hash>(std::move(reached), _session.round_hash());
+        });
+    }
+    virtual future<repair_hash> set_bound(const stdx::optional<repair_position>& bound) override {
+        return make_ready_future<repair_hash>(_session.set_bound(bound));
+    }
+    virtual future<std::vector<repair_hash>> round_hashes() override {
+        return make_ready_future<std::vector<repair_hash>>(_session.round_hashes());
+    }
+    virtual future<std::vector<frozen_mutation>> get_rows(std::vector<repair_hash> hashes) override {
+        return make_ready_future<std::vector<frozen_mutation>>(convert_rows(_session.get_rows(hashes), _session.schema(), _master_schema));
+    }
+    virtual future<> put_rows(std::vector<frozen_mutation> rows) override {
+        return _session.put_rows(convert_rows(std::move(rows), _master_schema, _session.schema()));
+    }
+};
+
+SEASTAR_TEST_CASE(test_row_level_repair_session) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table cf (p int, c int, s int static, v int, primary key (p, c));").get();
+        // Partition 1 has a static row and two clustering rows, partition 2
+        // has two clustering rows, partition 3 only a partition tombstone.
+        e.execute_cql("insert into cf (p, s) values (1, 0);").get();
+        e.execute_cql("insert into cf (p, c, v) values (1, 1, 1);").get();
+        e.execute_cql("insert into cf (p, c, v) values (1, 2, 2);").get();
+        e.execute_cql("insert into cf (p, c, v) values (2, 1, 1);").get();
+        e.execute_cql("insert into cf (p, c, v) values (2, 2, 2);").get();
+        e.execute_cql("delete from cf where p = 3;").get();
+        flush_all(e);
+
+        auto s = e.local_db().find_schema("ks", "cf");
+        std::map<int32_t, size_t> rows_in_partition = {{1, 3}, {2, 2}, {3, 1}};
+        std::vector<dht::decorated_key> keys;
+        for (auto& x : rows_in_partition) {
+            keys.push_back(dht::global_partitioner().decorate_key(*s, partition_key::from_single_value(*s, int32_type->decompose(x.first))));
+        }
+        boost::sort(keys, dht::decorated_key::less_comparator(s));
+        auto rows_of = [&] (const dht::decorated_key& dk) {
+            return rows_in_partition.at(value_cast<int32_t>(int32_type->deserialize(dk.key().explode(*s)[0])));
+        };
+
+        {
+            row_level_repair_session session(e.db(), "ks", "cf", full_range());
+            auto reached = session.fill(stdx::nullopt).get0();
+            BOOST_REQUIRE(!reached);
+            auto hashes = session.round_hashes();
+            BOOST_REQUIRE_EQUAL(hashes.size(), 6);
+            BOOST_REQUIRE_EQUAL(session.round_hash(), boost::accumulate(hashes, repair_hash(0)));
+
+            // Shrinking the round to the first partition gives back the other rows.
+            auto bound = stdx::make_optional(repair_position{keys[0], position_in_partition::after_all_clustered_rows()});
+            auto first_hash = session.set_bound(bound);
+            auto first_hashes = session.round_hashes();
+            BOOST_REQUIRE_EQUAL(first_hashes.size(), rows_of(keys[0]));
+            BOOST_REQUIRE_EQUAL(first_hash, boost::accumulate(first_hashes, repair_hash(0)));
+            for (auto& fm : session.get_rows(first_hashes)) {
+                BOOST_REQUIRE(fm.decorated_key(*s).equal(*s, keys[0]));
+            }
+            BOOST_REQUIRE_THROW(session.get_rows({hashes.back() + 1}), repair_exception);
+
+            // The next round starts after the bound.
+            reached = session.fill(bound).get0();
+            BOOST_REQUIRE(reached);
+            BOOST_REQUIRE_EQUAL(session.round_hashes().size(), 0);
+            reached = session.fill(stdx::nullopt).get0();
+            BOOST_REQUIRE(!reached);
+            auto rest = session.round_hashes();
+            BOOST_REQUIRE_EQUAL(rest.size(), 6 - rows_of(keys[0]));
+            BOOST_REQUIRE_EQUAL(first_hash + session.round_hash(), boost::accumulate(hashes, repair_hash(0)));
+            session.stop().get();
+        }
+
+        // Received rows are written when the session stops.
+        {
+            row_level_repair_session session(e.db(), "ks", "cf", full_range());
+            mutation m(partition_key::from_single_value(*s, int32_type->decompose(4)), s);
+            m.set_clustered_cell(clustering_key::from_single_value(*s, int32_type->decompose(1)), *s->get_column_definition("v"),
+                    atomic_cell::make_live(api::new_timestamp(), int32_type->decompose(4)));
+            session.put_rows({freeze(m)}).get();
+            assert_that(e.execute_cql("select v from cf where p = 4;").get0()).is_rows().is_empty();
+            session.stop().get();
+        }
+        assert_that(e.execute_cql("select v from cf where p = 4;").get0()).is_rows().with_rows({
+            {int32_type->decompose(4)},
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_repair_round_converges) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        for (auto cf : {"a", "b"}) {
+            e.execute_cql(sprint("create table %s (p int, c int, v int, primary key (p, c));", cf)).get();
+            // Rows both replicas agree on.
+            for (int p = 0; p < 10; ++p) {
+                e.execute_cql(sprint("insert into %s (p, c, v) values (%d, 0, 0) using timestamp 1;", cf, p)).get();
+            }
+        }
+        // Rows only one replica has, and a row both have with different values.
+        e.execute_cql("insert into a (p, c, v) values (1, 1, 1) using timestamp 1;").get();
+        e.execute_cql("insert into a (p, c, v) values (11, 0, 11) using timestamp 1;").get();
+        e.execute_cql("insert into b (p, c, v) values (2, 1, 2) using timestamp 1;").get();
+        e.execute_cql("delete from b where p = 3 and c = 0;").get();
+        e.execute_cql("insert into a (p, c, v) values (4, 0, 4) using timestamp 2;").get();
+        e.execute_cql("insert into b (p, c, v) values (4, 0, 5) using timestamp 3;").get();
+        flush_all(e);
+
+        row_level_repair_session master(e.db(), "ks", "a", full_range());
+        row_level_repair_session replica(e.db(), "ks", "b", full_range());
+        local_repair_neighbor neighbor(replica, master.schema());
+        while (repair_round(master, {&neighbor})) { }
+        master.stop().get();
+        replica.stop().get();
+
+        auto i = [] (int32_t v) -> bytes_opt { return int32_type->decompose(v); };
+        for (auto cf : {"a", "b"}) {
+            assert_that(e.execute_cql(sprint("select p, c, v from %s;", cf)).get0()).is_rows().with_rows_ignore_order({
+                {i(0), i(0), i(0)},
+                {i(1), i(0), i(0)},
+                {i(1), i(1), i(1)},
+                {i(2), i(0), i(0)},
+                {i(2), i(1), i(2)},
+                {i(4), i(0), i(5)},
+                {i(5), i(0), i(0)},
+                {i(6), i(0), i(0)},
+                {i(7), i(0), i(0)},
+                {i(8), i(0), i(0)},
+                {i(9), i(0), i(0)},
+                {i(11), i(0), i(11)},
+            });
+        }
+
+        // Once converged, a repair finds nothing to transfer.
+        row_level_repair_session master2(e.db(), "ks", "a", full_range());
+        row_level_repair_session replica2(e.db(), "ks", "b", full_range());
+        local_repair_neighbor neighbor2(replica2, master2.schema());
+        master2.fill(stdx::nullopt).get();
+        BOOST_REQUIRE_EQUAL(master2.round_hash(), std::get<1>(neighbor2.fill(stdx::nullopt).get()));
+        master2.stop().get();
+        replica2.stop().get();
+    });
+}
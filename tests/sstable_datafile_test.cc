@@ -57,6 +57,7 @@
 #include <ftw.h>
 #include <unistd.h>
 #include <boost/range/algorithm/find_if.hpp>
+#include <boost/range/algorithm/sort.hpp>
 #include <boost/algorithm/cxx11/all_of.hpp>
 #include <boost/algorithm/cxx11/is_sorted.hpp>
 #include "test_services.hh"
@@ -891,11 +892,11 @@ SEASTAR_TEST_CASE(datafile_generation_12) {
     });
 }
 
-static future<> sstable_compression_test(compressor c, unsigned generation) {
-    return test_setup::do_with_test_directory([c, generation] {
+static future<> sstable_compression_test(compression_parameters cp, unsigned generation) {
+    return test_setup::do_with_test_directory([cp, generation] {
         // NOTE: set a given compressor algorithm to schema.
         schema_builder builder(complex_schema());
-        builder.set_compressor_params(c);
+        builder.set_compressor_params(cp);
         auto s = builder.build(schema_builder::compact_storage::no);
 
         auto mtp = make_lw_shared<memtable>(s);
@@ -939,6 +940,18 @@ SEASTAR_TEST_CASE(datafile_generation_15) {
     return sstable_compression_test(compressor::deflate, 15);
 }
 
+SEASTAR_TEST_CASE(datafile_generation_zstd) {
+    return sstable_compression_test(compressor::zstd, 57);
+}
+
+SEASTAR_TEST_CASE(datafile_generation_zstd_dictionary) {
+    return sstable_compression_test(compression_parameters({
+        {compression_parameters::SSTABLE_COMPRESSION, "ZstdCompressor"},
+        {compression_parameters::COMPRESSION_LEVEL, "5"},
+        {compression_parameters::DICTIONARY_SIZE_KB, "4"},
+    }), 58);
+}
+
 SEASTAR_TEST_CASE(datafile_generation_16) {
     return test_setup::do_with_test_directory([] {
         auto s = uncompressed_schema();
@@ -4395,3 +4408,304 @@ SEASTAR_TEST_CASE(test_old_format_non_compound_range_tombstone_is_read) {
         }
     });
 }
+
+SEASTAR_TEST_CASE(test_lazy_filter_loading) {
+    return seastar::async([] {
+        auto s = schema_builder("tests", "lazy_filter")
+                .with_column("pk", int32_type, column_kind::partition_key)
+                .with_column("v", int32_type)
+                .build();
+        auto tmp = make_lw_shared<tmpdir>();
+
+        std::vector<mutation> muts;
+        for (int i = 0; i < 100; i++) {
+            auto pk = partition_key::from_exploded(*s, { int32_type->decompose(i) });
+            mutation m(pk, s);
+            m.set_clustered_cell(clustering_key::make_empty(), *s->get_column_definition("v"),
+                atomic_cell::make_live(1, int32_type->decompose(i)));
+            muts.push_back(std::move(m));
+        }
+        make_sstable_containing([s, tmp] { return make_sstable(s, tmp->path, 1, la, big); }, muts);
+
+        auto sst = make_sstable(s, tmp->path, 1, la, big);
+        sst->load(default_priority_class(), true).get();
+        BOOST_REQUIRE_EQUAL(sst->filter_memory_size(), 0);
+
+        // Until the filter is loaded every key is considered present
+        auto absent = partition_key::from_exploded(*s, { int32_type->decompose(1000) });
+        BOOST_REQUIRE(sst->filter_has_key(*s, absent));
+
+        // The check above started loading the filter in the background
+        BOOST_REQUIRE_EQUAL(sst->filter_memory_size(), 0);
+        await_background_jobs().get();
+        BOOST_REQUIRE_GT(sst->filter_memory_size(), 0);
+        BOOST_REQUIRE(!sst->filter_has_key(*s, absent));
+        for (auto& m : muts) {
+            BOOST_REQUIRE(sst->filter_has_key(*s, m.key()));
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(incremental_compaction_test) {
+    BOOST_REQUIRE(smp::count == 1);
+    return seastar::async([] {
+        storage_service_for_tests ssft;
+        cell_locker_stats cl_stats;
+
+        auto s = schema_builder("tests", "incremental_compaction")
+                .with_column("id", utf8_type, column_kind::partition_key)
+                .with_column("value", int32_type)
+                .build();
+        auto tmp = make_lw_shared<tmpdir>();
+        auto sst_gen = [s, tmp, gen = make_lw_shared<unsigned>(1)] () mutable {
+            return make_sstable(s, tmp->path, (*gen)++, la, big);
+        };
+
+        std::vector<mutation> muts;
+        for (auto i = 0; i < 40; i++) {
+            mutation m(partition_key::from_single_value(*s, to_bytes(sprint("key%d", i))), s);
+            m.set_clustered_cell(clustering_key::make_empty(), *s->get_column_definition("value"),
+                atomic_cell::make_live(1, int32_type->decompose(i)));
+            muts.push_back(std::move(m));
+        }
+        boost::sort(muts, mutation_decorated_key_less_comparator());
+
+        // Inputs cover disjoint ranges, so each can be released as soon as
+        // the output covering its last key is sealed.
+        std::vector<shared_sstable> inputs;
+        for (auto i = 0; i < 4; i++) {
+            inputs.push_back(make_sstable_containing(sst_gen, std::vector<mutation>(muts.begin() + i * 10, muts.begin() + (i + 1) * 10)));
+        }
+
+        auto cm = make_lw_shared<compaction_manager>();
+        auto cf = make_lw_shared<column_family>(s, column_family::config(), column_family::no_commitlog(), *cm, cl_stats);
+        cf->mark_ready_for_writes();
+        for (auto&& sst : inputs) {
+            column_family_test(cf).add_sstable(sst);
+        }
+
+        std::vector<shared_sstable> replaced;
+        std::vector<shared_sstable> sealed;
+        unsigned replacements = 0;
+        auto replacer = [&] (std::vector<shared_sstable> exhausted, std::vector<shared_sstable> new_sealed) {
+            replacements++;
+            sealed.insert(sealed.end(), new_sealed.begin(), new_sealed.end());
+            BOOST_REQUIRE(!sealed.empty());
+            auto& sealed_up_to = sealed.back()->get_last_decorated_key();
+            for (auto& sst : exhausted) {
+                BOOST_REQUIRE(sst->get_last_decorated_key().tri_compare(*s, sealed_up_to) <= 0);
+                replaced.push_back(sst);
+            }
+        };
+
+        // Cut the output after every partition
+        auto info = sstables::compact_sstables(inputs, *cf, sst_gen, 1, 0, false, nullptr, replacer).get0();
+
+        BOOST_REQUIRE_EQUAL(replacements, 4);
+        BOOST_REQUIRE(boost::copy_range<std::set<shared_sstable>>(replaced) == boost::copy_range<std::set<shared_sstable>>(inputs));
+        BOOST_REQUIRE(boost::copy_range<std::set<shared_sstable>>(sealed) == boost::copy_range<std::set<shared_sstable>>(info.new_sstables));
+        BOOST_REQUIRE_EQUAL(sealed.size(), muts.size());
+
+        std::vector<flat_mutation_reader> readers;
+        for (auto& sst : sealed) {
+            readers.push_back(sst->read_range_rows_flat(s, query::full_partition_range));
+        }
+        auto rd = assert_that(make_combined_reader(s, std::move(readers), streamed_mutation::forwarding::no, mutation_reader::forwarding::no));
+        for (auto& m : muts) {
+            rd.produces(m);
+        }
+        rd.produces_end_of_stream();
+    });
+}
+
+SEASTAR_TEST_CASE(incremental_compaction_purge_test) {
+    BOOST_REQUIRE(smp::count == 1);
+    return seastar::async([] {
+        storage_service_for_tests ssft;
+        cell_locker_stats cl_stats;
+
+        auto builder = schema_builder("tests", "incremental_compaction_purge")
+                .with_column("id", utf8_type, column_kind::partition_key)
+                .with_column("value", int32_type);
+        builder.set_gc_grace_seconds(0);
+        builder.set_compaction_strategy(sstables::compaction_strategy_type::leveled);
+        builder.set_compaction_strategy_options({{"incremental_compaction", "true"}, {"incremental_fragment_size_in_mb", "1"}});
+        auto s = builder.build();
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto sst_gen = [s, tmp, gen = make_lw_shared<unsigned>(1)] () mutable {
+            return make_sstable(s, tmp->path, (*gen)++, la, big);
+        };
+
+        auto cm = make_lw_shared<compaction_manager>();
+        column_family::config cfg;
+        cfg.datadir = tmp->path;
+        cfg.enable_commitlog = false;
+        cfg.enable_incremental_backups = false;
+        auto cf = make_lw_shared<column_family>(s, cfg, column_family::no_commitlog(), *cm, cl_stats);
+        cf->start();
+        cf->mark_ready_for_writes();
+
+        auto make_insert = [&] (sstring key, api::timestamp_type ts) {
+            mutation m(partition_key::from_single_value(*s, to_bytes(key)), s);
+            m.set_clustered_cell(clustering_key::make_empty(), bytes("value"), data_value(int32_t(1)), ts);
+            return m;
+        };
+
+        // The tombstone for "alpha" shadows data in another input, so it
+        // can be purged only as long as both inputs are released together.
+        auto alpha = make_insert("alpha", 1);
+        mutation alpha_delete(alpha.decorated_key(), s);
+        alpha_delete.partition().apply(tombstone(2, gc_clock::now() - std::chrono::hours(1)));
+
+        std::vector<shared_sstable> inputs = {
+            make_sstable_containing(sst_gen, {alpha}),
+            make_sstable_containing(sst_gen, {alpha_delete, make_insert("beta", 3), make_insert("gamma", 4)}),
+        };
+        for (auto&& sst : inputs) {
+            column_family_test(cf).add_sstable(sst);
+        }
+        // Make the generations of compaction outputs not collide with the inputs'.
+        column_family_test::update_sstables_known_generation(*cf, 10);
+
+        cf->compact_sstables(sstables::compaction_descriptor(inputs)).get();
+
+        auto sstables = cf->get_sstables();
+        BOOST_REQUIRE(!sstables->empty());
+        std::vector<flat_mutation_reader> readers;
+        for (auto& sst : *sstables) {
+            BOOST_REQUIRE(boost::find(inputs, sst) == inputs.end());
+            readers.push_back(sst->read_range_rows_flat(s, query::full_partition_range));
+        }
+        std::vector<mutation> expected = {make_insert("beta", 3), make_insert("gamma", 4)};
+        boost::sort(expected, mutation_decorated_key_less_comparator());
+        auto rd = assert_that(make_combined_reader(s, std::move(readers), streamed_mutation::forwarding::no, mutation_reader::forwarding::no));
+        for (auto& m : expected) {
+            rd.produces(m);
+        }
+        rd.produces_end_of_stream();
+    });
+}
+
+SEASTAR_TEST_CASE(compaction_backlog_test) {
+    return seastar::async([] {
+        auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
+            {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
+        compaction_manager cm;
+        column_family::config cfg;
+        cell_locker_stats cl_stats;
+        auto cf = make_lw_shared<column_family>(s, cfg, column_family::no_commitlog(), cm, cl_stats);
+        cf->mark_ready_for_writes();
+
+        auto key_and_token_pair = token_generation_for_current_shard(1);
+        auto key = key_and_token_pair[0].first;
+        uint64_t mb = 1024 * 1024;
+        auto make_sstables = [&] (int64_t first_gen, unsigned count, uint32_t level) {
+            std::vector<shared_sstable> ssts;
+            for (auto gen = first_gen; gen < first_gen + count; gen++) {
+                auto sst = make_sstable(s, "", gen, la, big);
+                sstables::test(sst).set_values_for_leveled_strategy(mb, level, 0, key, key);
+                ssts.push_back(std::move(sst));
+            }
+            return ssts;
+        };
+        auto add = [] (sstables::compaction_strategy& cs, const std::vector<shared_sstable>& ssts) {
+            for (auto& sst : ssts) {
+                cs.get_backlog_tracker().add_sstable(sst);
+            }
+        };
+        auto remove = [] (sstables::compaction_strategy& cs, const std::vector<shared_sstable>& ssts) {
+            for (auto& sst : ssts) {
+                cs.get_backlog_tracker().remove_sstable(sst);
+            }
+        };
+
+        auto stcs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, s->compaction_strategy_options());
+        auto lcs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::leveled, {{"sstable_size_in_mb", "1"}});
+        auto ncs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::null, {});
+        auto l0 = make_sstables(1, 4, 0);
+        auto l1 = make_sstables(5, 11, 1);
+
+        add(stcs, {l0[0]});
+        BOOST_REQUIRE_EQUAL(stcs.compaction_backlog(*cf), 0u);
+
+        // One tier of min_threshold sstables, each byte is rewritten once.
+        BOOST_REQUIRE_EQUAL(s->min_compaction_threshold(), 4);
+        add(stcs, {l0[1], l0[2], l0[3]});
+        BOOST_REQUIRE_EQUAL(stcs.compaction_backlog(*cf), 4 * mb);
+        add(ncs, l0);
+        BOOST_REQUIRE_EQUAL(ncs.compaction_backlog(*cf), 0u);
+
+        // All of L0 goes to L1, and the megabyte L1 is over its limit of 10MB
+        // is merged with ten times as many bytes of L2.
+        add(lcs, l0);
+        BOOST_REQUIRE_EQUAL(lcs.compaction_backlog(*cf), 4 * mb);
+        add(lcs, l1);
+        BOOST_REQUIRE_EQUAL(lcs.compaction_backlog(*cf), 4 * mb + 11 * mb);
+
+        // Removed sstables take their backlog with them.
+        remove(lcs, l1);
+        BOOST_REQUIRE_EQUAL(lcs.compaction_backlog(*cf), 4 * mb);
+        remove(stcs, {l0[1], l0[2], l0[3]});
+        BOOST_REQUIRE_EQUAL(stcs.compaction_backlog(*cf), 0u);
+
+        // The table keeps the backlog of its strategy up to date, across
+        // strategy changes too.
+        for (auto& sst : l0) {
+            column_family_test(cf).add_sstable(sst);
+        }
+        BOOST_REQUIRE_EQUAL(cf->compaction_backlog(), 4 * mb);
+        cf->set_compaction_strategy(sstables::compaction_strategy_type::leveled);
+        BOOST_REQUIRE_EQUAL(cf->compaction_backlog(), 4 * mb);
+        cf->set_compaction_strategy(sstables::compaction_strategy_type::null);
+        BOOST_REQUIRE_EQUAL(cf->compaction_backlog(), 0u);
+    });
+}
+
+SEASTAR_TEST_CASE(compaction_quota_test) {
+    return seastar::async([] {
+        auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
+            {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
+        compaction_manager cm;
+        column_family::config cfg;
+        cell_locker_stats cl_stats;
+        auto cf = make_lw_shared<column_family>(s, cfg, column_family::no_commitlog(), cm, cl_stats);
+        cf->mark_ready_for_writes();
+
+        auto key_and_token_pair = token_generation_for_current_shard(1);
+        auto key = key_and_token_pair[0].first;
+        uint64_t mb = 1024 * 1024;
+        BOOST_REQUIRE_EQUAL(s->min_compaction_threshold(), 4);
+
+        // Size-tiered sstables in steady state: one tier of each size has
+        // one sstable less than it takes to compact it.
+        auto quota_for_tiers = [&] (uint64_t unit) {
+            auto stcs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, s->compaction_strategy_options());
+            uint64_t total = 0;
+            int64_t gen = 1;
+            for (auto size : { unit, 4 * unit, 16 * unit }) {
+                for (auto i = 0; i < 3; i++) {
+                    auto sst = make_sstable(s, "", gen++, la, big);
+                    sstables::test(sst).set_values_for_leveled_strategy(size, 0, 0, key, key);
+                    stcs.get_backlog_tracker().add_sstable(sst);
+                    total += size;
+                }
+            }
+            auto sst = make_sstable(s, "", gen++, la, big);
+            sstables::test(sst).set_values_for_leveled_strategy(64 * unit, 0, 0, key, key);
+            stcs.get_backlog_tracker().add_sstable(sst);
+            total += 64 * unit;
+            return compaction_cpu_controller::quota(float(stcs.compaction_backlog(*cf)) / total);
+        };
+
+        // The quota stays well below its maximum, however large the
+        // sstables are.
+        auto quota = quota_for_tiers(mb);
+        BOOST_REQUIRE_GT(quota, 0.1f);
+        BOOST_REQUIRE_LT(quota, 0.5f);
+        BOOST_REQUIRE_CLOSE(quota_for_tiers(1024 * mb), quota, 0.1);
+
+        // A pile of uncompacted sstables of the same size is another matter.
+        BOOST_REQUIRE_EQUAL(compaction_cpu_controller::quota(3), 1.0f);
+    });
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/range/algorithm/copy.hpp>
+#include <boost/range/algorithm/sort.hpp>
+
+#include "database.hh"
+#include "sstables/sstables.hh"
+#include "streaming/stream_session.hh"
+#include "streaming/stream_transfer_task.hh"
+#include "utils/fb_utilities.hh"
+
+#include "tests/test-utils.hh"
+#include "tests/cql_test_env.hh"
+#include "tests/cql_assertions.hh"
+
+#include "core/sleep.hh"
+
+template<typename EventuallySucceedingFunction>
+static void eventually(EventuallySucceedingFunction&& f) {
+    constexpr unsigned max_attempts = 10;
+    unsigned attempts = 0;
+    while (true) {
+        try {
+            f();
+            break;
+        } catch (...) {
+            if (++attempts < max_attempts) {
+                sleep(std::chrono::milliseconds(1 << attempts)).get0();
+            } else {
+                throw;
+            }
+        }
+    }
+}
+
+static void flush_all(cql_test_env& e) {
+    e.db().invoke_on_all([] (database& db) {
+        return db.flush_all_memtables();
+    }).get();
+}
+
+static size_t files_in(const sstring& dir) {
+    namespace fs = boost::filesystem;
+    return std::count_if(fs::directory_iterator(dir.c_str()), fs::directory_iterator(), [] (const fs::directory_entry& e) {
+        return fs::is_regular_file(e.status());
+    });
+}
+
+// Sends all sstables of ks.from, on all shards, as whole files to the
+// session, which lives on this shard, as if they were streamed to ks.to.
+// Small chunks make sure components span several of them.
+static std::vector<utils::UUID> send_sstables(cql_test_env& e, streaming::stream_session& session, sstring from, utils::UUID to_id) {
+    constexpr size_t chunk_size = 1024;
+    auto shard = engine().cpu_id();
+    std::vector<utils::UUID> sent;
+    for (unsigned sender = 0; sender < smp::count; ++sender) {
+        auto ids = e.db().invoke_on(sender, [&session, from, to_id, shard] (database& db) {
+            auto sstables = boost::copy_range<std::vector<sstables::shared_sstable>>(*db.find_column_family("ks", from).get_sstables());
+            return do_with(std::move(sstables), std::vector<utils::UUID>(), [&session, to_id, shard] (auto& sstables, auto& ids) {
+                return do_for_each(sstables, [&session, to_id, shard, &ids] (sstables::shared_sstable sst) {
+                    auto sstable_id = utils::make_random_uuid();
+                    ids.push_back(sstable_id);
+                    return streaming::for_each_sstable_chunk(sst, chunk_size, [&session, to_id, shard, sstable_id] (sstring file_name, bytes data, bool last) {
+                        return smp::submit_to(shard, [&session, to_id, sstable_id, file_name = std::move(file_name), data = std::move(data), last] () mutable {
+                            return session.receive_sstable_component(to_id, sstable_id, std::move(file_name), std::move(data), last);
+                        });
+                    });
+                }).then([&ids] {
+                    return std::move(ids);
+                });
+            });
+        }).get0();
+        boost::copy(ids, std::back_inserter(sent));
+    }
+    return sent;
+}
+
+SEASTAR_TEST_CASE(test_whole_sstables_are_received_and_loaded) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table a (p int, c int, v text, primary key (p, c));").get();
+        e.execute_cql("create table b (p int, c int, v text, primary key (p, c));").get();
+        for (int p = 0; p < 100; ++p) {
+            for (int c = 0; c < 10; ++c) {
+                e.execute_cql(sprint("insert into a (p, c, v) values (%d, %d, '%s');", p, c, sstring(100, 'a' + c))).get();
+            }
+        }
+        flush_all(e);
+        auto& b = e.local_db().find_column_family("ks", "b");
+        auto b_id = b.schema()->id();
+
+        auto session = make_shared<streaming::stream_session>(utils::fb_utilities::get_broadcast_address());
+        auto ids = send_sstables(e, *session, "a", b_id);
+        BOOST_REQUIRE(!ids.empty());
+
+        // Nothing is visible until the sstables are sealed and loaded.
+        assert_that(e.execute_cql("select count(*) from b;").get0()).is_rows().with_rows({
+            {long_type->decompose(int64_t(0))},
+        });
+        for (auto& id : ids) {
+            session->seal_received_sstable(id).get();
+        }
+        BOOST_REQUIRE_THROW(session->seal_received_sstable(utils::make_random_uuid()).get(), std::runtime_error);
+        session->load_received_sstables(b_id).get();
+
+        auto rows_of = [&e] (sstring cf) {
+            auto msg = e.execute_cql(sprint("select p, c, v from %s;", cf)).get0();
+            auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+            BOOST_REQUIRE(rows);
+            auto result = boost::copy_range<std::vector<std::vector<bytes_opt>>>(rows->rs().rows());
+            boost::sort(result);
+            return result;
+        };
+        auto expected = rows_of("a");
+        BOOST_REQUIRE_EQUAL(expected.size(), 1000);
+        BOOST_REQUIRE(rows_of("b") == expected);
+    });
+}
+
+SEASTAR_TEST_CASE(test_aborted_session_removes_received_files) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table b (p int, c int, v text, primary key (p, c));").get();
+        auto& b = e.local_db().find_column_family("ks", "b");
+        auto b_id = b.schema()->id();
+        auto session = make_shared<streaming::stream_session>(utils::fb_utilities::get_broadcast_address());
+
+        // A TOC and part of a data file, for an sstable which is never sealed.
+        auto id = utils::make_random_uuid();
+        auto base = sstables::sstable::filename("", "ks", "b", sstables::sstable::version_types::la, 1,
+                sstables::sstable::format_types::big, sstables::sstable::component_type::TOC);
+        auto name_of = [] (sstring file_name) {
+            return file_name.substr(file_name.find_last_of('/') + 1);
+        };
+        auto data_name = sstables::sstable::filename("", "ks", "b", sstables::sstable::version_types::la, 1,
+                sstables::sstable::format_types::big, sstables::sstable::component_type::Data);
+        session->receive_sstable_component(b_id, id, name_of(base), to_bytes("Data.db\nTOC.txt\n"), true).get();
+        session->receive_sstable_component(b_id, id, name_of(data_name), bytes(1024, int8_t(0)), false).get();
+        BOOST_REQUIRE_EQUAL(files_in(b.dir()), 2);
+
+        // The session fails, as when the peer tells us so.
+        session->received_failed_complete_message();
+        BOOST_REQUIRE_THROW(session->receive_sstable_component(b_id, id, name_of(data_name), bytes(1024, int8_t(0)), true).get(), std::runtime_error);
+        eventually([&b] {
+            BOOST_REQUIRE_EQUAL(files_in(b.dir()), 0);
+        });
+        assert_that(e.execute_cql("select * from b;").get0()).is_rows().is_empty();
+    });
+}
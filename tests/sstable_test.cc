@@ -21,6 +21,7 @@
 
 
 #include <boost/test/unit_test.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
 
 #include "core/sstring.hh"
 #include "core/future-util.hh"
@@ -1253,6 +1254,82 @@ SEASTAR_TEST_CASE(promoted_index_write) {
     });
 }
 
+SEASTAR_TEST_CASE(test_zstd_dictionary_compressed_stream) {
+    return seastar::async([] {
+        tmpdir tmp;
+        auto file_path = tmp.path + "/test";
+        file f = open_file_dma(file_path, open_flags::create | open_flags::wo).get0();
+
+        sstables::compression c;
+        c.set_compressor(compression_parameters({
+            {compression_parameters::SSTABLE_COMPRESSION, "ZstdCompressor"},
+            {compression_parameters::DICTIONARY_SIZE_KB, "4"},
+        }));
+        c.set_uncompressed_chunk_length(4096);
+        c.init_full_checksum();
+        BOOST_REQUIRE_EQUAL(c.pending_dictionary_size(), 4096);
+
+        // Many similar rows, which is what dictionaries are good at.
+        sstring data;
+        for (int i = 0; data.size() < 512 * 1024; i++) {
+            data += sprint("row%d|user_%d@example.com|status=%s|", i, i * 7919 % 10007, i % 3 ? "active" : "inactive");
+        }
+
+        auto out = make_compressed_file_output_stream(f, file_output_stream_options(), &c);
+        out.write(data.c_str(), data.size()).get();
+        out.close().get();
+
+        BOOST_REQUIRE_EQUAL(c.pending_dictionary_size(), 0);
+        BOOST_REQUIRE(boost::algorithm::any_of(c.options.elements, [] (const sstables::option& opt) {
+            return opt.key.value == to_bytes(sstables::zstd_compression::DICTIONARY_OPTION) && !opt.value.value.empty();
+        }));
+
+        // update() sets the compressor up from the options, as when loading
+        // the "Compression Info" file.
+        c.update(f.size().get0());
+        f = open_file_dma(file_path, open_flags::ro).get0();
+        auto in = make_compressed_file_input_stream(f, &c, 0, data.size(), file_input_stream_options());
+        auto b = in.read_exactly(data.size()).get0();
+        BOOST_REQUIRE(sstring(b.get(), b.size()) == data);
+        BOOST_REQUIRE(in.read().get0().empty());
+    });
+}
+
+SEASTAR_TEST_CASE(test_zstd_invalid_compression_level) {
+    return seastar::async([] {
+        sstables::compression c;
+        c.set_compressor(compression_parameters({
+            {compression_parameters::SSTABLE_COMPRESSION, "ZstdCompressor"},
+        }));
+        for (auto&& opt : c.options.elements) {
+            if (opt.key.value == to_bytes(sstables::zstd_compression::LEVEL_OPTION)) {
+                opt.value.value = to_bytes("fast");
+            }
+        }
+        BOOST_REQUIRE_THROW(c.update(0), malformed_sstable_exception);
+    });
+}
+
+SEASTAR_TEST_CASE(test_zstd_dictionary_training_is_bounded) {
+    return seastar::async([] {
+        sstring data;
+        for (int i = 0; data.size() < 1024 * 1024; i++) {
+            data += sprint("row%d|user_%d@example.com|status=%s|", i, i * 7919 % 10007, i % 3 ? "active" : "inactive");
+        }
+        // A single big chunk is cut into samples, of which only the first
+        // max_zstd_training_bytes are used.
+        std::vector<temporary_buffer<char>> samples;
+        samples.emplace_back(data.c_str(), data.size());
+        auto dictionary = sstables::train_zstd_dictionary(samples, 63 * 1024);
+        BOOST_REQUIRE(!dictionary.empty());
+        BOOST_REQUIRE_LE(dictionary.size(), sstables::max_zstd_training_bytes / 10);
+
+        samples.clear();
+        samples.emplace_back(data.c_str(), 1024);
+        BOOST_REQUIRE(sstables::train_zstd_dictionary(samples, 63 * 1024).empty());
+    });
+}
+
 SEASTAR_TEST_CASE(test_skipping_in_compressed_stream) {
     return seastar::async([] {
         tmpdir tmp;
@@ -1331,3 +1408,133 @@ SEASTAR_TEST_CASE(test_skipping_in_compressed_stream) {
         expect_eof(in);
     });
 }
+
+SEASTAR_TEST_CASE(test_key_cache) {
+    return seastar::async([] {
+        key_cache cache;
+        auto make_entry = [] (sstring key, uint64_t position, sstring promoted) {
+            return index_entry(temporary_buffer<char>(key.data(), key.size()), position,
+                temporary_buffer<char>(promoted.data(), promoted.size()));
+        };
+        auto key_of = [] (const sstring& key) {
+            return bytes_view(reinterpret_cast<const int8_t*>(key.data()), key.size());
+        };
+
+        // Disabled until given a capacity
+        cache.insert(1, make_entry("k1", 10, "pi"), 20);
+        BOOST_REQUIRE(!cache.find(1, key_of("k1")));
+        BOOST_REQUIRE_EQUAL(cache.entries(), 0);
+
+        cache.set_capacity(1 << 20);
+        cache.insert(1, make_entry("k1", 10, "pi"), 20);
+        cache.insert(1, make_entry("k2", 20, ""), stdx::nullopt);
+        cache.insert(2, make_entry("k1", 30, ""), 40);
+        BOOST_REQUIRE_EQUAL(cache.entries(), 3);
+
+        auto e = cache.find(1, key_of("k1"));
+        BOOST_REQUIRE(e);
+        BOOST_REQUIRE_EQUAL(e->entry.position(), 10);
+        BOOST_REQUIRE(e->entry.get_key_bytes() == key_of("k1"));
+        BOOST_REQUIRE(e->entry.get_promoted_index_bytes() == key_of("pi"));
+        BOOST_REQUIRE(e->next_position && *e->next_position == 20);
+
+        e = cache.find(1, key_of("k2"));
+        BOOST_REQUIRE(e);
+        BOOST_REQUIRE(!e->next_position);
+
+        BOOST_REQUIRE(!cache.find(1, key_of("k3")));
+        BOOST_REQUIRE_EQUAL(cache.get_stats().hits.count(), 2);
+        BOOST_REQUIRE_EQUAL(cache.get_stats().misses.count(), 1);
+
+        cache.invalidate(1);
+        BOOST_REQUIRE(!cache.find(1, key_of("k1")));
+        BOOST_REQUIRE(!cache.find(1, key_of("k2")));
+        e = cache.find(2, key_of("k1"));
+        BOOST_REQUIRE(e);
+        BOOST_REQUIRE_EQUAL(e->entry.position(), 30);
+
+        // Big promoted indexes are not cached
+        cache.insert(3, make_entry("k1", 0, sstring(key_cache::max_promoted_index_size + 1, 'x')), stdx::nullopt);
+        BOOST_REQUIRE(!cache.find(3, key_of("k1")));
+
+        // Shrinking capacity evicts least recently used entries
+        for (unsigned i = 0; i < 1000; ++i) {
+            cache.insert(4, make_entry(sprint("key%d", i), i, sstring(100, 'x')), stdx::nullopt);
+        }
+        cache.set_capacity(cache.region().occupancy().used_space() / 2);
+        BOOST_REQUIRE(cache.entries() < 1000);
+        BOOST_REQUIRE(cache.get_stats().evictions > 0);
+        BOOST_REQUIRE(cache.find(4, key_of("key999")));
+
+        cache.clear();
+        BOOST_REQUIRE_EQUAL(cache.entries(), 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_chunk_cache) {
+    return seastar::async([] {
+        tmpdir tmp;
+        auto file_path = tmp.path + "/test";
+        file f = open_file_dma(file_path, open_flags::create | open_flags::wo).get0();
+
+        sstables::compression c;
+        c.set_compressor(compressor::lz4);
+        c.set_uncompressed_chunk_length(4096);
+        c.init_full_checksum();
+
+        sstring data;
+        for (int i = 0; data.size() < 64 * 1024; i++) {
+            data += sprint("row%d|", i);
+        }
+        auto out = make_compressed_file_output_stream(f, file_output_stream_options(), &c);
+        out.write(data.c_str(), data.size()).get();
+        out.close().get();
+        c.update(f.size().get0());
+
+        auto& cache = global_chunk_cache();
+        auto old_capacity = cache.capacity();
+        cache.set_capacity(1 << 20);
+        auto id = new_sstable_cache_id();
+        auto read_from = [&] (file f, uint64_t pos, size_t len) {
+            auto in = make_compressed_file_input_stream(f, &c, pos, len, file_input_stream_options(), id);
+            auto b = in.read_exactly(len).get0();
+            in.close().get();
+            return sstring(b.get(), b.size());
+        };
+        auto read = [&] (uint64_t pos, size_t len) {
+            f = open_file_dma(file_path, open_flags::ro).get0();
+            auto result = read_from(f, pos, len);
+            f.close().get();
+            return result;
+        };
+
+        auto chunks = (data.size() + 4095) / 4096;
+        auto hits_before = cache.get_stats().hits.count();
+        auto misses_before = cache.get_stats().misses.count();
+        auto insertions_before = cache.get_stats().insertions;
+        BOOST_REQUIRE(read(0, data.size()) == data);
+        BOOST_REQUIRE_EQUAL(cache.get_stats().hits.count(), hits_before);
+        BOOST_REQUIRE_EQUAL(cache.get_stats().insertions - insertions_before, chunks);
+
+        // Reads starting mid-chunk are served from the cache
+        BOOST_REQUIRE(read(5000, 10000) == data.substr(5000, 10000));
+        BOOST_REQUIRE(read(0, data.size()) == data);
+        BOOST_REQUIRE_EQUAL(cache.get_stats().misses.count(), misses_before + chunks);
+
+        // Reads served from the cache don't touch the file, read-ahead included
+        f = open_file_dma(file_path, open_flags::ro).get0();
+        f.close().get();
+        BOOST_REQUIRE(read_from(f, 5000, 10000) == data.substr(5000, 10000));
+
+        auto cached = cache.find(id, c.locate(4096).chunk_start);
+        BOOST_REQUIRE(cached);
+        BOOST_REQUIRE(sstring(cached->get(), cached->size()) == data.substr(4096, 4096));
+
+        cache.invalidate(id);
+        BOOST_REQUIRE(!cache.find(id, c.locate(4096).chunk_start));
+        BOOST_REQUIRE(read(5000, 10000) == data.substr(5000, 10000));
+
+        cache.clear();
+        cache.set_capacity(old_capacity);
+    });
+}
@@ -41,7 +41,8 @@ class column_family_test {
     column_family_test(lw_shared_ptr<column_family> cf) : _cf(cf) {}
 
     void add_sstable(sstables::shared_sstable sstable) {
-        _cf->_sstables->insert(std::move(sstable));
+        _cf->_sstables->insert(sstable);
+        _cf->_compaction_strategy.get_backlog_tracker().add_sstable(std::move(sstable));
     }
 
     static void update_sstables_known_generation(column_family& cf, unsigned generation) {
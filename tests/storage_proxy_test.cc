@@ -20,7 +20,9 @@
  */
 
 
+#include <boost/algorithm/cxx11/none_of.hpp>
 #include <seastar/core/thread.hh>
+#include <seastar/core/sleep.hh>
 #include <seastar/tests/test-utils.hh>
 #include "query-result-writer.hh"
 
@@ -30,6 +32,9 @@
 #include "service/storage_proxy.hh"
 #include "partition_slice_builder.hh"
 #include "schema_builder.hh"
+#include "message/messaging_service.hh"
+#include "utils/fb_utilities.hh"
+#include "cql3/query_processor.hh"
 
 // Returns random keys sorted in ring order.
 // The schema must have a single bytes_type partition key column.
@@ -111,3 +116,115 @@ SEASTAR_TEST_CASE(test_get_restricted_ranges) {
         });
     });
 }
+
+SEASTAR_TEST_CASE(test_group_writes) {
+    using group = std::vector<gms::inet_address>;
+    gms::inet_address a("10.0.0.1"), b("10.0.0.2"), c("10.0.0.3"), d("10.0.0.4"), old("10.0.0.5");
+
+    // The local DC group of each write, then a remote DC one.
+    std::vector<std::pair<int, std::vector<group>>> writes = {
+        {1, {{a}, {c, d, b}}},
+        {2, {{a}, {d, c, b}}},
+        {3, {{a}, {old, b}}},
+        {4, {{c}}},
+    };
+    std::vector<std::pair<int, group>> single;
+    auto batches = service::group_writes(std::move(writes), [&] (int, const group& g) {
+        return boost::algorithm::none_of_equal(g, old);
+    }, [&] (int w, group g) {
+        single.emplace_back(w, std::move(g));
+    });
+
+    BOOST_REQUIRE_EQUAL(batches.size(), 3u);
+    BOOST_REQUIRE(batches.at({a}) == std::vector<int>({1, 2, 3}));
+    // The coordinator stays last, the replicas it forwards to are sorted.
+    BOOST_REQUIRE(batches.at({c, d, b}) == std::vector<int>({1, 2}));
+    BOOST_REQUIRE(batches.at({c}) == std::vector<int>({4}));
+    BOOST_REQUIRE_EQUAL(single.size(), 1u);
+    BOOST_REQUIRE_EQUAL(single[0].first, 3);
+    BOOST_REQUIRE(single[0].second == group({old, b}));
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_mutations_verbs) {
+    return do_with_cql_env([] (cql_test_env& e) {
+        return seastar::async([&e] {
+            auto& proxy = service::get_storage_proxy();
+            proxy.invoke_on_all(&service::storage_proxy::init_messaging_service).get();
+
+            e.execute_cql("create table cf (p text, c int, v int, primary key (p, c));").get();
+            auto s = e.local_db().find_schema("ks", "cf");
+            std::vector<lw_shared_ptr<const frozen_mutation>> fms;
+            for (auto key : {"a", "b", "c"}) {
+                mutation m(partition_key::from_single_value(*s, to_bytes(key)), s);
+                m.set_clustered_cell(clustering_key::from_single_value(*s, int32_type->decompose(1)), "v", data_value(int32_t(1)), api::new_timestamp());
+                fms.push_back(make_lw_shared<const frozen_mutation>(freeze(m)));
+            }
+
+            auto stat = [&proxy] (uint64_t service::storage_proxy::stats::* counter) {
+                return proxy.map_reduce0([counter] (service::storage_proxy& p) {
+                    return p.get_stats().*counter;
+                }, uint64_t(0), std::plus<uint64_t>()).get0();
+            };
+            auto received = stat(&service::storage_proxy::stats::received_mutations);
+            auto forwarded = stat(&service::storage_proxy::stats::forwarded_mutations);
+
+            // Forwards to this node too, so every mutation is received twice.
+            // Replies with MUTATIONS_DONE to this node for unknown response ids.
+            auto me = utils::fb_utilities::get_broadcast_address();
+            auto timeout = service::storage_proxy::clock_type::now() + std::chrono::seconds(10);
+            netw::get_local_messaging_service().send_mutations(netw::messaging_service::msg_addr{me, 0}, timeout, fms, {me}, me, engine().cpu_id(),
+                    {1000001, 1000002, 1000003}, stdx::nullopt).get();
+
+            for (auto i = 0; i < 1000 && stat(&service::storage_proxy::stats::received_mutations) < received + 2 * fms.size(); ++i) {
+                seastar::sleep(std::chrono::milliseconds(10)).get();
+            }
+            BOOST_REQUIRE_EQUAL(stat(&service::storage_proxy::stats::received_mutations), received + 2 * fms.size());
+            BOOST_REQUIRE_EQUAL(stat(&service::storage_proxy::stats::forwarded_mutations), forwarded + fms.size());
+            BOOST_REQUIRE_EQUAL(e.local_qp().execute_internal("select p from ks.cf;").get0()->size(), fms.size());
+
+            netw::get_local_messaging_service().send_mutations_done(netw::messaging_service::msg_addr{me, 0}, engine().cpu_id(),
+                    {1000001, 1000002, 1000003}).get();
+        });
+    });
+}
+
+static query::result make_range_result(uint32_t rows, size_t bytes_size) {
+    bytes_ostream w;
+    w.write(bytes(bytes_size, int8_t(0)));
+    return query::result(std::move(w), query::short_read::no, rows, rows);
+}
+
+SEASTAR_TEST_CASE(test_next_range_concurrency_factor) {
+    using clock_type = service::storage_proxy::clock_type;
+    auto next = [] (int concurrency_factor, size_t ranges_queried, const query::result& result, clock_type::duration latency,
+            clock_type::duration time_left, uint32_t remaining_row_count, size_t remaining_ranges) {
+        return service::storage_proxy::next_range_concurrency_factor(concurrency_factor, ranges_queried, result, latency,
+                clock_type::now() + time_left, remaining_row_count, remaining_ranges);
+    };
+    auto fast = std::chrono::milliseconds(1);
+    auto time_left = std::chrono::seconds(10);
+
+    // Empty ranges double the concurrency.
+    BOOST_REQUIRE_EQUAL(next(1, 1, make_range_result(0, 0), fast, time_left, 100, 100), 2);
+    BOOST_REQUIRE_EQUAL(next(8, 8, make_range_result(0, 0), fast, time_left, 100, 100), 16);
+
+    // 10 rows per range, underestimated to 9, for 90 remaining rows.
+    BOOST_REQUIRE_EQUAL(next(4, 4, make_range_result(40, 0), fast, time_left, 90, 100), 10);
+
+    // No more than the remaining ranges, and at least one.
+    BOOST_REQUIRE_EQUAL(next(4, 4, make_range_result(40, 0), fast, time_left, 90, 5), 5);
+    BOOST_REQUIRE_EQUAL(next(1, 1, make_range_result(1000, 0), fast, time_left, 1, 100), 1);
+
+    // The results of the next round must fit in the reader memory budget.
+    auto budget = database::max_memory_concurrent_reads();
+    BOOST_REQUIRE_EQUAL(next(2, 2, make_range_result(2, budget), fast, time_left, 1000, 100), 2);
+
+    // Slow replicas, or an expired timeout, keep the current concurrency.
+    BOOST_REQUIRE_EQUAL(next(3, 3, make_range_result(0, 0), std::chrono::seconds(5), time_left, 100, 100), 3);
+    BOOST_REQUIRE_EQUAL(next(3, 3, make_range_result(0, 0), fast, -std::chrono::seconds(1), 100, 100), 3);
+    // But they may still lower it.
+    BOOST_REQUIRE_EQUAL(next(8, 4, make_range_result(40, 0), std::chrono::seconds(5), time_left, 18, 100), 2);
+
+    return make_ready_future<>();
+}
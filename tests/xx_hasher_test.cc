@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+
+#include "utils/xx_hasher.hh"
+#include "bytes.hh"
+
+static uint64_t hash_of(const sstring& s) {
+    xx_hasher h;
+    h.update(s.data(), s.size());
+    return h.finalize_uint64();
+}
+
+BOOST_AUTO_TEST_CASE(test_reference_values) {
+    // Results of the reference XXH64 implementation with seed 0.
+    BOOST_REQUIRE_EQUAL(hash_of(""), 0xef46db3751d8e999ULL);
+    BOOST_REQUIRE_EQUAL(hash_of("a"), 0xd24ec4f1a98c6e5bULL);
+    BOOST_REQUIRE_EQUAL(hash_of("abc"), 0x44bc2cf5ad770999ULL);
+    BOOST_REQUIRE_EQUAL(hash_of("Nobody inspects the spammish repetition"), 0xfbcea83c8a378bf1ULL);
+}
+
+BOOST_AUTO_TEST_CASE(test_split_updates) {
+    sstring data(sstring::initialized_later(), 1000);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = char(i * 7);
+    }
+    auto expected = hash_of(data);
+
+    for (size_t chunk : {1, 3, 13, 31, 32, 33, 100}) {
+        xx_hasher h;
+        for (size_t pos = 0; pos < data.size(); pos += chunk) {
+            h.update(data.data() + pos, std::min(chunk, data.size() - pos));
+        }
+        BOOST_REQUIRE_EQUAL(h.finalize_uint64(), expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_finalize_array) {
+    xx_hasher h;
+    h.update("abc", 3);
+    auto digest = h.finalize_array();
+    std::array<uint8_t, 16> expected = {0x44, 0xbc, 0x2c, 0xf5, 0xad, 0x77, 0x09, 0x99, 0, 0, 0, 0, 0, 0, 0, 0};
+    BOOST_REQUIRE(digest == expected);
+}
@@ -568,6 +568,7 @@ cql_server::connection::connection(cql_server& server, ipv4_addr server_addr, co
     , _read_buf(_fd.input())
     , _write_buf(_fd.output())
     , _client_state(service::client_state::external_tag{}, server._auth_service, addr)
+    , _shard(engine().cpu_id())
 {
     ++_server._total_connections;
     ++_server._current_connections;
@@ -666,11 +667,15 @@ future<> cql_server::connection::process_request() {
             with_gate(_pending_requests_gate, [this, flags, op, stream, buf = std::move(buf), tracing_requested, mem_permit = std::move(mem_permit)] () mutable {
                 auto bv = bytes_view{reinterpret_cast<const int8_t*>(buf.begin()), buf.size()};
                 auto cpu = pick_request_cpu();
-                return smp::submit_to(cpu, [this, bv = std::move(bv), op, stream, client_state = _client_state, tracing_requested] () mutable {
+                auto process = [this, bv = std::move(bv), op, stream, client_state = _client_state, tracing_requested] () mutable {
                     return process_request_stage(this, bv, op, stream, std::move(client_state), tracing_requested).then([] (auto&& response) {
                         return std::make_pair(make_foreign(response.first), response.second);
                     });
-                }).then([this, flags] (auto&& response) {
+                };
+                // Shard-aware clients send requests to the connection of the shard which owns
+                // the data, so the common case doesn't need a cross-shard hop.
+                auto f = cpu == engine().cpu_id() ? process() : smp::submit_to(cpu, std::move(process));
+                return f.then([this, flags] (auto&& response) {
                     _client_state.merge(response.second);
                     return this->write_response(std::move(response.first), _compression);
                 }).then([buf = std::move(buf), mem_permit = std::move(mem_permit)] {
@@ -1134,6 +1139,16 @@ shared_ptr<cql_server::response> cql_server::connection::make_supported(int16_t
     opts.insert({"CQL_VERSION", cql3::query_processor::CQL_VERSION});
     opts.insert({"COMPRESSION", "lz4"});
     opts.insert({"COMPRESSION", "snappy"});
+    // Sharding information for shard-aware clients. See docs/protocol-extensions.md.
+    auto& partitioner = dht::global_partitioner();
+    opts.insert({"SCYLLA_SHARD", sprint("%d", _shard)});
+    opts.insert({"SCYLLA_NR_SHARDS", sprint("%d", smp::count)});
+    opts.insert({"SCYLLA_PARTITIONER", partitioner.name()});
+    auto sharding_algorithm = partitioner.sharding_algorithm_name();
+    if (!sharding_algorithm.empty()) {
+        opts.insert({"SCYLLA_SHARDING_ALGORITHM", sharding_algorithm});
+        opts.insert({"SCYLLA_SHARDING_IGNORE_MSB", sprint("%d", partitioner.sharding_ignore_msb())});
+    }
     auto response = make_shared<cql_server::response>(stream, cql_binary_opcode::SUPPORTED, tr_state);
     response->write_string_multimap(opts);
     return response;
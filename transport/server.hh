@@ -147,6 +147,8 @@ class cql_server {
         service::client_state _client_state;
         std::unordered_map<uint16_t, cql_query_state> _query_states;
         unsigned _request_cpu = 0;
+        // The shard which owns this connection, published to shard-aware clients.
+        const unsigned _shard;
 
         enum class state : uint8_t {
             UNINITIALIZED, AUTHENTICATION, READY
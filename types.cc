@@ -128,6 +128,22 @@ struct simple_type_traits<db_clock::time_point> {
     }
 };
 
+// Describes the memcomparable form of simple types, see abstract_type::is_memcomparable().
+//
+// The form of an empty value is a single 0 byte. The form of a non-empty value is a 1 byte
+// followed by the big-endian serialized value, with the sign bit flipped for signed types.
+template<typename T>
+struct memcomparable_traits {
+    static constexpr bool supported = std::is_integral<T>::value;
+    static constexpr bool flip_sign_bit = std::is_signed<T>::value;
+};
+
+template<>
+struct memcomparable_traits<db_clock::time_point> {
+    static constexpr bool supported = true;
+    static constexpr bool flip_sign_bit = true;
+};
+
 template <typename T>
 struct simple_type_impl : concrete_type<T> {
     simple_type_impl(sstring name) : concrete_type<T>(std::move(name)) {}
@@ -148,6 +164,25 @@ struct simple_type_impl : concrete_type<T> {
     virtual bool is_byte_order_equal() const override {
         return true;
     }
+    virtual bool is_memcomparable() const override {
+        return memcomparable_traits<T>::supported;
+    }
+    virtual size_t memcomparable_size(bytes_view v) const override {
+        return 1 + v.size();
+    }
+    virtual void write_memcomparable(bytes_view v, memcomparable_writer& out) const override {
+        if (v.empty()) {
+            out.write(0);
+            return;
+        }
+        out.write(1);
+        auto i = v.begin();
+        auto first = *i++;
+        out.write(memcomparable_traits<T>::flip_sign_bit ? int8_t(uint8_t(first) ^ 0x80) : first);
+        for (; i != v.end() && !out.full(); ++i) {
+            out.write(*i);
+        }
+    }
     virtual size_t hash(bytes_view v) const override {
         return std::hash<bytes_view>()(v);
     }
@@ -282,6 +317,26 @@ struct long_type_impl : integer_type_impl<int64_t> {
     }
 };
 
+// Memcomparable form of types compared with compare_unsigned(): the value with
+// 0 bytes escaped as { 0, 0xff }, terminated with { 0, 0 }.
+static size_t escaped_memcomparable_size(bytes_view v) {
+    return v.size() + std::count(v.begin(), v.end(), 0) + 2;
+}
+
+static void write_escaped_memcomparable(bytes_view v, memcomparable_writer& out) {
+    for (auto b : v) {
+        if (out.full()) {
+            return;
+        }
+        out.write(b);
+        if (b == 0) {
+            out.write(int8_t(0xff));
+        }
+    }
+    out.write(0);
+    out.write(0);
+}
+
 struct string_type_impl : public concrete_type<sstring> {
     string_type_impl(sstring name)
         : concrete_type(name) {}
@@ -312,6 +367,15 @@ struct string_type_impl : public concrete_type<sstring> {
     virtual bool is_byte_order_comparable() const override {
         return true;
     }
+    virtual bool is_memcomparable() const override {
+        return true;
+    }
+    virtual size_t memcomparable_size(bytes_view v) const override {
+        return escaped_memcomparable_size(v);
+    }
+    virtual void write_memcomparable(bytes_view v, memcomparable_writer& out) const override {
+        write_escaped_memcomparable(v, out);
+    }
     virtual size_t hash(bytes_view v) const override {
         return std::hash<bytes_view>()(v);
     }
@@ -385,6 +449,15 @@ struct bytes_type_impl final : public concrete_type<bytes> {
     virtual bool is_byte_order_comparable() const override {
         return true;
     }
+    virtual bool is_memcomparable() const override {
+        return true;
+    }
+    virtual size_t memcomparable_size(bytes_view v) const override {
+        return escaped_memcomparable_size(v);
+    }
+    virtual void write_memcomparable(bytes_view v, memcomparable_writer& out) const override {
+        write_escaped_memcomparable(v, out);
+    }
     virtual size_t hash(bytes_view v) const override {
         return std::hash<bytes_view>()(v);
     }
@@ -466,6 +539,15 @@ struct boolean_type_impl : public simple_type_impl<bool> {
         }
         return boolean_to_string(*b.begin());
     }
+    virtual void write_memcomparable(bytes_view v, memcomparable_writer& out) const override {
+        if (v.empty()) {
+            out.write(0);
+            return;
+        }
+        // Any non-zero byte is true.
+        out.write(1);
+        out.write(*v.begin() != 0);
+    }
     virtual ::shared_ptr<cql3::cql3_type> as_cql3_type() const override {
         return cql3::cql3_type::boolean;
     }
@@ -1116,6 +1198,15 @@ struct inet_addr_type_impl : concrete_type<net::ipv4_address> {
     virtual bool is_byte_order_comparable() const override {
         return true;
     }
+    virtual bool is_memcomparable() const override {
+        return true;
+    }
+    virtual size_t memcomparable_size(bytes_view v) const override {
+        return escaped_memcomparable_size(v);
+    }
+    virtual void write_memcomparable(bytes_view v, memcomparable_writer& out) const override {
+        write_escaped_memcomparable(v, out);
+    }
     virtual size_t hash(bytes_view v) const override {
         return std::hash<bytes_view>()(v);
     }
@@ -3255,6 +3346,14 @@ thread_local const shared_ptr<const abstract_type> counter_type(make_shared<coun
 thread_local const shared_ptr<const abstract_type> duration_type(make_shared<duration_type_impl>());
 thread_local const data_type empty_type(make_shared<empty_type_impl>());
 
+size_t abstract_type::memcomparable_size(bytes_view v) const {
+    throw std::logic_error(sprint("Type %s has no memcomparable form", name()));
+}
+
+void abstract_type::write_memcomparable(bytes_view v, memcomparable_writer& out) const {
+    throw std::logic_error(sprint("Type %s has no memcomparable form", name()));
+}
+
 data_type abstract_type::parse_type(const sstring& name)
 {
     static thread_local const std::unordered_map<sstring, data_type> types = {
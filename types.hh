@@ -406,6 +406,29 @@ class serialized_compare;
 class serialized_tri_compare;
 class user_type_impl;
 
+// Destination of abstract_type::write_memcomparable(). Bytes which don't fit
+// in the buffer are dropped, so that a prefix of a form can be written without
+// producing the whole form.
+class memcomparable_writer {
+    bytes::iterator _out;
+    bytes::iterator _end;
+public:
+    memcomparable_writer(bytes::iterator begin, bytes::iterator end)
+        : _out(begin), _end(end)
+    { }
+    void write(int8_t b) {
+        if (_out != _end) {
+            *_out++ = b;
+        }
+    }
+    bool full() const {
+        return _out == _end;
+    }
+    bytes::iterator position() const {
+        return _out;
+    }
+};
+
 // Unsafe to access across shards unless otherwise noted.
 class abstract_type : public enable_shared_from_this<abstract_type> {
     sstring _name;
@@ -519,6 +542,21 @@ class abstract_type : public enable_shared_from_this<abstract_type> {
         // If we're byte order comparable, then we must also be byte order equal.
         return is_byte_order_comparable();
     }
+
+    /**
+     * When returns true, values of this type have a memcomparable ("normalized") form,
+     * produced by write_memcomparable(). Forms of two values compare with compare_unsigned()
+     * the same way as the values compare with compare(), and no form is a proper prefix of
+     * another, so that forms of components of a compound value can be concatenated.
+     */
+    virtual bool is_memcomparable() const {
+        return false;
+    }
+    // Valid only if is_memcomparable().
+    virtual size_t memcomparable_size(bytes_view v) const;
+    // Valid only if is_memcomparable(). Writes memcomparable_size(v) bytes, or as many as fit in out.
+    virtual void write_memcomparable(bytes_view v, memcomparable_writer& out) const;
+
     virtual sstring get_string(const bytes& b) const {
         validate(b);
         return to_string(b);
@@ -932,6 +970,18 @@ class reversed_type_impl : public abstract_type {
     virtual bool is_byte_order_equal() const override {
         return _underlying_type->is_byte_order_equal();
     }
+    virtual bool is_memcomparable() const override {
+        return _underlying_type->is_memcomparable();
+    }
+    virtual size_t memcomparable_size(bytes_view v) const override {
+        return _underlying_type->memcomparable_size(v);
+    }
+    // Inverting a prefix-free form reverses its order.
+    virtual void write_memcomparable(bytes_view v, memcomparable_writer& out) const override {
+        auto begin = out.position();
+        _underlying_type->write_memcomparable(v, out);
+        std::transform(begin, out.position(), begin, [] (int8_t b) { return int8_t(~b); });
+    }
     virtual size_t hash(bytes_view v) const override {
         return _underlying_type->hash(v);
     }
@@ -44,11 +44,16 @@
 #include "bytes.hh"
 #include "utils/murmur_hash.hh"
 #include "core/shared_ptr.hh"
+#include "core/print.hh"
 #include "utils/large_bitset.hh"
 #include <array>
 #include <cstdlib>
 #include "bloom_filter.hh"
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 namespace utils {
 namespace filter {
 
@@ -88,12 +93,110 @@ bool bloom_filter::is_present(const bytes_view& key) {
     return is_present(make_hashed_key(key));
 }
 
-filter_ptr create_filter(int hash, large_bitset&& bitset) {
+namespace {
+
+using block_contains_fn = bool (*)(const uint64_t* block, const uint64_t* mask);
+
+// Returns true if every bit set in mask is also set in block.
+bool block_contains_generic(const uint64_t* block, const uint64_t* mask) {
+    uint64_t missing = 0;
+    for (size_t i = 0; i < blocked_bloom_filter::words_per_block; ++i) {
+        missing |= mask[i] & ~block[i];
+    }
+    return !missing;
+}
+
+#if defined(__x86_64__)
+// We are compiled for a baseline which doesn't include AVX2, so the
+// function is compiled separately for it and selected at run time.
+__attribute__((target("avx2")))
+bool block_contains_avx2(const uint64_t* block, const uint64_t* mask) {
+    auto b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    auto b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 4));
+    auto m0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask));
+    auto m1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask + 4));
+    // testc(a, b) is set iff (~a & b) == 0
+    return _mm256_testc_si256(b0, m0) & _mm256_testc_si256(b1, m1);
+}
+#endif
+
+block_contains_fn select_block_contains() {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+        return block_contains_avx2;
+    }
+#endif
+    return block_contains_generic;
+}
+
+const block_contains_fn block_contains = select_block_contains();
+
+// Calls func(word, bit) for each probe of the key inside its block.
+template<typename Func>
+void for_each_probe(hashed_key hk, int count, Func&& func) {
+    uint64_t h = hk.hash()[1];
+    uint64_t base = h;
+    uint64_t inc = ((h << 32) | (h >> 32)) | 1;
+    for (int i = 0; i < count; i++) {
+        func(i % blocked_bloom_filter::words_per_block, base >> 58);
+        base += inc;
+    }
+}
+
+}
+
+blocked_bloom_filter::blocked_bloom_filter(int hashes, bitmap&& bs)
+        : bloom_filter(hashes, std::move(bs))
+        , _nr_blocks(bits().size() / block_bits) {
+    if (!_nr_blocks || bits().size() % block_bits) {
+        throw std::invalid_argument(sprint("Invalid size of blocked bloom filter: %d bits", bits().size()));
+    }
+}
+
+size_t blocked_bloom_filter::block_of(hashed_key hk) const {
+    return hk.hash()[0] % _nr_blocks;
+}
+
+void blocked_bloom_filter::make_mask(hashed_key hk, block_mask& mask) const {
+    mask.fill(0);
+    for_each_probe(hk, _hash_count, [&mask] (size_t word, unsigned bit) {
+        mask[word] |= uint64_t(1) << bit;
+    });
+}
+
+bool blocked_bloom_filter::is_present(hashed_key key) {
+    block_mask mask;
+    make_mask(key, mask);
+    auto block = _bitset.word_ptr(block_of(key) * block_bits);
+    return block_contains(block, mask.data());
+}
+
+void blocked_bloom_filter::add(const bytes_view& key) {
+    auto hk = make_hashed_key(key);
+    auto first_bit = block_of(hk) * block_bits;
+    for_each_probe(hk, _hash_count, [this, first_bit] (size_t word, unsigned bit) {
+        _bitset.set(first_bit + word * 64 + bit);
+    });
+}
+
+bool blocked_bloom_filter::is_present(const bytes_view& key) {
+    return is_present(make_hashed_key(key));
+}
+
+filter_ptr create_filter(int hash, large_bitset&& bitset, filter_format format) {
+    if (format == filter_format::blocked) {
+        return std::make_unique<blocked_bloom_filter>(hash, std::move(bitset));
+    }
     return std::make_unique<murmur3_bloom_filter>(hash, std::move(bitset));
 }
 
-filter_ptr create_filter(int hash, int64_t num_elements, int buckets_per) {
+filter_ptr create_filter(int hash, int64_t num_elements, int buckets_per, filter_format format) {
     int64_t num_bits = (num_elements * buckets_per) + bloom_calculations::EXCESS;
+    if (format == filter_format::blocked) {
+        num_bits = align_up<int64_t>(num_bits, blocked_bloom_filter::block_bits);
+        large_bitset bitset(num_bits);
+        return std::make_unique<blocked_bloom_filter>(hash, std::move(bitset));
+    }
     num_bits = align_up<int64_t>(num_bits, 64);  // Seems to be implied in origin
     large_bitset bitset(num_bits);
     return std::make_unique<murmur3_bloom_filter>(hash, std::move(bitset));
@@ -46,6 +46,7 @@
 #include "utils/murmur_hash.hh"
 #include "utils/large_bitset.hh"
 
+#include <array>
 #include <vector>
 
 namespace utils {
@@ -55,7 +56,7 @@ class bloom_filter: public i_filter {
 public:
     using bitmap = large_bitset;
 
-private:
+protected:
     bitmap _bitset;
     int _hash_count;
 public:
@@ -80,6 +81,10 @@ class bloom_filter: public i_filter {
     virtual size_t memory_size() override {
         return sizeof(_hash_count) + _bitset.memory_size();
     }
+
+    virtual filter_format format() const {
+        return filter_format::classic;
+    }
 };
 
 struct murmur3_bloom_filter: public bloom_filter {
@@ -88,6 +93,37 @@ struct murmur3_bloom_filter: public bloom_filter {
 
 };
 
+// A bloom filter which confines all the probes of a key to a single
+// 512-bit block, i.e. one cache line. The block is selected by the first
+// half of the murmur3 hash, and the bit positions inside the block by the
+// second half. Probe i always sets a bit in 64-bit word (i % 8) of the
+// block, so the whole test can be done with two 256-bit AND-NOT operations.
+//
+// The bitmap size must be a multiple of block_bits.
+class blocked_bloom_filter: public bloom_filter {
+public:
+    static constexpr size_t block_bits = 512;
+    static constexpr size_t words_per_block = block_bits / 64;
+    using block_mask = std::array<uint64_t, words_per_block>;
+private:
+    size_t _nr_blocks;
+private:
+    size_t block_of(hashed_key hk) const;
+    void make_mask(hashed_key hk, block_mask& mask) const;
+public:
+    blocked_bloom_filter(int hashes, bitmap&& bs);
+
+    virtual void add(const bytes_view& key) override;
+
+    virtual bool is_present(const bytes_view& key) override;
+
+    virtual bool is_present(hashed_key key) override;
+
+    virtual filter_format format() const override {
+        return filter_format::blocked;
+    }
+};
+
 struct always_present_filter: public i_filter {
 
     virtual bool is_present(const bytes_view& key) override {
@@ -109,7 +145,7 @@ struct always_present_filter: public i_filter {
     }
 };
 
-filter_ptr create_filter(int hash, large_bitset&& bitset);
-filter_ptr create_filter(int hash, int64_t num_elements, int buckets_per);
+filter_ptr create_filter(int hash, large_bitset&& bitset, filter_format format = filter_format::classic);
+filter_ptr create_filter(int hash, int64_t num_elements, int buckets_per, filter_format format = filter_format::classic);
 }
 }
@@ -58,6 +58,18 @@ class hashed_key {
 
 hashed_key make_hashed_key(bytes_view key);
 
+// Bit layout of a bloom filter.
+//
+// In the classic layout, the probes for a key are spread across the whole
+// bitmap, so each probe is likely to touch a different cache line. In the
+// blocked layout, all probes for a key land in a single 512-bit (64-byte)
+// block, so a lookup costs at most one cache miss, at the price of a
+// slightly higher false positive rate for the same number of bits.
+enum class filter_format {
+    classic,
+    blocked,
+};
+
 // FIXME: serialize() and serialized_size() not implemented. We should only be serializing to
 // disk, not in the wire.
 struct i_filter {
@@ -78,11 +90,11 @@ struct i_filter {
      *         Asserts that the given probability can be satisfied using this
      *         filter.
      */
-    static filter_ptr get_filter(int64_t num_elements, double max_false_pos_prob);
+    static filter_ptr get_filter(int64_t num_elements, double max_false_pos_prob, filter_format format = filter_format::classic);
     /**
      * @return A bloom_filter with the lowest practical false positive
      *         probability for the given number of elements.
      */
-    static filter_ptr get_filter(int64_t num_elements, int target_buckets_per_elem);
+    static filter_ptr get_filter(int64_t num_elements, int target_buckets_per_elem, filter_format format = filter_format::classic);
 };
 }
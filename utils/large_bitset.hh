@@ -31,8 +31,10 @@
 #include <algorithm>
 
 class large_bitset {
-    static constexpr size_t block_size() { return 128 * 1024; }
+public:
     using int_type = unsigned long;
+private:
+    static constexpr size_t block_size() { return 128 * 1024; }
     static constexpr size_t bits_per_int() {
         return std::numeric_limits<int_type>::digits;
     }
@@ -81,6 +83,14 @@ class large_bitset {
         auto idx3 = idx;
         _storage[idx1][idx2] &= ~(int_type(1) << idx3);
     }
+    // Returns a pointer to the word holding bit idx. Words are contiguous
+    // within a storage block, so any naturally aligned run of up to
+    // block_size() bytes can be accessed through the returned pointer.
+    const int_type* word_ptr(size_t idx) const {
+        auto idx1 = idx / bits_per_block();
+        idx %= bits_per_block();
+        return _storage[idx1].get() + idx / bits_per_int();
+    }
     void clear();
     // load data from host bitmap (in host byte order); returns end bit position
     template <typename IntegerIterator>
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <seastar/core/byteorder.hh>
+#include "bytes.hh"
+#include "seastarx.hh"
+
+// Streaming implementation of the 64-bit xxHash (XXH64), a fast
+// non-cryptographic hash. Fulfills the Hasher concept from hashing.hh.
+//
+// The result is the same as the one of the reference implementation
+// for the same seed, regardless of how the input was split into updates.
+class xx_hasher {
+    static constexpr uint64_t prime1 = 11400714785074694791ULL;
+    static constexpr uint64_t prime2 = 14029467366897019727ULL;
+    static constexpr uint64_t prime3 = 1609587929392839161ULL;
+    static constexpr uint64_t prime4 = 9650029242287828579ULL;
+    static constexpr uint64_t prime5 = 2870177450012600261ULL;
+    static constexpr size_t stripe_size = 32;
+
+    uint64_t _seed;
+    uint64_t _acc[4];
+    uint64_t _total_length = 0;
+    // Input which doesn't fill a whole stripe yet.
+    std::array<char, stripe_size> _buffer;
+    size_t _buffered = 0;
+
+    static uint64_t rotl(uint64_t x, unsigned r) {
+        return (x << r) | (x >> (64 - r));
+    }
+    static uint64_t read64(const char* p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return le_to_cpu(v);
+    }
+    static uint32_t read32(const char* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return le_to_cpu(v);
+    }
+    static uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * prime2;
+        acc = rotl(acc, 31);
+        return acc * prime1;
+    }
+    static uint64_t merge_round(uint64_t acc, uint64_t val) {
+        acc ^= round(0, val);
+        return acc * prime1 + prime4;
+    }
+    void consume_stripe(const char* p) {
+        _acc[0] = round(_acc[0], read64(p));
+        _acc[1] = round(_acc[1], read64(p + 8));
+        _acc[2] = round(_acc[2], read64(p + 16));
+        _acc[3] = round(_acc[3], read64(p + 24));
+    }
+public:
+    explicit xx_hasher(uint64_t seed = 0)
+        : _seed(seed)
+        , _acc{seed + prime1 + prime2, seed + prime2, seed, seed - prime1}
+    { }
+
+    void update(const char* ptr, size_t length) {
+        _total_length += length;
+        if (_buffered + length < stripe_size) {
+            std::copy_n(ptr, length, _buffer.data() + _buffered);
+            _buffered += length;
+            return;
+        }
+        if (_buffered) {
+            auto n = stripe_size - _buffered;
+            std::copy_n(ptr, n, _buffer.data() + _buffered);
+            consume_stripe(_buffer.data());
+            ptr += n;
+            length -= n;
+            _buffered = 0;
+        }
+        while (length >= stripe_size) {
+            consume_stripe(ptr);
+            ptr += stripe_size;
+            length -= stripe_size;
+        }
+        std::copy_n(ptr, length, _buffer.data());
+        _buffered = length;
+    }
+
+    uint64_t finalize_uint64() const {
+        uint64_t h;
+        if (_total_length >= stripe_size) {
+            h = rotl(_acc[0], 1) + rotl(_acc[1], 7) + rotl(_acc[2], 12) + rotl(_acc[3], 18);
+            for (auto acc : _acc) {
+                h = merge_round(h, acc);
+            }
+        } else {
+            h = _seed + prime5;
+        }
+        h += _total_length;
+
+        auto p = _buffer.data();
+        auto end = p + _buffered;
+        for (; p + 8 <= end; p += 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * prime1 + prime4;
+        }
+        if (p + 4 <= end) {
+            h ^= uint64_t(read32(p)) * prime1;
+            h = rotl(h, 23) * prime2 + prime3;
+            p += 4;
+        }
+        for (; p < end; ++p) {
+            h ^= uint64_t(uint8_t(*p)) * prime5;
+            h = rotl(h, 11) * prime1;
+        }
+
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    bytes finalize() const {
+        bytes digest{bytes::initialized_later(), sizeof(uint64_t)};
+        auto h = cpu_to_be(finalize_uint64());
+        std::memcpy(digest.begin(), &h, sizeof(h));
+        return digest;
+    }
+
+    // Returns the hash in the first 8 bytes of a 16 byte array, so that it
+    // fits in a query::result_digest, followed by zeroes.
+    std::array<uint8_t, 16> finalize_array() const {
+        std::array<uint8_t, 16> digest{};
+        auto h = cpu_to_be(finalize_uint64());
+        std::memcpy(digest.data(), &h, sizeof(h));
+        return digest;
+    }
+};